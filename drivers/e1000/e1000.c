@@ -43,7 +43,9 @@ _PROTOTYPE( PRIVATE void e1000_init_addr, (e1000_t *e)		        );
 _PROTOTYPE( PRIVATE void e1000_init_buf,  (e1000_t *e)			);
 _PROTOTYPE( PRIVATE void e1000_reset_hw, (e1000_t *e)			);
 _PROTOTYPE( PRIVATE void e1000_writev_s, (message *mp, int from_int)	);
+_PROTOTYPE( PRIVATE void e1000_writering_s, (message *mp, int from_int) );
 _PROTOTYPE( PRIVATE void e1000_readv_s, (message *mp, int from_int)	);
+_PROTOTYPE( PRIVATE void e1000_readring_s, (message *mp, int from_int)	);
 _PROTOTYPE( PRIVATE void e1000_getstat_s, (message *mp)			);
 _PROTOTYPE( PRIVATE void e1000_interrupt, (message *mp)			);
 _PROTOTYPE( PRIVATE int  e1000_link_changed, (e1000_t *e)		);
@@ -106,7 +108,9 @@ int main(int argc, char *argv[])
 	switch (m.m_type)
 	{
 	    case DL_WRITEV_S:   e1000_writev_s(&m, FALSE);	break;
+	    case DL_WRITERING_S: e1000_writering_s(&m, FALSE);	break;
 	    case DL_READV_S:    e1000_readv_s(&m, FALSE);	break;
+	    case DL_READRING_S: e1000_readring_s(&m, FALSE);	break;
 	    case DL_CONF:	e1000_init(&m);			break;
 	    case DL_GETSTAT_S:  e1000_getstat_s(&m);		break;
 	    default:
@@ -209,7 +213,7 @@ PRIVATE void e1000_init(message *mp)
     }
     /* Reply back to INET. */
     reply_mess.m_type  = DL_CONF_REPLY;
-    reply_mess.DL_STAT = OK;
+    reply_mess.DL_STAT = DL_STAT_RING | DL_STAT_TXRING;
     *(ether_addr_t *) reply_mess.DL_HWADDR = e->address;
     mess_reply(mp, &reply_mess);
 }
@@ -691,6 +695,88 @@ int from_int;
     reply(e);
 }
 
+/*===========================================================================*
+ *				e1000_writering_s			     *
+ *===========================================================================*/
+PRIVATE void e1000_writering_s(mp, from_int)
+message *mp;
+int from_int;
+{
+    e1000_t *e = &e1000_state;
+    e1000_tx_desc_t *desc;
+    int r, head, tail, last, room, count;
+
+    E1000_DEBUG(3, ("e1000: writering_s(%p,%d)\n", mp, from_int));
+
+    /* Are we called from the interrupt handler? */
+    if (!from_int)
+    {
+	e->tx_message = *mp;
+	e->client     = mp->m_source;
+	e->status    |= E1000_WRITING;
+	e->status    &= ~E1000_TRANSMIT;
+
+	if ((r = netdriver_ring_start(&e->tx_ring, mp)) != OK)
+	{
+	    panic("bad DL_WRITERING_S request: %d", r);
+	}
+    }
+    else if (!(e->status & E1000_WRITING))
+    {
+	return;
+    }
+
+    /* Find the head and tail descriptors. */
+    head = e1000_reg_read(e, E1000_REG_TDH);
+    tail = e1000_reg_read(e, E1000_REG_TDT);
+    room = (head - tail - 1 + e->tx_desc_count) % e->tx_desc_count;
+    last = -1;
+
+    E1000_DEBUG(4, ("%s: head=%d, tail=%d\n",
+	             e->name, head, tail));
+
+    /*
+     * One descriptor per frame, as many as there is room for.
+     */
+    while (room > 0 && netdriver_ring_room(&e->tx_ring) > 0)
+    {
+	desc = &e->tx_desc[tail];
+	desc->status  = 0;
+	desc->command = E1000_TX_CMD_EOP | E1000_TX_CMD_FCS;
+	desc->length  = netdriver_ring_get(&e->tx_ring,
+					   (vir_bytes) e->tx_buffer +
+					   (tail * E1000_IOBUF_SIZE));
+	last = tail;
+	tail = (tail + 1) % e->tx_desc_count;
+	room--;
+    }
+    if (last != -1)
+    {
+	if ((count = netdriver_ring_flush(&e->tx_ring)) < 0)
+	{
+	    panic("netdriver_ring_flush() failed: %d", count);
+	}
+	/* Report status on the last one only. Start transmission. */
+	e->tx_desc[last].command |= E1000_TX_CMD_RS;
+	e1000_reg_write(e, E1000_REG_TDT, tail);
+
+	E1000_DEBUG(2, ("e1000: wrote %d packets\n", count));
+    }
+
+    /*
+     * The client may reuse its ring once every frame is ours. Otherwise
+     * wait for descriptors to come free.
+     */
+    if (netdriver_ring_room(&e->tx_ring) == 0)
+    {
+	e->status |= E1000_TRANSMIT;
+    }
+    if (!from_int || (e->status & E1000_TRANSMIT))
+    {
+	reply(e);
+    }
+}
+
 /*===========================================================================*
  *				e1000_readv_s				     *
  *===========================================================================*/
@@ -780,6 +866,72 @@ int from_int;
     reply(e);
 }
 
+/*===========================================================================*
+ *				e1000_readring_s			     *
+ *===========================================================================*/
+PRIVATE void e1000_readring_s(mp, from_int)
+message *mp;
+int from_int;
+{
+    e1000_t *e = &e1000_state;
+    e1000_rx_desc_t *desc;
+    int r, tail, next, count;
+
+    E1000_DEBUG(3, ("e1000: readring_s(%p,%d)\n", mp, from_int));
+
+    /* Are we called from the interrupt handler? */
+    if (!from_int)
+    {
+	e->rx_message = *mp;
+	e->client     = mp->m_source;
+	e->status    |= E1000_READING;
+	e->rx_size    = 0;
+
+	if ((r = netdriver_ring_start(&e->rx_ring, mp)) != OK)
+	{
+	    panic("bad DL_READRING_S request: %d", r);
+	}
+    }
+    if (e->status & E1000_READING)
+    {
+	/*
+	 * Queue every completed descriptor the client has room for.
+	 */
+	tail = e1000_reg_read(e, E1000_REG_RDT);
+	next = (tail + 1) % e->rx_desc_count;
+
+	while (netdriver_ring_room(&e->rx_ring) > 0 &&
+	       (e->rx_desc[next].status & E1000_RX_STATUS_EOP))
+	{
+	    desc = &e->rx_desc[next];
+	    netdriver_ring_put(&e->rx_ring, (vir_bytes) e->rx_buffer +
+			       (next * E1000_IOBUF_SIZE), desc->length);
+	    next = (next + 1) % e->rx_desc_count;
+	}
+	/*
+	 * Copy them out in one go, then give the descriptors back.
+	 */
+	if ((count = netdriver_ring_flush(&e->rx_ring)) < 0)
+	{
+	    panic("netdriver_ring_flush() failed: %d", count);
+	}
+	if (count > 0)
+	{
+	    while ((tail + 1) % e->rx_desc_count != next)
+	    {
+		tail = (tail + 1) % e->rx_desc_count;
+		e->rx_desc[tail].status = 0;
+	    }
+	    e->rx_size   = count;
+	    e->status   |= E1000_RECEIVED;
+	    E1000_DEBUG(2, ("e1000: got %d packets\n", count));
+
+	    e1000_reg_write(e, E1000_REG_RDT, tail);
+	}
+    }
+    reply(e);
+}
+
 /*===========================================================================*
  *				e1000_getstat_s				     *
  *===========================================================================*/
@@ -844,11 +996,21 @@ message *mp;
 	    e1000_link_changed(e);
 
 	if (cause & (E1000_REG_ICR_RXO | E1000_REG_ICR_RXT))
-	    e1000_readv_s(&e->rx_message, TRUE);
+	{
+	    if (e->rx_message.m_type == DL_READRING_S)
+		e1000_readring_s(&e->rx_message, TRUE);
+	    else
+		e1000_readv_s(&e->rx_message, TRUE);
+	}
 	
 	if ((cause & E1000_REG_ICR_TXQE) ||
 	    (cause & E1000_REG_ICR_TXDW))
-	    e1000_writev_s(&e->tx_message, TRUE);
+	{
+	    if (e->tx_message.m_type == DL_WRITERING_S)
+		e1000_writering_s(&e->tx_message, TRUE);
+	    else
+		e1000_writev_s(&e->tx_message, TRUE);
+	}
     }
 }
 
@@ -1187,6 +1349,10 @@ e1000_t *e;
 	msg.DL_COUNT = e->rx_size >= ETH_MIN_PACK_SIZE ?
 		       e->rx_size  : ETH_MIN_PACK_SIZE;
 
+	/* For a ring the count is the number of frames. */
+	if (e->rx_message.m_type == DL_READRING_S)
+	    msg.DL_COUNT = e->rx_size;
+
         /* Clear flags. */
 	e->status &= ~(E1000_READING | E1000_RECEIVED);
     }
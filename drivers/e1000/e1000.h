@@ -167,7 +167,10 @@ typedef struct e1000
     int client;                   /**< Process ID being served by e1000. */
     message rx_message;		  /**< Read message received from client. */
     message tx_message;		  /**< Write message received from client. */
-    size_t rx_size;		  /**< Size of one packet received. */
+    size_t rx_size;		  /**< Size of one packet received, or
+				       number of frames for a ring. */
+    netdriver_ring_t rx_ring;	  /**< State of a DL_READRING_S request. */
+    netdriver_ring_t tx_ring;	  /**< State of a DL_WRITERING_S request. */
 }
 e1000_t;
 
@@ -156,6 +156,8 @@ typedef struct re {
 	ether_addr_t re_address;
 	message re_rx_mess;
 	message re_tx_mess;
+	netdriver_ring_t re_rx_ring;	/* state of a DL_READRING_S request */
+	netdriver_ring_t re_tx_ring;	/* state of a DL_WRITERING_S request */
 	char re_name[sizeof("rtl8169#n")];
 	iovec_t re_iovec[IOVEC_NR];
 	iovec_s_t re_iovec_s[IOVEC_NR];
@@ -243,7 +245,9 @@ _PROTOTYPE( static void rl_reset_hw, (re_t *rep)			);
 _PROTOTYPE( static void rl_confaddr, (re_t *rep)			);
 _PROTOTYPE( static void rl_rec_mode, (re_t *rep)			);
 _PROTOTYPE( static void rl_readv_s, (const message *mp, int from_int)	);
+_PROTOTYPE( static void rl_readring_s, (const message *mp, int from_int) );
 _PROTOTYPE( static void rl_writev_s, (const message *mp, int from_int)	);
+_PROTOTYPE( static void rl_writering_s, (const message *mp, int from_int) );
 _PROTOTYPE( static void rl_check_ints, (re_t *rep)			);
 _PROTOTYPE( static void rl_report_link, (re_t *rep)			);
 _PROTOTYPE( static void rl_do_reset, (re_t *rep)			);
@@ -319,7 +323,9 @@ int main(int argc, char *argv[])
 
 		switch (m.m_type) {
 		case DL_WRITEV_S:	rl_writev_s(&m, FALSE);	 break;
+		case DL_WRITERING_S:	rl_writering_s(&m, FALSE); break;
 		case DL_READV_S:	rl_readv_s(&m, FALSE);	 break;
+		case DL_READRING_S:	rl_readring_s(&m, FALSE); break;
 		case DL_CONF:		rl_init(&m);		 break;
 		case DL_GETSTAT_S:	rl_getstat_s(&m);	 break;
 		default:
@@ -611,7 +617,7 @@ message *mp;
 	rl_rec_mode(rep);
 
 	reply_mess.m_type = DL_CONF_REPLY;
-	reply_mess.DL_STAT = OK;
+	reply_mess.DL_STAT = DL_STAT_RING | DL_STAT_TXRING;
 	*(ether_addr_t *) reply_mess.DL_HWADDR = rep->re_address;
 
 	mess_reply(mp, &reply_mess);
@@ -1367,6 +1373,116 @@ suspend:
 	reply(rep);
 }
 
+/*===========================================================================*
+ *				rl_readring_s				     *
+ *===========================================================================*/
+static void rl_readring_s(const message *mp, int from_int)
+{
+	int r, count, index;
+	port_t port;
+	unsigned totlen;
+	re_desc *desc;
+	u32_t rxstat;
+	re_t *rep;
+
+	rep = &re_state;
+
+	rep->re_client = mp->m_source;
+
+	assert(rep->re_mode == REM_ENABLED);
+	assert(rep->re_flags & REF_ENABLED);
+
+	port = rep->re_base_port;
+
+	if (!from_int) {
+		r = netdriver_ring_start(&rep->re_rx_ring, mp);
+		if (r != OK)
+			panic("rl_readring_s: bad request: %d", r);
+	}
+
+	/*
+	 * Assume that the RL_CR_BUFE check was been done by rl_checks_ints
+	 */
+	if (!from_int && (rl_inb(port, RL_CR) & RL_CR_BUFE))
+		goto suspend;		/* Receive buffer is empty, suspend */
+
+	/* Queue as many frames as the client has room for. The descriptors
+	 * stay ours until the frames have been copied out.
+	 */
+	index = rep->re_rx_head;
+	while (netdriver_ring_room(&rep->re_rx_ring) > 0) {
+		desc = &rep->re_rx_desc[index];
+		rxstat = desc->status;
+
+		if (rxstat & DESC_OWN)
+			break;
+
+		if (rxstat & DESC_RX_CRC)
+			rep->re_stat.ets_CRCerr++;
+
+		if ((rxstat & (DESC_FS | DESC_LS)) != (DESC_FS | DESC_LS)) {
+			printf("rl_readring_s: packet is fragmented\n");
+		} else {
+			totlen = rxstat & DESC_RX_LENMASK;
+			if (totlen < 8 || totlen > 2 * ETH_MAX_PACK_SIZE) {
+				/* Someting went wrong */
+				printf(
+			"rl_readring_s: bad length (%u) in status 0x%08lx\n",
+					totlen, rxstat);
+				panic(NULL);
+			}
+
+			/* Should subtract the CRC */
+			netdriver_ring_put(&rep->re_rx_ring,
+				(vir_bytes) rep->re_rx[index].v_ret_buf,
+				totlen - ETH_CRC_SIZE);
+			rep->re_stat.ets_packetR++;
+		}
+		index = (index + 1) % N_RX_DESC;
+	}
+
+	count = netdriver_ring_flush(&rep->re_rx_ring);
+	if (count < 0)
+		panic("rl_readring_s: netdriver_ring_flush failed: %d", count);
+
+	/* Give the descriptors back to the card */
+	while (rep->re_rx_head != index) {
+		desc = &rep->re_rx_desc[rep->re_rx_head];
+		if (rep->re_rx_head == N_RX_DESC - 1) {
+			desc->status =  DESC_EOR | DESC_OWN | (RX_BUFSIZE & DESC_RX_LENMASK);
+			rep->re_rx_head = 0;
+		} else {
+			desc->status =  DESC_OWN | (RX_BUFSIZE & DESC_RX_LENMASK);
+			rep->re_rx_head++;
+		}
+	}
+
+	if (count == 0)
+		goto suspend;
+
+	rep->re_read_s = count;
+	rep->re_flags = (rep->re_flags & ~REF_READING) | REF_PACK_RECV;
+
+	if (!from_int)
+		reply(rep);
+
+	return;
+
+suspend:
+	if (from_int) {
+		assert(rep->re_flags & REF_READING);
+
+		/* No need to store any state */
+		return;
+	}
+
+	rep->re_rx_mess = *mp;
+	assert(!(rep->re_flags & REF_READING));
+	rep->re_flags |= REF_READING;
+
+	reply(rep);
+}
+
 /*===========================================================================*
  *				rl_writev_s				     *
  *===========================================================================*/
@@ -1499,6 +1615,102 @@ suspend:
 	reply(rep);
 }
 
+/*===========================================================================*
+ *				rl_writering_s				     *
+ *===========================================================================*/
+static void rl_writering_s(const message *mp, int from_int)
+{
+	int i, n, r, first, tx_head;
+	size_t size[ETH_RING_NR];
+	re_desc *desc;
+	re_t *rep;
+
+	rep = &re_state;
+
+	rep->re_client = mp->m_source;
+	assert(rep->setup);
+
+	assert(rep->re_mode == REM_ENABLED);
+	assert(rep->re_flags & REF_ENABLED);
+
+	if (from_int) {
+		assert(rep->re_flags & REF_SEND_AVAIL);
+		rep->re_flags &= ~REF_SEND_AVAIL;
+		rep->re_send_int = FALSE;
+		rep->re_tx_alive = TRUE;
+	} else {
+		r = netdriver_ring_start(&rep->re_tx_ring, mp);
+		if (r != OK)
+			panic("rl_writering_s: bad request: %d", r);
+	}
+
+	assert(!(rep->re_flags & REF_PACK_SENT));
+
+again:
+	/* Take as many frames as there are free descriptors. The
+	 * descriptors are handed to the card after the copy.
+	 */
+	first = tx_head = rep->re_tx_head;
+	for (n = 0; netdriver_ring_room(&rep->re_tx_ring) > 0 &&
+		!rep->re_tx[tx_head].ret_busy; n++) {
+		size[n] = netdriver_ring_get(&rep->re_tx_ring,
+			(vir_bytes) rep->re_tx[tx_head].v_ret_buf);
+		rep->re_tx[tx_head].ret_busy = TRUE;
+		if (++tx_head == N_TX_DESC)
+			tx_head = 0;
+	}
+
+	if (n > 0) {
+		r = netdriver_ring_flush(&rep->re_tx_ring);
+		if (r != n)
+			panic("rl_writering_s: netdriver_ring_flush failed: %d", r);
+
+		for (i = 0, tx_head = first; i < n; i++) {
+			desc = &rep->re_tx_desc[tx_head];
+			if (tx_head == N_TX_DESC - 1) {
+				desc->status =  DESC_EOR | DESC_OWN | DESC_FS | DESC_LS | size[i];
+				tx_head = 0;
+			} else {
+				desc->status =  DESC_OWN | DESC_FS | DESC_LS | size[i];
+				tx_head++;
+			}
+		}
+		rep->re_tx_head = tx_head;
+
+		/* One poll for the whole batch */
+		rl_outl(rep->re_base_port, RL_TPPOLL, RL_TPPOLL_NPQ);
+	}
+
+	if (netdriver_ring_room(&rep->re_tx_ring) == 0) {
+		rep->re_flags |= REF_PACK_SENT;
+
+		/*
+		 * If the interrupt handler called, don't send a reply. The
+		 * reply will be sent after all interrupts are handled.
+		 */
+		if (from_int)
+			return;
+		reply(rep);
+		return;
+	}
+
+	/* Out of descriptors, wait for the card to free some. See
+	 * rl_writev_s about checking ret_busy twice.
+	 */
+	rep->re_flags |= REF_SEND_AVAIL;
+	if (!rep->re_tx[rep->re_tx_head].ret_busy) {
+		rep->re_flags &= ~REF_SEND_AVAIL;
+		rep->re_send_int = FALSE;
+		goto again;
+	}
+
+	if (from_int)
+		return;
+
+	rep->re_tx_mess = *mp;
+	reply(rep);
+}
+
 /*===========================================================================*
  *				rl_check_ints				     *
  *===========================================================================*/
@@ -1512,16 +1724,24 @@ re_t *rep;
 	if ((re_flags & REF_READING) &&
 		!(rl_inb(rep->re_base_port, RL_CR) & RL_CR_BUFE))
 	{
-		assert(rep->re_rx_mess.m_type == DL_READV_S);
-		rl_readv_s(&rep->re_rx_mess, TRUE /* from int */);
+		if (rep->re_rx_mess.m_type == DL_READRING_S)
+			rl_readring_s(&rep->re_rx_mess, TRUE /* from int */);
+		else {
+			assert(rep->re_rx_mess.m_type == DL_READV_S);
+			rl_readv_s(&rep->re_rx_mess, TRUE /* from int */);
+		}
 	}
 
 	if (rep->re_need_reset)
 		rl_do_reset(rep);
 
 	if (rep->re_send_int) {
-		assert(rep->re_tx_mess.m_type == DL_WRITEV_S);
-		rl_writev_s(&rep->re_tx_mess, TRUE /* from int */);
+		if (rep->re_tx_mess.m_type == DL_WRITERING_S)
+			rl_writering_s(&rep->re_tx_mess, TRUE /* from int */);
+		else {
+			assert(rep->re_tx_mess.m_type == DL_WRITEV_S);
+			rl_writev_s(&rep->re_tx_mess, TRUE /* from int */);
+		}
 	}
 
 	if (rep->re_report_link)
@@ -255,6 +255,8 @@
 #define DL_GETSTAT_S	(DL_RQ_BASE + 1)
 #define DL_WRITEV_S	(DL_RQ_BASE + 2)
 #define DL_READV_S	(DL_RQ_BASE + 3)
+#define DL_READRING_S	(DL_RQ_BASE + 4)	/* fill an eth_ring_t */
+#define DL_WRITERING_S	(DL_RQ_BASE + 5)	/* send an eth_ring_t */
 
 /* Message type for data link layer replies. */
 #define DL_CONF_REPLY	(DL_RS_BASE + 0)
@@ -280,6 +282,12 @@
 #  define DL_MULTI_REQ		0x2
 #  define DL_BROAD_REQ		0x4
 
+/* Bits in a positive 'DL_STAT' field of DL_CONF_REPLY. Drivers that
+ * reply OK support DL_READV_S only.
+ */
+#  define DL_STAT_RING		0x1	/* driver accepts DL_READRING_S */
+#  define DL_STAT_TXRING	0x2	/* driver accepts DL_WRITERING_S */
+
 /*===========================================================================*
  *                  SYSTASK request types and field names                    *
  *===========================================================================*/
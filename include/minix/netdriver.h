@@ -5,10 +5,38 @@
 
 #include <minix/endpoint.h>
 #include <minix/ipc.h>
+#include <minix/safecopies.h>
+#include <net/gen/ether.h>
+#include <net/gen/eth_io.h>
+
+/* State of a DL_READRING_S or DL_WRITERING_S request while a driver
+ * works on it. Frames are queued with netdriver_ring_put (receive) or
+ * netdriver_ring_get (transmit) and copied in one vectored copy by
+ * netdriver_ring_flush, so the driver must leave the queued buffers
+ * alone until the flush.
+ */
+typedef struct netdriver_ring {
+	endpoint_t nr_client;		/* who sent the request */
+	cp_grant_id_t nr_grant;		/* grant for the client's eth_ring_t */
+	int nr_write;			/* TRUE for DL_WRITERING_S */
+	int nr_size;			/* slots in this request */
+	int nr_next;			/* next slot to fill or take */
+	int nr_count;			/* copies queued since the last flush */
+	u16_t nr_len[ETH_RING_NR];
+	struct vscp_vec nr_vec[ETH_RING_NR + 1];
+} netdriver_ring_t;
 
 /* Functions defined by netdriver.c: */
 _PROTOTYPE( void netdriver_announce, (void) );
 _PROTOTYPE( int netdriver_receive, (endpoint_t src, message *m_ptr,
 	int *status_ptr) );
+_PROTOTYPE( int netdriver_ring_start, (netdriver_ring_t *ring,
+	const message *m_ptr) );
+_PROTOTYPE( int netdriver_ring_room, (const netdriver_ring_t *ring) );
+_PROTOTYPE( void netdriver_ring_put, (netdriver_ring_t *ring,
+	vir_bytes buf, size_t len) );
+_PROTOTYPE( size_t netdriver_ring_get, (netdriver_ring_t *ring,
+	vir_bytes buf) );
+_PROTOTYPE( int netdriver_ring_flush, (netdriver_ring_t *ring) );
 
 #endif /* _MINIX_NETDRIVER_H */
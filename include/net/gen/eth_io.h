@@ -76,4 +76,26 @@ typedef struct nwio_ethstat
 	eth_stat_t nwes_stat;
 } nwio_ethstat_t;
 
+/* Frame ring for DL_READRING_S and DL_WRITERING_S. The client grants
+ * the whole structure once and passes a slot count in DL_COUNT.
+ *
+ * For DL_READRING_S the count is the number of free slots. The driver
+ * copies up to that many frames into er_data, sets er_len for each and
+ * replies with DL_PACK_RECV and the number of frames in DL_COUNT.
+ *
+ * For DL_WRITERING_S the client fills the first DL_COUNT slots and
+ * their er_len. The driver replies with DL_PACK_SEND once it has taken
+ * all of them.
+ *
+ * Either way the slots belong to the client again after the reply.
+ */
+#define ETH_RING_NR	32
+#define ETH_RING_SLOT	1536		/* >= ETH_MAX_PACK_SIZE_TAGGED */
+
+typedef struct eth_ring
+{
+	u16_t er_len[ETH_RING_NR];
+	u8_t er_data[ETH_RING_NR][ETH_RING_SLOT];
+} eth_ring_t;
+
 #endif /* __SERVER__IP__GEN__ETH_IO_H__ */
@@ -0,0 +1,27 @@
+/* Pick the oneC_sum() implementation for this CPU on the first call.
+ * oneC_sum() itself is a jump through _oneC_sum_fn, see oneC_sum.S.
+ */
+#include <sys/types.h>
+#include <minix/cpufeature.h>
+#include <net/gen/oneCsum.h>
+
+_PROTOTYPE(u16_t _oneC_sum_386, (u16_t prev, void *data, size_t len));
+_PROTOTYPE(u16_t _oneC_sum_sse2, (u16_t prev, void *data, size_t len));
+_PROTOTYPE(static u16_t oneC_sum_probe, (u16_t prev, void *data,
+								size_t len));
+
+u16_t (*_oneC_sum_fn) _ARGS((u16_t prev, void *data, size_t len))=
+	oneC_sum_probe;
+
+static u16_t oneC_sum_probe(u16_t prev, void *data, size_t len)
+{
+	/* The kernel saves the SSE registers with FXSAVE, which covers the
+	 * xmm registers but not the upper halves of the AVX ones, so SSE2
+	 * is as wide as we go.
+	 */
+	if (_cpufeature(_CPUF_I386_SSE2) && _cpufeature(_CPUF_I386_FXSR))
+		_oneC_sum_fn= _oneC_sum_sse2;
+	else
+		_oneC_sum_fn= _oneC_sum_386;
+	return (*_oneC_sum_fn)(prev, data, len);
+}
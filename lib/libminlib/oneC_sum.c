@@ -0,0 +1,78 @@
+/*	oneC_sum() - One complement's checksum, portable version
+ *
+ * See RFC 1071, "Computing the Internet checksum".  Used on architectures
+ * without an assembly version; sums 32 bit words into a 64 bit accumulator
+ * so the carries only have to be folded back in once at the end.
+ */
+#include <sys/types.h>
+#include <stdint.h>
+#include <net/gen/oneCsum.h>
+
+u16_t oneC_sum(u16_t prev, void *data, size_t len)
+{
+	u8_t *p;
+	u32_t *wp;
+	u64_t sum;
+	int swapped;
+	union { u8_t b[2]; u16_t w; } odd;
+
+	p= data;
+	sum= prev;
+	swapped= 0;
+
+	/* Starting on an odd address shifts every byte to the other half
+	 * of its word, which is the same as summing byte swapped.  Swap
+	 * the previous sum now and the result back at the end.
+	 */
+	if (((uintptr_t)p & 1) && len > 0)
+	{
+		sum= ((sum & 0xff) << 8) | (sum >> 8);
+		odd.b[0]= 0;
+		odd.b[1]= *p++;
+		sum += odd.w;
+		len--;
+		swapped= 1;
+	}
+	if (((uintptr_t)p & 2) && len >= 2)
+	{
+		sum += *(u16_t *)p;
+		p += 2;
+		len -= 2;
+	}
+
+	wp= (u32_t *)p;
+	while (len >= 16)
+	{
+		sum += (u64_t)wp[0] + wp[1];
+		sum += (u64_t)wp[2] + wp[3];
+		wp += 4;
+		len -= 16;
+	}
+	while (len >= 4)
+	{
+		sum += *wp++;
+		len -= 4;
+	}
+	p= (u8_t *)wp;
+	if (len >= 2)
+	{
+		sum += *(u16_t *)p;
+		p += 2;
+		len -= 2;
+	}
+	if (len)
+	{
+		odd.b[0]= *p;
+		odd.b[1]= 0;
+		sum += odd.w;
+	}
+
+	sum= (sum >> 32) + (sum & 0xffffffff);
+	sum= (sum >> 32) + (sum & 0xffffffff);
+	sum= (sum >> 16) + (sum & 0xffff);
+	sum= (sum >> 16) + (sum & 0xffff);
+	sum= (sum >> 16) + (sum & 0xffff);
+	if (swapped)
+		sum= ((sum & 0xff) << 8) | (sum >> 8);
+	return (u16_t)sum;
+}
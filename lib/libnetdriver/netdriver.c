@@ -7,12 +7,19 @@
  *
  *   netdriver_announce: called by a network driver to announce it is up
  *   netdriver_receive:	 receive() interface for network drivers
+ *   netdriver_ring_start: accept a DL_READRING_S or DL_WRITERING_S request
+ *   netdriver_ring_room:  number of slots the request has left
+ *   netdriver_ring_put:   queue a received frame for the client's ring
+ *   netdriver_ring_get:   queue a frame from the client's ring for sending
+ *   netdriver_ring_flush: do the queued copies
  */
 
 #include <minix/drivers.h>
 #include <minix/endpoint.h>
 #include <minix/netdriver.h>
 #include <minix/ds.h>
+#include <assert.h>
+#include <stddef.h>
 
 PRIVATE int conf_expected = TRUE;
 
@@ -75,3 +82,155 @@ int *status_ptr;
   return OK;
 }
 
+/*===========================================================================*
+ *			     netdriver_ring_start			     *
+ *===========================================================================*/
+PUBLIC int netdriver_ring_start(ring, m_ptr)
+netdriver_ring_t *ring;
+const message *m_ptr;
+{
+/* Accept a DL_READRING_S or DL_WRITERING_S request. The driver keeps the
+ * request pending until it is done with it, as it does for DL_READV_S
+ * and DL_WRITEV_S. For a write the frame lengths are fetched here.
+ */
+  int i, r;
+
+  if (m_ptr->DL_COUNT <= 0 || m_ptr->DL_COUNT > ETH_RING_NR)
+	return EINVAL;
+
+  ring->nr_client = m_ptr->m_source;
+  ring->nr_grant = (cp_grant_id_t) m_ptr->DL_GRANT;
+  ring->nr_write = (m_ptr->m_type == DL_WRITERING_S);
+  ring->nr_size = m_ptr->DL_COUNT;
+  ring->nr_next = 0;
+  ring->nr_count = 0;
+
+  if (!ring->nr_write)
+	return OK;
+
+  r = sys_safecopyfrom(ring->nr_client, ring->nr_grant,
+	offsetof(eth_ring_t, er_len), (vir_bytes) ring->nr_len,
+	ring->nr_size * sizeof(ring->nr_len[0]), D);
+  if (r != OK)
+	return r;
+
+  for (i = 0; i < ring->nr_size; i++) {
+	if (ring->nr_len[i] < ETH_MIN_PACK_SIZE ||
+		ring->nr_len[i] > ETH_MAX_PACK_SIZE_TAGGED)
+		return EINVAL;
+  }
+
+  return OK;
+}
+
+/*===========================================================================*
+ *			     netdriver_ring_room			     *
+ *===========================================================================*/
+PUBLIC int netdriver_ring_room(ring)
+const netdriver_ring_t *ring;
+{
+  return ring->nr_size - ring->nr_next;
+}
+
+/*===========================================================================*
+ *			     netdriver_ring_put				     *
+ *===========================================================================*/
+PUBLIC void netdriver_ring_put(ring, buf, len)
+netdriver_ring_t *ring;
+vir_bytes buf;
+size_t len;
+{
+/* Queue a frame of 'len' bytes at 'buf' for the next free slot. Nothing
+ * is copied until netdriver_ring_flush. Short frames are reported as
+ * ETH_MIN_PACK_SIZE bytes, as the DL_READV_S replies do.
+ */
+  struct vscp_vec *vp;
+  int slot;
+
+  assert(!ring->nr_write);
+  assert(ring->nr_next < ring->nr_size);
+
+  if (len > ETH_RING_SLOT)
+	len = ETH_RING_SLOT;
+
+  slot = ring->nr_next++;
+  vp = &ring->nr_vec[ring->nr_count++];
+  vp->v_from = SELF;
+  vp->v_to = ring->nr_client;
+  vp->v_gid = ring->nr_grant;
+  vp->v_offset = offsetof(eth_ring_t, er_data) + slot * ETH_RING_SLOT;
+  vp->v_addr = buf;
+  vp->v_bytes = len;
+
+  ring->nr_len[slot] = len < ETH_MIN_PACK_SIZE ? ETH_MIN_PACK_SIZE : len;
+}
+
+/*===========================================================================*
+ *			     netdriver_ring_get				     *
+ *===========================================================================*/
+PUBLIC size_t netdriver_ring_get(ring, buf)
+netdriver_ring_t *ring;
+vir_bytes buf;
+{
+/* Queue a copy of the next frame to be sent into 'buf', which must hold
+ * ETH_MAX_PACK_SIZE_TAGGED bytes. Return the length of the frame. The
+ * frame is only in 'buf' after netdriver_ring_flush.
+ */
+  struct vscp_vec *vp;
+  int slot;
+
+  assert(ring->nr_write);
+  assert(ring->nr_next < ring->nr_size);
+
+  slot = ring->nr_next++;
+  vp = &ring->nr_vec[ring->nr_count++];
+  vp->v_from = ring->nr_client;
+  vp->v_to = SELF;
+  vp->v_gid = ring->nr_grant;
+  vp->v_offset = offsetof(eth_ring_t, er_data) + slot * ETH_RING_SLOT;
+  vp->v_addr = buf;
+  vp->v_bytes = ring->nr_len[slot];
+
+  return ring->nr_len[slot];
+}
+
+/*===========================================================================*
+ *			     netdriver_ring_flush			     *
+ *===========================================================================*/
+PUBLIC int netdriver_ring_flush(ring)
+netdriver_ring_t *ring;
+{
+/* Do all queued copies with a single kernel call. A receive request is
+ * finished by its flush: the frame lengths go along and the number of
+ * frames is returned, which the driver passes in the DL_COUNT field of
+ * its DL_TASK_REPLY. A transmit request may be flushed several times if
+ * the driver runs out of descriptors; the number of frames copied is
+ * returned. A negative value is an error.
+ */
+  struct vscp_vec *vp;
+  int r, count, nr_vec;
+
+  count = ring->nr_count;
+  if (count == 0)
+	return 0;
+
+  nr_vec = count;
+  if (!ring->nr_write) {
+	vp = &ring->nr_vec[nr_vec++];
+	vp->v_from = SELF;
+	vp->v_to = ring->nr_client;
+	vp->v_gid = ring->nr_grant;
+	vp->v_offset = offsetof(eth_ring_t, er_len);
+	vp->v_addr = (vir_bytes) ring->nr_len;
+	vp->v_bytes = ring->nr_next * sizeof(ring->nr_len[0]);
+  }
+
+  if ((r = sys_vsafecopy(ring->nr_vec, nr_vec)) != OK)
+	return r;
+
+  ring->nr_count = 0;
+  if (!ring->nr_write)
+	ring->nr_size = ring->nr_next = 0;
+
+  return count;
+}
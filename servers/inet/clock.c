@@ -12,23 +12,60 @@ Copyright 1995 Philip Homburg
 
 THIS_FILE
 
+/* Timers are kept in a hierarchical timing wheel. Level 0 has a slot for
+ * each of the next WHEEL_SIZE ticks, a slot in level n covers WHEEL_SIZE^n
+ * ticks. A timer goes into the lowest level whose range reaches its
+ * timeout, and moves down a level each time the wheel turns to its slot.
+ * Timeouts beyond the last level are parked in its farthest slot until
+ * they get closer.
+ */
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE-1)
+#define WHEEL_LEVELS	5
+#define WHEEL_MAX	((time_t)1 << (WHEEL_BITS*WHEEL_LEVELS))
+
 PUBLIC int clck_call_expire;
 
 PRIVATE time_t curr_time;
 PRIVATE time_t prev_time;
-PRIVATE timer_t *timer_chain;
 PRIVATE time_t next_timeout;
+PRIVATE timer_t *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+PRIVATE time_t wheel_time;	/* Next tick to process, never after now */
+PRIVATE int timer_nr;
+PRIVATE timer_t *expire_list;
+PRIVATE time_t clck_coalesce;	/* Round alarms up to this many ticks */
 
 FORWARD _PROTOTYPE( void clck_fast_release, (timer_t *timer) );
 FORWARD _PROTOTYPE( void set_timer, (void) );
+FORWARD _PROTOTYPE( void wheel_insert, (timer_t *timer) );
+FORWARD _PROTOTYPE( void wheel_cascade, (void) );
+FORWARD _PROTOTYPE( time_t wheel_next, (void) );
 
 PUBLIC void clck_init()
 {
+	char *cp;
+	unsigned long ms;
+
 	clck_call_expire= 0;
 	curr_time= 0;
 	prev_time= 0;
 	next_timeout= 0;
-	timer_chain= 0;
+	wheel_time= 0;
+	timer_nr= 0;
+	expire_list= NULL;
+
+	/* With inetcoalesce=<ms> in the environment, alarms are rounded up
+	 * to multiples of that many milliseconds, so that timers expiring
+	 * close together are handled in one pass.
+	 */
+	clck_coalesce= 0;
+	cp= getenv("inetcoalesce");
+	if (cp != NULL)
+	{
+		ms= strtoul(cp, NULL, 10);
+		clck_coalesce= (ms * HZ + 999) / 1000;
+	}
 }
 
 PUBLIC time_t get_time()
@@ -71,35 +108,22 @@ time_t timeout;
 timer_func_t func;
 int fd;
 {
-	timer_t *timer_index;
-
 	if (timer->tim_active)
 		clck_fast_release(timer);
 	assert(!timer->tim_active);
 
-	timer->tim_next= 0;
 	timer->tim_func= func;
 	timer->tim_ref= fd;
 	timer->tim_time= timeout;
 	timer->tim_active= 1;
 
-	if (!timer_chain)
-		timer_chain= timer;
-	else if (timeout < timer_chain->tim_time)
-	{
-		timer->tim_next= timer_chain;
-		timer_chain= timer;
-	}
-	else
-	{
-		timer_index= timer_chain;
-		while (timer_index->tim_next &&
-			timer_index->tim_next->tim_time < timeout)
-			timer_index= timer_index->tim_next;
-		timer->tim_next= timer_index->tim_next;
-		timer_index->tim_next= timer;
-	}
-	if (next_timeout == 0 || timer_chain->tim_time < next_timeout)
+	/* An empty wheel may have stood still for a long time */
+	if (timer_nr == 0)
+		wheel_time= get_time();
+	wheel_insert(timer);
+	timer_nr++;
+
+	if (next_timeout == 0 || timeout < next_timeout)
 		set_timer();
 }
 
@@ -113,22 +137,14 @@ message *mess;
 PRIVATE void clck_fast_release (timer)
 timer_t *timer;
 {
-	timer_t *timer_index;
-
 	if (!timer->tim_active)
 		return;
 
-	if (timer == timer_chain)
-		timer_chain= timer_chain->tim_next;
-	else
-	{
-		timer_index= timer_chain;
-		while (timer_index && timer_index->tim_next != timer)
-			timer_index= timer_index->tim_next;
-		assert(timer_index);
-		timer_index->tim_next= timer->tim_next;
-	}
+	*timer->tim_pprev= timer->tim_next;
+	if (timer->tim_next)
+		timer->tim_next->tim_pprev= timer->tim_pprev;
 	timer->tim_active= 0;
+	timer_nr--;
 }
 
 PRIVATE void set_timer()
@@ -136,16 +152,21 @@ PRIVATE void set_timer()
 	time_t new_time;
 	time_t curr_time;
 
-	if (!timer_chain)
+	if (timer_nr == 0)
 		return;
 
 	curr_time= get_time();
-	new_time= timer_chain->tim_time;
+	new_time= wheel_next();
 	if (new_time <= curr_time)
 	{
 		clck_call_expire= 1;
 		return;
 	}
+	if (clck_coalesce > 1)
+	{
+		new_time= (new_time + clck_coalesce - 1) / clck_coalesce *
+			clck_coalesce;
+	}
 
 	if (next_timeout == 0 || new_time < next_timeout)
 	{
@@ -166,26 +187,152 @@ timer_t *timer;
 
 PUBLIC void clck_expire_timers()
 {
-	time_t curr_time;
-	timer_t *timer_index;
+	time_t curr_time, next;
+	timer_t *timer, **slot;
 
 	clck_call_expire= 0;
 
-	if (timer_chain == NULL)
+	if (timer_nr == 0)
 		return;
 
 	curr_time= get_time();
-	while (timer_chain && timer_chain->tim_time<=curr_time)
+	for (;;)
 	{
-		assert(timer_chain->tim_active);
-		timer_chain->tim_active= 0;
-		timer_index= timer_chain;
-		timer_chain= timer_chain->tim_next;
-		(*timer_index->tim_func)(timer_index->tim_ref, timer_index);
+		if ((wheel_time & WHEEL_MASK) == 0)
+			wheel_cascade();
+
+		/* Everything in this slot is due. Take the lot off the wheel
+		 * first. A callback that sets a timer that is already due
+		 * puts it back in this slot, so go round until it is empty.
+		 */
+		slot= &wheel[0][wheel_time & WHEEL_MASK];
+		while (*slot)
+		{
+			expire_list= *slot;
+			*slot= NULL;
+			expire_list->tim_pprev= &expire_list;
+			while (expire_list)
+			{
+				timer= expire_list;
+				assert(timer->tim_active);
+				assert(timer->tim_time <= curr_time);
+				clck_fast_release(timer);
+				(*timer->tim_func)(timer->tim_ref, timer);
+			}
+		}
+
+		if (wheel_time >= curr_time)
+			break;
+
+		/* Skip the ticks that have nothing to expire or to cascade */
+		wheel_time++;
+		next= wheel_next();
+		if (next == 0 || next > curr_time)
+			next= curr_time;
+		assert(next >= wheel_time);
+		wheel_time= next;
 	}
 	set_timer();
 }
 
+PRIVATE void wheel_insert(timer)
+timer_t *timer;
+{
+	time_t t, delta;
+	int level, shift;
+	timer_t **slot;
+
+	t= timer->tim_time;
+	if (t < wheel_time)
+		t= wheel_time;
+	delta= t - wheel_time;
+	if (delta >= WHEEL_MAX)
+	{
+		t= wheel_time + WHEEL_MAX - 1;
+		delta= WHEEL_MAX - 1;
+	}
+	level= 0;
+	shift= 0;
+	while (delta >= ((time_t)1 << (shift + WHEEL_BITS)))
+	{
+		level++;
+		shift += WHEEL_BITS;
+	}
+	slot= &wheel[level][(t >> shift) & WHEEL_MASK];
+
+	timer->tim_next= *slot;
+	if (timer->tim_next)
+		timer->tim_next->tim_pprev= &timer->tim_next;
+	timer->tim_pprev= slot;
+	*slot= timer;
+}
+
+PRIVATE void wheel_cascade()
+{
+	int level, shift, index;
+	timer_t *list, *timer;
+
+	/* Called when level 0 starts a new round. Move the timers of the
+	 * slot level 1 has come to down, and those of higher levels
+	 * when the level below has come round as well.
+	 */
+	for (level= 1, shift= WHEEL_BITS; level < WHEEL_LEVELS;
+		level++, shift += WHEEL_BITS)
+	{
+		index= (wheel_time >> shift) & WHEEL_MASK;
+		list= wheel[level][index];
+		wheel[level][index]= NULL;
+		while (list)
+		{
+			timer= list;
+			list= list->tim_next;
+			wheel_insert(timer);
+		}
+		if (index != 0)
+			break;
+	}
+}
+
+PRIVATE time_t wheel_next()
+{
+	int i, level, shift;
+	time_t t, base, best;
+
+	/* Level 0 is exact. In a higher level the start of the first
+	 * occupied slot is when its timers come down a level, which is
+	 * not after any of them expires.
+	 */
+	best= 0;
+	for (i= 0; i<WHEEL_SIZE; i++)
+	{
+		if (wheel[0][(wheel_time + i) & WHEEL_MASK])
+		{
+			best= wheel_time + i;
+			break;
+		}
+	}
+	for (level= 1, shift= WHEEL_BITS; level < WHEEL_LEVELS;
+		level++, shift += WHEEL_BITS)
+	{
+		/* The current slot is still to come down if the wheel is at
+		 * its very start, otherwise it holds the next round.
+		 */
+		base= wheel_time >> shift;
+		i= (wheel_time & (((time_t)1 << shift) - 1)) == 0 ? 0 : 1;
+		for (; i<=WHEEL_SIZE; i++)
+		{
+			if (wheel[level][(base + i) & WHEEL_MASK])
+				break;
+		}
+		if (i > WHEEL_SIZE)
+			continue;
+		t= (base + i) << shift;
+		if (best == 0 || t < best)
+			best= t;
+	}
+	return best;
+}
+
 /*
  * $PchId: clock.c,v 1.10 2005/06/28 14:23:40 philip Exp $
  */
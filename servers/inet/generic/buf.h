@@ -25,6 +25,8 @@ Copyright 1995 Philip Homburg
 
 #define ICMP_PRI_QUEUE		1
 
+#define NF_PRI_FRAGBUFS		4
+
 #define TCP_PRI_FRAG2SEND	4
 #define TCP_PRI_CONN_EXTRA	5
 #define TCP_PRI_CONNwoUSER	7
@@ -17,6 +17,7 @@ Copyright 1995 Philip Homburg
 #include "eth_int.h"
 #include "sr.h"
 #include "nfcore.h"
+#include "nf.h"
 
 THIS_FILE
 
@@ -51,6 +52,7 @@ typedef struct eth_fd
 #		define 	EFF_IOCTL_IP	0x8
 #	define EFF_OPTSET       0x10
 #   define EFF_SEL_READ	0x20
+#	define EFF_IP		0x40	/* IP's own, its frames passed the IP hooks */
 
 /* Note that the vh_type field is normally considered part of the ethernet
  * header.
@@ -77,6 +79,7 @@ FORWARD void reply_thr_put ARGS(( eth_fd_t *eth_fd,
 FORWARD void do_rec_conf ARGS(( eth_port_t *eth_port ));
 FORWARD u32_t compute_rec_conf ARGS(( eth_port_t *eth_port ));
 FORWARD acc_t *insert_vlan_hdr ARGS(( eth_port_t *eth_port, acc_t *pack ));
+FORWARD int eth_filter ARGS(( int fd, acc_t **pack ));
 
 PUBLIC eth_port_t *eth_port_table;
 PUBLIC int no_ethWritePort= 0;
@@ -485,13 +488,6 @@ int fd;
 acc_t *data;
 size_t data_len;
 {
-acc_t *temppack;
-unsigned char src_ip[4];
-unsigned char dst_ip[4];
-int verdict=NF_ACCEPT;
-int pack_len;
-char ifin[]="ethX";
-char ifout[]="ethX";
 	eth_fd_t *eth_fd;
 	eth_port_t *eth_port, *rep;
 	eth_hdr_t *eth_hdr;
@@ -499,7 +495,6 @@ char ifout[]="ethX";
 	unsigned long nweo_flags;
 	size_t count;
 	ev_arg_t ev_arg;
-	int i;
 
 	eth_fd= &eth_fd_table[fd];
 	eth_port= eth_fd->ef_port;
@@ -507,49 +502,6 @@ char ifout[]="ethX";
 	if (!(eth_fd->ef_flags & EFF_OPTSET))
 		return EBADMODE;
 
-        if (fd<3)
-        {
-           ifin[3]='1'-fd;
-           ifout[3]='0'+fd;
-        }
-        inetEthIn(ifin);
-        inetEthOut(ifout);
-/*printf("IP Packet to be sent: port=%d, len=%d\n",fd,data_len);*/
-for (temppack=data; temppack;)
-{
-  pack_len+=temppack->acc_length;
-  temppack=temppack->acc_next;
-}
-inetSetPackSize(pack_len);
-inetContainLayers(NF_LAYER_ETH);
-for (i=0, temppack=data, count=data_len; temppack && count>0;)
-{
-  inetSetDataSize(temppack->acc_length);
-  if (i==1)
-  {
-     *((uint32_t*)src_ip)=(*((uint32_t*)(&(temppack->acc_buffer->buf_data_p[12+temppack->acc_offset]))));
-     *((uint32_t*)dst_ip)=(*((uint32_t*)(&(temppack->acc_buffer->buf_data_p[16+temppack->acc_offset]))));
-  }
-  inetData( (void*) (&(temppack->acc_buffer->buf_data_p[temppack->acc_offset])) );
-  i++;
-  count-=temppack->acc_buffer->buf_size;
-  temppack=temppack->acc_next;
-  /*printf("\n----------------\n");*/
-}
-/*printf("\n");*/
-        if (inetCheckLocalIP(src_ip[0],src_ip[1],src_ip[2],src_ip[3])||
-            inetCheckLocalIP(dst_ip[0],dst_ip[1],dst_ip[2],dst_ip[3]))
-        {
-           inetHook(NF_IP_LOCAL_OUT);
-        }
-        else
-        {
-           inetHook(NF_IP_FORWARD);
-#ifdef _DEBUG
-  printf("eth.c.c :eth_send(): calls inetProcess()\n");
-#endif
-           verdict=inetProcess();
-        }
 	count= data_len;
 	if (eth_fd->ef_ethopt.nweo_flags & NWEO_RWDATONLY)
 		count += ETH_HDR_SIZE;
@@ -567,6 +519,18 @@ for (i=0, temppack=data, count=data_len; temppack && count>0;)
 		return NW_WOULDBLOCK;
 	
 	nweo_flags= eth_fd->ef_ethopt.nweo_flags;
+
+	/* The packet is ours from here on, let the filter have a look
+	 * unless IP has routed it through its hooks already.
+	 */
+	if (!(nweo_flags & NWEO_RWDATONLY) &&
+		!(eth_fd->ef_flags & EFF_IP) &&
+		eth_filter(fd, &data) != NF_ACCEPT)
+	{
+		bf_afree(data);
+		return NW_OK;
+	}
+
 	if (nweo_flags & NWEO_RWDATONLY)
 	{
 		eth_pack= bf_memreq(ETH_HDR_SIZE);
@@ -612,14 +576,7 @@ for (i=0, temppack=data, count=data_len; temppack && count>0;)
 		}
 	}
 
-	if (verdict==NF_ACCEPT)
-	{
-	   eth_write_port(rep, eth_pack);
-	}
-	else
-	{ 
-	   bf_afree(eth_pack);
-	}
+	eth_write_port(rep, eth_pack);
 	return NW_OK;
 }
 
@@ -744,6 +701,24 @@ unsigned operations;
 	return resops;
 }
 
+/*
+eth_set_ip
+
+Marks the fd IP sends its packets through. They have been filtered at
+IP's hooks, so only frames written on other fds, bridged ones, pass the
+FORWARD hook in eth_send.
+*/
+
+PUBLIC void eth_set_ip(fd)
+int fd;
+{
+	eth_fd_t *eth_fd;
+
+	eth_fd= &eth_fd_table[fd];
+	assert(eth_fd->ef_flags & EFF_INUSE);
+	eth_fd->ef_flags |= EFF_IP;
+}
+
 PUBLIC void eth_close(fd)
 int fd;
 {
@@ -1300,6 +1275,16 @@ PRIVATE void eth_bufcheck()
 	{
 		bf_check_acc(eth_port_table[i].etp_rd_pack);
 		bf_check_acc(eth_port_table[i].etp_wr_pack);
+		for (pack= eth_port_table[i].etp_osdep.etp_txq_head; pack;
+			pack= pack->acc_ext_link)
+		{
+			bf_check_acc(pack);
+		}
+		for (pack= eth_port_table[i].etp_osdep.etp_tx_sent; pack;
+			pack= pack->acc_ext_link)
+		{
+			bf_check_acc(pack);
+		}
 	}
 	for (i= 0, eth_fd= eth_fd_table; i<ETH_FD_NR; i++, eth_fd++)
 	{
@@ -1415,6 +1400,38 @@ acc_t *pack;
 	return pack;
 }
 
+PRIVATE int eth_filter(fd, pack)
+int fd;
+acc_t **pack;
+{
+	eth_hdr_t *eth_hdr;
+	ip_hdr_t *ip_hdr;
+	char ifin[]="ethX";
+	char ifout[]="ethX";
+
+	if (bf_bufsize(*pack) < ETH_HDR_SIZE + IP_MIN_HDR_SIZE)
+		return NF_ACCEPT;
+	ip_hdr= nf_pullup(pack, NF_LAYER_ETH, NULL);
+	eth_hdr= (eth_hdr_t *)ptr2acc_data(*pack);
+	if (ip_hdr == NULL || eth_hdr->eh_proto != HTONS(ETH_IP_PROTO))
+		return NF_ACCEPT;
+
+	/* Locally sent and received packets pass the IP hooks instead. */
+	if (inetCheckLocalIP(ip_hdr->ih_src) ||
+		inetCheckLocalIP(ip_hdr->ih_dst))
+	{
+		return NF_ACCEPT;
+	}
+
+	if (fd<3)
+	{
+		ifin[3]='1'-fd;
+		ifout[3]='0'+fd;
+	}
+	return nf_hook(NF_IP_FORWARD, pack, ifin, ifout, NF_LAYER_ETH,
+		NULL, 0);
+}
+
 /*
  * $PchId: eth.c,v 1.23 2005/06/28 14:15:58 philip Exp $
  */
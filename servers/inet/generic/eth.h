@@ -30,6 +30,7 @@ int eth_write ARGS(( int port, size_t count ));
 int eth_cancel ARGS(( int fd, int which_operation ));
 int eth_select ARGS(( int fd, unsigned operations ));
 void eth_close ARGS(( int fd ));
+void eth_set_ip ARGS(( int fd ));
 int eth_send ARGS(( int port, struct acc *data, size_t data_len ));
 
 #endif /* ETH_H */
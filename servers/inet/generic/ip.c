@@ -446,6 +446,11 @@ PRIVATE void ip_bufcheck()
 			{
 				bf_check_acc(pack);
 			}
+			for (pack= ip_port->ip_dl.dl_eth.de_arrive_head; pack;
+				pack= pack->acc_ext_link)
+			{
+				bf_check_acc(pack);
+			}
 		}
 		else if (ip_port->ip_dl_type == IPDL_PSIP)
 		{
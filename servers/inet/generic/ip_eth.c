@@ -56,6 +56,10 @@ FORWARD int ipeth_update_ttl ARGS(( time_t enq_time, time_t now,
 	acc_t *eth_pack ));
 FORWARD void ip_eth_arrived ARGS(( int port, acc_t *pack,
 	size_t pack_size ));
+FORWARD void ip_eth_reinject ARGS(( int ref, acc_t *pack ));
+FORWARD void ip_eth_arrived_burst ARGS(( int port, acc_t **packs,
+	int count ));
+FORWARD void ip_eth_arrive_ev ARGS(( event_t *ev, ev_arg_t ev_arg ));
 
 
 PUBLIC int ipeth_init(ip_port)
@@ -73,12 +77,16 @@ ip_port_t *ip_port;
 		DBLOCK(1, printf("ip.c: unable to open eth port\n"));
 		return -1;
 	}
+	eth_set_ip(ip_port->ip_dl.dl_eth.de_fd);
 	ip_port->ip_dl.dl_eth.de_state= IES_EMPTY;
 	ip_port->ip_dl.dl_eth.de_flags= IEF_EMPTY;
 	ip_port->ip_dl.dl_eth.de_q_head= NULL;
 	ip_port->ip_dl.dl_eth.de_q_tail= NULL;
 	ip_port->ip_dl.dl_eth.de_arp_head= NULL;
 	ip_port->ip_dl.dl_eth.de_arp_tail= NULL;
+	ip_port->ip_dl.dl_eth.de_arrive_head= NULL;
+	ip_port->ip_dl.dl_eth.de_arrive_tail= NULL;
+	ev_init(&ip_port->ip_dl.dl_eth.de_arrive_event);
 	ip_port->ip_dev_main= ipeth_main;
 	ip_port->ip_dev_set_ipaddr= ipeth_set_ipaddr;
 	ip_port->ip_dev_send= ipeth_send;
@@ -279,8 +287,14 @@ int type;
 	time_t t;
 	u32_t *p;
 	char ifout[]="ethX";
-	size_t count;
-	acc_t *temppack;
+
+	ifout[3]='0'+ip_port->ip_port;
+	if (nf_hook(NF_IP_POST_ROUTING, &pack, NULL, ifout, NF_LAYER_IP,
+		NULL, 0) != NF_ACCEPT)
+	{
+		bf_afree(pack);
+		return NW_OK;
+	}
 
 	/* Start optimistic: the arp will succeed without blocking and the
 	 * ethernet packet can be sent without blocking also. Start with
@@ -306,34 +320,6 @@ int type;
 	}
 	eth_hdr= (eth_hdr_t *)ptr2acc_data(eth_pack);
 
-        ifout[3]='0'+ip_port->ip_port;
-        inetEthIn(NULL);
-        inetEthOut(ifout);
-        inetSetPackSize(pack_size);
-        inetContainLayers(NF_LAYER_IP);
-         /* sending all buffer parts to the filter */
-        for (i=0, temppack=pack, count=pack_size; temppack && count>0;)
-        {
-                inetSetDataSize(temppack->acc_buffer->buf_size);
-                inetData((void*) (((vir_bytes)temppack->acc_buffer->buf_data_p)
-                        +temppack->acc_offset)
-                        );
-                i++; count-=temppack->acc_buffer->buf_size;
-                temppack=temppack->acc_next;
-        }
-        inetHook(NF_IP_POST_ROUTING);
-  
-         /* do the filtering work */
-#ifdef _DEBUG
-   printf("ip_eth.c :ipeth_send(): calls inetProcess()\n");
-#endif
-        if (inetProcess()==0) 
-        {
-           return NW_OK;
-        }
-        inetGetData(NULL);
- 
-
 	/* Lookup the ethernet address */
 	if (type != IP_LT_NORMAL)
 	{
@@ -731,53 +717,154 @@ ip_port_t *ip_port;
 	}
 }
 
+/*
+ip_eth_arrived
+
+Queues a frame eth has received. The frames that come in while inet
+handles one message, all those of a DL_READRING_S reply, go on to
+netfilter together from ip_eth_arrive_ev.
+*/
+
 PRIVATE void ip_eth_arrived(port, pack, pack_size)
 int port;
 acc_t *pack;
 size_t pack_size;
 {
-	int broadcast;
 	ip_port_t *ip_port;
-	int i;
-	acc_t *temppack;
-	int count;
-	char ifin[]="ethX";
-	char ifout[]="ethX";
+	acc_t *tmp_pack;
+	ev_arg_t ev_arg;
 
 	ip_port= &ip_port_table[port];
-	broadcast= (*(u8_t *)ptr2acc_data(pack) & 1);
 
-	pack= bf_delhead(pack, ETH_HDR_SIZE);
+	if (pack->acc_linkC != 1)
+	{
+		tmp_pack= bf_dupacc(pack);
+		bf_afree(pack);
+		pack= tmp_pack;
+		tmp_pack= NULL;
+	}
+	pack->acc_ext_link= NULL;
+	if (ip_port->ip_dl.dl_eth.de_arrive_head)
+	{
+		ip_port->ip_dl.dl_eth.de_arrive_tail->acc_ext_link= pack;
+		ip_port->ip_dl.dl_eth.de_arrive_tail= pack;
+		return;
+	}
 
-	ifin[3]='0'+port;
-	inetEthIn(ifin);
-	inetEthOut(NULL);
-	inetSetPackSize(pack_size);
-	inetContainLayers(NF_LAYER_IP);
-	 /* sending all buffer parts to the filter */
-	for (i=0, temppack=pack, count=pack_size; temppack && count>0;)
+	ip_port->ip_dl.dl_eth.de_arrive_head= pack;
+	ip_port->ip_dl.dl_eth.de_arrive_tail= pack;
+	ev_arg.ev_ptr= ip_port;
+	ev_enqueue(&ip_port->ip_dl.dl_eth.de_arrive_event, ip_eth_arrive_ev,
+		ev_arg);
+}
+
+/*
+ip_eth_arrive_ev
+
+Hands the queued frames of a port to ip_eth_arrived_burst, NF_BATCH_MAX
+at a time.
+*/
+
+PRIVATE void ip_eth_arrive_ev(ev, ev_arg)
+event_t *ev;
+ev_arg_t ev_arg;
+{
+	acc_t *packs[NF_BATCH_MAX];
+	ip_port_t *ip_port;
+	acc_t *pack;
+	int n;
+
+	ip_port= ev_arg.ev_ptr;
+	assert(&ip_port->ip_dl.dl_eth.de_arrive_event == ev);
+
+	while (ip_port->ip_dl.dl_eth.de_arrive_head != NULL)
 	{
-	        inetSetDataSize(temppack->acc_buffer->buf_size);
-	        inetData((void*) (((vir_bytes)temppack->acc_buffer->buf_data_p)
-	                +temppack->acc_offset)
-	                );
-	        i++; count-=temppack->acc_buffer->buf_size;
-	        temppack=temppack->acc_next;
+		for (n= 0; n<NF_BATCH_MAX; n++)
+		{
+			pack= ip_port->ip_dl.dl_eth.de_arrive_head;
+			if (pack == NULL)
+				break;
+			ip_port->ip_dl.dl_eth.de_arrive_head=
+				pack->acc_ext_link;
+			packs[n]= pack;
+		}
+		ip_eth_arrived_burst(ip_port->ip_port, packs, n);
 	}
-	inetHook(NF_IP_PRE_ROUTING);
-	
-        /* do the filtering work */
-	#ifdef _DEBUG
-	  printf("ip_eth.c :ip_eth_arrived(): calls inetProcess()");
-	#endif
-	        if (inetProcess()==1) 
-	        {
-	           if (broadcast)
-	               ip_arrived_broadcast(ip_port, pack);
-	           else
-		       ip_arrived(ip_port, pack);
+}
+
+/*
+ip_eth_arrived_burst
+
+Passes frames received on one port through the PRE_ROUTING hook with a
+single netfilter call per NF_BATCH_MAX frames, then hands the accepted
+ones to IP in the order they arrived. The frames are taken over.
+*/
+
+PRIVATE void ip_eth_arrived_burst(port, packs, count)
+int port;
+acc_t **packs;
+int count;
+{
+	int broadcast[NF_BATCH_MAX];
+	int verdicts[NF_BATCH_MAX];
+	int refs[NF_BATCH_MAX];
+	ip_port_t *ip_port;
+	char ifin[]="ethX";
+	int first, i, n;
+
+	ip_port= &ip_port_table[port];
+	ifin[3]='0'+port;
+
+	for (first= 0; first<count; first += n)
+	{
+		n= count-first;
+		if (n > NF_BATCH_MAX)
+			n= NF_BATCH_MAX;
+
+		for (i= 0; i<n; i++)
+		{
+			broadcast[i]= (*(u8_t *)ptr2acc_data(packs[first+i]) &
+				1);
+			packs[first+i]= bf_delhead(packs[first+i],
+				ETH_HDR_SIZE);
+			refs[i]= (port << 1) | broadcast[i];
+		}
+
+		nf_hook_batch(NF_IP_PRE_ROUTING, packs+first, n, ifin, NULL,
+			NF_LAYER_IP, verdicts, ip_eth_reinject, refs);
+
+		for (i= 0; i<n; i++)
+		{
+			if (verdicts[i] == NF_STOLEN)
+				continue;
+			if (verdicts[i] != NF_ACCEPT)
+				bf_afree(packs[first+i]);
+			else if (broadcast[i])
+				ip_arrived_broadcast(ip_port, packs[first+i]);
+			else
+				ip_arrived(ip_port, packs[first+i]);
 		}
-		inetGetData(NULL);
+	}
+}
+
+/*
+ip_eth_reinject
+
+Takes back a packet that was queued at PREROUTING, ref is its port and
+whether it arrived as a link level broadcast.
+*/
+
+PRIVATE void ip_eth_reinject(ref, pack)
+int ref;
+acc_t *pack;
+{
+	ip_port_t *ip_port;
+
+	ip_port= &ip_port_table[ref >> 1];
+	if (ref & 1)
+		ip_arrived_broadcast(ip_port, pack);
+	else
+		ip_arrived(ip_port, pack);
 }
 
 /*
@@ -42,6 +42,9 @@ typedef struct ip_port
 			acc_t *de_q_tail;
 			acc_t *de_arp_head;
 			acc_t *de_arp_tail;
+			acc_t *de_arrive_head;
+			acc_t *de_arrive_tail;
+			event_t de_arrive_event;
 		} dl_eth;
 		struct
 		{
@@ -176,6 +179,7 @@ void ip_packet2user ARGS(( ip_fd_t *ip_fd, acc_t *pack, time_t exp_time,
 void dll_eth_write_frame ARGS(( ip_port_t *port ));
 acc_t *ip_split_pack ARGS(( ip_port_t *ip_port, acc_t **ref_last, int mtu ));
 void ip_hdr_chksum ARGS(( ip_hdr_t *ip_hdr, int ip_hdr_len ));
+int ip_send_pack ARGS(( int port_nr, acc_t *pack ));
 
 
 extern ip_fd_t ip_fd_table[IP_FD_NR];
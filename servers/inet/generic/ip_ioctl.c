@@ -17,6 +17,7 @@ Copyright 1995 Philip Homburg
 #include "ip_int.h"
 #include "ipr.h"
 #include "nfcore.h"
+#include "nfnat.h"
 
 THIS_FILE
 
@@ -250,12 +251,6 @@ ioreq_t req;
 		ipconf= (nwio_ipconf_t *)ptr2acc_data(data);
 		ipconf->nwic_flags= NWIC_IPADDR_SET;
 		ipconf->nwic_ipaddr= ip_port->ip_ipaddr;
-		inetRegisterLocalIP(
-		                      (ntohl(ip_port->ip_ipaddr)>>24)&0xff,
-		                      (ntohl(ip_port->ip_ipaddr)>>16)&0xff,
-		                      (ntohl(ip_port->ip_ipaddr)>>8)&0xff,
-		                      (ntohl(ip_port->ip_ipaddr)>>0)&0xff 
-		                   );
 		ipconf->nwic_netmask= ip_port->ip_subnetmask;
 		if (ip_port->ip_flags & IPF_NETMASKSET)
 			ipconf->nwic_flags |= NWIC_NETMASK_SET;
@@ -519,6 +514,7 @@ nwio_ipconf_t *ipconf;
 	ip_fd_t *ip_fd;
 	ipaddr_t ipaddr;
 	u32_t mtu;
+	char ifname[]="ethX";
 
 	ip_port= &ip_port_table[ip_port_nr];
 
@@ -546,6 +542,13 @@ nwio_ipconf_t *ipconf;
 	if (ipconf->nwic_flags & NWIC_IPADDR_SET)
 	{
 		ipaddr= ipconf->nwic_ipaddr;
+
+		/* the filter tells local traffic from forwarded by these */
+		if (ip_port->ip_flags & IPF_IPADDRSET)
+			inetUnregisterLocalIP(ip_port->ip_ipaddr);
+		if (ipaddr != HTONL(0x00000000))
+			inetRegisterLocalIP(ipaddr);
+
 		ip_port->ip_ipaddr= ipaddr;
 		ip_port->ip_flags |= IPF_IPADDRSET;
 		ip_port->ip_classfulmask=
@@ -562,6 +565,10 @@ nwio_ipconf_t *ipconf;
 		}
 		(*ip_port->ip_dev_set_ipaddr)(ip_port);
 
+		/* MASQUERADE and REDIRECT bindings follow the address */
+		ifname[3]='0'+ip_port_nr;
+		nfNatSetIfAddr(ifname, ipaddr);
+
 		/* revive calls waiting for an ip addresses */
 		for (i=0, ip_fd= ip_fd_table; i<IP_FD_NR; i++, ip_fd++)
 		{
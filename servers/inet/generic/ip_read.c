@@ -29,6 +29,10 @@ FORWARD int ip_frag_chk ARGS(( acc_t *pack ));
 FORWARD acc_t *reassemble ARGS(( ip_port_t *ip_port, acc_t *pack, 
 	ip_hdr_t *ip_hdr ));
 FORWARD void route_packets ARGS(( event_t *ev, ev_arg_t ev_arg ));
+FORWARD void route_pack ARGS(( ip_port_t *ip_port, acc_t *pack ));
+FORWARD void route_reinject ARGS(( int ref, acc_t *pack ));
+FORWARD void ip_port_deliver ARGS(( ip_port_t *ip_port, acc_t *pack ));
+FORWARD void ip_port_reinject ARGS(( int ref, acc_t *pack ));
 FORWARD int broadcast_dst ARGS(( ip_port_t *ip_port, ipaddr_t dest ));
 
 PUBLIC int ip_read(int fd, size_t count)
@@ -477,52 +481,46 @@ PUBLIC void ip_port_arrive (ip_port, pack, ip_hdr)
 ip_port_t *ip_port;
 acc_t *pack;
 ip_hdr_t *ip_hdr;
+{
+	char ifin[]="ethX";
+	int r;
+
+	assert (pack->acc_linkC>0);
+	assert (pack->acc_length >= IP_MIN_HDR_SIZE);
+
+	ifin[3]='0'+ip_port->ip_dl.dl_eth.de_port;
+	r= nf_hook(NF_IP_LOCAL_IN, &pack, ifin, NULL, NF_LAYER_IP,
+		ip_port_reinject, ip_port->ip_port);
+	if (r != NF_ACCEPT)
+	{
+		if (r != NF_STOLEN)
+			bf_afree(pack);
+		return;
+	}
+	ip_port_deliver(ip_port, pack);
+}
+
+/* a packet queued at INPUT is back, ref is its port */
+PRIVATE void ip_port_reinject(ref, pack)
+int ref;
+acc_t *pack;
+{
+	ip_port_deliver(&ip_port_table[ref], pack);
+}
+
+PRIVATE void ip_port_deliver (ip_port, pack)
+ip_port_t *ip_port;
+acc_t *pack;
 {
 	ip_fd_t *ip_fd, *first_fd, *share_fd;
+	ip_hdr_t *ip_hdr;
 	unsigned long ip_pack_stat;
 	unsigned size;
 	int i;
 	int hash, proto;
 	time_t exp_time;
-	char ifin[]="ethX";
-	acc_t *temppack;
-	size_t pack_size;
-	int count;
-
-	assert (pack->acc_linkC>0);
-	assert (pack->acc_length >= IP_MIN_HDR_SIZE);
 
-/*printf("ip_read: Proto: %d\n",ip_hdr->ih_proto);*/
-        pack_size=pack->acc_length;
-        ifin[3]='0'+ip_port->ip_dl.dl_eth.de_port;
-        inetEthIn(ifin);
-        inetEthOut("");
-        inetSetPackSize(pack_size);
-        inetContainLayers(NF_LAYER_IP);
-
-        /* sending all buffer parts to the filter */
-        for (i=0, temppack=pack, count=pack_size; temppack && count>0;)
-        {
-                inetSetDataSize(temppack->acc_buffer->buf_size);
-                inetData((void*) (((vir_bytes)temppack->acc_buffer->buf_data_p)
-                        +temppack->acc_offset)
-                        );
-                i++; count-=temppack->acc_buffer->buf_size;
-                temppack=temppack->acc_next;
-        }
-        inetHook(NF_IP_LOCAL_IN);
- 
-        /* do the filtering work */
-#ifdef _DEBUG
-  printf("ip_read.c :ip_port_arrive(): calls inetProcess()");
-#endif
-        if (!inetProcess())
-        {
-               inetGetData(NULL);
-               bf_afree(pack); pack= NULL;
-               return;
-        }
-        inetGetData(NULL);
+	ip_hdr= (ip_hdr_t *)ptr2acc_data(pack);
 
 	if (ntohs(ip_hdr->ih_flags_fragoff) & (IH_FRAGOFF_MASK|IH_MORE_FRAGS))
 	{
@@ -830,23 +828,12 @@ event_t *ev;
 ev_arg_t ev_arg;
 {
 	ip_port_t *ip_port;
-	ipaddr_t dest;
 	acc_t *pack;
 	iroute_t *iroute;
-	ip_port_t *next_port;
-	int r, type;
 	ip_hdr_t *ip_hdr;
-	size_t req_mtu;
-
-        char ifin[]="ethX";
-        char ifout[]="ethX";
-        size_t pack_size;
-        acc_t *temppack;
-        int i,count;
-
-#ifdef _DEBUG
-  printf("ip_read.c :route_packets(): enter\n");
-#endif
+	int r;
+	char ifin[]="ethX";
+	char ifout[]="ethX";
 
 	ip_port= ev_arg.ev_ptr;
 	assert(&ip_port->ip_routeq_event == ev);
@@ -855,229 +842,234 @@ ev_arg_t ev_arg;
 	{
 		ip_port->ip_routeq_head= pack->acc_ext_link;
 
+		/* FORWARD sees the port the packet leaves on. Without a
+		 * route it is not forwarded, route_pack sends the ICMP.
+		 */
 		ip_hdr= (ip_hdr_t *)ptr2acc_data(pack);
-		dest= ip_hdr->ih_dst;
-
-                temppack= (acc_t *)ip_hdr; /*ip_hdr; << brian original*/
-#ifdef _DEBUG
-  printf("ip_read.c :route_packets(): temppack->acclength: %d\n",temppack->acc_length);
-#endif
-                if (temppack)
-                {
-                  ifin[3]='0'+ip_port->ip_port;
-                  ifout[3]='0'+ip_port->ip_port;
-                  pack_size=temppack->acc_length;
-                  inetEthIn(ifin);
-                  inetEthOut(ifout);
-                  inetSetPackSize(pack_size);
-                  inetContainLayers(NF_LAYER_IP);
-                  /* sending all buffer parts to the filter */
-                  for (i=0, temppack=pack, count=pack_size; temppack && count>0;)
-                  {
-                          inetSetDataSize(temppack->acc_buffer->buf_size);
-                          inetData((void*) (((vir_bytes)temppack->acc_buffer->buf_data_p)
-                                  +temppack->acc_offset)
-                                  );
-                          i++; count-=temppack->acc_buffer->buf_size;
-                          temppack=temppack->acc_next;
-                  }
-                  inetHook(NF_IP_FORWARD);
-         
-                  /* do the filtering work */
-#ifdef _DEBUG
-  printf("ip_read.c :route_packets(): calls inetProcess()\n");
-#endif
-                  if (inetProcess()==0) 
-                  {
-                       inetGetData(NULL);
-                       continue;
-                  }
-                  inetGetData(NULL);
-                }
-
-		iroute= iroute_frag(ip_port->ip_port, dest);
+		iroute= iroute_frag(ip_port->ip_port, ip_hdr->ih_dst);
 		if (iroute == NULL || iroute->irt_dist == IRTD_UNREACHABLE)
 		{
-			/* Also unreachable */
-			/* Finding out if we send a network unreachable is too
-			 * much trouble.
-			 */
-			if (iroute == NULL)
-			{
-				printf("ip[%d]: no route to ",
-					ip_port-ip_port_table);
-				writeIpAddr(dest);
-				printf("\n");
-			}
-			icmp_snd_unreachable(ip_port->ip_port, pack,
-				ICMP_HOST_UNRCH);
+			route_pack(ip_port, pack);
+			continue;
+		}
+		ifin[3]='0'+ip_port->ip_port;
+		ifout[3]='0'+iroute->irt_port;
+		r= nf_hook(NF_IP_FORWARD, &pack, ifin, ifout, NF_LAYER_IP,
+			route_reinject, ip_port->ip_port);
+		if (r != NF_ACCEPT)
+		{
+			if (r != NF_STOLEN)
+				bf_afree(pack);
 			continue;
 		}
-		next_port= &ip_port_table[iroute->irt_port];
+		route_pack(ip_port, pack);
+	}
+}
+
+/* a packet queued at FORWARD is back, ref is the port it came in on */
+PRIVATE void route_reinject(ref, pack)
+int ref;
+acc_t *pack;
+{
+	route_pack(&ip_port_table[ref], pack);
+}
+
+PRIVATE void route_pack(ip_port, pack)
+ip_port_t *ip_port;
+acc_t *pack;
+{
+	ipaddr_t dest;
+	iroute_t *iroute;
+	ip_port_t *next_port;
+	int r, type;
+	ip_hdr_t *ip_hdr;
+	size_t req_mtu;
 
-		if (ip_hdr->ih_flags_fragoff & HTONS(IH_DONT_FRAG))
+	ip_hdr= (ip_hdr_t *)ptr2acc_data(pack);
+	dest= ip_hdr->ih_dst;
+
+	iroute= iroute_frag(ip_port->ip_port, dest);
+	if (iroute == NULL || iroute->irt_dist == IRTD_UNREACHABLE)
+	{
+		/* Also unreachable */
+		/* Finding out if we send a network unreachable is too
+		 * much trouble.
+		 */
+		if (iroute == NULL)
 		{
-			req_mtu= bf_bufsize(pack);
-			if (req_mtu > next_port->ip_mtu ||
-				(iroute->irt_mtu && req_mtu>iroute->irt_mtu))
-			{
-				icmp_snd_mtu(ip_port->ip_port, pack,
-					next_port->ip_mtu);
-				continue;
-			}
+			printf("ip[%d]: no route to ",
+				ip_port-ip_port_table);
+			writeIpAddr(dest);
+			printf("\n");
 		}
+		icmp_snd_unreachable(ip_port->ip_port, pack,
+			ICMP_HOST_UNRCH);
+		return;
+	}
+	next_port= &ip_port_table[iroute->irt_port];
 
-		if (next_port != ip_port)
+	if (ip_hdr->ih_flags_fragoff & HTONS(IH_DONT_FRAG))
+	{
+		req_mtu= bf_bufsize(pack);
+		if (req_mtu > next_port->ip_mtu ||
+			(iroute->irt_mtu && req_mtu>iroute->irt_mtu))
 		{
-			if (iroute->irt_gateway != 0)
-			{
-				/* Just send the packet to the next gateway */
-				pack->acc_linkC++; /* Extra ref for ICMP */
-				r= next_port->ip_dev_send(next_port,
-					iroute->irt_gateway,
-					pack, IP_LT_NORMAL);
-				if (r == EHOSTUNREACH)
-				{
-					printf("ip[%d]: gw ",
-						ip_port-ip_port_table);
-					writeIpAddr(iroute->irt_gateway);
-					printf(" on ip[%d] is down for dest ",
-						next_port-ip_port_table);
-					writeIpAddr(dest);
-					printf("\n");
-					icmp_snd_unreachable(next_port-
-						ip_port_table, pack,
-						ICMP_HOST_UNRCH);
-					pack= NULL;
-				}
-				else
-				{
-					assert(r == 0);
-					bf_afree(pack); pack= NULL;
-				}
-				continue;
-			}
-			/* The packet is for the attached network. Special
-			 * addresses are the ip address of the interface and
-			 * net.0 if no IP_42BSD_BCAST.
-			 */
-			if (dest == next_port->ip_ipaddr)
-			{
-				ip_port_arrive (next_port, pack, ip_hdr);
-				continue;
-			}
-			if (dest == iroute->irt_dest)
-			{
-				/* Never forward obsolete directed broadcasts */
-#if IP_42BSD_BCAST && 0
-				type= IP_LT_BROADCAST;
-#else
-				/* Bogus destination address */
-				DBLOCK(1, printf(
-			"ip[%d]: dropping old-fashioned directed broadcast ",
-						ip_port-ip_port_table);
-					writeIpAddr(dest);
-					printf("\n"););
-				icmp_snd_unreachable(next_port-ip_port_table,
-					pack, ICMP_HOST_UNRCH);
-				continue;
-#endif
-			}
-			else if (dest == (iroute->irt_dest |
-				~iroute->irt_subnetmask))
-			{
-				if (!ip_forward_directed_bcast)
-				{
-					/* Do not forward directed broadcasts */
-					DBLOCK(1, printf(
-					"ip[%d]: dropping directed broadcast ",
-							ip_port-ip_port_table);
-						writeIpAddr(dest);
-						printf("\n"););
-					icmp_snd_unreachable(next_port-
-						ip_port_table, pack,
-						ICMP_HOST_UNRCH);
-					continue;
-				}
-				else
-					type= IP_LT_BROADCAST;
-			}
-			else
-				type= IP_LT_NORMAL;
+			icmp_snd_mtu(ip_port->ip_port, pack,
+				next_port->ip_mtu);
+			return;
+		}
+	}
 
-			/* Just send the packet to it's destination */
+	if (next_port != ip_port)
+	{
+		if (iroute->irt_gateway != 0)
+		{
+			/* Just send the packet to the next gateway */
 			pack->acc_linkC++; /* Extra ref for ICMP */
-			r= next_port->ip_dev_send(next_port, dest, pack, type);
+			r= next_port->ip_dev_send(next_port,
+				iroute->irt_gateway,
+				pack, IP_LT_NORMAL);
 			if (r == EHOSTUNREACH)
 			{
-				DBLOCK(1, printf("ip[%d]: next hop ",
+				printf("ip[%d]: gw ",
 					ip_port-ip_port_table);
-					writeIpAddr(dest);
-					printf(" on ip[%d] is down\n",
-					next_port-ip_port_table););
-				icmp_snd_unreachable(next_port-ip_port_table,
-					pack, ICMP_HOST_UNRCH);
+				writeIpAddr(iroute->irt_gateway);
+				printf(" on ip[%d] is down for dest ",
+					next_port-ip_port_table);
+				writeIpAddr(dest);
+				printf("\n");
+				icmp_snd_unreachable(next_port-
+					ip_port_table, pack,
+					ICMP_HOST_UNRCH);
 				pack= NULL;
 			}
 			else
 			{
-				assert(r == 0 || (printf("r = %d\n", r), 0));
+				assert(r == 0);
 				bf_afree(pack); pack= NULL;
 			}
-			continue;
+			return;
 		}
-
-		/* Now we know that the packet should be routed over the same
-		 * network as it came from. If there is a next hop gateway,
-		 * we can send the packet to that gateway and send a redirect
-		 * ICMP to the sender if the sender is on the attached
-		 * network. If there is no gateway complain.
+		/* The packet is for the attached network. Special
+		 * addresses are the ip address of the interface and
+		 * net.0 if no IP_42BSD_BCAST.
 		 */
-		if (iroute->irt_gateway == 0)
+		if (dest == next_port->ip_ipaddr)
 		{
-			printf("ip_arrived: packet should not be here, src=");
-			writeIpAddr(ip_hdr->ih_src);
-			printf(" dst=");
-			writeIpAddr(ip_hdr->ih_dst);
-			printf("\n");
-			bf_afree(pack);
-			continue;
+			ip_port_arrive (next_port, pack, ip_hdr);
+			return;
 		}
-		if (((ip_hdr->ih_src ^ ip_port->ip_ipaddr) &
-			ip_port->ip_subnetmask) == 0)
+		if (dest == iroute->irt_dest)
 		{
-			/* Finding out if we can send a network redirect
-			 * instead of a host redirect is too much trouble.
-			 */
-			pack->acc_linkC++;
-			icmp_snd_redirect(ip_port->ip_port, pack,
-				ICMP_REDIRECT_HOST, iroute->irt_gateway);
+			/* Never forward obsolete directed broadcasts */
+#if IP_42BSD_BCAST && 0
+			type= IP_LT_BROADCAST;
+#else
+			/* Bogus destination address */
+			DBLOCK(1, printf(
+		"ip[%d]: dropping old-fashioned directed broadcast ",
+					ip_port-ip_port_table);
+				writeIpAddr(dest);
+				printf("\n"););
+			icmp_snd_unreachable(next_port-ip_port_table,
+				pack, ICMP_HOST_UNRCH);
+			return;
+#endif
+		}
+		else if (dest == (iroute->irt_dest |
+			~iroute->irt_subnetmask))
+		{
+			if (!ip_forward_directed_bcast)
+			{
+				/* Do not forward directed broadcasts */
+				DBLOCK(1, printf(
+				"ip[%d]: dropping directed broadcast ",
+						ip_port-ip_port_table);
+					writeIpAddr(dest);
+					printf("\n"););
+				icmp_snd_unreachable(next_port-
+					ip_port_table, pack,
+					ICMP_HOST_UNRCH);
+				return;
+			}
+			else
+				type= IP_LT_BROADCAST;
+		}
+		else
+			type= IP_LT_NORMAL;
+
+		/* Just send the packet to it's destination */
+		pack->acc_linkC++; /* Extra ref for ICMP */
+		r= next_port->ip_dev_send(next_port, dest, pack, type);
+		if (r == EHOSTUNREACH)
+		{
+			DBLOCK(1, printf("ip[%d]: next hop ",
+				ip_port-ip_port_table);
+				writeIpAddr(dest);
+				printf(" on ip[%d] is down\n",
+				next_port-ip_port_table););
+			icmp_snd_unreachable(next_port-ip_port_table,
+				pack, ICMP_HOST_UNRCH);
+			pack= NULL;
 		}
 		else
 		{
-			printf("ip_arrived: packet is wrongly routed, src=");
-			writeIpAddr(ip_hdr->ih_src);
-			printf(" dst=");
-			writeIpAddr(ip_hdr->ih_dst);
-			printf("\n");
-			printf("in port %d, output %d, dest net ",
-				ip_port->ip_port, 
-				iroute->irt_port);
-			writeIpAddr(iroute->irt_dest);
-			printf("/");
-			writeIpAddr(iroute->irt_subnetmask);
-			printf(" next hop ");
-			writeIpAddr(iroute->irt_gateway);
-			printf("\n");
-			bf_afree(pack);
-			continue;
+			assert(r == 0 || (printf("r = %d\n", r), 0));
+			bf_afree(pack); pack= NULL;
 		}
-		/* No code for unreachable ICMPs here. The sender should
-		 * process the ICMP redirect and figure it out.
+		return;
+	}
+
+	/* Now we know that the packet should be routed over the same
+	 * network as it came from. If there is a next hop gateway,
+	 * we can send the packet to that gateway and send a redirect
+	 * ICMP to the sender if the sender is on the attached
+	 * network. If there is no gateway complain.
+	 */
+	if (iroute->irt_gateway == 0)
+	{
+		printf("ip_arrived: packet should not be here, src=");
+		writeIpAddr(ip_hdr->ih_src);
+		printf(" dst=");
+		writeIpAddr(ip_hdr->ih_dst);
+		printf("\n");
+		bf_afree(pack);
+		return;
+	}
+	if (((ip_hdr->ih_src ^ ip_port->ip_ipaddr) &
+		ip_port->ip_subnetmask) == 0)
+	{
+		/* Finding out if we can send a network redirect
+		 * instead of a host redirect is too much trouble.
 		 */
-		ip_port->ip_dev_send(ip_port, iroute->irt_gateway, pack,
-			IP_LT_NORMAL);
+		pack->acc_linkC++;
+		icmp_snd_redirect(ip_port->ip_port, pack,
+			ICMP_REDIRECT_HOST, iroute->irt_gateway);
 	}
+	else
+	{
+		printf("ip_arrived: packet is wrongly routed, src=");
+		writeIpAddr(ip_hdr->ih_src);
+		printf(" dst=");
+		writeIpAddr(ip_hdr->ih_dst);
+		printf("\n");
+		printf("in port %d, output %d, dest net ",
+			ip_port->ip_port, 
+			iroute->irt_port);
+		writeIpAddr(iroute->irt_dest);
+		printf("/");
+		writeIpAddr(iroute->irt_subnetmask);
+		printf(" next hop ");
+		writeIpAddr(iroute->irt_gateway);
+		printf("\n");
+		bf_afree(pack);
+		return;
+	}
+	/* No code for unreachable ICMPs here. The sender should
+	 * process the ICMP redirect and figure it out.
+	 */
+	ip_port->ip_dev_send(ip_port, iroute->irt_gateway, pack,
+		IP_LT_NORMAL);
 }
 
 PRIVATE int broadcast_dst(ip_port, dest)
@@ -63,44 +63,24 @@ size_t data_len;
 	ip_hdr_t *ip_hdr, *tmp_hdr;
 	ipaddr_t dstaddr, nexthop, hostrep_dst, my_ipaddr, netmask;
 	u8_t *addrInBytes;
-	acc_t *tmp_pack, *tmp_pack1, *temppack;
+	acc_t *tmp_pack, *tmp_pack1;
 	int hdr_len, hdr_opt_len, r;
 	int type, ttl;
 	size_t req_mtu;
 	ev_arg_t arg;
-	int i,count;
 	char ifout[]="ethX";
 
 	ip_fd= &ip_fd_table[fd];
 	ip_port= ip_fd->if_port;
 
 #if 0
-        inetEthIn("");
-        ifout[3]='0'+ip_port->ip_dl.dl_eth.de_port;
-        inetEthOut(ifout);
-        inetSetPackSize(data_len);
-        for (i=0, temppack=data, count=data_len; temppack && count>0;)
-        {
-                inetSetDataSize(temppack->acc_buffer->buf_size);
-                inetData( (void*)(((vir_bytes)temppack->acc_buffer->buf_data_p)
-                          +temppack->acc_offset)
-                        );
-                i++; count-=temppack->acc_buffer->buf_size;
-                temppack=temppack->acc_next;
-        }
-        inetHook(NF_IP_LOCAL_OUT);
-
-        /* do the filtering work */
-#ifdef _DEBUG
-        printf("inet called by ip_write\n");
-#endif
-        if (inetProcess()==0)
-        {
-                inetGetData(NULL);
-                bf_afree(data);
-                return NW_OK;
-        } 
-        inetGetData(NULL);
+	ifout[3]='0'+ip_port->ip_dl.dl_eth.de_port;
+	if (nf_hook(NF_IP_LOCAL_OUT, &data, NULL, ifout, NF_LAYER_IP,
+		NULL, 0) != NF_ACCEPT)
+	{
+		bf_afree(data);
+		return NW_OK;
+	}
 #endif
 
 	if (!(ip_fd->if_flags & IFF_OPTSET))
@@ -383,6 +363,71 @@ printf("\n");
 	return r;
 }
 
+/*
+ip_send_pack
+
+Sends an IP packet that is complete with its header and checksums and
+keeps its source address; netfilter sends the packets of its SYN proxy
+with it. A packet for one of our own addresses is taken in as if it had
+arrived on that port, others are routed from port_nr like forwarded
+packets, or like our own if there is no forwarding route.
+*/
+
+PUBLIC int ip_send_pack(port_nr, pack)
+int port_nr;
+acc_t *pack;
+{
+	ip_port_t *ip_port, *next_port;
+	ip_hdr_t *ip_hdr;
+	iroute_t *iroute;
+	ipaddr_t dstaddr, nexthop;
+	int i, r;
+
+	pack= bf_packIffLess(pack, IP_MIN_HDR_SIZE);
+	ip_hdr= (ip_hdr_t *)ptr2acc_data(pack);
+	dstaddr= ip_hdr->ih_dst;
+
+	for (i= 0, next_port= ip_port_table; i<ip_conf_nr; i++, next_port++)
+	{
+		if ((next_port->ip_flags & IPF_IPADDRSET) &&
+			dstaddr == next_port->ip_ipaddr)
+		{
+			ip_port_arrive(next_port, pack, ip_hdr);
+			return NW_OK;
+		}
+	}
+
+	ip_port= &ip_port_table[port_nr];
+	iroute= iroute_frag(port_nr, dstaddr);
+	if (iroute != NULL && iroute->irt_dist != IRTD_UNREACHABLE)
+	{
+		next_port= &ip_port_table[iroute->irt_port];
+		nexthop= iroute->irt_gateway ? iroute->irt_gateway : dstaddr;
+	}
+	else
+	{
+		if (!(ip_port->ip_flags & IPF_IPADDRSET))
+		{
+			bf_afree(pack);
+			return ENETDOWN;
+		}
+		next_port= ip_port;
+		nexthop= dstaddr;
+		if ((dstaddr ^ ip_port->ip_ipaddr) & ip_port->ip_subnetmask)
+		{
+			r= oroute_frag(port_nr, dstaddr, ip_hdr->ih_ttl, 0,
+				&nexthop);
+			if (r != NW_OK)
+			{
+				bf_afree(pack);
+				return r;
+			}
+		}
+	}
+	return (*next_port->ip_dev_send)(next_port, nexthop, pack,
+		IP_LT_NORMAL);
+}
+
 PUBLIC void ip_hdr_chksum(ip_hdr, ip_hdr_len)
 ip_hdr_t *ip_hdr;
 int ip_hdr_len;
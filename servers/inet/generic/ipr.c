@@ -17,8 +17,14 @@ Copyright 1995 Philip Homburg
 
 THIS_FILE
 
-#define OROUTE_NR		128
-#define OROUTE_STATIC_NR	16
+/* Routes are allocated OROUTE_CHUNK at a time, up to OROUTE_CHUNK_NR chunks,
+ * so that pointers to them stay valid and ipr_get_oroute can number them.
+ * Static routes are never thrown out to make room, so they may use all but
+ * OROUTE_DYNAMIC_NR of the entries.
+ */
+#define OROUTE_CHUNK		128
+#define OROUTE_CHUNK_NR		256
+#define OROUTE_DYNAMIC_NR	112
 #define OROUTE_HASH_ASS_NR	 4
 #define OROUTE_HASH_NR		32
 #define OROUTE_HASH_MASK	(OROUTE_HASH_NR-1)
@@ -35,12 +41,25 @@ typedef struct oroute_hash
 	oroute_t *orh_route;
 } oroute_hash_t;
 
-PRIVATE oroute_t oroute_table[OROUTE_NR];
-PRIVATE oroute_t *oroute_head;
+PRIVATE oroute_t *oroute_chunk[OROUTE_CHUNK_NR];
+PRIVATE int oroute_nr;
+PRIVATE oroute_t *oroute_free;
 PRIVATE int static_oroute_nr;
 PRIVATE oroute_hash_t oroute_hash_table[OROUTE_HASH_NR][OROUTE_HASH_ASS_NR];
 
-#define IROUTE_NR		512
+#define oroute_ent(i)	(&oroute_chunk[(i) / OROUTE_CHUNK][(i) % OROUTE_CHUNK])
+
+/* The best route of each network (port, destination and netmask) is in a
+ * hash table, chained through ort_nextnw. A lookup tries the prefix lengths
+ * that are in use, longest first.
+ */
+PRIVATE oroute_t **oroute_nw_hash;
+PRIVATE int oroute_nw_hash_nr;
+PRIVATE int oroute_nw_nr;
+PRIVATE int oroute_len_nr[33];
+
+#define IROUTE_CHUNK		128
+#define IROUTE_CHUNK_NR		256
 #define IROUTE_HASH_ASS_NR	 4
 #define IROUTE_HASH_NR		32
 #define IROUTE_HASH_MASK	(IROUTE_HASH_NR-1)
@@ -57,29 +76,64 @@ typedef struct iroute_hash
 	iroute_t *irh_route;
 } iroute_hash_t;
 
-PRIVATE iroute_t iroute_table[IROUTE_NR];
+PRIVATE iroute_t *iroute_chunk[IROUTE_CHUNK_NR];
+PRIVATE int iroute_nr;
+PRIVATE iroute_t *iroute_free;
 PRIVATE iroute_hash_t iroute_hash_table[IROUTE_HASH_NR][IROUTE_HASH_ASS_NR];
 
+#define iroute_ent(i)	(&iroute_chunk[(i) / IROUTE_CHUNK][(i) % IROUTE_CHUNK])
+
+/* All input routes are in a hash table on destination and netmask, chained
+ * through irt_next.
+ */
+PRIVATE iroute_t **iroute_nw_hash;
+PRIVATE int iroute_nw_hash_nr;
+PRIVATE int iroute_nw_nr;
+PRIVATE int iroute_len_nr[33];
+
+#define IPR_HASH_INIT_NR	64
+
+FORWARD int mask_len ARGS(( ipaddr_t mask ));
+FORWARD ipaddr_t len_mask ARGS(( int len ));
+FORWARD unsigned hash_nw ARGS(( int port_nr, ipaddr_t dest, int len ));
+FORWARD int oroute_grow ARGS(( void ));
+FORWARD oroute_t *oroute_alloc ARGS(( time_t currtim ));
+FORWARD void oroute_release ARGS(( oroute_t *oroute ));
+FORWARD oroute_t *oroute_nw_find ARGS(( int port_nr, ipaddr_t dest,
+	ipaddr_t netmask ));
+FORWARD void oroute_nw_link ARGS(( oroute_t *oroute ));
+FORWARD void oroute_nw_unlink ARGS(( oroute_t *oroute ));
+FORWARD void oroute_nw_rehash ARGS(( void ));
+FORWARD oroute_t *oroute_lpm ARGS(( int port_nr, ipaddr_t dest ));
 FORWARD oroute_t *oroute_find_ent ARGS(( int port_nr, ipaddr_t dest ));
 FORWARD void oroute_del ARGS(( oroute_t *oroute ));
 FORWARD oroute_t *sort_dists ARGS(( oroute_t *oroute ));
 FORWARD oroute_t *sort_gws ARGS(( oroute_t *oroute ));
 FORWARD	void oroute_uncache_nw ARGS(( ipaddr_t dest, ipaddr_t netmask ));
 FORWARD	void iroute_uncache_nw ARGS(( ipaddr_t dest, ipaddr_t netmask ));
+FORWARD int iroute_grow ARGS(( void ));
+FORWARD void iroute_link ARGS(( iroute_t *iroute ));
+FORWARD void iroute_unlink ARGS(( iroute_t *iroute ));
+FORWARD void iroute_release ARGS(( iroute_t *iroute ));
+FORWARD void iroute_rehash ARGS(( void ));
 
 PUBLIC void ipr_init()
 {
-	int i;
-	oroute_t *oroute;
-	iroute_t *iroute;
-
-	for (i= 0, oroute= oroute_table; i<OROUTE_NR; i++, oroute++)
-		oroute->ort_flags= ORTF_EMPTY;
+	oroute_nr= 0;
+	oroute_free= NULL;
 	static_oroute_nr= 0;
+	oroute_nw_hash_nr= IPR_HASH_INIT_NR;
+	oroute_nw_hash= calloc(oroute_nw_hash_nr, sizeof(oroute_nw_hash[0]));
+	if (oroute_nw_hash == NULL || !oroute_grow())
+		ip_panic(( "ipr_init: out of memory for output routes" ));
 	assert(OROUTE_HASH_ASS_NR == 4);
 
-	for (i= 0, iroute= iroute_table; i<IROUTE_NR; i++, iroute++)
-		iroute->irt_flags= IRTF_EMPTY;
+	iroute_nr= 0;
+	iroute_free= NULL;
+	iroute_nw_hash_nr= IPR_HASH_INIT_NR;
+	iroute_nw_hash= calloc(iroute_nw_hash_nr, sizeof(iroute_nw_hash[0]));
+	if (iroute_nw_hash == NULL || !iroute_grow())
+		ip_panic(( "ipr_init: out of memory for input routes" ));
 	assert(IROUTE_HASH_ASS_NR == 4);
 }
 
@@ -88,12 +142,12 @@ PUBLIC iroute_t *iroute_frag(port_nr, dest)
 int port_nr;
 ipaddr_t dest;
 {
-	int hash, i;
+	int hash, len;
 	iroute_hash_t *iroute_hash;
 	iroute_hash_t tmp_hash;
 	iroute_t *iroute, *bestroute;
 	unsigned long hash_tmp;
-	u32_t tmp_mask;
+	ipaddr_t mask;
 
 	hash= hash_iroute(port_nr, dest, hash_tmp);
 	iroute_hash= &iroute_hash_table[hash][0];
@@ -128,48 +182,48 @@ ipaddr_t dest;
 	if (iroute)
 		return iroute;
 
+	/* More specific netmasks are better, so the longest prefix length
+	 * that has a match decides.
+	 */
 	bestroute= NULL;
-	for (i= 0, iroute= iroute_table; i < IROUTE_NR; i++, iroute++)
+	for (len= 32; len >= 0 && bestroute == NULL; len--)
 	{
-		if (!(iroute->irt_flags & IRTF_INUSE))
-			continue;
-		if (((dest ^ iroute->irt_dest) & iroute->irt_subnetmask) != 0)
-			continue;
-		if (!bestroute)
-		{
-			bestroute= iroute;
-			continue;
-		}
-
-		/* More specific netmasks are better */
-		if (iroute->irt_subnetmask != bestroute->irt_subnetmask)
-		{
-			/* Using two ntohl macros in one expression
-			 * is not allowed (tmp_l is modified twice)
-			 */
-			tmp_mask= ntohl(iroute->irt_subnetmask);
-			if (tmp_mask > ntohl(bestroute->irt_subnetmask))
-				bestroute= iroute;
+		if (iroute_len_nr[len] == 0)
 			continue;
-		}
-			
-		/* Dynamic routes override static routes */
-		if ((iroute->irt_flags & IRTF_STATIC) != 
-			(bestroute->irt_flags & IRTF_STATIC))
+		mask= len_mask(len);
+		iroute= iroute_nw_hash[hash_nw(0, dest & mask, len) &
+			(iroute_nw_hash_nr-1)];
+		for (; iroute; iroute= iroute->irt_next)
 		{
-			if (bestroute->irt_flags & IRTF_STATIC)
+			if (iroute->irt_subnetmask != mask ||
+				((dest ^ iroute->irt_dest) & mask) != 0)
+			{
+				continue;
+			}
+			if (!bestroute)
+			{
 				bestroute= iroute;
-			continue;
-		}
+				continue;
+			}
 
-		/* A route to the local interface give an opportunity
-		 * to send redirects.
-		 */
-		if (iroute->irt_port != bestroute->irt_port)
-		{
-			if (iroute->irt_port == port_nr)
-				bestroute= iroute;
-			continue;
+			/* Dynamic routes override static routes */
+			if ((iroute->irt_flags & IRTF_STATIC) != 
+				(bestroute->irt_flags & IRTF_STATIC))
+			{
+				if (bestroute->irt_flags & IRTF_STATIC)
+					bestroute= iroute;
+				continue;
+			}
+
+			/* A route to the local interface give an
+			 * opportunity to send redirects.
+			 */
+			if (iroute->irt_port != bestroute->irt_port)
+			{
+				if (iroute->irt_port == port_nr)
+					bestroute= iroute;
+				continue;
+			}
 		}
 	}
 	if (bestroute == NULL)
@@ -220,7 +274,6 @@ int static_route;
 i32_t preference;
 oroute_t **oroute_p;
 {
-	int i;
 	ip_port_t *ip_port;
 	oroute_t *oroute, *oldest_route, *prev, *nw_route, *gw_route, 
 		*prev_route;
@@ -251,25 +304,23 @@ oroute_t **oroute_p;
 		return EINVAL;
 	}
 
+	/* Routes are looked up by prefix length */
+	if (mask_len(subnetmask) < 0)
+		return EINVAL;
+
 	if (static_route)
 	{
-		if (static_oroute_nr >= OROUTE_STATIC_NR)
+		if (static_oroute_nr >= oroute_nr - OROUTE_DYNAMIC_NR &&
+			!oroute_grow())
+		{
 			return ENOMEM;
+		}
 		static_oroute_nr++;
 	}
 	else
 	{
 		/* Try to track down any old routes. */
-		for(oroute= oroute_head; oroute; oroute= oroute->ort_nextnw)
-		{
-			if (oroute->ort_port != port_nr)
-				continue;
-			if (oroute->ort_dest == dest &&
-				oroute->ort_subnetmask == subnetmask)
-			{
-				break;
-			}
-		}
+		oroute= oroute_nw_find(port_nr, dest, subnetmask);
 		for(; oroute; oroute= oroute->ort_nextgw)
 		{
 			if (oroute->ort_gateway == gateway)
@@ -310,42 +361,12 @@ oroute_t **oroute_p;
 
 	if (oldest_route == NULL)
 	{
-		/* Look for an unused entry, or remove an existing one */
-		for (i= 0, oroute= oroute_table; i<OROUTE_NR; i++, oroute++)
-		{
-			if ((oroute->ort_flags & ORTF_INUSE) == 0)
-				break;
-			if (oroute->ort_exp_tim && oroute->ort_exp_tim < 
-				currtim)
-			{
-				oroute_del(oroute);
-				oroute->ort_flags= 0;
-				break;
-			}
-			if (oroute->ort_flags & ORTF_STATIC)
-				continue;
-			if (oroute->ort_dest == 0)
-			{
-				/* Never remove default routes. */
-				continue;
-			}
-			if (oldest_route == NULL)
-			{
-				oldest_route= oroute;
-				continue;
-			}
-			if (oroute->ort_timestamp < oldest_route->ort_timestamp)
-			{
-				oldest_route= oroute;
-			}
-		}
-		if (i < OROUTE_NR)
-			oldest_route= oroute;
-		else
+		oldest_route= oroute_alloc(currtim);
+		if (oldest_route == NULL)
 		{
-			assert(oldest_route);
-			oroute_del(oldest_route);
-			oldest_route->ort_flags= 0;
+			if (static_route)
+				static_oroute_nr--;
+			return ENOMEM;
 		}
 	}
 
@@ -365,21 +386,9 @@ oroute_t **oroute_p;
 	/* Insert the route by tearing apart the routing table, 
 	 * and insert the entry during the reconstruction.
 	 */
-	for (prev= 0, nw_route= oroute_head; nw_route; 
-		prev= nw_route, nw_route= nw_route->ort_nextnw)
-	{
-		if (nw_route->ort_port != port_nr)
-			continue;
-		if (nw_route->ort_dest == dest &&
-			nw_route->ort_subnetmask == subnetmask)
-		{
-			if (prev)
-				prev->ort_nextnw= nw_route->ort_nextnw;
-			else
-				oroute_head= nw_route->ort_nextnw;
-			break;
-		}
-	}
+	nw_route= oroute_nw_find(port_nr, dest, subnetmask);
+	if (nw_route)
+		oroute_nw_unlink(nw_route);
 	prev_route= nw_route;
 	for(prev= NULL, gw_route= nw_route; gw_route; 
 		prev= gw_route, gw_route= gw_route->ort_nextgw)
@@ -399,8 +408,7 @@ oroute_t **oroute_p;
 	gw_route->ort_nextgw= nw_route;
 	nw_route= gw_route;
 	nw_route= sort_gws(nw_route);
-	nw_route->ort_nextnw= oroute_head;
-	oroute_head= nw_route;
+	oroute_nw_link(nw_route);
 	if (nw_route != prev_route)
 		oroute_uncache_nw(nw_route->ort_dest, nw_route->ort_subnetmask);
 	if (oroute_p != NULL)
@@ -415,33 +423,30 @@ ipaddr_t subnetmask;
 ipaddr_t gateway;
 int static_route;
 {
-	int i;
-	oroute_t *oroute;
+	oroute_t *nw_route, *gw_route, *oroute;
 
-	for(i= 0, oroute= oroute_table; i<OROUTE_NR; i++, oroute++)
+	/* All routes to a network hang off the best one */
+	oroute= NULL;
+	nw_route= oroute_nw_find(port_nr, dest, subnetmask);
+	for (gw_route= nw_route; gw_route; gw_route= gw_route->ort_nextgw)
 	{
-		if ((oroute->ort_flags & ORTF_INUSE) == 0)
+		if (gw_route->ort_gateway != gateway)
 			continue;
-		if (oroute->ort_port != port_nr ||
-			oroute->ort_dest != dest ||
-			oroute->ort_subnetmask != subnetmask ||
-			oroute->ort_gateway != gateway)
+		for (oroute= gw_route; oroute; oroute= oroute->ort_nextdist)
 		{
-			continue;
+			if (!!(oroute->ort_flags & ORTF_STATIC) == static_route)
+				break;
 		}
-		if (!!(oroute->ort_flags & ORTF_STATIC) != static_route)
-			continue;
 		break;
 	}
 
-	if (i == OROUTE_NR)
+	if (oroute == NULL)
 		return ESRCH;
 
 	if (static_route)
 		static_oroute_nr--;
 
-	oroute_del(oroute);
-	oroute->ort_flags &= ~ORTF_INUSE;
+	oroute_release(oroute);
 	return NW_OK;
 }
 
@@ -471,8 +476,9 @@ ipaddr_t mask;
 		addr= mask= HTONL(0xffffffff);
 	}
 
-	for(i= 0, oroute= oroute_table; i<OROUTE_NR; i++, oroute++)
+	for(i= 0; i<oroute_nr; i++)
 	{
+		oroute= oroute_ent(i);
 		if ((oroute->ort_flags & ORTF_INUSE) == 0)
 			continue;
 		if (oroute->ort_port != port_nr ||
@@ -489,8 +495,7 @@ ipaddr_t mask;
 
 		if (oroute->ort_flags & ORTF_STATIC)
 			static_oroute_nr--;
-		oroute_del(oroute);
-		oroute->ort_flags &= ~ORTF_INUSE;
+		oroute_release(oroute);
 	}
 }
 
@@ -506,8 +511,9 @@ time_t timeout;
 	int result;
 
 	currtim= get_time();
-	for (i= 0, route_ind= oroute_table; i<OROUTE_NR; i++, route_ind++)
+	for (i= 0; i<oroute_nr; i++)
 	{
+		route_ind= oroute_ent(i);
 		if (!(route_ind->ort_flags & ORTF_INUSE))
 			continue;
 		if (route_ind->ort_gateway != gateway)
@@ -689,19 +695,18 @@ nwio_route_t *route_ent;
 {
 	oroute_t *oroute;
 
-	if (ent_no<0 || ent_no>= OROUTE_NR)
+	if (ent_no<0 || ent_no>= oroute_nr)
 		return ENOENT;
 
-	oroute= &oroute_table[ent_no];
+	oroute= oroute_ent(ent_no);
 	if ((oroute->ort_flags & ORTF_INUSE) && oroute->ort_exp_tim &&
 					oroute->ort_exp_tim < get_time())
 	{
-		oroute_del(oroute);
-		oroute->ort_flags &= ~ORTF_INUSE;
+		oroute_release(oroute);
 	}
 
 	route_ent->nwr_ent_no= ent_no;
-	route_ent->nwr_ent_count= OROUTE_NR;
+	route_ent->nwr_ent_count= oroute_nr;
 	route_ent->nwr_dest= oroute->ort_dest;
 	route_ent->nwr_netmask= oroute->ort_subnetmask;
 	route_ent->nwr_gateway= oroute->ort_gateway;
@@ -730,7 +735,6 @@ ipaddr_t dest;
 	oroute_t *oroute, *bestroute;
 	time_t currtim;
 	unsigned long hash_tmp;
-	u32_t tmp_mask;
 
 	currtim= get_time();
 
@@ -768,37 +772,12 @@ ipaddr_t dest;
 	{
 		assert(oroute->ort_port == port_nr);
 		if (oroute->ort_exp_tim && oroute->ort_exp_tim<currtim)
-		{
-			oroute_del(oroute);
-			oroute->ort_flags &= ~ORTF_INUSE;
-		}
+			oroute_release(oroute);
 		else
 			return oroute;
 	}
 
-	bestroute= NULL;
-	for (oroute= oroute_head; oroute; oroute= oroute->ort_nextnw)
-	{
-		if (((dest ^ oroute->ort_dest) & oroute->ort_subnetmask) != 0)
-			continue;
-		if (oroute->ort_port != port_nr)
-			continue;
-		if (!bestroute)
-		{
-			bestroute= oroute;
-			continue;
-		}
-		assert(oroute->ort_dest != bestroute->ort_dest);
-		/* Using two ntohl macros in one expression
-		 * is not allowed (tmp_l is modified twice)
-		 */
-		tmp_mask= ntohl(oroute->ort_subnetmask);
-		if (tmp_mask > ntohl(bestroute->ort_subnetmask))
-		{
-			bestroute= oroute;
-			continue;
-		}
-	}
+	bestroute= oroute_lpm(port_nr, dest);
 	if (bestroute == NULL)
 		return NULL;
 
@@ -830,21 +809,10 @@ oroute_t *oroute;
 			(long)oroute->ort_pref, (long)oroute->ort_mtu);
 		printf("flags 0x%x\n", oroute->ort_flags));
 
-	for (prev= NULL, nw_route= oroute_head; nw_route; 
-				prev= nw_route, nw_route= nw_route->ort_nextnw)
-	{
-		if (oroute->ort_port == nw_route->ort_port &&
-			oroute->ort_dest == nw_route->ort_dest &&
-			oroute->ort_subnetmask == nw_route->ort_subnetmask)
-		{
-			break;
-		}
-	}
+	nw_route= oroute_nw_find(oroute->ort_port, oroute->ort_dest,
+		oroute->ort_subnetmask);
 	assert(nw_route);
-	if (prev)
-		prev->ort_nextnw= nw_route->ort_nextnw;
-	else
-		oroute_head= nw_route->ort_nextnw;
+	oroute_nw_unlink(nw_route);
 	prev_route= nw_route;
 	for (prev= NULL, gw_route= nw_route; gw_route; 
 				prev= gw_route, gw_route= gw_route->ort_nextgw)
@@ -876,10 +844,7 @@ oroute_t *oroute;
 	}
 	nw_route= sort_gws(nw_route);
 	if (nw_route != NULL)
-	{
-		nw_route->ort_nextnw= oroute_head;
-		oroute_head= nw_route;
-	}
+		oroute_nw_link(nw_route);
 	if (nw_route != prev_route)
 	{
 		oroute_uncache_nw(prev_route->ort_dest, 
@@ -998,6 +963,214 @@ ipaddr_t netmask;
 }
 
 
+PRIVATE int oroute_grow()
+{
+	oroute_t *chunk;
+	int i;
+
+	if (oroute_nr >= OROUTE_CHUNK * OROUTE_CHUNK_NR)
+		return FALSE;
+	chunk= calloc(OROUTE_CHUNK, sizeof(chunk[0]));
+	if (chunk == NULL)
+		return FALSE;
+	oroute_chunk[oroute_nr / OROUTE_CHUNK]= chunk;
+	oroute_nr += OROUTE_CHUNK;
+
+	for (i= OROUTE_CHUNK-1; i >= 0; i--)
+	{
+		chunk[i].ort_flags= ORTF_EMPTY;
+		chunk[i].ort_nextnw= oroute_free;
+		oroute_free= &chunk[i];
+	}
+	return TRUE;
+}
+
+
+PRIVATE oroute_t *oroute_alloc(currtim)
+time_t currtim;
+{
+	int i;
+	oroute_t *oroute, *oldest_route;
+
+	if (oroute_free == NULL)
+		(void) oroute_grow();
+	if (oroute_free != NULL)
+	{
+		oroute= oroute_free;
+		oroute_free= oroute->ort_nextnw;
+		return oroute;
+	}
+
+	/* The table is as large as it gets, remove an expired route or
+	 * the oldest one.
+	 */
+	oldest_route= NULL;
+	for (i= 0; i<oroute_nr; i++)
+	{
+		oroute= oroute_ent(i);
+		assert(oroute->ort_flags & ORTF_INUSE);
+		if (oroute->ort_exp_tim && oroute->ort_exp_tim < currtim)
+		{
+			oldest_route= oroute;
+			break;
+		}
+		if (oroute->ort_flags & ORTF_STATIC)
+			continue;
+		if (oroute->ort_dest == 0)
+		{
+			/* Never remove default routes. */
+			continue;
+		}
+		if (oldest_route == NULL ||
+			oroute->ort_timestamp < oldest_route->ort_timestamp)
+		{
+			oldest_route= oroute;
+		}
+	}
+	if (oldest_route == NULL)
+		return NULL;
+	oroute_del(oldest_route);
+	oldest_route->ort_flags= ORTF_EMPTY;
+	return oldest_route;
+}
+
+
+PRIVATE void oroute_release(oroute)
+oroute_t *oroute;
+{
+	oroute_del(oroute);
+	oroute->ort_flags= ORTF_EMPTY;
+	oroute->ort_nextnw= oroute_free;
+	oroute_free= oroute;
+}
+
+
+PRIVATE oroute_t *oroute_nw_find(port_nr, dest, netmask)
+int port_nr;
+ipaddr_t dest;
+ipaddr_t netmask;
+{
+	int len;
+	oroute_t *nw_route;
+
+	len= mask_len(netmask);
+	if (len < 0)
+		return NULL;
+	nw_route= oroute_nw_hash[hash_nw(port_nr, dest & netmask, len) &
+		(oroute_nw_hash_nr-1)];
+	for (; nw_route; nw_route= nw_route->ort_nextnw)
+	{
+		if (nw_route->ort_port == port_nr &&
+			nw_route->ort_dest == dest &&
+			nw_route->ort_subnetmask == netmask)
+		{
+			break;
+		}
+	}
+	return nw_route;
+}
+
+
+PRIVATE void oroute_nw_link(oroute)
+oroute_t *oroute;
+{
+	int len;
+	oroute_t **bucket;
+
+	if (oroute_nw_nr >= oroute_nw_hash_nr)
+		oroute_nw_rehash();
+
+	len= mask_len(oroute->ort_subnetmask);
+	assert(len >= 0);
+	bucket= &oroute_nw_hash[hash_nw(oroute->ort_port,
+		oroute->ort_dest & oroute->ort_subnetmask, len) &
+		(oroute_nw_hash_nr-1)];
+	oroute->ort_nextnw= *bucket;
+	*bucket= oroute;
+	oroute_nw_nr++;
+	oroute_len_nr[len]++;
+}
+
+
+PRIVATE void oroute_nw_unlink(oroute)
+oroute_t *oroute;
+{
+	int len;
+	oroute_t **bucket;
+
+	len= mask_len(oroute->ort_subnetmask);
+	assert(len >= 0);
+	bucket= &oroute_nw_hash[hash_nw(oroute->ort_port,
+		oroute->ort_dest & oroute->ort_subnetmask, len) &
+		(oroute_nw_hash_nr-1)];
+	while (*bucket != oroute)
+	{
+		assert(*bucket);
+		bucket= &(*bucket)->ort_nextnw;
+	}
+	*bucket= oroute->ort_nextnw;
+	oroute_nw_nr--;
+	oroute_len_nr[len]--;
+}
+
+
+PRIVATE void oroute_nw_rehash()
+{
+	int i, new_nr;
+	oroute_t **new_hash, **bucket, *oroute, *next;
+
+	new_nr= oroute_nw_hash_nr * 2;
+	new_hash= calloc(new_nr, sizeof(new_hash[0]));
+	if (new_hash == NULL)
+		return;		/* Just make do with longer chains */
+
+	for (i= 0; i<oroute_nw_hash_nr; i++)
+	{
+		for (oroute= oroute_nw_hash[i]; oroute; oroute= next)
+		{
+			next= oroute->ort_nextnw;
+			bucket= &new_hash[hash_nw(oroute->ort_port,
+				oroute->ort_dest & oroute->ort_subnetmask,
+				mask_len(oroute->ort_subnetmask)) & (new_nr-1)];
+			oroute->ort_nextnw= *bucket;
+			*bucket= oroute;
+		}
+	}
+	free(oroute_nw_hash);
+	oroute_nw_hash= new_hash;
+	oroute_nw_hash_nr= new_nr;
+}
+
+
+PRIVATE oroute_t *oroute_lpm(port_nr, dest)
+int port_nr;
+ipaddr_t dest;
+{
+	int len;
+	ipaddr_t mask;
+	oroute_t *oroute;
+
+	for (len= 32; len >= 0; len--)
+	{
+		if (oroute_len_nr[len] == 0)
+			continue;
+		mask= len_mask(len);
+		oroute= oroute_nw_hash[hash_nw(port_nr, dest & mask, len) &
+			(oroute_nw_hash_nr-1)];
+		for (; oroute; oroute= oroute->ort_nextnw)
+		{
+			if (oroute->ort_port == port_nr &&
+				oroute->ort_subnetmask == mask &&
+				((dest ^ oroute->ort_dest) & mask) == 0)
+			{
+				return oroute;
+			}
+		}
+	}
+	return NULL;
+}
+
+
 /*
  * Input routing
  */
@@ -1008,13 +1181,13 @@ nwio_route_t *route_ent;
 {
 	iroute_t *iroute;
 
-	if (ent_no<0 || ent_no>= IROUTE_NR)
+	if (ent_no<0 || ent_no>= iroute_nr)
 		return ENOENT;
 
-	iroute= &iroute_table[ent_no];
+	iroute= iroute_ent(ent_no);
 
 	route_ent->nwr_ent_no= ent_no;
-	route_ent->nwr_ent_count= IROUTE_NR;
+	route_ent->nwr_ent_count= iroute_nr;
 	route_ent->nwr_dest= iroute->irt_dest;
 	route_ent->nwr_netmask= iroute->irt_subnetmask;
 	route_ent->nwr_gateway= iroute->irt_gateway;
@@ -1046,7 +1219,7 @@ int mtu;
 int static_route;
 iroute_t **iroute_p;
 {
-	int i;
+	int len;
 	iroute_t *iroute, *unused_route;
 	ip_port_t *ip_port;
 
@@ -1062,32 +1235,21 @@ iroute_t **iroute_p;
 		return EINVAL;
 	}
 
+	/* Routes are looked up by prefix length */
+	len= mask_len(subnetmask);
+	if (len < 0)
+		return EINVAL;
+
+	/* Static routes are not reused automatically, so we only look
+	 * for an old route to replace if this one is dynamic.
+	 */
 	unused_route= NULL;
-	if (static_route)
+	if (!static_route)
 	{
-		/* Static routes are not reused automatically, so we look 
-		 * for an unused entry.
-		 */
-		for(i= 0, iroute= iroute_table; i<IROUTE_NR; i++, iroute++)
+		iroute= iroute_nw_hash[hash_nw(0, dest & subnetmask, len) &
+			(iroute_nw_hash_nr-1)];
+		for (; iroute; iroute= iroute->irt_next)
 		{
-			if ((iroute->irt_flags & IRTF_INUSE) == 0)
-				break;
-		}
-		if (i != IROUTE_NR)
-			unused_route= iroute;
-	}
-	else
-	{
-		/* Try to track down any old routes, and look for an
-		 * unused one.
-		 */
-		for(i= 0, iroute= iroute_table; i<IROUTE_NR; i++, iroute++)
-		{
-			if ((iroute->irt_flags & IRTF_INUSE) == 0)
-			{
-				unused_route= iroute;
-				continue;
-			}
 			if ((iroute->irt_flags & IRTF_STATIC) != 0)
 				continue;
 			if (iroute->irt_port != port_nr ||
@@ -1099,12 +1261,21 @@ iroute_t **iroute_p;
 			}
 			break;
 		}
-		if (i != IROUTE_NR)
+		if (iroute != NULL)
+		{
+			iroute_unlink(iroute);
 			unused_route= iroute;
+		}
 	}
-
 	if (unused_route == NULL)
-		return ENOMEM;
+	{
+		if (iroute_free == NULL)
+			(void) iroute_grow();
+		if (iroute_free == NULL)
+			return ENOMEM;
+		unused_route= iroute_free;
+		iroute_free= unused_route->irt_next;
+	}
 	iroute= unused_route;
 
 	iroute->irt_port= port_nr;
@@ -1116,6 +1287,7 @@ iroute_t **iroute_p;
 	iroute->irt_flags= IRTF_INUSE;
 	if (static_route)
 		iroute->irt_flags |= IRTF_STATIC;
+	iroute_link(iroute);
 	
 	iroute_uncache_nw(iroute->irt_dest, iroute->irt_subnetmask);
 	if (iroute_p != NULL)
@@ -1131,16 +1303,17 @@ ipaddr_t subnetmask;
 ipaddr_t gateway;
 int static_route;
 {
-	int i;
+	int len;
 	iroute_t *iroute;
 
-	/* Try to track down any old routes, and look for an
-	 * unused one.
-	 */
-	for(i= 0, iroute= iroute_table; i<IROUTE_NR; i++, iroute++)
+	len= mask_len(subnetmask);
+	if (len < 0)
+		return ESRCH;
+
+	iroute= iroute_nw_hash[hash_nw(0, dest & subnetmask, len) &
+		(iroute_nw_hash_nr-1)];
+	for (; iroute; iroute= iroute->irt_next)
 	{
-		if ((iroute->irt_flags & IRTF_INUSE) == 0)
-			continue;
 		if (iroute->irt_port != port_nr ||
 			iroute->irt_dest != dest ||
 			iroute->irt_subnetmask != subnetmask ||
@@ -1153,11 +1326,11 @@ int static_route;
 		break;
 	}
 
-	if (i == IROUTE_NR)
+	if (iroute == NULL)
 		return ESRCH;
 
 	iroute_uncache_nw(iroute->irt_dest, iroute->irt_subnetmask);
-	iroute->irt_flags= IRTF_EMPTY;
+	iroute_release(iroute);
 	return NW_OK;
 }
 
@@ -1186,8 +1359,9 @@ ipaddr_t mask;
 		addr= mask= HTONL(0xffffffff);
 	}
 
-	for(i= 0, iroute= iroute_table; i<IROUTE_NR; i++, iroute++)
+	for(i= 0; i<iroute_nr; i++)
 	{
+		iroute= iroute_ent(i);
 		if ((iroute->irt_flags & IRTF_INUSE) == 0)
 			continue;
 		if (iroute->irt_port != port_nr)
@@ -1213,7 +1387,7 @@ ipaddr_t mask;
 		    printf("\n"));
 
 		iroute_uncache_nw(iroute->irt_dest, iroute->irt_subnetmask);
-		iroute->irt_flags &= ~IRTF_INUSE;
+		iroute_release(iroute);
 	}
 }
 
@@ -1241,6 +1415,151 @@ ipaddr_t netmask;
 }
 
 
+PRIVATE int iroute_grow()
+{
+	iroute_t *chunk;
+	int i;
+
+	if (iroute_nr >= IROUTE_CHUNK * IROUTE_CHUNK_NR)
+		return FALSE;
+	chunk= calloc(IROUTE_CHUNK, sizeof(chunk[0]));
+	if (chunk == NULL)
+		return FALSE;
+	iroute_chunk[iroute_nr / IROUTE_CHUNK]= chunk;
+	iroute_nr += IROUTE_CHUNK;
+
+	for (i= IROUTE_CHUNK-1; i >= 0; i--)
+	{
+		chunk[i].irt_flags= IRTF_EMPTY;
+		chunk[i].irt_next= iroute_free;
+		iroute_free= &chunk[i];
+	}
+	return TRUE;
+}
+
+
+PRIVATE void iroute_link(iroute)
+iroute_t *iroute;
+{
+	int len;
+	iroute_t **bucket;
+
+	if (iroute_nw_nr >= iroute_nw_hash_nr)
+		iroute_rehash();
+
+	len= mask_len(iroute->irt_subnetmask);
+	assert(len >= 0);
+	bucket= &iroute_nw_hash[hash_nw(0,
+		iroute->irt_dest & iroute->irt_subnetmask, len) &
+		(iroute_nw_hash_nr-1)];
+	iroute->irt_next= *bucket;
+	*bucket= iroute;
+	iroute_nw_nr++;
+	iroute_len_nr[len]++;
+}
+
+
+PRIVATE void iroute_unlink(iroute)
+iroute_t *iroute;
+{
+	int len;
+	iroute_t **bucket;
+
+	len= mask_len(iroute->irt_subnetmask);
+	assert(len >= 0);
+	bucket= &iroute_nw_hash[hash_nw(0,
+		iroute->irt_dest & iroute->irt_subnetmask, len) &
+		(iroute_nw_hash_nr-1)];
+	while (*bucket != iroute)
+	{
+		assert(*bucket);
+		bucket= &(*bucket)->irt_next;
+	}
+	*bucket= iroute->irt_next;
+	iroute_nw_nr--;
+	iroute_len_nr[len]--;
+}
+
+
+PRIVATE void iroute_release(iroute)
+iroute_t *iroute;
+{
+	iroute_unlink(iroute);
+	iroute->irt_flags= IRTF_EMPTY;
+	iroute->irt_next= iroute_free;
+	iroute_free= iroute;
+}
+
+
+PRIVATE void iroute_rehash()
+{
+	int i, new_nr;
+	iroute_t **new_hash, **bucket, *iroute, *next;
+
+	new_nr= iroute_nw_hash_nr * 2;
+	new_hash= calloc(new_nr, sizeof(new_hash[0]));
+	if (new_hash == NULL)
+		return;		/* Just make do with longer chains */
+
+	for (i= 0; i<iroute_nw_hash_nr; i++)
+	{
+		for (iroute= iroute_nw_hash[i]; iroute; iroute= next)
+		{
+			next= iroute->irt_next;
+			bucket= &new_hash[hash_nw(0,
+				iroute->irt_dest & iroute->irt_subnetmask,
+				mask_len(iroute->irt_subnetmask)) & (new_nr-1)];
+			iroute->irt_next= *bucket;
+			*bucket= iroute;
+		}
+	}
+	free(iroute_nw_hash);
+	iroute_nw_hash= new_hash;
+	iroute_nw_hash_nr= new_nr;
+}
+
+
+/*
+ * Prefix helpers
+ */
+
+PRIVATE int mask_len(mask)
+ipaddr_t mask;
+{
+	u32_t m;
+	int len;
+
+	m= ntohl(mask);
+	for (len= 0; len < 32 && (m & 0x80000000); len++)
+		m <<= 1;
+	if (len < 32 && m != 0)
+		return -1;	/* Not contiguous */
+	return len;
+}
+
+
+PRIVATE ipaddr_t len_mask(len)
+int len;
+{
+	if (len == 0)
+		return 0;
+	return htonl((u32_t)0xffffffff << (32-len));
+}
+
+
+PRIVATE unsigned hash_nw(port_nr, dest, len)
+int port_nr;
+ipaddr_t dest;
+int len;
+{
+	u32_t h;
+
+	h= (u32_t)dest ^ ((u32_t)port_nr << 24) ^ (u32_t)len;
+	h *= 0x9E3779B1;
+	return h ^ (h >> 16);
+}
+
+
 
 /*
  * $PchId: ipr.c,v 1.23 2003/01/22 11:49:58 philip Exp $
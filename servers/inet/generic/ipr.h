@@ -20,7 +20,9 @@ typedef struct oroute
 	time_t ort_timestamp;
 	int ort_flags;
 
-	struct oroute *ort_nextnw;
+	struct oroute *ort_nextnw;	/* next network in the hash chain, or
+					 * next unused entry
+					 */
 	struct oroute *ort_nextgw;
 	struct oroute *ort_nextdist;
 } oroute_t;
@@ -40,6 +42,10 @@ typedef struct iroute
 	u32_t irt_mtu;
 	int irt_port;
 	int irt_flags;
+
+	struct iroute *irt_next;	/* next route in the hash chain, or
+					 * next unused entry
+					 */
 } iroute_t;
 
 #define IRTD_UNREACHABLE	512
@@ -1,9 +1,14 @@
 #include "inet.h"
 #include "buf.h"
+#include "clock.h"
 #include "type.h"
 #include <stdio.h>
 #include "assert.h"
 #include "sr.h"
+#include "event.h"
+#include "ip.h"
+#include "ip_int.h"
+#include "rand256.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
@@ -11,13 +16,52 @@
 #include <unistd.h>
 #include "nf.h"
 #include <nfcore.h>
+#include <nfconntrack.h>
+#include <nfset.h>
+#include <nflog.h>
+#include <nfnat.h>
+#include <nfrate.h>
+#include <nfsynproxy.h>
 #include <nf_ioctl_cmd.h>
 
 THIS_FILE 
 
-PUBLIC nf_fd_t nf_fd_table[1];
-int nf_opened;
-int ioctl_pend;
+PUBLIC nf_fd_t nf_fd_table[NF_FD_NR];
+PRIVATE timer_t nf_ct_timer;
+PRIVATE struct nf_batchctx nf_ctx;	/* inet evaluates one burst at a time */
+
+PRIVATE nf_fd_t nf_log_fd;		/* the reader of /dev/nflog */
+PRIVATE int nf_log_opened;
+PRIVATE size_t nf_log_count;		/* size of the waiting read, or 0 */
+PRIVATE int nf_log_sel;			/* select for reading pending */
+PRIVATE int nf_log_timed;		/* nf_log_timer is running */
+PRIVATE timer_t nf_log_timer;
+
+PRIVATE nf_queue_t nf_queue_table[NF_QUEUE_MAX];
+PRIVATE nf_qent_t nf_qent_table[NF_QUEUE_LEN];
+PRIVATE nf_qent_t *nf_qent_free;
+
+PRIVATE event_t nf_sp_event;		/* sends what the SYN proxy built */
+PRIVATE acc_t *nf_sp_pass;		/* let through the next hook once */
+
+FORWARD void nf_ct_timeout ARGS(( int ref, timer_t *timer ));
+FORWARD void nf_log_notify ARGS(( void ));
+FORWARD void nf_log_flush ARGS(( int ref, timer_t *timer ));
+FORWARD void nf_log_deliver ARGS(( void ));
+FORWARD void nf_stream ARGS(( nf_fd_t *nf_fd, size_t count,
+	int (*func) ARGS(( const void *data, size_t len )) ));
+FORWARD void nf_counters_read ARGS(( nf_fd_t *nf_fd, size_t count ));
+FORWARD void nf_stream_reset ARGS(( nf_fd_t *nf_fd ));
+FORWARD int nf_queue ARGS(( unsigned int hook, acc_t *pack, int verdict,
+	char *ifin, char *ifout, int layerid, nf_okfn_t okfn, int ref ));
+FORWARD void nf_queue_kick ARGS(( void ));
+FORWARD void nf_queue_bind ARGS(( nf_fd_t *nf_fd, size_t count ));
+FORWARD void nf_queue_unbind ARGS(( nf_fd_t *nf_fd ));
+FORWARD void nf_queue_deliver ARGS(( nf_fd_t *nf_fd ));
+FORWARD void nf_queue_verdicts ARGS(( nf_fd_t *nf_fd, size_t count ));
+FORWARD void nf_queue_finish ARGS(( nf_qent_t *list, int verdict ));
+FORWARD void nf_sp_notify ARGS(( void ));
+FORWARD void nf_sp_send ARGS(( event_t *ev, ev_arg_t ev_arg ));
 
 PUBLIC void nf_prep( void )
 {
@@ -33,62 +77,346 @@ put_pkt_t put_pkt;
 select_res_t select_res;
 {
 	nf_fd_t *nf_fd;
+	int i;
+
+	for (i= 0; i<NF_FD_NR && (nf_fd_table[i].nf_flags & NFF_INUSE); i++)
+		;
+	if (i >= NF_FD_NR)
+		return EAGAIN;
 
-	nf_fd= &nf_fd_table[0];
+	nf_fd= &nf_fd_table[i];
 
+	nf_fd->nf_flags= NFF_INUSE;
 	nf_fd->nf_srfd= srfd;
 	nf_fd->nf_get_userdata= get_userdata_func;
 	nf_fd->nf_put_userdata= put_userdata_func;
 	nf_fd->nf_select_res= select_res;
-	nf_opened=TRUE;
+	nf_fd->nf_ioctl= 0;
+	nf_fd->nf_queue= -1;
+	nf_fd->nf_read_count= 0;
 
-	return 0;
+	return i;
 }
 
 PRIVATE void nf_close( fd )
 int fd;
 {
-	nf_opened=FALSE;
+	nf_fd_t *nf_fd;
+
+	nf_fd= &nf_fd_table[fd];
+	nf_stream_reset(nf_fd);
+	if (nf_fd->nf_queue >= 0)
+		nf_queue_unbind(nf_fd);
+	nf_fd->nf_flags= NFF_EMPTY;
 }
 
 PUBLIC int nf_init( void )
 {
+	u8_t bits[RAND256_BUFSIZE];
+	int i;
+
 	nfCoreInit();
+	nf_frag_init();
 	sr_add_minor(if2minor(0, NF_DEV_OFF),
 		0, nf_open, nf_close, nf_read,
 		nf_write, nf_ioctl, nf_cancel, nf_select);
-	nf_opened=FALSE;
+	for (i= 0; i<NF_FD_NR; i++)
+		nf_fd_table[i].nf_flags= NFF_EMPTY;
+	for (i= 0; i<NF_QUEUE_MAX; i++)
+	{
+		nf_queue_table[i].nq_head= NULL;
+		nf_queue_table[i].nq_tail= NULL;
+		nf_queue_table[i].nq_unread= NULL;
+		nf_queue_table[i].nq_fd= -1;
+	}
+	nf_qent_free= NULL;
+	for (i= NF_QUEUE_LEN-1; i>=0; i--)
+	{
+		nf_qent_table[i].qe_next= nf_qent_free;
+		nf_qent_free= &nf_qent_table[i];
+	}
+	nfLogInit(nf_log_notify);
+	sr_add_minor(if2minor(0, NF_LOG_DEV_OFF),
+		0, nf_log_open, nf_log_close, nf_log_read,
+		nf_log_write, nf_log_ioctl, nf_log_cancel, nf_log_select);
+	nf_log_opened=FALSE;
+	rand256(bits);
+	nfSynproxyInit(nf_sp_notify, bits, sizeof(bits));
+	ev_init(&nf_sp_event);
+	nf_sp_pass= NULL;
+	clck_timer(&nf_ct_timer, get_time() + NF_CT_GC_TIME*HZ,
+		nf_ct_timeout, 0);
+}
+
+/*
+nf_ct_timeout
+
+Periodically returns timed out flows of the connection tracking and NAT
+bindings to their free lists, and frees fragments that waited too long
+for the rest of their datagram and proxied connections that are gone.
+Lookups ignore timed out entries on their own, this only keeps the hash
+chains short.
+*/
+
+PRIVATE void nf_ct_timeout(ref, timer)
+int ref;
+timer_t *timer;
+{
+	nfConntrackSetTime(get_time() / HZ);
+	nfConntrackExpire();
+	nfNatSetTime(get_time() / HZ);
+	nfNatExpire();
+	nfSynproxySetTime(get_time() / HZ);
+	nfSynproxyExpire();
+	nf_frag_expire();
+	clck_timer(&nf_ct_timer, get_time() + NF_CT_GC_TIME*HZ,
+		nf_ct_timeout, 0);
+}
+
+/*
+nf_pullup
+
+Makes the link level header (if any) and up to NF_HDR_PULLUP bytes of the
+IP packet contiguous, so the filter can read them in place. bf_packIffLess
+only repacks if the accessor is too short, and a separate ethernet header
+accessor (as built by ipeth_send) is kept as it is. The pulled up bytes
+are copied if the buffer is shared, since NAT rewrites them in place.
+*pack is updated if it had to be repacked. Returns the IP header or NULL for a runt; the
+number of contiguous bytes there is stored in *hdr_lenp.
+*/
+
+PUBLIC ip_hdr_t *nf_pullup(pack, layerid, hdr_lenp)
+acc_t **pack;
+int layerid;
+size_t *hdr_lenp;
+{
+	acc_t **ip_pack, *tmp_pack;
+	size_t hdr_off, hdr_len, pack_len;
+
+	ip_pack= pack;
+	hdr_off= 0;
+	if (layerid == NF_LAYER_ETH)
+	{
+		*pack= bf_packIffLess(*pack, ETH_HDR_SIZE);
+		if ((*pack)->acc_length == ETH_HDR_SIZE &&
+			(*pack)->acc_next && (*pack)->acc_linkC == 1)
+		{
+			ip_pack= &(*pack)->acc_next;
+		}
+		else
+			hdr_off= ETH_HDR_SIZE;
+	}
+
+	pack_len= hdr_len= bf_bufsize(*ip_pack);
+	if (hdr_len < hdr_off + IP_MIN_HDR_SIZE)
+		return NULL;
+	if (hdr_len > hdr_off + NF_HDR_PULLUP)
+		hdr_len= hdr_off + NF_HDR_PULLUP;
+
+	*ip_pack= bf_packIffLess(*ip_pack, hdr_len);
+	if ((*ip_pack)->acc_linkC != 1 ||
+		(*ip_pack)->acc_buffer->buf_linkC != 1)
+	{
+		/* Get a private copy of the headers */
+		tmp_pack= bf_memreq(hdr_len);
+		memcpy(ptr2acc_data(tmp_pack), ptr2acc_data(*ip_pack),
+			hdr_len);
+		if (pack_len > hdr_len)
+			tmp_pack->acc_next= bf_delhead(*ip_pack, hdr_len);
+		else
+			bf_afree(*ip_pack);
+		*ip_pack= tmp_pack;
+	}
+	if (hdr_lenp)
+		*hdr_lenp= (*ip_pack)->acc_length - hdr_off;
+	return (ip_hdr_t *)(ptr2acc_data(*ip_pack) + hdr_off);
+}
+
+/*
+nf_hook
+
+Runs a packet through the netfilter hook without copying it out of its
+accessor chain; the headers are pulled up with nf_pullup, *pack is
+updated if that repacks it. The packet is never freed here. A packet
+the NFQUEUE target parks returns NF_STOLEN, it then belongs to the queue
+until its reader accepts it and okfn(ref, pack) takes it back. Callers
+that can not take a packet back pass a NULL okfn; a queue verdict then
+counts as if nobody read the queue. The packets of the SYN proxy pass
+the first hook they get to unfiltered, see nf_sp_send.
+*/
+
+PUBLIC int nf_hook(hook, pack, ifin, ifout, layerid, okfn, ref)
+unsigned int hook;
+acc_t **pack;
+char *ifin;
+char *ifout;
+int layerid;
+nf_okfn_t okfn;
+int ref;
+{
+	int verdict;
+
+	if (nf_sp_pass != NULL && *pack == nf_sp_pass)
+	{
+		nf_sp_pass= NULL;
+		return NF_ACCEPT;
+	}
+	nf_hook_batch(hook, pack, 1, ifin, ifout, layerid, &verdict,
+		okfn, &ref);
+	return verdict;
+}
+
+/*
+nf_hook_batch
+
+nf_hook for a burst of packets arriving at the same hook. The verdict of
+packs[i] is stored in verdicts[i]; runts are dropped. packs[i] is taken
+back with refs[i] if it is queued. At PREROUTING fragments are held by
+nf_defrag (NF_STOLEN) until the fragment that completes their datagram
+comes in; packs[i] of that one is replaced by the whole datagram, which
+is what the chains see. Returns the number of accepted packets.
+*/
+
+PUBLIC int nf_hook_batch(hook, packs, count, ifin, ifout, layerid, verdicts,
+	okfn, refs)
+unsigned int hook;
+acc_t **packs;
+int count;
+char *ifin;
+char *ifout;
+int layerid;
+int *verdicts;
+nf_okfn_t okfn;
+int *refs;
+{
+	struct nf_packet pkts[NF_BATCH_MAX];
+	int index[NF_BATCH_MAX];
+	int vec[NF_BATCH_MAX];
+	ip_hdr_t *ip_hdr;
+	size_t hdr_len;
+	clock_t now;
+	int first, i, n, accepted, queued, v;
+
+	now= get_time();
+	nfConntrackSetTime(now / HZ);
+	nfLogSetTime(now / HZ, (now % HZ) * (1000000 / HZ));
+	nfNatSetTime(now / HZ);
+	nfSynproxySetTime(now / HZ);
+	nfRateSetTime((now / HZ) * 1000UL + (now % HZ) * 1000UL / HZ);
+	accepted= queued= 0;
+	for (first= 0; first<count; first += NF_BATCH_MAX)
+	{
+		n= 0;
+		for (i= first; i<count && i<first+NF_BATCH_MAX; i++)
+		{
+			ip_hdr= nf_pullup(&packs[i], layerid, &hdr_len);
+			if (ip_hdr == NULL)
+			{
+				verdicts[i]= NF_DROP;
+				continue;
+			}
+			if (hook == NF_IP_PRE_ROUTING &&
+				layerid == NF_LAYER_IP &&
+				(ip_hdr->ih_flags_fragoff &
+				HTONS(IH_FRAGOFF_MASK|IH_MORE_FRAGS)))
+			{
+				verdicts[i]= nf_defrag(&packs[i]);
+				if (verdicts[i] != NF_ACCEPT)
+					continue;
+				ip_hdr= nf_pullup(&packs[i], layerid,
+					&hdr_len);
+			}
+			pkts[n].mac= NULL;
+			pkts[n].packsize= bf_bufsize(packs[i]);
+			if (layerid == NF_LAYER_ETH)
+			{
+				pkts[n].mac= ptr2acc_data(packs[i]);
+				pkts[n].packsize -= ETH_HDR_SIZE;
+			}
+			pkts[n].data= (char *)ip_hdr;
+			pkts[n].hdrlen= hdr_len;
+			index[n]= i;
+			n++;
+		}
+		accepted += inetProcessBatch(&nf_ctx, hook, ifin, ifout,
+			pkts, n, vec);
+		for (i= 0; i<n; i++)
+		{
+			v= vec[i];
+			if ((v & NF_VERDICT_MASK) == NF_QUEUE)
+			{
+				v= nf_queue(hook, packs[index[i]], v, ifin,
+					ifout, layerid, okfn,
+					refs ? refs[index[i]] : 0);
+				if (v == NF_STOLEN)
+					queued++;
+				else if (v == NF_ACCEPT)
+					accepted++;
+			}
+			verdicts[index[i]]= v;
+		}
+	}
+
+	/* the readers get the whole burst at once */
+	if (queued)
+		nf_queue_kick();
+	return accepted;
 }
 
 PRIVATE int nf_ioctl( fd, request )
 int fd;
 ioreq_t request;
 {
-  nf_fd_t *nf_fd=&nf_fd_table[0];
+  nf_fd_t *nf_fd=&nf_fd_table[fd];
 
-  if (!nf_opened)
-  {
-    reply_thr_get (nf_fd, EBADMODE, TRUE);
-    return NW_OK;
-  }
-  ioctl_pend=request;
-  reply_thr_get (nf_fd, NW_OK, TRUE);
+  /* data left over from an unfinished write sequence is dropped */
+  nf_stream_reset(nf_fd);
+  nf_fd->nf_ioctl=request;
+  nf_reply_thr_get (nf_fd, NW_OK, TRUE);
 
   return NW_OK;
 }
 
+/*
+nf_read
+
+Reads the data of the pending ioctl. Without one, a descriptor bound to
+a queue reads the packets queued for it; the read waits while there
+are none.
+*/
+
 PRIVATE int nf_read( fd, count )
 int fd;
 size_t count;
 {
-  nf_fd_t *nf_fd=&nf_fd_table[0];
-  if (!nf_opened || !ioctl_pend)
+  nf_fd_t *nf_fd=&nf_fd_table[fd];
+
+  if (!nf_fd->nf_ioctl && nf_fd->nf_queue >= 0)
+  {
+    if (count < sizeof(struct nfq_packet))
+    {
+      nf_reply_thr_put (nf_fd, EINVAL, FALSE);
+      return NW_OK;
+    }
+    nf_fd->nf_read_count=count;
+    if (nf_queue_table[nf_fd->nf_queue].nq_unread == NULL)
+      return NW_SUSPEND;
+    nf_queue_deliver(nf_fd);
+    return NW_OK;
+  }
+  if (!nf_fd->nf_ioctl)
+  {
+    nf_reply_thr_put (nf_fd, EBADMODE, FALSE);
+    return NW_OK;
+  }
+  if ((nf_fd->nf_ioctl == IOCTL_IPT_GET_COUNTERS) ||
+      (nf_fd->nf_ioctl == IOCTL_IPT_GET_ZERO_COUNTERS))
   {
-    reply_thr_put (nf_fd, EBADMODE, FALSE);
+    nf_counters_read(nf_fd, count);
     return NW_OK;
   }
-  ioctl_pend=0;                     /* reset ioctl number */
-  reply_thr_put (nf_fd, NW_OK, FALSE);
+  nf_fd->nf_ioctl=0;                /* reset ioctl number */
+  nf_reply_thr_put (nf_fd, NW_OK, FALSE);
 
   return NW_OK;
 }
@@ -97,17 +425,35 @@ PRIVATE int nf_write( fd, count )
 int fd;
 size_t count;
 {
-  nf_fd_t *nf_fd=&nf_fd_table[0];
+  nf_fd_t *nf_fd=&nf_fd_table[fd];
   acc_t *data=NULL;
   void *data_p;
   int i=0;
 
-  if (!nf_opened)
+  switch (nf_fd->nf_ioctl)
   {
-    reply_thr_get (nf_fd, EBADMODE, FALSE);
+  case 0:
+    /* verdicts on the packets read from the queue */
+    if (nf_fd->nf_queue >= 0)
+    {
+      nf_queue_verdicts(nf_fd, count);
+      return NW_OK;
+    }
+    break;
+  case IOCTL_NFQ_BIND:
+    nf_queue_bind(nf_fd, count);
+    return NW_OK;
+  case IOCTL_IPT_RESTORE:
+    nf_stream(nf_fd, count, iptablesRestore);
+    return NW_OK;
+  case IOCTL_IPSET_ADD:
+    nf_stream(nf_fd, count, ipsetAdd);
+    return NW_OK;
+  case IOCTL_IPSET_DEL:
+    nf_stream(nf_fd, count, ipsetDel);
     return NW_OK;
   }
-  if (ioctl_pend)
+  if (nf_fd->nf_ioctl)
   {
     /* fetch data from iptables */
     printf("nf_write:nf_srfd=%x  count=%u\n", nf_fd->nf_srfd, count);
@@ -121,16 +467,117 @@ for (i=0;i<10;i++)
 }
 printf("\n");
 */
-    i=nf_ioctl_cmd(ioctl_pend,data_p);
+    i=nf_ioctl_cmd(nf_fd->nf_ioctl,data_p);
     bf_afree(data);
   }
-  ioctl_pend=0;                     /* reset ioctl number */
-  reply_thr_get (nf_fd, i, FALSE);
+  nf_fd->nf_ioctl=0;                /* reset ioctl number */
+  nf_reply_thr_get (nf_fd, i, FALSE);
 
   return NW_OK;
 }
 
-void reply_thr_put(nf_fd, reply, for_ioctl)
+/*
+nf_stream
+
+Data written after IOCTL_IPT_RESTORE, IOCTL_IPSET_ADD or IOCTL_IPSET_DEL
+may be bigger than an accessor and is written in several parts, each of
+which is passed on to func. func returns 1 if it expects more data, 0
+when it is done and -1 on errors. The ioctl stays pending as long as
+more data is expected. Every write is answered with its count, or with
+0 if the data was refused.
+*/
+
+PRIVATE void nf_stream(nf_fd, count, func)
+nf_fd_t *nf_fd;
+size_t count;
+int (*func) ARGS(( const void *data, size_t len ));
+{
+  acc_t *data, *acc;
+  int r;
+
+  data=(*nf_fd->nf_get_userdata)(nf_fd->nf_srfd,0,count,FALSE);
+  assert(data);
+  r=1;
+  for (acc=data; acc && r == 1; acc=acc->acc_next)
+    r=(*func)(ptr2acc_data(acc), acc->acc_length);
+  bf_afree(data);
+
+  /* the data can not end within a write, unless the writer is confused */
+  if (r == 0 && acc != NULL)
+    r= -1;
+  if (r != 1)
+    nf_fd->nf_ioctl=0;
+  nf_reply_thr_get (nf_fd, r == -1 ? 0 : (int)count, FALSE);
+}
+
+/* drops what a write sequence of nf_fd left unfinished */
+PRIVATE void nf_stream_reset(nf_fd)
+nf_fd_t *nf_fd;
+{
+  switch (nf_fd->nf_ioctl)
+  {
+  case IOCTL_IPT_RESTORE:
+    iptablesRestore(NULL, 0);
+    break;
+  case IOCTL_IPSET_ADD:
+  case IOCTL_IPSET_DEL:
+    ipsetAdd(NULL, 0);
+    break;
+  }
+  nf_fd->nf_ioctl=0;
+}
+
+/*
+nf_counters_read
+
+Answers a read after IOCTL_IPT_GET_COUNTERS or IOCTL_IPT_GET_ZERO_COUNTERS
+with the counters of all rules of the selected table in one transfer.
+Reading and zeroing them happens in one go, so no packet is counted in
+between. If count is too small the read fails with E2BIG and the ioctl
+stays pending, the reader may try again with a larger buffer.
+*/
+
+PRIVATE void nf_counters_read(nf_fd, count)
+nf_fd_t *nf_fd;
+size_t count;
+{
+  unsigned char *buf;
+  acc_t *pack, *acc;
+  size_t need, len;
+  int r;
+
+  need= iptablesGetCounters(NULL, 0, 0);
+  if (need > count)
+  {
+    nf_reply_thr_put(nf_fd, E2BIG, FALSE);
+    return;
+  }
+  r= 0;
+  if (need > 0)
+  {
+    buf= malloc(need);
+    if (buf == NULL)
+    {
+      nf_fd->nf_ioctl=0;
+      nf_reply_thr_put(nf_fd, ENOMEM, FALSE);
+      return;
+    }
+    iptablesGetCounters(buf, need,
+      nf_fd->nf_ioctl == IOCTL_IPT_GET_ZERO_COUNTERS);
+    pack= bf_memreq(need);
+    for (acc= pack, len= 0; acc; acc= acc->acc_next)
+    {
+      memcpy(ptr2acc_data(acc), buf + len, acc->acc_length);
+      len += acc->acc_length;
+    }
+    free(buf);
+    r= (*nf_fd->nf_put_userdata)(nf_fd->nf_srfd, 0, pack, FALSE);
+  }
+  nf_fd->nf_ioctl=0;
+  nf_reply_thr_put(nf_fd, r < 0 ? r : (int)need, FALSE);
+}
+
+void nf_reply_thr_put(nf_fd, reply, for_ioctl)
 nf_fd_t *nf_fd;
 int reply;
 int for_ioctl;
@@ -143,10 +590,10 @@ int for_ioctl;
 }
 
 /*
-reply_thr_get
+nf_reply_thr_get
 */
 
-void reply_thr_get(nf_fd, reply, for_ioctl)
+void nf_reply_thr_get(nf_fd, reply, for_ioctl)
 nf_fd_t *nf_fd;
 int reply;
 int for_ioctl;
@@ -170,18 +617,679 @@ int which_operation;
 	switch (which_operation)
 	{
 	case SR_CANCEL_READ:
-	case SR_CANCEL_WRITE:
-	case SR_CANCEL_IOCTL:
+		/* only a queue read waits */
+		assert(nf_fd->nf_read_count);
+		nf_fd->nf_read_count= 0;
+		nf_reply_thr_put(nf_fd, EINTR, FALSE);
+		break;
 	default:
 		ip_panic(( "got unknown cancel request" ));
 	}
 	return NW_OK;
 }
 
+/*
+nf_select
+
+Only a descriptor bound to a queue can have to wait for reading, until
+a packet is queued. Writes never wait.
+*/
+
 PRIVATE int nf_select(fd, operations)
 int fd;
-int operations;
+unsigned operations;
+{
+	nf_fd_t *nf_fd;
+	unsigned resops;
+
+	nf_fd= &nf_fd_table[fd];
+	resops= 0;
+	if (operations & SR_SELECT_READ)
+	{
+		if (nf_fd->nf_queue < 0 ||
+			nf_queue_table[nf_fd->nf_queue].nq_unread != NULL)
+		{
+			resops |= SR_SELECT_READ;
+		}
+		else if (!(operations & SR_SELECT_POLL))
+			nf_fd->nf_flags |= NFF_SEL_READ;
+	}
+	if (operations & SR_SELECT_WRITE)
+		resops |= SR_SELECT_WRITE;
+	return resops;
+}
+
+/*
+nf_queue
+
+Parks a packet the NFQUEUE target gave the queue verdict. The packet
+waits in its queue until the reader's verdict; all queues share
+NF_QUEUE_LEN entries. If the caller can not take the packet back, the
+queue has no reader or there is no room, the packet is dropped, or
+accepted if the rule has --queue-bypass. Returns NF_STOLEN if the
+packet was parked, the verdict otherwise.
+*/
+
+PRIVATE int nf_queue(hook, pack, verdict, ifin, ifout, layerid, okfn, ref)
+unsigned int hook;
+acc_t *pack;
+int verdict;
+char *ifin;
+char *ifout;
+int layerid;
+nf_okfn_t okfn;
+int ref;
+{
+	nf_queue_t *q;
+	nf_qent_t *qe;
+	unsigned num;
+
+	num= (unsigned)verdict >> NF_VERDICT_QBITS;
+	if (okfn == NULL || num >= NF_QUEUE_MAX ||
+		nf_queue_table[num].nq_fd < 0 || nf_qent_free == NULL)
+	{
+		return (verdict & NF_VERDICT_FLAG_QUEUE_BYPASS) ?
+			NF_ACCEPT : NF_DROP;
+	}
+	q= &nf_queue_table[num];
+
+	qe= nf_qent_free;
+	nf_qent_free= qe->qe_next;
+	qe->qe_next= NULL;
+	qe->qe_pack= pack;
+	qe->qe_okfn= okfn;
+	qe->qe_ref= ref;
+	qe->qe_id= q->nq_next_id++;
+	qe->qe_hook= hook;
+	qe->qe_flags= (verdict & NF_VERDICT_FLAG_QUEUE_BYPASS) ? QEF_BYPASS : 0;
+	qe->qe_hdroff= (layerid == NF_LAYER_ETH) ? ETH_HDR_SIZE : 0;
+	strncpy(qe->qe_ifin, ifin ? ifin : "", NF_QUEUE_IFNAMELEN-1);
+	qe->qe_ifin[NF_QUEUE_IFNAMELEN-1]= '\0';
+	strncpy(qe->qe_ifout, ifout ? ifout : "", NF_QUEUE_IFNAMELEN-1);
+	qe->qe_ifout[NF_QUEUE_IFNAMELEN-1]= '\0';
+
+	if (q->nq_tail)
+		q->nq_tail->qe_next= qe;
+	else
+		q->nq_head= qe;
+	q->nq_tail= qe;
+	if (q->nq_unread == NULL)
+		q->nq_unread= qe;
+	return NF_STOLEN;
+}
+
+/* answers waiting reads and selects of the queues with unread packets */
+PRIVATE void nf_queue_kick()
 {
-	ip_panic(( "got unimplemented select call" ));
+	nf_queue_t *q;
+	nf_fd_t *nf_fd;
+
+	for (q= nf_queue_table; q < &nf_queue_table[NF_QUEUE_MAX]; q++)
+	{
+		if (q->nq_fd < 0 || q->nq_unread == NULL)
+			continue;
+		nf_fd= &nf_fd_table[q->nq_fd];
+		if (nf_fd->nf_flags & NFF_SEL_READ)
+		{
+			nf_fd->nf_flags &= ~NFF_SEL_READ;
+			(*nf_fd->nf_select_res)(nf_fd->nf_srfd,
+				SR_SELECT_READ);
+		}
+		if (nf_fd->nf_read_count)
+			nf_queue_deliver(nf_fd);
+	}
+}
+
+/*
+nf_queue_bind
+
+Makes nf_fd the reader of the queue given by the struct nfq_bind written
+after IOCTL_NFQ_BIND. A descriptor reads one queue at a time, binding it
+again lets go of the previous one.
+*/
+
+PRIVATE void nf_queue_bind(nf_fd, count)
+nf_fd_t *nf_fd;
+size_t count;
+{
+	struct nfq_bind bind;
+	acc_t *data;
+	nf_queue_t *q;
+
+	nf_fd->nf_ioctl= 0;
+	if (count != sizeof(bind))
+	{
+		nf_reply_thr_get(nf_fd, EINVAL, FALSE);
+		return;
+	}
+	data= (*nf_fd->nf_get_userdata)(nf_fd->nf_srfd, 0, count, FALSE);
+	assert(data);
+	data= bf_packIffLess(data, sizeof(bind));
+	memcpy(&bind, ptr2acc_data(data), sizeof(bind));
+	bf_afree(data);
+
+	if (bind.queuenum >= NF_QUEUE_MAX)
+	{
+		nf_reply_thr_get(nf_fd, EINVAL, FALSE);
+		return;
+	}
+	q= &nf_queue_table[bind.queuenum];
+	if (q->nq_fd >= 0 && &nf_fd_table[q->nq_fd] != nf_fd)
+	{
+		nf_reply_thr_get(nf_fd, EBUSY, FALSE);
+		return;
+	}
+	if (nf_fd->nf_queue >= 0 && nf_fd->nf_queue != bind.queuenum)
+		nf_queue_unbind(nf_fd);
+
+	q->nq_fd= nf_fd - nf_fd_table;
+	q->nq_copy_range= bind.copy_range;
+	nf_fd->nf_queue= bind.queuenum;
+	nf_reply_thr_get(nf_fd, (int)count, FALSE);
+}
+
+/* lets go of the queue nf_fd reads, its packets get the default verdict */
+PRIVATE void nf_queue_unbind(nf_fd)
+nf_fd_t *nf_fd;
+{
+	nf_queue_t *q;
+	nf_qent_t *qe, *accept, *drop;
+
+	q= &nf_queue_table[nf_fd->nf_queue];
+	accept= drop= NULL;
+	while ((qe= q->nq_head) != NULL)
+	{
+		q->nq_head= qe->qe_next;
+		if (qe->qe_flags & QEF_BYPASS)
+		{
+			qe->qe_next= accept;
+			accept= qe;
+		}
+		else
+		{
+			qe->qe_next= drop;
+			drop= qe;
+		}
+	}
+	q->nq_tail= q->nq_unread= NULL;
+	q->nq_fd= -1;
+	nf_fd->nf_queue= -1;
+	nf_fd->nf_flags &= ~NFF_SEL_READ;
+
+	nf_queue_finish(drop, NF_DROP);
+	nf_queue_finish(accept, NF_ACCEPT);
+}
+
+/*
+nf_queue_deliver
+
+Answers the waiting read of nf_fd with the unread packets of its queue,
+as many whole records as fit. The packet data is not copied within
+inet, the accessors are passed on as they are.
+*/
+
+PRIVATE void nf_queue_deliver(nf_fd)
+nf_fd_t *nf_fd;
+{
+	struct nfq_packet hdr;
+	nf_queue_t *q;
+	nf_qent_t *qe;
+	acc_t *pack;
+	size_t offset, pktlen, caplen, len;
+	int r;
+
+	q= &nf_queue_table[nf_fd->nf_queue];
+	r= 0;
+	for (offset= 0; (qe= q->nq_unread) != NULL; offset += len)
+	{
+		pktlen= bf_bufsize(qe->qe_pack) - qe->qe_hdroff;
+		caplen= pktlen;
+		if (q->nq_copy_range && caplen > q->nq_copy_range)
+			caplen= q->nq_copy_range;
+		len= (sizeof(hdr) + caplen + 3) & ~3;
+		if (offset + len > nf_fd->nf_read_count)
+		{
+			if (offset > 0)
+				break;
+			/* the first record is cut short to fit */
+			caplen= (nf_fd->nf_read_count - sizeof(hdr)) & ~3;
+			len= sizeof(hdr) + caplen;
+		}
+
+		hdr.id= qe->qe_id;
+		hdr.len= len;
+		hdr.pktlen= pktlen;
+		hdr.caplen= caplen;
+		hdr.hook= qe->qe_hook;
+		hdr.flags= 0;
+		hdr.queuenum= nf_fd->nf_queue;
+		memcpy(hdr.indev, qe->qe_ifin, NF_QUEUE_IFNAMELEN);
+		memcpy(hdr.outdev, qe->qe_ifout, NF_QUEUE_IFNAMELEN);
+
+		pack= bf_memreq(sizeof(hdr));
+		assert(pack->acc_next == NULL);
+		memcpy(ptr2acc_data(pack), &hdr, sizeof(hdr));
+		if (caplen > 0)
+		{
+			pack->acc_next= bf_cut(qe->qe_pack, qe->qe_hdroff,
+				caplen);
+		}
+		r= (*nf_fd->nf_put_userdata)(nf_fd->nf_srfd, offset, pack,
+			FALSE);
+		if (r < 0)
+			break;
+		qe->qe_flags |= QEF_READ;
+		q->nq_unread= qe->qe_next;
+	}
+	nf_fd->nf_read_count= 0;
+	nf_reply_thr_put(nf_fd, (r < 0 && offset == 0) ? r : (int)offset,
+		FALSE);
+}
+
+/*
+nf_queue_verdicts
+
+Takes the struct nfq_verdict records written to a bound descriptor. The
+packets are taken out of the queue first and handed on once all
+verdicts of the write are known, a packet taken back may well be
+queued again. A verdict for a packet that was not read or is gone
+already is ignored. A bad verdict fails the write, the ones before it
+still apply.
+*/
+
+PRIVATE void nf_queue_verdicts(nf_fd, count)
+nf_fd_t *nf_fd;
+size_t count;
+{
+	struct nfq_verdict v;
+	nf_queue_t *q;
+	nf_qent_t *qe, *prev, *next, *accept, *drop;
+	acc_t *data, *acc;
+	size_t n, got, len, aoff;
+	int r;
+
+	if (count == 0 || count % sizeof(v) != 0)
+	{
+		nf_reply_thr_get(nf_fd, EINVAL, FALSE);
+		return;
+	}
+	data= (*nf_fd->nf_get_userdata)(nf_fd->nf_srfd, 0, count, FALSE);
+	assert(data);
+
+	q= &nf_queue_table[nf_fd->nf_queue];
+	accept= drop= NULL;
+	r= (int)count;
+	acc= data;
+	aoff= 0;
+	for (n= 0; n<count; n += sizeof(v))
+	{
+		/* a record may span accessors */
+		for (got= 0; got<sizeof(v); got += len)
+		{
+			while (aoff == acc->acc_length)
+			{
+				acc= acc->acc_next;
+				aoff= 0;
+			}
+			len= acc->acc_length - aoff;
+			if (len > sizeof(v) - got)
+				len= sizeof(v) - got;
+			memcpy((char *)&v + got, ptr2acc_data(acc) + aoff,
+				len);
+			aoff += len;
+		}
+		if (v.verdict != NF_ACCEPT && v.verdict != NF_DROP)
+		{
+			r= EINVAL;
+			break;
+		}
+
+		/* the packets read are the first ones of the queue */
+		prev= NULL;
+		for (qe= q->nq_head; qe && (qe->qe_flags & QEF_READ); qe= next)
+		{
+			next= qe->qe_next;
+			if (qe->qe_id != v.id &&
+				(!(v.flags & NFQ_VERDICT_BATCH) ||
+				(i32_t)(qe->qe_id - v.id) > 0))
+			{
+				prev= qe;
+				continue;
+			}
+			if (prev)
+				prev->qe_next= next;
+			else
+				q->nq_head= next;
+			if (q->nq_tail == qe)
+				q->nq_tail= prev;
+			if (v.verdict == NF_ACCEPT)
+			{
+				qe->qe_next= accept;
+				accept= qe;
+			}
+			else
+			{
+				qe->qe_next= drop;
+				drop= qe;
+			}
+			if (qe->qe_id == v.id)
+				break;
+		}
+	}
+	bf_afree(data);
+
+	nf_queue_finish(drop, NF_DROP);
+	nf_queue_finish(accept, NF_ACCEPT);
+	nf_reply_thr_get(nf_fd, r, FALSE);
+}
+
+/*
+nf_queue_finish
+
+Frees the entries of a list taken out of a queue and drops or hands
+back their packets. The list is in reverse order, it is turned around
+first so the packets of a flow go on in the order they came.
+*/
+
+PRIVATE void nf_queue_finish(list, verdict)
+nf_qent_t *list;
+int verdict;
+{
+	nf_qent_t *qe, *next, *fifo;
+	nf_okfn_t okfn;
+	acc_t *pack;
+	int ref;
+
+	for (fifo= NULL; list; list= next)
+	{
+		next= list->qe_next;
+		list->qe_next= fifo;
+		fifo= list;
+	}
+	for (qe= fifo; qe; qe= next)
+	{
+		next= qe->qe_next;
+		pack= qe->qe_pack;
+		okfn= qe->qe_okfn;
+		ref= qe->qe_ref;
+		qe->qe_next= nf_qent_free;
+		nf_qent_free= qe;
+
+		if (verdict == NF_ACCEPT)
+			(*okfn)(ref, pack);
+		else
+			bf_afree(pack);
+	}
+}
+
+/*
+nf_log_open
+
+/dev/nflog has a single reader, it receives the records the ULOG target
+puts into the log ring (see nflog.c). Records that arrive while nobody
+reads stay in the ring until it is full.
+*/
+
+PRIVATE int nf_log_open( port, srfd, get_userdata_func, put_userdata_func,
+             put_pkt, select_res )
+int port;
+int srfd;
+get_userdata_t get_userdata_func;
+put_userdata_t put_userdata_func;
+put_pkt_t put_pkt;
+select_res_t select_res;
+{
+	if (nf_log_opened)
+		return EBUSY;
+
+	nf_log_fd.nf_srfd= srfd;
+	nf_log_fd.nf_get_userdata= get_userdata_func;
+	nf_log_fd.nf_put_userdata= put_userdata_func;
+	nf_log_fd.nf_select_res= select_res;
+	nf_log_opened= TRUE;
+	nf_log_count= 0;
+	nf_log_sel= FALSE;
+
+	return 0;
+}
+
+PRIVATE void nf_log_close( fd )
+int fd;
+{
+	if (nf_log_timed)
+	{
+		clck_untimer(&nf_log_timer);
+		nf_log_timed= FALSE;
+	}
+	nf_log_opened= FALSE;
+	nf_log_count= 0;
+	nf_log_sel= FALSE;
+}
+
+/*
+nf_log_read
+
+Returns as many whole records as fit into count bytes. If the ring is
+empty the read waits; it is answered once NF_LOG_THRESHOLD bytes are
+buffered or NF_LOG_FLUSH ticks after the first record, so a busy log is
+read in large batches.
+*/
+
+PRIVATE int nf_log_read( fd, count )
+int fd;
+size_t count;
+{
+	if (count < NF_LOG_RECMAX)
+	{
+		nf_reply_thr_put(&nf_log_fd, EINVAL, FALSE);
+		return NW_OK;
+	}
+	nf_log_count= count;
+	if (nfLogUsed() == 0)
+		return NW_SUSPEND;
+	nf_log_deliver();
 	return NW_OK;
 }
+
+PRIVATE int nf_log_write( fd, count )
+int fd;
+size_t count;
+{
+	nf_reply_thr_get(&nf_log_fd, EBADMODE, FALSE);
+	return NW_OK;
+}
+
+PRIVATE int nf_log_ioctl( fd, request )
+int fd;
+ioreq_t request;
+{
+	nf_reply_thr_get(&nf_log_fd, EBADMODE, TRUE);
+	return NW_OK;
+}
+
+PRIVATE int nf_log_cancel(fd, which_operation)
+int fd;
+int which_operation;
+{
+	DBLOCK(0x10, printf("nf_log_cancel(%d, %d)\n", fd, which_operation));
+
+	switch (which_operation)
+	{
+	case SR_CANCEL_READ:
+		assert(nf_log_count);
+		nf_log_count= 0;
+		nf_reply_thr_put(&nf_log_fd, EINTR, FALSE);
+		break;
+	default:
+		ip_panic(( "got unknown cancel request" ));
+	}
+	return NW_OK;
+}
+
+PRIVATE int nf_log_select(fd, operations)
+int fd;
+unsigned operations;
+{
+	unsigned resops;
+
+	resops= 0;
+	if (operations & SR_SELECT_READ)
+	{
+		if (nfLogUsed() > 0)
+			resops |= SR_SELECT_READ;
+		else if (!(operations & SR_SELECT_POLL))
+			nf_log_sel= TRUE;
+	}
+	return resops;
+}
+
+/*
+nf_log_notify
+
+Called by the log ring when its first record arrives and when it fills
+up to NF_LOG_THRESHOLD.
+*/
+
+PRIVATE void nf_log_notify()
+{
+	if (!nf_log_opened)
+		return;
+	if (nf_log_sel)
+	{
+		nf_log_sel= FALSE;
+		(*nf_log_fd.nf_select_res)(nf_log_fd.nf_srfd, SR_SELECT_READ);
+	}
+	if (!nf_log_count)
+		return;
+	if (nfLogUsed() >= NF_LOG_THRESHOLD)
+	{
+		if (nf_log_timed)
+		{
+			clck_untimer(&nf_log_timer);
+			nf_log_timed= FALSE;
+		}
+		nf_log_deliver();
+	}
+	else if (!nf_log_timed)
+	{
+		nf_log_timed= TRUE;
+		clck_timer(&nf_log_timer, get_time() + NF_LOG_FLUSH,
+			nf_log_flush, 0);
+	}
+}
+
+PRIVATE void nf_log_flush(ref, timer)
+int ref;
+timer_t *timer;
+{
+	nf_log_timed= FALSE;
+	if (nf_log_count && nfLogUsed() > 0)
+		nf_log_deliver();
+}
+
+/*
+nf_log_deliver
+
+Answers the waiting read. The records are copied out in pieces of at
+most NF_LOG_CHUNK bytes and taken out of the ring once copied.
+*/
+
+PRIVATE void nf_log_deliver()
+{
+	const unsigned char *data;
+	acc_t *pack, *acc;
+	size_t offset, n, len;
+	int r;
+
+	r= 0;
+	for (offset= 0; offset < nf_log_count; offset += n)
+	{
+		n= nf_log_count - offset;
+		if (n > NF_LOG_CHUNK)
+			n= NF_LOG_CHUNK;
+		n= nfLogPeek(&data, n);
+		if (n == 0)
+			break;
+
+		pack= bf_memreq(n);
+		for (acc= pack, len= 0; acc; acc= acc->acc_next)
+		{
+			memcpy(ptr2acc_data(acc), data + len,
+				acc->acc_length);
+			len += acc->acc_length;
+		}
+		r= (*nf_log_fd.nf_put_userdata)(nf_log_fd.nf_srfd, offset,
+			pack, FALSE);
+		if (r < 0)
+			break;
+		nfLogConsume(n);
+	}
+	nf_log_count= 0;
+	nf_reply_thr_put(&nf_log_fd, (r < 0 && offset == 0) ? r : (int)offset,
+		FALSE);
+}
+
+/*
+nf_sp_notify
+
+The SYN proxy queues its packets in the middle of a burst, they are sent
+from an event once the burst is done.
+*/
+
+PRIVATE void nf_sp_notify()
+{
+	ev_arg_t arg;
+
+	if (ev_in_queue(&nf_sp_event))
+		return;
+	arg.ev_ptr= NULL;
+	ev_enqueue(&nf_sp_event, nf_sp_send, arg);
+}
+
+/*
+nf_sp_send
+
+Sends the packets the SYN proxy built, from the port the packet they
+answer came in on; one whose port is not known is dropped. They have
+been through the firewall already, in the shape of that packet: nf_hook
+lets each through the first hook it gets to, which is POSTROUTING in
+ipeth_send or INPUT in ip_port_arrive. A local TCP that answers at once
+does so with nf_sp_pass cleared, so its packets are filtered (and its
+SYN-ACK taken by the proxy).
+*/
+
+PRIVATE void nf_sp_send(ev, ev_arg)
+event_t *ev;
+ev_arg_t ev_arg;
+{
+	const struct nf_sp_pkt *sp;
+	acc_t *pack;
+	long port_nr;
+	char *end;
+
+	while ((sp= nfSynproxyPeek()) != NULL)
+	{
+		/* a packet for a port that is gone is dropped */
+		port_nr= -1;
+		if (strncmp(sp->ifname, "eth", 3) == 0 && sp->ifname[3] != '\0')
+		{
+			port_nr= strtol(sp->ifname+3, &end, 10);
+			if (*end != '\0')
+				port_nr= -1;
+		}
+		if (port_nr < 0 || port_nr >= ip_conf_nr)
+		{
+			DBLOCK(1, printf("nf_sp_send: no port '%s'\n",
+				sp->ifname));
+			nfSynproxyConsume();
+			continue;
+		}
+		pack= bf_memreq(sp->len);
+		memcpy(ptr2acc_data(pack), sp->data, sp->len);
+		nfSynproxyConsume();
+
+		nf_sp_pass= pack;
+		ip_send_pack(port_nr, pack);
+		nf_sp_pass= NULL;
+	}
+}
@@ -1,16 +1,94 @@
 #ifndef NF_H
 #define NF_H NF_H
 
+#include <nfqueue.h>
+
 typedef struct nf_fd
 {
+	int nf_flags;
 	int nf_srfd;
 	get_userdata_t nf_get_userdata;
 	put_userdata_t nf_put_userdata;
 	put_pkt_t nf_put_pkt;
-	ioreq_t nf_ioctl;
+	ioreq_t nf_ioctl;		/* waits for its data, or 0 */
 	select_res_t nf_select_res;
+	int nf_queue;			/* queue it reads, or -1 */
+	size_t nf_read_count;		/* size of the waiting read, or 0 */
 } nf_fd_t;
 
+#define NFF_EMPTY	0x0
+#define NFF_INUSE	0x1
+#define NFF_SEL_READ	0x2
+
+#define NF_FD_NR	8
+
+/* Takes back a packet the NFQUEUE target parked once its reader accepts
+ * it; ref is what the caller of nf_hook passed along with it.
+ */
+typedef void (*nf_okfn_t) ARGS(( int ref, acc_t *pack ));
+
+typedef struct nf_qent
+{
+	struct nf_qent *qe_next;
+	acc_t *qe_pack;
+	nf_okfn_t qe_okfn;
+	int qe_ref;
+	u32_t qe_id;
+	int qe_hook;
+	int qe_flags;
+	size_t qe_hdroff;		/* link level header before IP */
+	char qe_ifin[NF_QUEUE_IFNAMELEN];
+	char qe_ifout[NF_QUEUE_IFNAMELEN];
+} nf_qent_t;
+
+#define QEF_BYPASS	0x1		/* accepted if the reader goes away */
+#define QEF_READ	0x2		/* copied to the reader */
+
+typedef struct nf_queue
+{
+	nf_qent_t *nq_head;		/* oldest packet */
+	nf_qent_t *nq_tail;
+	nf_qent_t *nq_unread;		/* first one not read yet, or NULL */
+	int nq_fd;			/* reader, or -1 */
+	u32_t nq_copy_range;
+	u32_t nq_next_id;
+} nf_queue_t;
+
+/* Fragments waiting at PREROUTING for the rest of their datagram, see
+ * nf_frag.c. Fragments are kept by offset on the acc_ext_link list.
+ */
+typedef struct nf_frag
+{
+	acc_t *nr_frags;
+	int nr_state;
+	ipaddr_t nr_src;
+	ipaddr_t nr_dst;
+	u16_t nr_id;
+	ipproto_t nr_proto;
+	size_t nr_size;			/* datagram payload, 0 until the last */
+	size_t nr_mem;			/* bytes of the fragments held */
+	time_t nr_exp_time;
+} nf_frag_t;
+
+#define NRS_EMPTY	0
+#define NRS_HOLD	1		/* fragments are coming in */
+#define NRS_DONE	2		/* passed on or dropped, only the key */
+
+#define NF_FRAG_NR	16		/* datagrams reassembled at a time */
+#define NF_FRAG_SIZE	0xffffL		/* payload bytes one may hold */
+#define NF_FRAG_MEM	(NF_FRAG_NR*64*1024L)	/* and all of them together */
+#define NF_FRAG_TIME	(30*HZ)		/* to get all fragments of one */
+#define NF_FRAG_LINGER	(2*HZ)		/* late fragments of a done one */
+
+/* headers made contiguous for the filter: IP and TCP with options */
+#define NF_HDR_PULLUP	(IP_MAX_HDR_SIZE + TCP_MAX_HDR_SIZE)
+
+/* /dev/nflog: a waiting read is answered after at most this many ticks,
+ * or at once when NF_LOG_THRESHOLD bytes are buffered; the records are
+ * copied out in pieces of NF_LOG_CHUNK bytes
+ */
+#define NF_LOG_FLUSH	(HZ/10)
+#define NF_LOG_CHUNK	4096
 
 void nf_prep( void );
 PRIVATE int nf_open( int port, int srfd, get_userdata_t get_userdata_func,
@@ -18,11 +96,29 @@ PRIVATE int nf_open( int port, int srfd, get_userdata_t get_userdata_func,
              put_pkt_t put_pkt, select_res_t select_res );
 PRIVATE void nf_close( int fd );
 int nf_init( void );
+ip_hdr_t *nf_pullup( acc_t **pack, int layerid, size_t *hdr_lenp );
+int nf_hook( unsigned int hook, acc_t **pack, char *ifin, char *ifout,
+             int layerid, nf_okfn_t okfn, int ref );
+int nf_hook_batch( unsigned int hook, acc_t **packs, int count,
+                   char *ifin, char *ifout, int layerid, int *verdicts,
+                   nf_okfn_t okfn, int *refs );
+void nf_frag_init( void );
+int nf_defrag( acc_t **pack );
+void nf_frag_expire( void );
 PRIVATE int nf_ioctl( int fd, ioreq_t request );
 PRIVATE int nf_read( int fd, size_t count );
 PRIVATE int nf_write( int fd, size_t count );
-void reply_thr_put(nf_fd_t *nf_fd, int reply, int for_ioctl);
-void reply_thr_get(nf_fd_t *nf_fd, int reply, int for_ioctl);
+void nf_reply_thr_put(nf_fd_t *nf_fd, int reply, int for_ioctl);
+void nf_reply_thr_get(nf_fd_t *nf_fd, int reply, int for_ioctl);
 PRIVATE int nf_cancel(int fd, int which_operation);
-PRIVATE int nf_select(int fd, int operations);
+PRIVATE int nf_select(int fd, unsigned operations);
+PRIVATE int nf_log_open( int port, int srfd, get_userdata_t get_userdata_func,
+             put_userdata_t put_userdata_func,
+             put_pkt_t put_pkt, select_res_t select_res );
+PRIVATE void nf_log_close( int fd );
+PRIVATE int nf_log_ioctl( int fd, ioreq_t request );
+PRIVATE int nf_log_read( int fd, size_t count );
+PRIVATE int nf_log_write( int fd, size_t count );
+PRIVATE int nf_log_cancel(int fd, int which_operation);
+PRIVATE int nf_log_select(int fd, unsigned operations);
 #endif
@@ -0,0 +1,404 @@
+/*
+generic/nf_frag.c
+
+Reassembly of IP fragments in front of the PREROUTING hook. The filter
+and connection tracking only see whole datagrams; a forwarded datagram
+is split again by ipeth_send if it does not fit the outgoing link.
+
+A datagram is kept in one of NF_FRAG_NR entries, keyed on source,
+destination, id and protocol, for at most NF_FRAG_TIME ticks. Only the
+payload of the fragments is counted: a datagram holds at most
+NF_FRAG_SIZE bytes, all entries together at most NF_FRAG_MEM. Beyond
+that the datagram that is closest to its timeout makes room for new
+fragments. Overlapping
+fragments and datagrams that do not fit are dropped. Once a datagram
+has been passed on or dropped its key lingers for NF_FRAG_LINGER ticks,
+so fragments that still arrive for it do not go through the chains
+again and do not start a datagram that never completes.
+*/
+
+#include "inet.h"
+#include "buf.h"
+#include "clock.h"
+#include "type.h"
+#include "assert.h"
+#include "event.h"
+#include "ip.h"
+#include "ip_int.h"
+#include "nfcore.h"
+#include "nf.h"
+
+THIS_FILE
+
+PRIVATE nf_frag_t nf_frag_table[NF_FRAG_NR];
+PRIVATE size_t nf_frag_mem;		/* held by all entries */
+
+FORWARD nf_frag_t *nf_frag_find ARGS(( ip_hdr_t *ip_hdr, time_t now ));
+FORWARD nf_frag_t *nf_frag_oldest ARGS(( nf_frag_t *skip ));
+FORWARD int nf_frag_insert ARGS(( nf_frag_t *nr, acc_t *pack ));
+FORWARD acc_t *nf_frag_whole ARGS(( nf_frag_t *nr ));
+FORWARD void nf_frag_free ARGS(( nf_frag_t *nr, int state, time_t now ));
+FORWARD size_t nf_frag_off ARGS(( acc_t *pack ));
+FORWARD size_t nf_frag_end ARGS(( acc_t *pack ));
+FORWARD void nf_frag_buffree ARGS(( int priority ));
+#ifdef BUF_CONSISTENCY_CHECK
+FORWARD void nf_frag_bufcheck ARGS(( void ));
+#endif
+
+PUBLIC void nf_frag_init()
+{
+	int i;
+
+	for (i= 0; i<NF_FRAG_NR; i++)
+	{
+		nf_frag_table[i].nr_frags= NULL;
+		nf_frag_table[i].nr_state= NRS_EMPTY;
+		nf_frag_table[i].nr_mem= 0;
+	}
+	nf_frag_mem= 0;
+
+#ifndef BUF_CONSISTENCY_CHECK
+	bf_logon(nf_frag_buffree);
+#else
+	bf_logon(nf_frag_buffree, nf_frag_bufcheck);
+#endif
+}
+
+/*
+nf_defrag
+
+Takes a fragment that arrived at PREROUTING, its headers made contiguous
+by nf_pullup. Returns NF_STOLEN if the fragment is held until the rest
+of its datagram arrives, NF_ACCEPT if *pack is now the whole datagram,
+and NF_DROP if the caller has to drop it. A fragment with a broken
+header is left alone and accepted, IP drops it.
+*/
+
+PUBLIC int nf_defrag(pack)
+acc_t **pack;
+{
+	ip_hdr_t *ip_hdr;
+	nf_frag_t *nr, *old;
+	acc_t *tmp_pack;
+	size_t hdr_len, len, size;
+	time_t now;
+	int r;
+
+	ip_hdr= (ip_hdr_t *)ptr2acc_data(*pack);
+	hdr_len= (ip_hdr->ih_vers_ihl & IH_IHL_MASK) * 4;
+	len= ntohs(ip_hdr->ih_length);
+	size= bf_bufsize(*pack);
+	if (((ip_hdr->ih_vers_ihl >> 4) & IH_VERSION_MASK) != IP_VERSION ||
+		hdr_len < IP_MIN_HDR_SIZE || (*pack)->acc_length < hdr_len ||
+		len < hdr_len || len > size ||
+		(u16_t)~oneC_sum(0, (u16_t *)ip_hdr, hdr_len))
+	{
+		return NF_ACCEPT;
+	}
+	if (size > len)
+	{
+		/* link level padding */
+		tmp_pack= bf_cut(*pack, 0, len);
+		bf_afree(*pack);
+		*pack= tmp_pack;
+		ip_hdr= (ip_hdr_t *)ptr2acc_data(*pack);
+	}
+
+	now= get_time();
+	nr= nf_frag_find(ip_hdr, now);
+	if (nr->nr_state == NRS_DONE)
+		return NF_DROP;
+
+	if (nr->nr_mem + len-hdr_len > NF_FRAG_SIZE)
+	{
+		DBLOCK(1, printf("nf_defrag: datagram too large\n"));
+		nf_frag_free(nr, NRS_DONE, now);
+		return NF_DROP;
+	}
+	while (nf_frag_mem + len-hdr_len > NF_FRAG_MEM)
+	{
+		old= nf_frag_oldest(nr);
+		assert(old != NULL);
+		nf_frag_free(old, NRS_EMPTY, now);
+	}
+
+	r= nf_frag_insert(nr, *pack);
+	if (r == NF_DROP)
+	{
+		DBLOCK(1, printf("nf_defrag: bad or overlapping fragment\n"));
+		nf_frag_free(nr, NRS_DONE, now);
+		return NF_DROP;
+	}
+	if (r == NF_STOLEN)
+		return NF_STOLEN;
+
+	*pack= nf_frag_whole(nr);
+	nf_frag_free(nr, NRS_DONE, now);
+	return NF_ACCEPT;
+}
+
+/*
+nf_frag_expire
+
+Frees the fragments of datagrams that did not complete in time and
+forgets done ones, called with the connection tracking timeouts.
+*/
+
+PUBLIC void nf_frag_expire()
+{
+	nf_frag_t *nr;
+	time_t now;
+
+	now= get_time();
+	for (nr= nf_frag_table; nr < &nf_frag_table[NF_FRAG_NR]; nr++)
+	{
+		if (nr->nr_state != NRS_EMPTY && nr->nr_exp_time <= now)
+			nf_frag_free(nr, NRS_EMPTY, now);
+	}
+}
+
+/* the entry of a fragment's datagram, a new one if there is none yet */
+PRIVATE nf_frag_t *nf_frag_find(ip_hdr, now)
+ip_hdr_t *ip_hdr;
+time_t now;
+{
+	nf_frag_t *nr, *victim;
+
+	victim= NULL;
+	for (nr= nf_frag_table; nr < &nf_frag_table[NF_FRAG_NR]; nr++)
+	{
+		if (nr->nr_state != NRS_EMPTY && nr->nr_exp_time <= now)
+			nf_frag_free(nr, NRS_EMPTY, now);
+		if (nr->nr_state == NRS_EMPTY)
+		{
+			if (victim == NULL || victim->nr_state != NRS_EMPTY)
+				victim= nr;
+			continue;
+		}
+		if (nr->nr_id == ip_hdr->ih_id &&
+			nr->nr_src == ip_hdr->ih_src &&
+			nr->nr_dst == ip_hdr->ih_dst &&
+			nr->nr_proto == ip_hdr->ih_proto)
+		{
+			return nr;
+		}
+		if (victim == NULL || (victim->nr_state != NRS_EMPTY &&
+			nr->nr_exp_time < victim->nr_exp_time))
+		{
+			victim= nr;
+		}
+	}
+
+	nr= victim;
+	if (nr->nr_state != NRS_EMPTY)
+		nf_frag_free(nr, NRS_EMPTY, now);
+	nr->nr_state= NRS_HOLD;
+	nr->nr_src= ip_hdr->ih_src;
+	nr->nr_dst= ip_hdr->ih_dst;
+	nr->nr_id= ip_hdr->ih_id;
+	nr->nr_proto= ip_hdr->ih_proto;
+	nr->nr_size= 0;
+	nr->nr_exp_time= now + NF_FRAG_TIME;
+	return nr;
+}
+
+/* the datagram holding fragments that times out first, other than skip */
+PRIVATE nf_frag_t *nf_frag_oldest(skip)
+nf_frag_t *skip;
+{
+	nf_frag_t *nr, *oldest;
+
+	oldest= NULL;
+	for (nr= nf_frag_table; nr < &nf_frag_table[NF_FRAG_NR]; nr++)
+	{
+		if (nr == skip || nr->nr_frags == NULL)
+			continue;
+		if (oldest == NULL || nr->nr_exp_time < oldest->nr_exp_time)
+			oldest= nr;
+	}
+	return oldest;
+}
+
+/*
+nf_frag_insert
+
+Adds a fragment to its datagram. Returns NF_STOLEN if the fragment is
+held (or was a copy of one that is) and the datagram is not complete
+yet, NF_ACCEPT if it is complete, and NF_DROP without taking the
+fragment if it overlaps the ones held or contradicts them about the
+length of the datagram.
+*/
+
+PRIVATE int nf_frag_insert(nr, pack)
+nf_frag_t *nr;
+acc_t *pack;
+{
+	ip_hdr_t *ip_hdr;
+	acc_t *prev, *next;
+	size_t hdr_len, offset, end, expect;
+	int more;
+
+	ip_hdr= (ip_hdr_t *)ptr2acc_data(pack);
+	hdr_len= (ip_hdr->ih_vers_ihl & IH_IHL_MASK) * 4;
+	more= (ntohs(ip_hdr->ih_flags_fragoff) & IH_MORE_FRAGS) != 0;
+	offset= nf_frag_off(pack);
+	end= nf_frag_end(pack);
+
+	/* the total length has to fit the IP header */
+	if (hdr_len + end > 0xffff)
+		return NF_DROP;
+	if (more && (end == offset || ((end-offset) & 7)))
+		return NF_DROP;
+	if (nr->nr_size && (more ? end > nr->nr_size : end != nr->nr_size))
+		return NF_DROP;
+
+	prev= NULL;
+	for (next= nr->nr_frags; next; next= next->acc_ext_link)
+	{
+		if (nf_frag_off(next) >= offset)
+			break;
+		prev= next;
+	}
+	if (next && nf_frag_off(next) == offset && nf_frag_end(next) == end)
+	{
+		/* sent twice */
+		bf_afree(pack);
+		return NF_STOLEN;
+	}
+	if (prev && nf_frag_end(prev) > offset)
+		return NF_DROP;
+	if (next && (nf_frag_off(next) < end || !more))
+		return NF_DROP;
+
+	pack->acc_ext_link= next;
+	if (prev)
+		prev->acc_ext_link= pack;
+	else
+		nr->nr_frags= pack;
+	nr->nr_mem += end-offset;
+	nf_frag_mem += end-offset;
+	if (!more)
+		nr->nr_size= end;
+
+	if (nr->nr_size == 0)
+		return NF_STOLEN;
+	expect= 0;
+	for (next= nr->nr_frags; next; next= next->acc_ext_link)
+	{
+		if (nf_frag_off(next) != expect)
+			return NF_STOLEN;
+		expect= nf_frag_end(next);
+	}
+	return NF_ACCEPT;
+}
+
+/*
+nf_frag_whole
+
+Joins the fragments of a complete datagram behind the first one. Only
+the header is copied, and only if its buffer is shared; the data stays
+where it arrived.
+*/
+
+PRIVATE acc_t *nf_frag_whole(nr)
+nf_frag_t *nr;
+{
+	ip_hdr_t *ip_hdr;
+	acc_t *pack, *frag, *next, *data;
+	size_t hdr_len;
+
+	pack= nr->nr_frags;
+	frag= pack->acc_ext_link;
+	pack->acc_ext_link= NULL;
+	nr->nr_frags= NULL;
+	nf_frag_mem -= nr->nr_mem;
+	nr->nr_mem= 0;
+
+	for (; frag; frag= next)
+	{
+		next= frag->acc_ext_link;
+		ip_hdr= (ip_hdr_t *)ptr2acc_data(frag);
+		hdr_len= (ip_hdr->ih_vers_ihl & IH_IHL_MASK) * 4;
+		data= bf_cut(frag, hdr_len, bf_bufsize(frag)-hdr_len);
+		bf_afree(frag);
+		pack= bf_append(pack, data);
+	}
+
+	ip_hdr= nf_pullup(&pack, NF_LAYER_IP, NULL);
+	assert(ip_hdr != NULL);
+	hdr_len= (ip_hdr->ih_vers_ihl & IH_IHL_MASK) * 4;
+	ip_hdr->ih_length= htons(hdr_len + nr->nr_size);
+	ip_hdr->ih_flags_fragoff &= ~HTONS(IH_FRAGOFF_MASK|IH_MORE_FRAGS);
+	ip_hdr_chksum(ip_hdr, hdr_len);
+	return pack;
+}
+
+/* frees the fragments an entry holds and gives it a new state */
+PRIVATE void nf_frag_free(nr, state, now)
+nf_frag_t *nr;
+int state;
+time_t now;
+{
+	acc_t *pack;
+
+	while (nr->nr_frags != NULL)
+	{
+		pack= nr->nr_frags;
+		nr->nr_frags= pack->acc_ext_link;
+		bf_afree(pack);
+	}
+	nf_frag_mem -= nr->nr_mem;
+	nr->nr_mem= 0;
+	nr->nr_state= state;
+	if (state == NRS_DONE)
+		nr->nr_exp_time= now + NF_FRAG_LINGER;
+}
+
+/* byte offset of a fragment's data in its datagram */
+PRIVATE size_t nf_frag_off(pack)
+acc_t *pack;
+{
+	ip_hdr_t *ip_hdr;
+
+	ip_hdr= (ip_hdr_t *)ptr2acc_data(pack);
+	return (ntohs(ip_hdr->ih_flags_fragoff) & IH_FRAGOFF_MASK) * 8;
+}
+
+/* byte offset just past a fragment's data */
+PRIVATE size_t nf_frag_end(pack)
+acc_t *pack;
+{
+	ip_hdr_t *ip_hdr;
+
+	ip_hdr= (ip_hdr_t *)ptr2acc_data(pack);
+	return nf_frag_off(pack) + ntohs(ip_hdr->ih_length) -
+		(ip_hdr->ih_vers_ihl & IH_IHL_MASK) * 4;
+}
+
+PRIVATE void nf_frag_buffree(priority)
+int priority;
+{
+	nf_frag_t *nr;
+
+	if (priority != NF_PRI_FRAGBUFS)
+		return;
+	for (nr= nf_frag_table; nr < &nf_frag_table[NF_FRAG_NR]; nr++)
+	{
+		if (nr->nr_state == NRS_HOLD)
+			nf_frag_free(nr, NRS_EMPTY, 0);
+	}
+}
+
+#ifdef BUF_CONSISTENCY_CHECK
+PRIVATE void nf_frag_bufcheck()
+{
+	nf_frag_t *nr;
+	acc_t *pack;
+
+	for (nr= nf_frag_table; nr < &nf_frag_table[NF_FRAG_NR]; nr++)
+	{
+		for (pack= nr->nr_frags; pack; pack= pack->acc_ext_link)
+			bf_check_acc(pack);
+	}
+}
+#endif
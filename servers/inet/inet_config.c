@@ -117,6 +117,7 @@ static void check_dev(int type, int ifno)
 		{	"/dev/tcp",	0666,	TCP_DEV_OFF	},
 		{	"/dev/udp",	0666,	UDP_DEV_OFF	},
 		{	"/dev/netfilter",0600,	NF_DEV_OFF	},
+		{	"/dev/nflog",	0600,	NF_LOG_DEV_OFF	},
 	};
 	struct devlist *dvp;
 	int i;
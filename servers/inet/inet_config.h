@@ -73,6 +73,7 @@ struct udp_conf
 #define TCP_DEV_OFF	2
 #define UDP_DEV_OFF	3
 #define NF_DEV_OFF	4
+#define NF_LOG_DEV_OFF	5
 
 extern struct eth_conf eth_conf[IP_PORT_MAX];
 extern struct psip_conf psip_conf[IP_PORT_MAX];
@@ -23,8 +23,14 @@ THIS_FILE
 
 FORWARD _PROTOTYPE( void setup_read, (eth_port_t *eth_port) );
 FORWARD _PROTOTYPE( void read_int, (eth_port_t *eth_port, int count) );
+FORWARD _PROTOTYPE( void read_ring_int, (eth_port_t *eth_port, int count) );
 FORWARD _PROTOTYPE( void eth_issue_send, (eth_port_t *eth_port) );
 FORWARD _PROTOTYPE( void write_int, (eth_port_t *eth_port) );
+FORWARD _PROTOTYPE( void eth_queue_send, (eth_port_t *eth_port,
+	acc_t *pack) );
+FORWARD _PROTOTYPE( void eth_tx_ev, (event_t *ev, ev_arg_t ev_arg) );
+FORWARD _PROTOTYPE( void eth_issue_ring_send, (eth_port_t *eth_port) );
+FORWARD _PROTOTYPE( void write_ring_int, (eth_port_t *eth_port) );
 FORWARD _PROTOTYPE( void eth_restart, (eth_port_t *eth_port,
 	endpoint_t endpoint) );
 FORWARD _PROTOTYPE( void send_getstat, (eth_port_t *eth_port) );
@@ -47,6 +53,15 @@ PUBLIC void osdep_eth_init()
 		for (j= 0; j<RD_IOVEC; j++)
 			eth_port->etp_osdep.etp_rd_iovec[j].iov_grant= -1;
 		eth_port->etp_osdep.etp_rd_vec_grant= -1;
+		eth_port->etp_osdep.etp_ring= NULL;
+		eth_port->etp_osdep.etp_ring_grant= -1;
+		eth_port->etp_osdep.etp_tx_ring= NULL;
+		eth_port->etp_osdep.etp_tx_ring_grant= -1;
+		eth_port->etp_osdep.etp_txq_head= NULL;
+		eth_port->etp_osdep.etp_txq_tail= NULL;
+		eth_port->etp_osdep.etp_txq_nr= 0;
+		eth_port->etp_osdep.etp_tx_sent= NULL;
+		ev_init(&eth_port->etp_osdep.etp_txev);
 
 		eth_port->etp_osdep.etp_state= OEPS_INIT;
 		eth_port->etp_osdep.etp_flags= OEPF_EMPTY;
@@ -92,6 +107,26 @@ PUBLIC void osdep_eth_init()
 		}
 		eth_port->etp_osdep.etp_rd_vec_grant= gid;
 
+		/* The receive ring is granted once the driver says it
+		 * supports one.
+		 */
+		if (cpf_getgrants(&gid, 1) != 1)
+		{
+			ip_panic((
+		"osdep_eth_init: cpf_getgrants failed: %d\n",
+				errno));
+		}
+		eth_port->etp_osdep.etp_ring_grant= gid;
+		eth_port->etp_osdep.etp_ring= alloc(sizeof(eth_ring_t));
+		if (cpf_getgrants(&gid, 1) != 1)
+		{
+			ip_panic((
+		"osdep_eth_init: cpf_getgrants failed: %d\n",
+				errno));
+		}
+		eth_port->etp_osdep.etp_tx_ring_grant= gid;
+		eth_port->etp_osdep.etp_tx_ring= alloc(sizeof(eth_ring_t));
+
 		eth_port->etp_osdep.etp_task= NONE;
 		eth_port->etp_osdep.etp_recvconf= 0;
 		ev_init(&eth_port->etp_osdep.etp_recvev);
@@ -164,6 +199,13 @@ acc_t *pack;
 	assert(!eth_port->etp_vlan);
 
 	assert(eth_port->etp_wr_pack == NULL);
+
+	if (eth_port->etp_osdep.etp_flags & OEPF_TXRING)
+	{
+		eth_queue_send(eth_port, pack);
+		return;
+	}
+
 	eth_port->etp_wr_pack= pack;
 
 	if (eth_port->etp_osdep.etp_state != OEPS_IDLE)
@@ -178,7 +220,7 @@ acc_t *pack;
 
 PUBLIC void eth_rec(message *m)
 {
-	int i, r, m_type, flags;
+	int i, r, m_type, flags, stat;
 	eth_port_t *loc_port, *vlan_port;
 
 	m_type= m->m_type;
@@ -219,11 +261,11 @@ PUBLIC void eth_rec(message *m)
 			return;
 		}
 
-		r= m->DL_STAT;
-		if (r < 0)
+		stat= m->DL_STAT;
+		if (stat < 0)
 		{
 			ip_warning(("eth_rec: DL_CONF returned error %d\n",
-				r));
+				stat));
 
 			/* Just leave it in limbo. Nothing more we can do. */
 			return;
@@ -231,6 +273,41 @@ PUBLIC void eth_rec(message *m)
 	
 		loc_port->etp_osdep.etp_flags &= ~OEPF_NEED_CONF;
 		loc_port->etp_osdep.etp_state= OEPS_IDLE;
+
+		/* Older drivers reply OK and only know DL_READV_S and
+		 * DL_WRITEV_S.
+		 */
+		loc_port->etp_osdep.etp_flags &= ~(OEPF_RING|OEPF_TXRING);
+		if (stat & DL_STAT_RING)
+		{
+			r= cpf_setgrant_direct(
+				loc_port->etp_osdep.etp_ring_grant,
+				loc_port->etp_osdep.etp_task,
+				(vir_bytes)loc_port->etp_osdep.etp_ring,
+				(vir_bytes)sizeof(eth_ring_t), CPF_WRITE);
+			if (r != 0)
+			{
+				ip_panic((
+			"eth_rec: cpf_setgrant_direct failed: %d\n",
+					errno));
+			}
+			loc_port->etp_osdep.etp_flags |= OEPF_RING;
+		}
+		if (stat & DL_STAT_TXRING)
+		{
+			r= cpf_setgrant_direct(
+				loc_port->etp_osdep.etp_tx_ring_grant,
+				loc_port->etp_osdep.etp_task,
+				(vir_bytes)loc_port->etp_osdep.etp_tx_ring,
+				(vir_bytes)sizeof(eth_ring_t), CPF_READ);
+			if (r != 0)
+			{
+				ip_panic((
+			"eth_rec: cpf_setgrant_direct failed: %d\n",
+					errno));
+			}
+			loc_port->etp_osdep.etp_flags |= OEPF_TXRING;
+		}
 		loc_port->etp_flags |= EPF_ENABLED;
 
 		loc_port->etp_ethaddr= *(ether_addr_t *)m->DL_HWADDR;
@@ -340,7 +417,7 @@ PUBLIC void eth_rec(message *m)
 		loc_port->etp_osdep.etp_flags & OEPF_NEED_SEND)
 	{
 		loc_port->etp_osdep.etp_flags &= ~OEPF_NEED_SEND;
-		if (loc_port->etp_wr_pack)
+		if (loc_port->etp_wr_pack || loc_port->etp_osdep.etp_txq_head)
 			eth_issue_send(loc_port);
 	}
 	if (loc_port->etp_osdep.etp_state == OEPS_IDLE &&
@@ -487,6 +564,12 @@ eth_port_t *eth_port;
 	iovec_s_t *iovec;
 	message m;
 
+	if (eth_port->etp_osdep.etp_flags & OEPF_TXRING)
+	{
+		eth_issue_ring_send(eth_port);
+		return;
+	}
+
 	iovec= eth_port->etp_osdep.etp_wr_iovec;
 	pack= eth_port->etp_wr_pack;
 	pack_size= 0;
@@ -558,12 +641,190 @@ eth_port_t *eth_port;
 	eth_port->etp_osdep.etp_state= OEPS_SEND_SENT;
 }
 
+/*
+eth_queue_send
+
+Queues a frame for the next DL_WRITERING_S. Frames written while one is
+pending pile up here and go out together. Once a ring's worth is
+waiting, the frame is held in etp_wr_pack, which makes eth_send block
+as it does for a single frame write.
+*/
+
+PRIVATE void eth_queue_send(eth_port, pack)
+eth_port_t *eth_port;
+acc_t *pack;
+{
+	ev_arg_t ev_arg;
+
+	if (eth_port->etp_osdep.etp_txq_nr >= ETH_RING_NR)
+	{
+		eth_port->etp_wr_pack= pack;
+		return;
+	}
+
+	pack->acc_ext_link= NULL;
+	if (eth_port->etp_osdep.etp_txq_head == NULL)
+		eth_port->etp_osdep.etp_txq_head= pack;
+	else
+		eth_port->etp_osdep.etp_txq_tail->acc_ext_link= pack;
+	eth_port->etp_osdep.etp_txq_tail= pack;
+	eth_port->etp_osdep.etp_txq_nr++;
+
+	/* Send from an event, so that everything written while handling
+	 * the current message goes in the same request.
+	 */
+	if (!ev_in_queue(&eth_port->etp_osdep.etp_txev))
+	{
+		ev_arg.ev_ptr= eth_port;
+		ev_enqueue(&eth_port->etp_osdep.etp_txev, eth_tx_ev, ev_arg);
+	}
+}
+
+PRIVATE void eth_tx_ev(ev, ev_arg)
+event_t *ev;
+ev_arg_t ev_arg;
+{
+	eth_port_t *eth_port;
+
+	eth_port= ev_arg.ev_ptr;
+	assert(ev == &eth_port->etp_osdep.etp_txev);
+
+	if (eth_port->etp_osdep.etp_state != OEPS_IDLE)
+	{
+		eth_port->etp_osdep.etp_flags |= OEPF_NEED_SEND;
+		return;
+	}
+	if (eth_port->etp_wr_pack || eth_port->etp_osdep.etp_txq_head)
+		eth_issue_send(eth_port);
+}
+
+PRIVATE void eth_issue_ring_send(eth_port)
+eth_port_t *eth_port;
+{
+	eth_ring_t *ring;
+	acc_t *pack, *pack_ptr;
+	u8_t *data;
+	int i, r, pack_size;
+	message m;
+
+	/* The driver still has the ring */
+	if (eth_port->etp_osdep.etp_tx_sent)
+		return;
+
+	/* A frame held back while the queue was full, or written before
+	 * the driver said it takes rings, joins the queue. Unless it is a
+	 * local loopback that eth_loop_ev has yet to deliver.
+	 */
+	if (eth_port->etp_wr_pack &&
+		!ev_in_queue(&eth_port->etp_sendev))
+	{
+		pack= eth_port->etp_wr_pack;
+		eth_port->etp_wr_pack= NULL;
+		eth_queue_send(eth_port, pack);
+		if (!eth_port->etp_wr_pack)
+			eth_restart_write(eth_port);
+	}
+
+	pack= eth_port->etp_osdep.etp_txq_head;
+	if (pack == NULL)
+		return;
+
+	ring= eth_port->etp_osdep.etp_tx_ring;
+	for (i= 0; pack; i++, pack= pack->acc_ext_link)
+	{
+		assert(i < ETH_RING_NR);
+		data= ring->er_data[i];
+		pack_size= 0;
+		for (pack_ptr= pack; pack_ptr; pack_ptr= pack_ptr->acc_next)
+		{
+			assert(pack_size + pack_ptr->acc_length <=
+				ETH_RING_SLOT);
+			memcpy(data, ptr2acc_data(pack_ptr),
+				pack_ptr->acc_length);
+			data += pack_ptr->acc_length;
+			pack_size += pack_ptr->acc_length;
+		}
+		assert (pack_size >= ETH_MIN_PACK_SIZE);
+		ring->er_len[i]= pack_size;
+	}
+
+	m.m_type= DL_WRITERING_S;
+	m.DL_COUNT= i;
+	m.DL_GRANT= eth_port->etp_osdep.etp_tx_ring_grant;
+
+	assert(eth_port->etp_osdep.etp_state == OEPS_IDLE);
+	r= asynsend(eth_port->etp_osdep.etp_task, &m);
+
+	if (r < 0)
+	{
+		printf("eth_issue_ring_send: send to %d failed: %d\n",
+			eth_port->etp_osdep.etp_task, r);
+		return;
+	}
+	eth_port->etp_osdep.etp_tx_sent= eth_port->etp_osdep.etp_txq_head;
+	eth_port->etp_osdep.etp_txq_head= NULL;
+	eth_port->etp_osdep.etp_txq_tail= NULL;
+	eth_port->etp_osdep.etp_txq_nr= 0;
+	eth_port->etp_osdep.etp_state= OEPS_SEND_SENT;
+}
+
+PRIVATE void write_ring_int(eth_port)
+eth_port_t *eth_port;
+{
+	acc_t *pack, *next;
+	int multicast;
+	u8_t *eth_dst_ptr;
+	ev_arg_t ev_arg;
+
+	pack= eth_port->etp_osdep.etp_tx_sent;
+	if (pack == NULL)
+	{
+		printf("write_ring_int: strange no packets on eth port %d\n",
+			(int)(eth_port-eth_port_table));
+		return;
+	}
+	eth_port->etp_osdep.etp_tx_sent= NULL;
+
+	for (; pack; pack= next)
+	{
+		next= pack->acc_ext_link;
+
+		eth_dst_ptr= (u8_t *)ptr2acc_data(pack);
+		multicast= (*eth_dst_ptr & 1);
+		if (multicast ||
+			(eth_port->etp_osdep.etp_recvconf & NWEO_EN_PROMISC))
+		{
+			assert(!no_ethWritePort);
+			no_ethWritePort= 1;
+			eth_arrive(eth_port, pack, bf_bufsize(pack));
+			assert(no_ethWritePort);
+			no_ethWritePort= 0;
+		}
+		else
+			bf_afree(pack);
+	}
+
+	/* Whatever queued up meanwhile goes next */
+	if ((eth_port->etp_osdep.etp_txq_head || eth_port->etp_wr_pack) &&
+		!ev_in_queue(&eth_port->etp_osdep.etp_txev))
+	{
+		ev_arg.ev_ptr= eth_port;
+		ev_enqueue(&eth_port->etp_osdep.etp_txev, eth_tx_ev, ev_arg);
+	}
+}
+
 PRIVATE void write_int(eth_port_t *eth_port)
 {
 	acc_t *pack;
 	int multicast;
 	u8_t *eth_dst_ptr;
 
+	if (eth_port->etp_osdep.etp_flags & OEPF_TXRING)
+	{
+		write_ring_int(eth_port);
+		return;
+	}
+
 	pack= eth_port->etp_wr_pack;
 	if (pack == NULL)
 	{
@@ -608,6 +869,12 @@ int count;
 		return;
 	}
 
+	if (eth_port->etp_osdep.etp_flags & OEPF_RING)
+	{
+		read_ring_int(eth_port, count);
+		return;
+	}
+
 	pack= eth_port->etp_rd_pack;
 	eth_port->etp_rd_pack= NULL;
 
@@ -655,6 +922,71 @@ int count;
 	setup_read(eth_port);
 }
 
+/*
+read_ring_int
+
+Hands the frames of a DL_READRING_S reply to eth_arrive. The ring is only
+read between the reply and the next request, each frame is copied into
+an accessor first so that the driver cannot change it under us. IP
+queues its frames and filters them as one burst, see ip_eth_arrived.
+*/
+
+PRIVATE void read_ring_int(eth_port, count)
+eth_port_t *eth_port;
+int count;
+{
+	eth_ring_t *ring;
+	acc_t *pack, *pack_ptr;
+	u8_t *data;
+	int i, len;
+
+	ring= eth_port->etp_osdep.etp_ring;
+
+	if (count < 0 || count > ETH_RING_NR)
+	{
+		printf("mnx_eth`read_ring_int: bad frame count (%d)\n",
+			count);
+		count= 0;
+	}
+
+	for (i= 0; i<count; i++)
+	{
+		len= ring->er_len[i];
+		if (len < ETH_MIN_PACK_SIZE)
+		{
+			printf(
+			"mnx_eth`read_ring_int: packet size too small (%d)\n",
+				len);
+			continue;
+		}
+		if (len > ETH_MAX_PACK_SIZE_TAGGED)
+		{
+			printf(
+			"mnx_eth`read_ring_int: packet size too big (%d)\n",
+				len);
+			continue;
+		}
+
+		pack= bf_memreq(len);
+		data= ring->er_data[i];
+		for (pack_ptr= pack; pack_ptr; pack_ptr= pack_ptr->acc_next)
+		{
+			memcpy(ptr2acc_data(pack_ptr), data,
+				pack_ptr->acc_length);
+			data += pack_ptr->acc_length;
+		}
+
+		assert(!no_ethWritePort);
+		no_ethWritePort= 1;
+		eth_arrive(eth_port, pack, len);
+		assert(no_ethWritePort);
+		no_ethWritePort= 0;
+	}
+
+	eth_port->etp_flags &= ~(EPF_READ_IP|EPF_READ_SP);
+	setup_read(eth_port);
+}
+
 PRIVATE void setup_read(eth_port)
 eth_port_t *eth_port;
 {
@@ -675,6 +1007,18 @@ eth_port_t *eth_port;
 
 	assert (!eth_port->etp_rd_pack);
 
+	/* With a ring there is nothing to set up, the grant stays valid
+	 * as long as the driver does.
+	 */
+	if (eth_port->etp_osdep.etp_flags & OEPF_RING)
+	{
+		mess.m_type= DL_READRING_S;
+		mess.DL_COUNT= ETH_RING_NR;
+		mess.DL_GRANT= eth_port->etp_osdep.etp_ring_grant;
+		pack= NULL;
+		goto send;
+	}
+
 	iovec= eth_port->etp_osdep.etp_rd_iovec;
 	pack= bf_memreq (ETH_MAX_PACK_SIZE_TAGGED);
 
@@ -712,6 +1056,7 @@ eth_port_t *eth_port;
 	mess.DL_COUNT= i;
 	mess.DL_GRANT= eth_port->etp_osdep.etp_rd_vec_grant;
 
+send:
 	assert(eth_port->etp_osdep.etp_state == OEPS_IDLE);
 
 	r= asynsend(eth_port->etp_osdep.etp_task, &mess);
@@ -734,6 +1079,7 @@ static void eth_restart(eth_port_t *eth_port, endpoint_t endpoint)
 	unsigned flags, dl_flags;
 	cp_grant_id_t gid;
 	message mess;
+	acc_t *pack, *next;
 
 	eth_port->etp_osdep.etp_task= endpoint;
 
@@ -798,6 +1144,25 @@ static void eth_restart(eth_port_t *eth_port, endpoint_t endpoint)
 	}
 	eth_port->etp_osdep.etp_state= OEPS_CONF_SENT;
 
+	/* Queued and pending ring frames are lost like etp_wr_pack. Until
+	 * the new driver says otherwise, send one frame at a time.
+	 */
+	eth_port->etp_osdep.etp_flags &= ~OEPF_TXRING;
+	for (pack= eth_port->etp_osdep.etp_tx_sent; pack; pack= next)
+	{
+		next= pack->acc_ext_link;
+		bf_afree(pack);
+	}
+	for (pack= eth_port->etp_osdep.etp_txq_head; pack; pack= next)
+	{
+		next= pack->acc_ext_link;
+		bf_afree(pack);
+	}
+	eth_port->etp_osdep.etp_tx_sent= NULL;
+	eth_port->etp_osdep.etp_txq_head= NULL;
+	eth_port->etp_osdep.etp_txq_tail= NULL;
+	eth_port->etp_osdep.etp_txq_nr= 0;
+
 	if (eth_port->etp_wr_pack)
 	{
 		bf_afree(eth_port->etp_wr_pack);
@@ -808,8 +1173,9 @@ static void eth_restart(eth_port_t *eth_port, endpoint_t endpoint)
 	{
 		bf_afree(eth_port->etp_rd_pack);
 		eth_port->etp_rd_pack= NULL;
-		eth_port->etp_flags &= ~(EPF_READ_IP|EPF_READ_SP);
 	}
+	/* A ring read has no packet to free */
+	eth_port->etp_flags &= ~(EPF_READ_IP|EPF_READ_SP);
 
 }
 
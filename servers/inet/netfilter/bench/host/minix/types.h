@@ -0,0 +1,2 @@
+/* Host build of the netfilter, see sys/types.h */
+#include <sys/types.h>
@@ -0,0 +1,13 @@
+/* Host build of the netfilter: the resolver functions of <net/gen/inet.h>,
+ * which the system's C library has under the same names.
+ */
+#ifndef NFBENCH_NET_GEN_INET_H
+#define NFBENCH_NET_GEN_INET_H
+
+#include <net/gen/in.h>
+
+ipaddr_t inet_addr(const char *addr);
+char *inet_ntoa(ipaddr_t addr);
+int inet_aton(const char *cp, ipaddr_t *pin);
+
+#endif
@@ -0,0 +1,15 @@
+/* Host build of the netfilter: byte order conversion. The system's
+ * <arpa/inet.h> would pull in its <netinet/in.h>, which clashes with
+ * <net/gen/in.h>.
+ */
+#ifndef NFBENCH_NET_HTON_H
+#define NFBENCH_NET_HTON_H
+
+#include <endian.h>
+
+#define htons(x)	((u16_t)htobe16(x))
+#define ntohs(x)	((u16_t)be16toh(x))
+#define htonl(x)	((u32_t)htobe32(x))
+#define ntohl(x)	((u32_t)be32toh(x))
+
+#endif
@@ -0,0 +1,18 @@
+/* Host build of the netfilter: the little of <netinet/in.h> it uses,
+ * on top of <net/gen/in.h> like on MINIX.
+ */
+#ifndef NFBENCH_NETINET_IN_H
+#define NFBENCH_NETINET_IN_H
+
+#include <sys/types.h>
+#include <net/hton.h>
+#include <net/gen/in.h>
+
+typedef u32_t in_addr_t;
+typedef u16_t in_port_t;
+
+struct in_addr {
+	in_addr_t s_addr;
+};
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Host build of the netfilter: the system's types plus the fixed size
+ * integer types MINIX adds to them.
+ */
+#ifndef NFBENCH_SYS_TYPES_H
+#define NFBENCH_SYS_TYPES_H
+
+#include_next <sys/types.h>
+#include <stdint.h>
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef uint64_t u64_t;
+typedef int8_t i8_t;
+typedef int16_t i16_t;
+typedef int32_t i32_t;
+typedef int64_t i64_t;
+
+/* as on MINIX, where <sys/types.h> brings <sys/endian.h> */
+#include <net/hton.h>
+
+#endif
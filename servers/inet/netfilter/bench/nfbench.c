@@ -0,0 +1,683 @@
+/*
+ *  MINIX-3 network filter - offline replay benchmark
+ *
+ *  Runs the rule engine of inet on the development host: nfcore.c and
+ *  the match and target modules are linked in as they are, the rules
+ *  are loaded from a file in the iptables-restore format and packets
+ *  from a pcap file or a synthetic traffic mix are run through
+ *  inetProcessBatch() at each hook given, in bursts like nf_hook_batch
+ *  hands them over. Reported are packets per second, nanoseconds and
+ *  allocations per packet and how the packets were decided:
+ *
+ *      nfbench -r rules.txt -c trace.pcap -H PREROUTING,INPUT
+ *      nfbench -r rules.txt -n 1000000 -f 5000 -m tcp=70,udp=25,icmp=5
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <nfdefs.h>
+#include <nfcore.h>
+#include <nfblob.h>
+#include <nfconntrack.h>
+#include <nflog.h>
+#include <nfnat.h>
+#include <nfrate.h>
+#include <nfsynproxy.h>
+#include <net/gen/in.h>
+#include <net/gen/inet.h>
+#include <net/gen/ip_hdr.h>
+#include "../iptables/iptparse.h"
+
+#define MAX_CHAINS 16
+#define MAX_ARGS 64
+#define MAX_LINE 1024
+#define MAX_PACKSIZE 1500
+#define MAX_LOCAL 64
+
+/* a packet to replay, data is the IP header */
+struct benchPkt {
+  unsigned char *data;
+  int len;
+  unsigned long usec;            /* arrival, from the start of the run */
+};
+
+static struct benchPkt *pkts;
+static int npkts, maxpkts;
+
+static int hooks[NF_IP_NUMHOOKS];
+static int nhooks;
+static char *ifin="eth0";
+static char *ifout="eth1";
+
+/* allocations while counting is set, see the --wrap options in Makefile */
+static int counting;
+static unsigned long allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+  if (counting) allocs++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+  if (counting) allocs++;
+  return __real_calloc(n,size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+  if (counting) allocs++;
+  return __real_realloc(p,size);
+}
+
+void printHelp( void )
+{
+   printf("nfbench: -r <rules> [-c <pcap>] [opts]\n");
+   printf("\n");
+   printf("          options: -r <file>           rules as for iptables-restore\n");
+   printf("                   -c <file>           replay a pcap file (ethernet,\n");
+   printf("                                       raw IP or linux cooked)\n");
+   printf("                   -n <n>              synthetic packets (def: 100000)\n");
+   printf("                   -f <n>              synthetic flows (def: 1000)\n");
+   printf("                   -m tcp=a,udp=b,icmp=c  synthetic mix in percent\n");
+   printf("                                       (def: tcp=80,udp=15,icmp=5)\n");
+   printf("                   -p <pps>            synthetic packet rate, for the\n");
+   printf("                                       clock of limits and timeouts\n");
+   printf("                                       (def: 100000)\n");
+   printf("                   -H <hook,..>        hooks in the order a packet\n");
+   printf("                                       passes them (def: PREROUTING,INPUT)\n");
+   printf("                   -i <if> -o <if>     interfaces (def: eth0, eth1)\n");
+   printf("                   -l <ipaddr>         register a local address\n");
+   printf("                   -b <n>              packets per burst (def: %d)\n",
+          NF_BATCH_MAX);
+   printf("                   -R <n>              replay the packets n times\n");
+}
+
+/*******************************************************************
+ * loading the rules                                               *
+ *******************************************************************/
+
+/* a rule and the chain it is appended to, as in iptables-restore */
+struct loadRule {
+  int chain;
+  struct nf_blob_rule rule;
+};
+
+static int table;
+static struct nf_blob_chain chains[MAX_CHAINS];
+static int nchains;
+static struct loadRule *rules;
+static int nrules, maxrules;
+static int lineno;
+
+void lineError(char *msg, char *arg)
+{
+  printf("line %d: %s%s\n",lineno,msg,arg);
+  exit(2);
+}
+
+/* splits a line into words, "quoted strings" are kept together */
+int splitLine(char *line, char **argv, int max)
+{
+  int argc=0;
+
+  argv[argc++]="iptables";
+  while (*line)
+  {
+    while ((*line==' ') || (*line=='\t')) line++;
+    if (*line=='\0') break;
+    if (argc==max-1) lineError("too many arguments","");
+    if (*line=='"')
+    {
+      argv[argc++]=++line;
+      while (*line && (*line!='"')) line++;
+      if (*line=='\0') lineError("missing quote","");
+    }
+    else
+    {
+      argv[argc++]=line;
+      while (*line && (*line!=' ') && (*line!='\t')) line++;
+    }
+    if (*line) *line++='\0';
+  }
+  argv[argc]=NULL;
+  return argc;
+}
+
+int findChain(char *name)
+{
+  int i;
+
+  for (i=0;i<nchains;i++)
+  {
+    if (strcmp(chains[i].name,name)==0) return i;
+  }
+  return -1;
+}
+
+void addChain(int argc, char **argv)
+{
+  struct nf_blob_chain *chain;
+
+  if ((argc<3) || (strlen(argv[1])<2)) lineError("bad chain line","");
+  if (findChain(argv[1]+1)>=0) lineError("chain listed twice: ",argv[1]+1);
+  if (nchains==MAX_CHAINS) lineError("too many chains","");
+
+  chain=&chains[nchains++];
+  memset(chain,0,sizeof(*chain));
+  strncpy(chain->name,argv[1]+1,31);
+  if (strcmp(argv[2],"ACCEPT")==0) chain->policy=NF_ACCEPT;
+  else if (strcmp(argv[2],"DROP")==0) chain->policy=NF_DROP;
+  else if (strcmp(argv[2],"-")==0) chain->policy=-1;
+  else lineError("unknown policy: ",argv[2]);
+}
+
+void addRule(int argc, char **argv)
+{
+  struct ipt_cmd cmd;
+  struct loadRule *r;
+  int chain;
+
+  parseArgs(argc,argv,&cmd);
+  if (cmd.action!=A_APPEND) lineError("only -A is allowed here","");
+  chain=findChain(cmd.chain);
+  if (chain<0) lineError("chain not declared: ",cmd.chain);
+  if (strlen(cmd.target)==0) lineError("no target","");
+
+  if (nrules==maxrules)
+  {
+    maxrules=maxrules ? 2*maxrules : 32;
+    rules=(struct loadRule*)realloc(rules,maxrules*sizeof(struct loadRule));
+    if (rules==NULL)
+    {
+      printf("out of memory\n");
+      exit(3);
+    }
+  }
+  r=&rules[nrules++];
+  memset(r,0,sizeof(*r));
+  r->chain=chain;
+  r->rule.ip=cmd.ip;
+  strcpy(r->rule.match,cmd.match);
+  strcpy(r->rule.target,cmd.target);
+  memcpy(r->rule.matchinfo,&cmd.matchinfo,cmd.matchinfosize);
+  memcpy(r->rule.targinfo,&cmd.targinfo,sizeof(cmd.targinfo));
+}
+
+/* packs the table into a blob and hands it to the core like nf_stream */
+void commitTable( void )
+{
+  struct nf_blob_hdr *hdr;
+  struct nf_blob_chain *chain;
+  unsigned char *blob, *p;
+  size_t size, off, n;
+  int c, i, r;
+
+  if (!table) lineError("COMMIT outside of a table","");
+  size=sizeof(struct nf_blob_hdr)+nchains*sizeof(struct nf_blob_chain)+
+       nrules*sizeof(struct nf_blob_rule);
+  if (size>NF_BLOB_MAXSIZE) lineError("too many rules in table","");
+  blob=(unsigned char*)malloc(size);
+  if (blob==NULL)
+  {
+    printf("out of memory\n");
+    exit(3);
+  }
+
+  hdr=(struct nf_blob_hdr*)blob;
+  hdr->magic=NF_BLOB_MAGIC;
+  hdr->version=NF_BLOB_VERSION;
+  hdr->size=size;
+  hdr->table=table;
+  hdr->nchains=nchains;
+  p=blob+sizeof(struct nf_blob_hdr);
+  for (c=0;c<nchains;c++)
+  {
+    chain=(struct nf_blob_chain*)p;
+    memcpy(chain,&chains[c],sizeof(struct nf_blob_chain));
+    chain->nrules=0;
+    p+=sizeof(struct nf_blob_chain);
+    for (i=0;i<nrules;i++)
+    {
+      if (rules[i].chain!=c) continue;
+      memcpy(p,&rules[i].rule,sizeof(struct nf_blob_rule));
+      p+=sizeof(struct nf_blob_rule);
+      chain->nrules++;
+    }
+  }
+
+  r=1;
+  for (off=0;(off<size) && (r==1);off+=n)
+  {
+    n=size-off;
+    if (n>NF_BLOB_CHUNK) n=NF_BLOB_CHUNK;
+    r=iptablesRestore(blob+off,n);
+  }
+  if (r!=0) lineError("table rejected by netfilter","");
+  free(blob);
+  table=0;
+}
+
+void loadRules(char *name)
+{
+  FILE *in;
+  char line[MAX_LINE];
+  char *args[MAX_ARGS];
+  int n;
+
+  if ((in=fopen(name,"r"))==NULL)
+  {
+    printf("could not open %s\n",name);
+    exit(1);
+  }
+  while (fgets(line,MAX_LINE,in)!=NULL)
+  {
+    lineno++;
+    n=strlen(line);
+    while ((n>0) && ((line[n-1]=='\n') || (line[n-1]=='\r'))) line[--n]='\0';
+    if ((n==0) || (line[0]=='#')) continue;
+
+    if (line[0]=='*')
+    {
+      if (table) lineError("COMMIT missing before table ",line+1);
+      if (strcmp(line+1,"filter")==0) table=NF_TABLE_FILTER;
+      else if (strcmp(line+1,"nat")==0) table=NF_TABLE_NAT;
+      else if (strcmp(line+1,"mangle")==0) table=NF_TABLE_MANGLE;
+      else lineError("no such table: ",line+1);
+      nchains=0;
+      nrules=0;
+      continue;
+    }
+    if (strcmp(line,"COMMIT")==0) { commitTable(); continue; }
+    if (!table) lineError("rule outside of a table","");
+    n=splitLine(line,args,MAX_ARGS);
+    if (line[0]==':') addChain(n,args);
+    else addRule(n,args);
+  }
+  if (table) lineError("COMMIT missing at end of input","");
+  fclose(in);
+}
+
+/*******************************************************************
+ * traffic                                                         *
+ *******************************************************************/
+
+void addPacket(const unsigned char *data, int len, unsigned long usec)
+{
+  struct benchPkt *p;
+
+  if (npkts==maxpkts)
+  {
+    maxpkts=maxpkts ? 2*maxpkts : 1024;
+    pkts=(struct benchPkt*)realloc(pkts,maxpkts*sizeof(struct benchPkt));
+    if (pkts==NULL)
+    {
+      printf("out of memory\n");
+      exit(3);
+    }
+  }
+  p=&pkts[npkts++];
+  p->data=(unsigned char*)malloc(len);
+  if (p->data==NULL)
+  {
+    printf("out of memory\n");
+    exit(3);
+  }
+  memcpy(p->data,data,len);
+  p->len=len;
+  p->usec=usec;
+}
+
+static u32_t rd32(const unsigned char *p, int swap)
+{
+  return swap ? (u32_t)p[0]<<24 | p[1]<<16 | p[2]<<8 | p[3]
+              : (u32_t)p[3]<<24 | p[2]<<16 | p[1]<<8 | p[0];
+}
+
+/* reads the IPv4 packets of a pcap file, others are skipped */
+void loadPcap(char *name)
+{
+  FILE *in;
+  unsigned char hdr[24], rec[16];
+  unsigned char *buf;
+  u32_t magic, link, caplen, sec, frac, first=0;
+  unsigned long usec;
+  int swap, nsec, off, type, skipped=0;
+
+  if ((in=fopen(name,"rb"))==NULL)
+  {
+    printf("could not open %s\n",name);
+    exit(1);
+  }
+  if (fread(hdr,sizeof(hdr),1,in)!=1)
+  {
+    printf("%s: not a pcap file\n",name);
+    exit(2);
+  }
+  magic=rd32(hdr,0);
+  swap=(magic==0xd4c3b2a1) || (magic==0x4d3cb2a1);
+  nsec=(magic==0xa1b23c4d) || (magic==0x4d3cb2a1);
+  if (!swap && (magic!=0xa1b2c3d4) && !nsec)
+  {
+    printf("%s: not a pcap file\n",name);
+    exit(2);
+  }
+  link=rd32(hdr+20,swap);
+  if ((link!=1) && (link!=101) && (link!=228) && (link!=113))
+  {
+    printf("%s: link type %lu not supported\n",name,(unsigned long)link);
+    exit(2);
+  }
+  buf=(unsigned char*)malloc(65536);
+  while (fread(rec,sizeof(rec),1,in)==1)
+  {
+    sec=rd32(rec,swap);
+    frac=rd32(rec+4,swap);
+    caplen=rd32(rec+8,swap);
+    if ((caplen>65536) || (fread(buf,caplen,1,in)!=1)) break;
+    if (npkts==0 && skipped==0) first=sec;
+    usec=(sec-first)*1000000UL+(nsec ? frac/1000 : frac);
+
+    /* find the IP header */
+    off=0;
+    type=0x0800;
+    if (link==1)
+    {
+      off=14;
+      type=caplen>=14 ? buf[12]<<8 | buf[13] : 0;
+      if ((type==0x8100) && (caplen>=18)) { off=18; type=buf[16]<<8 | buf[17]; }
+    }
+    else if (link==113)
+    {
+      off=16;
+      type=caplen>=16 ? buf[14]<<8 | buf[15] : 0;
+    }
+    if ((type!=0x0800) || ((int)caplen<off+IP_MIN_HDR_SIZE) ||
+        ((buf[off]>>4)!=4))
+    {
+      skipped++;
+      continue;
+    }
+    addPacket(buf+off,caplen-off,usec);
+  }
+  free(buf);
+  fclose(in);
+  if (skipped) printf("%s: %d packets that are not IPv4 skipped\n",name,skipped);
+}
+
+static u32_t seed=1;
+
+static u32_t rnd( void )
+{
+  seed=seed*1103515245+12345;
+  return seed>>8;
+}
+
+/* builds count packets of flows flows, the first of a TCP flow is a SYN */
+void makeTraffic(int count, int flows, int tcp, int udp, unsigned long pps)
+{
+  unsigned char pkt[MAX_PACKSIZE];
+  ip_hdr_t *iph=(ip_hdr_t*)pkt;
+  unsigned char *l4=pkt+IP_MIN_HDR_SIZE;
+  unsigned char *seen;
+  int i, f, kind, len;
+
+  seen=(unsigned char*)calloc(flows,1);
+  for (i=0; i<count; i++)
+  {
+    f=rnd()%flows;
+    kind=(f*7919)%100;
+    kind=kind<tcp ? IPPROTO_TCP : kind<tcp+udp ? IPPROTO_UDP : IPPROTO_ICMP;
+    len=IP_MIN_HDR_SIZE+20+rnd()%(MAX_PACKSIZE-IP_MIN_HDR_SIZE-20);
+
+    memset(pkt,0,IP_MIN_HDR_SIZE+20);
+    iph->ih_vers_ihl=0x45;
+    iph->ih_length=htons(len);
+    iph->ih_ttl=64;
+    iph->ih_proto=kind;
+    iph->ih_src=htonl(0x0a000000 | f);                /* 10.x.x.x    */
+    iph->ih_dst=htonl(0xc0a80000 | (f*13)%65536);     /* 192.168.x.x */
+    if (kind==IPPROTO_ICMP)
+      l4[0]=8;                                        /* echo request */
+    else
+    {
+      l4[0]=(1024+f%60000)>>8;
+      l4[1]=(1024+f%60000)&0xff;
+      l4[2]=0;
+      l4[3]=(f%4==0) ? 22 : (f%4==1) ? 80 : (f%4==2) ? 443 : 53;
+      if (kind==IPPROTO_TCP)
+      {
+        l4[12]=0x50;
+        l4[13]=seen[f] ? 0x10 : 0x02;                 /* ACK : SYN   */
+      }
+    }
+    seen[f]=1;
+    addPacket(pkt,len,(unsigned long)((double)i*1000000.0/pps));
+  }
+  free(seen);
+}
+
+/*******************************************************************
+ * replay                                                          *
+ *******************************************************************/
+
+int hookNumber(char *name)
+{
+  if (strcmp(name,"PREROUTING")==0) return NF_IP_PRE_ROUTING;
+  if (strcmp(name,"INPUT")==0) return NF_IP_LOCAL_IN;
+  if (strcmp(name,"FORWARD")==0) return NF_IP_FORWARD;
+  if (strcmp(name,"POSTROUTING")==0) return NF_IP_POST_ROUTING;
+  if (strcmp(name,"OUTPUT")==0) return NF_IP_LOCAL_OUT;
+  printf("no such hook: %s\n",name);
+  exit(2);
+}
+
+static double now( void )
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+int main (int argc, char **argv)
+{
+  static struct nf_batchctx ctx;
+  struct nf_packet batch[NF_BATCH_MAX];
+  int verdicts[NF_BATCH_MAX];
+  int index[NF_BATCH_MAX];
+  int final[NF_BATCH_MAX];
+  unsigned char *work[NF_BATCH_MAX];
+  unsigned long hist[NF_MAX_VERDICT+2];
+  static const char *vname[]={"DROP","ACCEPT","STOLEN","QUEUE","REPEAT",
+                              "other"};
+  char *rulefile=NULL, *pcapfile=NULL, *p;
+  int count=100000, flows=1000, tcp=80, udp=15, icmp=5;
+  unsigned long pps=100000, usec, base, passes;
+  int burst=NF_BATCH_MAX, reps=1;
+  ipaddr_t local[MAX_LOCAL];
+  int a, b, c, d;
+  int nlocal=0;
+  int i, j, h, n, first, rep;
+  double elapsed, t;
+
+  for (i=1;i<argc;i++)
+  {
+    if ((argv[i][0]!='-') || (strlen(argv[i])!=2) || (i+1==argc))
+    {
+      printHelp();
+      exit(1);
+    }
+    p=argv[++i];
+    switch (argv[i-1][1])
+    {
+      case 'r': rulefile=p; break;
+      case 'c': pcapfile=p; break;
+      case 'n': count=atoi(p); break;
+      case 'f': flows=atoi(p); break;
+      case 'p': pps=strtoul(p,NULL,10); break;
+      case 'i': ifin=p; break;
+      case 'o': ifout=p; break;
+      case 'b': burst=atoi(p); break;
+      case 'R': reps=atoi(p); break;
+      case 'm':
+        if (sscanf(p,"tcp=%d,udp=%d,icmp=%d",&tcp,&udp,&icmp)!=3 ||
+            (tcp<0) || (udp<0) || (icmp<0) || (tcp+udp+icmp!=100))
+        {
+          printf("invalid mix: %s\n",p);
+          exit(2);
+        }
+        break;
+      case 'H':
+        nhooks=0;
+        for (p=strtok(p,","); p!=NULL; p=strtok(NULL,","))
+        {
+          if (nhooks==NF_IP_NUMHOOKS) { printf("too many hooks\n"); exit(2); }
+          hooks[nhooks++]=hookNumber(p);
+        }
+        break;
+      case 'l':
+        if ((nlocal==MAX_LOCAL) ||
+            (sscanf(p,"%d.%d.%d.%d",&a,&b,&c,&d)!=4))
+        {
+          printf("invalid or too many local addresses: %s\n",p);
+          exit(2);
+        }
+        local[nlocal++]=htonl(((u32_t)a<<24)|(b<<16)|(c<<8)|d);
+        break;
+      default:
+        printHelp();
+        exit(1);
+    }
+  }
+  if ((rulefile==NULL) || (count<=0) || (flows<=0) || (pps==0) ||
+      (burst<=0) || (burst>NF_BATCH_MAX) || (reps<=0))
+  {
+    printHelp();
+    exit(1);
+  }
+  if (nhooks==0)
+  {
+    hooks[nhooks++]=NF_IP_PRE_ROUTING;
+    hooks[nhooks++]=NF_IP_LOCAL_IN;
+  }
+
+  nfCoreInit();
+  nfLogInit(NULL);
+  nfSynproxyInit(NULL,NULL,0);
+  for (i=0;i<nlocal;i++)
+    inetRegisterLocalIP(local[i]);
+  loadRules(rulefile);
+  if (pcapfile) loadPcap(pcapfile);
+  else makeTraffic(count,flows,tcp,udp,pps);
+  if (npkts==0)
+  {
+    printf("no packets to replay\n");
+    exit(2);
+  }
+  for (i=0;i<burst;i++) work[i]=(unsigned char*)malloc(65536);
+
+  memset(hist,0,sizeof(hist));
+  elapsed=0;
+  passes=0;
+  allocs=0;
+  base=0;
+  for (rep=0;rep<reps;rep++)
+  {
+    for (first=0;first<npkts;first+=burst)
+    {
+      n=npkts-first < burst ? npkts-first : burst;
+
+      /* the targets may rewrite the packets, each run gets a copy */
+      for (i=0;i<n;i++)
+      {
+        memcpy(work[i],pkts[first+i].data,pkts[first+i].len);
+        final[i]=NF_ACCEPT;
+      }
+
+      /* the clock nf_hook_batch sets, from the time of the first packet */
+      usec=base+pkts[first].usec;
+      nfConntrackSetTime(usec/1000000);
+      nfLogSetTime(usec/1000000,usec%1000000);
+      nfNatSetTime(usec/1000000);
+      nfRateSetTime(usec/1000);
+      nfSynproxySetTime(usec/1000000);
+
+      for (h=0;h<nhooks;h++)
+      {
+        /* only the packets the hooks before accepted go on */
+        for (i=0,j=0;i<n;i++)
+        {
+          if (final[i]!=NF_ACCEPT) continue;
+          batch[j].mac=NULL;
+          batch[j].data=(char*)work[i];
+          batch[j].hdrlen=pkts[first+i].len;
+          batch[j].packsize=pkts[first+i].len;
+          index[j++]=i;
+        }
+        if (j==0) break;
+
+        counting=1;
+        t=now();
+        inetProcessBatch(&ctx,hooks[h],
+                         (hooks[h]==NF_IP_LOCAL_OUT) ? NULL : ifin,
+                         (hooks[h]==NF_IP_PRE_ROUTING) ||
+                         (hooks[h]==NF_IP_LOCAL_IN) ? NULL : ifout,
+                         batch,j,verdicts);
+        elapsed+=now()-t;
+        counting=0;
+        passes+=j;
+        for (i=0;i<j;i++) final[index[i]]=verdicts[i];
+      }
+      /* nobody sends what SYNPROXY answers */
+      while (nfSynproxyPeek()!=NULL) nfSynproxyConsume();
+      for (i=0;i<n;i++)
+      {
+        /* queued packets are counted whatever queue they went to */
+        if ((final[i] & NF_VERDICT_MASK) == NF_QUEUE) hist[NF_QUEUE]++;
+        else if ((final[i]>=0) && (final[i]<=NF_MAX_VERDICT)) hist[final[i]]++;
+        else hist[NF_MAX_VERDICT+1]++;
+      }
+    }
+    base+=pkts[npkts-1].usec+1;
+  }
+
+  n=npkts*reps;
+  printf("packets        %d\n",n);
+  printf("hook passes    %lu\n",passes);
+  printf("seconds        %.3f\n",elapsed);
+  printf("packets/s      %.0f\n",elapsed>0 ? n/elapsed : 0.0);
+  printf("ns/packet      %.1f\n",elapsed*1e9/n);
+  printf("allocs/packet  %.3f\n",(double)allocs/n);
+  printf("verdicts      ");
+  for (i=0;i<=NF_MAX_VERDICT+1;i++)
+  {
+    if (hist[i]==0) continue;
+    printf(" %s %lu (%.1f%%)",vname[i],hist[i],100.0*hist[i]/n);
+  }
+  printf("\n");
+  return 0;
+}
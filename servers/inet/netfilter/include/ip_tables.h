@@ -22,6 +22,8 @@
 #include <list.h>
 #include <netfilter_ipv4.h>
 #include <nfdefs.h>
+#include "../targets/ipt_limit.h"
+#include "../targets/ipt_recent.h"
 
 #define IPT_FUNCTION_MAXNAMELEN 128
 #define IPT_TABLE_MAXNAMELEN 128 
@@ -32,7 +34,11 @@
 #define max(a,b) (a>=b?a:b)
 #define MATCHINFO_MAXSIZE max(   sizeof(struct ipt_tcp),\
                                  max(  sizeof(struct ipt_udp),\
-                                 sizeof(struct ipt_icmp) )  )
+                                 max(  sizeof(struct ipt_icmp),\
+                                 max(  sizeof(struct ipt_set_info),\
+                                 max(  sizeof(struct ipt_rateinfo),\
+                                 max(  sizeof(struct ipt_hashlimit_info),\
+                                 sizeof(struct ipt_recent_info) )  )  )  )  )  )
 
 #define TARGINFO_MAXSIZE 128
 
@@ -111,6 +117,15 @@ struct ipt_counters
 	unsigned long pcnt, bcnt;	/* Packet and byte counters */
 };
 
+/* Read after IOCTL_IPT_GET_COUNTERS: every chain of the selected table
+   in turn, each as this header followed by the counters of its count
+   rules. */
+struct ipt_counters_chain
+{
+	char name[IPT_CHAIN_MAXNAMELEN];
+	unsigned int count;
+};
+
 /* Values for "flag" field in struct ipt_ip (general ip structure). */
 #define IPT_F_FRAG		0x01	/* Set if rule is a fragment rule */
 #define IPT_F_MASK		0x01	/* All possible flag bits mask. */
@@ -125,54 +140,6 @@ struct ipt_counters
 #define IPT_INV_PROTO		0x40	/* Invert the sense of PROTO. */
 #define IPT_INV_MASK		0x7F	/* All possible flag bits mask. */
 
-/* This structure defines each of the firewall rules.  Consists of 3
-   parts which are 1) general IP header stuff 2) match specific
-   stuff 3) the target to perform if the rule matches */
-struct ipt_entry
-{
-	struct ipt_ip ip;
-
-	/* Mark with fields that we care about. */
-	unsigned int nfcache;
-
-	/* Size of ipt_entry + matches */
-	u16_t target_offset;
-	/* Size of ipt_entry + matches + target */
-	u16_t next_offset;
-
-	/* Back pointer */
-	unsigned int comefrom;
-
-	/* Packet and byte counters. */
-	struct ipt_counters counters;
-
-	/* The matches (if any), then the target. */
-	void *l3match;
-	void *targinfo;
-
-	/* jump chain (address of target chain to jump to, NULL if
-		       target is a module) */
-	struct ipt_chain *jumpchain;
-
-	/* Match */
-	struct ipt_match *match;
-
-	/* Target */
-	struct ipt_target *target;
-
-};
-
-/* A chain is a container for a specified ruleset,
-   which has a meaningful name and a list of rules */
-struct ipt_chain
-{
-	struct list_head list;
-	char name[IPT_CHAIN_MAXNAMELEN];
-	struct ipt_entry **entry;
-	int builtin;
-	int defaultverdict;
-};
-
 /*
  * New IP firewall options for [gs]etsockopt at the RAW IP level.
  * Unlike BSD Linux inherits IP options so you don't have to use a raw
@@ -194,6 +161,12 @@ struct ipt_chain
 #define NF_REPEAT 4
 #define NF_MAX_VERDICT NF_REPEAT
 
+/* NF_QUEUE carries the queue number in its upper bits */
+#define NF_VERDICT_MASK 0x000000ff
+#define NF_VERDICT_QBITS 16
+#define NF_VERDICT_FLAG_QUEUE_BYPASS 0x00008000
+#define NF_QUEUE_NR(x) ((((x) << NF_VERDICT_QBITS) & 0xffff0000) | NF_QUEUE)
+
 /* CONTINUE verdict for targets */
 #define IPT_CONTINUE 0xFFFFFFFF
 
@@ -242,6 +215,83 @@ struct ipt_icmp
 /* Values for "inv" field for struct ipt_icmp. */
 #define IPT_ICMP_INV	0x01	/* Invert the sense of type/code test */
 
+/* IP set matching stuff */
+#define IPT_SET_MAXNAMELEN 16
+
+struct ipt_set_info
+{
+	char name[IPT_SET_MAXNAMELEN];	/* set to look the packet up in */
+	int index;			/* filled in by checkentry */
+	u8_t flags;			/* IPT_SET_* */
+};
+
+/* Values for "flags" field in struct ipt_set_info. */
+#define IPT_SET_SRC	0x01	/* Look up the source, not the dest. */
+#define IPT_SET_INV	0x02	/* Invert the sense of the lookup. */
+
+/* This structure defines each of the firewall rules.  Consists of 3
+   parts which are 1) general IP header stuff 2) match specific
+   stuff 3) the target to perform if the rule matches */
+struct ipt_entry
+{
+	struct ipt_ip ip;
+
+	/* Mark with fields that we care about. */
+	unsigned int nfcache;
+
+	/* Size of ipt_entry + matches */
+	u16_t target_offset;
+	/* Size of ipt_entry + matches + target */
+	u16_t next_offset;
+
+	/* Back pointer */
+	unsigned int comefrom;
+
+	/* jump chain (address of target chain to jump to, NULL if
+		       target is a module) */
+	struct ipt_chain *jumpchain;
+
+	/* Match */
+	struct ipt_match *match;
+
+	/* Target */
+	struct ipt_target *target;
+
+	/* The target info, then the match info. Kept last and in this
+	   order so that both start pointer aligned. */
+	unsigned char targinfo[TARGINFO_MAXSIZE];
+	unsigned char l3match[MATCHINFO_MAXSIZE];
+};
+
+/* The rules of a chain, stored one after the other. A block is not
+   changed once a rule set snapshot uses it, inserting or deleting a
+   rule builds a new one; the old one is freed together with the last
+   snapshot using it, and with it the entry[dead] to entry[dead+ndead-1]
+   that were deleted. The counters of the rules are kept apart from them
+   in the same allocation, so counting a packet touches a small dense
+   array and not the rule; they move with the rules to a new block. */
+struct ipt_rules
+{
+	struct ipt_rules *retired;	/* next block waiting to be freed */
+	int count;			/* entries in entry[] */
+	int dead, ndead;
+	struct ipt_counters *counters;	/* count, after entry[] */
+	struct ipt_entry entry[1];	/* allocated for count entries */
+};
+
+/* A chain is a container for a specified ruleset,
+   which has a meaningful name and a list of rules */
+struct ipt_chain
+{
+	struct list_head list;
+	char name[IPT_CHAIN_MAXNAMELEN];
+	struct ipt_rules *rules;	/* NULL if the chain is empty */
+	int builtin;
+	int defaultverdict;	/* IPT_RETURN for user chains */
+	int view;		/* its view in the rule set being committed */
+	int depth;		/* scratch of the jump check in nfcore.c */
+};
+
 /* The argument to IPT_SO_GET_INFO */
 struct ipt_getinfo
 {
@@ -430,6 +480,9 @@ struct ipt_table
 	/* What hooks you will enter on */
 	unsigned int valid_hooks;
 
+	/* Built-in chain bound to each NF_IP_* hook, NULL if none */
+	struct ipt_chain *hook[NF_IP_NUMHOOKS+1];
+
 	/* Lock for the curtain */
 /*rwlock_t lock;*/
 
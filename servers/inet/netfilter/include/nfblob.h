@@ -0,0 +1,45 @@
+#ifndef NFBLOB_H
+#define NFBLOB_H NFBLOB_H
+
+#include <ip_tables.h>
+
+/* Binary image of a whole table as written after IOCTL_IPT_RESTORE:
+ *
+ *   struct nf_blob_hdr
+ *   nchains times:  struct nf_blob_chain
+ *                   nrules times: struct nf_blob_rule
+ *
+ * The table is replaced as a whole, chains of the table missing in the
+ * blob are flushed. Nothing is changed if any part of it is invalid.
+ */
+
+#define NF_BLOB_MAGIC     0x4e46424cU    /* "NFBL"                      */
+#define NF_BLOB_VERSION   1
+#define NF_BLOB_MAXSIZE   65536          /* largest blob the core takes */
+
+/* data written per write() call by iptables-restore */
+#define NF_BLOB_CHUNK     4096
+
+struct nf_blob_hdr {
+  unsigned int magic;
+  unsigned int version;
+  unsigned int size;             /* of the whole blob, this included */
+  int table;                     /* NF_TABLE_*                       */
+  int nchains;
+};
+
+struct nf_blob_chain {
+  char name[IPT_CHAIN_MAXNAMELEN];
+  int policy;                    /* NF_ACCEPT, NF_DROP or -1 to keep */
+  int nrules;
+};
+
+struct nf_blob_rule {
+  struct ipt_ip ip;
+  char match[IPT_FUNCTION_MAXNAMELEN];
+  char target[IPT_FUNCTION_MAXNAMELEN];  /* target or chain to jump to */
+  unsigned char matchinfo[MATCHINFO_MAXSIZE];
+  unsigned char targinfo[TARGINFO_MAXSIZE];
+};
+
+#endif
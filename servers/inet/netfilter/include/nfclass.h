@@ -0,0 +1,81 @@
+#ifndef NFCLASS_H
+#define NFCLASS_H NFCLASS_H
+
+#include <sys/types.h>
+#include <net/gen/in.h>
+
+/* protocol classes the classifier splits a chain into */
+#define NF_CLASS_TCP    0
+#define NF_CLASS_UDP    1
+#define NF_CLASS_ICMP   2
+#define NF_CLASS_OTHER  3
+#define NF_CLASS_NR     4
+
+/* destination port range sharing one candidate list */
+struct nf_class_range {
+  int lo;                        /* first port of the range           */
+  int first;                     /* first candidate in the rule pool  */
+  int count;                     /* number of candidates              */
+};
+
+struct nf_class_proto {
+  int nranges;
+  struct nf_class_range *range;  /* sorted by lo, range[0].lo == 0    */
+  int allfirst;                  /* candidates if port is unknown     */
+  int allcount;
+};
+
+/* address fields the classifier keeps a prefix trie for */
+#define NF_CLASS_SRC    0
+#define NF_CLASS_DST    1
+#define NF_CLASS_ADDRS  2
+
+/* node of a path compressed binary trie of address prefixes */
+struct nf_class_node {
+  u32_t prefix;                  /* host byte order, low bits zero    */
+  int plen;                      /* prefix length, 0 at the root      */
+  int child[2];                  /* by the bit after the prefix, or -1 */
+};
+
+/* Each node carries a bitmap of the rules whose prefix covers it,
+ * including the rules of its ancestors and the rules without a prefix
+ * on the field, so the deepest node covering an address holds all
+ * rules the address can match.
+ */
+struct nf_class_trie {
+  int nnodes;
+  struct nf_class_node *node;    /* node[0] is the root               */
+  u32_t *bits;                   /* nnodes bitmaps of words each      */
+};
+
+struct nf_classifier {
+  struct nf_class_proto proto[NF_CLASS_NR];
+  struct nf_class_range *ranges; /* storage of all ranges             */
+  int *rules;                    /* pool of rule indices, chain order */
+  int words;                     /* u32_t per rule bitmap             */
+  struct nf_class_trie *addr[NF_CLASS_ADDRS]; /* NULL: field unused   */
+};
+
+/* result of nfClassLookup */
+struct nf_class_match {
+  const int *rules;              /* candidates by protocol and port   */
+  int count;
+  const u32_t *addr[NF_CLASS_ADDRS]; /* bitmaps of rules the address  */
+                                 /* can match, NULL if no trie        */
+};
+
+/* can rule r of the candidates match the packet's addresses ? */
+#define NF_CLASS_BIT(b,r)  ((b) == NULL || ((b)[(r)>>5] & (1UL<<((r)&31))))
+#define NF_CLASS_ADDROK(m,r) \
+  (NF_CLASS_BIT((m)->addr[NF_CLASS_SRC],r) && \
+   NF_CLASS_BIT((m)->addr[NF_CLASS_DST],r))
+
+struct ipt_entry;
+
+struct nf_classifier *nfClassCompile(const struct ipt_entry *entry, int n,
+                                     const char *name);
+void nfClassFree(struct nf_classifier *cls);
+void nfClassLookup(const struct nf_classifier *cls, int proto, int dport,
+                   ipaddr_t src, ipaddr_t dst, struct nf_class_match *m);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef NFCONNTRACK_H
+#define NFCONNTRACK_H NFCONNTRACK_H
+
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <net/gen/ip_hdr.h>
+
+/* state of a packet with respect to its connection */
+enum ip_conntrack_info {
+  IP_CT_ESTABLISHED,             /* part of a flow that has seen a reply */
+  IP_CT_RELATED,                 /* ICMP error about a known flow        */
+  IP_CT_NEW,                     /* flow has not seen a reply yet        */
+  IP_CT_IS_REPLY,                /* added for packets in reply direction */
+  IP_CT_NUMBER = IP_CT_IS_REPLY*2-1
+};
+#define IP_CT_INVALID     (-1)   /* packet does not fit any flow         */
+
+enum ip_conntrack_dir {
+  IP_CT_DIR_ORIGINAL,
+  IP_CT_DIR_REPLY,
+  IP_CT_DIR_MAX
+};
+#define CTINFO2DIR(ctinfo) \
+  ((ctinfo) >= IP_CT_IS_REPLY ? IP_CT_DIR_REPLY : IP_CT_DIR_ORIGINAL)
+
+/* ct->status bits */
+#define IPS_SEEN_REPLY    0x01   /* packets went both ways               */
+
+/* TCP states of a flow */
+enum nf_ct_tcp_state {
+  TCP_CT_NONE,
+  TCP_CT_SYN_SENT,
+  TCP_CT_SYN_RECV,
+  TCP_CT_ESTABLISHED,
+  TCP_CT_FIN_WAIT,               /* one side has sent a FIN              */
+  TCP_CT_TIME_WAIT,              /* both sides have sent a FIN           */
+  TCP_CT_CLOSE,                  /* reset                                */
+  TCP_CT_MAX
+};
+
+/* Ports and addresses in network byte order. ICMP queries store the
+ * identifier in both port fields, so the reply tuple is the inverse.
+ */
+struct ip_conntrack_tuple {
+  ipaddr_t src;
+  ipaddr_t dst;
+  u16_t sport;
+  u16_t dport;
+  u8_t proto;
+};
+
+struct nf_conn {
+  struct nf_conn *next;          /* hash chain or free list              */
+  struct nf_conn *lru_prev, *lru_next; /* use order, see ctTouch         */
+  struct ip_conntrack_tuple tuple; /* original direction                 */
+  unsigned long expires;         /* seconds, see nfConntrackSetTime      */
+  int status;
+  int tcpstate;
+  int finseen;                   /* FIN bit per direction                */
+  unsigned long gen;             /* rule generation of the hook masks    */
+  unsigned int accepted[IP_CT_DIR_MAX]; /* hooks that accepted the flow  */
+  unsigned int passed[IP_CT_DIR_MAX];   /* and those on the way there    */
+};
+
+/* flow table size, NF_CT_HASH must be a power of 2; both can be set
+ * at build time, e.g. make EXTRA=-DNF_CT_NR=16384
+ */
+#ifndef NF_CT_NR
+#define NF_CT_NR          4096
+#endif
+#ifndef NF_CT_HASH
+#define NF_CT_HASH        1024
+#endif
+
+/* garbage collection interval of the inet timer in seconds */
+#define NF_CT_GC_TIME     10
+
+struct sk_buff;
+
+void nfConntrackInit(void);
+void nfConntrackSetTime(unsigned long now);
+struct nf_conn *nfConntrackIn(struct sk_buff *skb, int hdrlen);
+int nfConntrackTuple(const ip_hdr_t *ip, int hdrlen,
+                     struct ip_conntrack_tuple *t, int *related);
+int nfConntrackInUse(const struct ip_conntrack_tuple *t);
+void nfConntrackPass(struct sk_buff *skb, unsigned int hook,
+                     unsigned long gen);
+void nfConntrackConfirm(struct sk_buff *skb, int hdrlen, unsigned int hook,
+                        unsigned long gen);
+struct nf_conn *nfConntrackEstablish(const struct ip_conntrack_tuple *t);
+int nfConntrackExpire(void);
+
+#endif
@@ -1,25 +1,53 @@
 #ifndef NFCORE_H
 #define NFCORE_H
 #include <sys/types.h>
+#include <net/gen/in.h>
 #include <ip_tables.h>
 
 enum nftable {NFT_FILTER,NFT_NAT,NFT_MANGLE};
-#define MAX_ENTRIES_PER_CHAIN 16
-#define MAX_LOCAL_IPS 8
+#define NF_LOCAL_HASH 16        /* first size of the local address set */
+#define NF_BATCH_MAX 32
+#define NF_JUMP_MAXDEPTH 16      /* built-in chain plus nested user chains */
+
+/* a packet handed to inetProcessBatch, see there */
+struct nf_packet {
+  char *mac;                     /* link level header or NULL  */
+  char *data;                    /* start of the IP header     */
+  int hdrlen;                    /* contiguous bytes at data   */
+  int packsize;                  /* IP packet length           */
+};
+
+/* evaluation state of a single packet */
+struct nf_pktctx {
+  struct sk_buff skb;
+  int dport;                     /* for the classifier, -1 if unknown */
+  int fragoff;                   /* fragment offset in 8 byte units   */
+  int decided;                   /* verdict known before the chains   */
+};
+
+struct nf_ruleset;
+
+/* Everything inetProcessBatch works on. Each caller that may evaluate
+ * packets at the same time as another one needs its own context.
+ */
+struct nf_batchctx {
+  struct net_device in;
+  struct net_device out;
+  struct nf_ruleset *rules;      /* rule set snapshot in use   */
+  struct nf_pktctx pkt[NF_BATCH_MAX];
+};
 
 void nfCoreInit(void);
-void inetRegisterLocalIP(int a, int b, int c, int d);
-int inetCheckLocalIP(int a, int b, int c, int d);
-void inetEthIn(char *ethername);
-void inetEthOut(char *ethername);
-void inetSetPackSize(int size);
-void inetSetDataSize(int size);
-int inetGetDataSize(void);
-void inetHook(unsigned int hook);
-int inetData(char *address);
-void inetContainLayers(int layerid);
-int inetProcess(void);
-int inetGetData(char *address);
+int inetRegisterLocalIP(ipaddr_t addr);
+void inetUnregisterLocalIP(ipaddr_t addr);
+int inetCheckLocalIP(ipaddr_t addr);
+int inetProcessBatch(struct nf_batchctx *ctx,
+                     unsigned int hook,
+                     const char *ifin,
+                     const char *ifout,
+                     const struct nf_packet *pkts,
+                     int count,
+                     int *verdicts);
 int iptablesNewChain(const struct ipt_table *table,
                      const char *name,
 		     int policy,
@@ -27,6 +55,8 @@ int iptablesNewChain(const struct ipt_table *table,
 		     int hooknum);
 int chainExists(const struct ipt_table *table, const char *name);
 struct ipt_chain *getChain(const struct ipt_table *table, const char *name);
+int iptablesNewUserChain(char *name);
+int iptablesDeleteChain(char *name);
 int iptablesSelectTable(enum nftable table);
 int iptablesSelectChain(char *name);
 int iptablesSelectTarget(char *name);
@@ -36,7 +66,11 @@ int iptablesSetIPMatchInfo(void *matchinfo);
 int iptablesSetTargInfo(void *targinfo);
 int iptablesSetPolicy(int policy);
 int iptablesAppendRule(void);
+int iptablesInsertRule(int index);
 int iptablesDeleteRule(int index);
 int iptablesFlushChain(void);
+int iptablesZeroCounters(void);
+size_t iptablesGetCounters(void *buf, size_t size, int zero);
+int iptablesRestore(const void *data, size_t len);
 
 #endif
@@ -43,6 +43,16 @@
 #define IOCTL_IPT_FLUSH      1013
 #define IOCTL_IPT_SET_POLICY 1014
 #define IOCTL_IPT_ZERO       1015
+#define IOCTL_IPT_RESTORE    1016
+#define IOCTL_IPSET_CREATE   1017
+#define IOCTL_IPSET_DESTROY  1018
+#define IOCTL_IPSET_FLUSH    1019
+#define IOCTL_IPSET_SELECT   1020
+#define IOCTL_IPSET_ADD      1021
+#define IOCTL_IPSET_DEL      1022
+#define IOCTL_IPT_GET_COUNTERS 1023  /* then read the selected table's */
+#define IOCTL_IPT_GET_ZERO_COUNTERS 1024 /* same, and zero them       */
+#define IOCTL_NFQ_BIND       1025  /* then write a struct nfq_bind  */
 #define NF_TABLE_FILTER      2
 #define NF_TABLE_NAT         3
 #define NF_TABLE_MANGLE      1
@@ -0,0 +1,45 @@
+#ifndef NFLOG_H
+#define NFLOG_H NFLOG_H
+
+#include <sys/types.h>
+
+#define NF_LOG_RINGSIZE   65536  /* bytes of records kept in inet      */
+#define NF_LOG_THRESHOLD  16384  /* a waiting reader is woken at once  */
+                                 /* when this much is buffered         */
+#define NF_LOG_PREFIXLEN  32
+#define NF_LOG_IFNAMELEN  16     /* same as IF_NAMESIZE                */
+#define NF_LOG_CAPMAX     256    /* packet bytes a record holds at most */
+
+/* Record as read from /dev/nflog. Each read returns whole records,
+ * as many as fit. The captured packet bytes (IP header, transport
+ * header, payload prefix) follow the header; len is padded to a
+ * multiple of 4 so the next record is aligned.
+ */
+struct nf_log_rec {
+  u16_t len;                     /* record bytes, header included      */
+  u8_t hook;                     /* NF_IP_*                            */
+  u8_t flags;                    /* reserved                           */
+  u32_t lost;                    /* records lost before this one       */
+                                 /* because the ring was full          */
+  u32_t sec;                     /* time stamp, uptime of inet         */
+  u32_t usec;
+  u16_t pktlen;                  /* length of the IP packet            */
+  u16_t caplen;                  /* bytes of it after the header       */
+  char indev[NF_LOG_IFNAMELEN];
+  char outdev[NF_LOG_IFNAMELEN];
+  char prefix[NF_LOG_PREFIXLEN];
+};
+
+/* a read must have room for a record of this size */
+#define NF_LOG_RECMAX   (sizeof(struct nf_log_rec)+NF_LOG_CAPMAX)
+
+void nfLogInit(void (*notify)(void));
+void nfLogSetTime(u32_t sec, u32_t usec);
+int nfLogPut(unsigned int hook, const char *indev, const char *outdev,
+             const char *prefix, const void *pkt, size_t caplen,
+             size_t pktlen);
+size_t nfLogUsed(void);
+size_t nfLogPeek(const unsigned char **data, size_t max);
+void nfLogConsume(size_t len);
+
+#endif
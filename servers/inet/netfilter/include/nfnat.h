@@ -0,0 +1,60 @@
+#ifndef NFNAT_H
+#define NFNAT_H NFNAT_H
+
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <nfconntrack.h>
+
+/* what a binding rewrites in the original direction */
+#define NF_NAT_SRC        1      /* SNAT, MASQUERADE                      */
+#define NF_NAT_DST        2      /* DNAT, REDIRECT                        */
+
+/* skb->natinfo is the direction of the packet, plus this bit if it is
+ * an ICMP error quoting a translated packet
+ */
+#define NF_NAT_RELATED    2
+
+#define NF_NAT_NR         1024   /* bindings                              */
+#define NF_NAT_HASH       512    /* buckets per direction, power of 2     */
+#define NF_NAT_MAXIFS     8      /* interfaces MASQUERADE knows           */
+#define NF_NAT_TIMEOUT    120    /* seconds until the flow is confirmed   */
+#define NF_NAT_PORTMIN    1024   /* ports picked when the original one   */
+#define NF_NAT_PORTMAX    65535  /* is taken and the rule gives none      */
+
+/* Targinfo of SNAT, DNAT, MASQUERADE and REDIRECT. Addresses in network
+ * byte order, 0 where MASQUERADE and REDIRECT use the interface address.
+ * Ports in host byte order, 0 keeps the port if it is free.
+ */
+struct nf_nat_range {
+  ipaddr_t minip;
+  ipaddr_t maxip;
+  u16_t minport;
+  u16_t maxport;
+};
+
+/* A translated flow. key[IP_CT_DIR_ORIGINAL] is the tuple of its first
+ * packet as it arrived, key[IP_CT_DIR_REPLY] the tuple its replies
+ * arrive with; a packet of one direction is rewritten to the inverse of
+ * the other key. Both keys are hashed.
+ */
+struct nf_nat {
+  struct nf_nat *next[IP_CT_DIR_MAX];
+  struct ip_conntrack_tuple key[IP_CT_DIR_MAX];
+  int manip;                     /* NF_NAT_SRC or NF_NAT_DST              */
+  unsigned long expires;         /* seconds, follows the conntrack flow   */
+};
+
+struct sk_buff;
+
+void nfNatInit(void);
+void nfNatSetTime(unsigned long now);
+void nfNatSetIfAddr(const char *ifname, ipaddr_t addr);
+ipaddr_t nfNatIfAddr(const char *ifname);
+struct nf_nat *nfNatLookup(struct sk_buff *skb);
+int nfNatBind(struct sk_buff *skb, int manip,
+              const struct nf_nat_range *range);
+int nfNatApply(struct sk_buff *skb, unsigned int hook);
+void nfNatTouch(struct sk_buff *skb);
+int nfNatExpire(void);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef NFQUEUE_H
+#define NFQUEUE_H NFQUEUE_H
+
+#include <sys/types.h>
+
+#define NF_QUEUE_MAX      8      /* queue numbers 0 .. NF_QUEUE_MAX-1     */
+#define NF_QUEUE_LEN      256    /* packets parked in inet, all queues    */
+#define NF_QUEUE_IFNAMELEN 16    /* same as IF_NAMESIZE                   */
+
+/* Written after IOCTL_NFQ_BIND to make a descriptor of /dev/netfilter
+ * the reader of a queue. A queue has one reader at a time.
+ */
+struct nfq_bind {
+  u16_t queuenum;
+  u16_t flags;                   /* reserved, 0                           */
+  u32_t copy_range;              /* packet bytes a record holds, 0: all   */
+};
+
+/* Record as read from a bound descriptor. Each read returns whole
+ * records, as many as are queued and fit; only the first one is cut
+ * short if the buffer is too small for it. caplen bytes of the IP
+ * packet follow the header; len is padded to a multiple of 4 so the
+ * next record is aligned.
+ */
+struct nfq_packet {
+  u32_t id;                      /* to give the verdict with              */
+  u32_t len;                     /* record bytes, header included         */
+  u16_t pktlen;                  /* length of the IP packet               */
+  u16_t caplen;                  /* bytes of it after the header          */
+  u8_t hook;                     /* NF_IP_*                               */
+  u8_t flags;                    /* reserved                              */
+  u16_t queuenum;
+  char indev[NF_QUEUE_IFNAMELEN];
+  char outdev[NF_QUEUE_IFNAMELEN];
+};
+
+/* Written to a bound descriptor, any number of them in one write. A
+ * verdict with NFQ_VERDICT_BATCH applies to id and to all packets read
+ * before it that are still waiting.
+ */
+struct nfq_verdict {
+  u32_t id;
+  u16_t verdict;                 /* NF_ACCEPT or NF_DROP                  */
+  u16_t flags;
+};
+
+#define NFQ_VERDICT_BATCH 1
+
+#endif
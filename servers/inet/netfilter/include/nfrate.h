@@ -0,0 +1,50 @@
+#ifndef NFRATE_H
+#define NFRATE_H NFRATE_H
+
+#include <sys/types.h>
+#include <net/gen/in.h>
+
+#define NF_RATE_PERMS     10     /* credits per millisecond, the        */
+                                 /* IPT_LIMIT_SCALE of a second / 1000   */
+#define NF_RATE_HITS      8      /* time stamps a recent list keeps     */
+#define NF_RATE_NAMELEN   16     /* same as IPT_RECENT_NAME_LEN         */
+#define NF_RATE_MAXSIZE   65536  /* addresses a table holds at most     */
+
+/* An address a hashlimit or recent match has seen. Tables have a fixed
+ * number of these; when they are used up the least recently seen
+ * address is forgotten.
+ */
+struct nf_rate_node {
+  struct nf_rate_node *next;     /* hash chain                          */
+  struct nf_rate_node *newer, *older; /* LRU list                       */
+  ipaddr_t addr;
+  unsigned long stamp;           /* ms of the last refill or hit        */
+  u32_t credit;                  /* hashlimit: tokens left              */
+  int nhits;                     /* recent: stamps in hits[]            */
+  int hit;                       /* recent: slot of the next one        */
+  unsigned long hits[NF_RATE_HITS];
+};
+
+struct nf_rate_table {
+  struct nf_rate_table *next;    /* named tables                        */
+  char name[NF_RATE_NAMELEN];    /* "" if private to a rule             */
+  int refcnt;                    /* rules using the table               */
+  int size;                      /* nodes                               */
+  unsigned int hashsize;         /* buckets, power of 2                 */
+  struct nf_rate_node **hash;
+  struct nf_rate_node *pool;
+  struct nf_rate_node *free;
+  struct nf_rate_node *newest, *oldest;
+};
+
+void nfRateSetTime(unsigned long ms);
+unsigned long nfRateNow(void);
+u32_t nfRateRefill(u32_t credit, u32_t cap, unsigned long elapsed);
+struct nf_rate_table *nfRateCreate(const char *name, int size);
+void nfRateRelease(struct nf_rate_table *table);
+struct nf_rate_node *nfRateFind(struct nf_rate_table *table, ipaddr_t addr);
+struct nf_rate_node *nfRateAdd(struct nf_rate_table *table, ipaddr_t addr,
+                               int *fresh);
+void nfRateRemove(struct nf_rate_table *table, struct nf_rate_node *node);
+
+#endif
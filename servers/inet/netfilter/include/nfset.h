@@ -0,0 +1,61 @@
+#ifndef NFSET_H
+#define NFSET_H NFSET_H
+
+#include <sys/types.h>
+#include <net/gen/in.h>
+
+/* set types */
+#define NF_SET_NET        1      /* addresses and CIDR prefixes          */
+#define NF_SET_IPPORT     2      /* address, protocol and port           */
+
+#define NF_SET_MAX        16     /* number of sets                       */
+#define NF_SET_MAXNAMELEN 16     /* same as IPT_SET_MAXNAMELEN           */
+#define NF_SET_MAXELEM    65536  /* elements per set                     */
+#define NF_SET_MINHASH    64     /* initial number of buckets, power of 2 */
+#define NF_SET_CHUNK      4096   /* data written per write() by ipset    */
+
+/* argument of IOCTL_IPSET_CREATE */
+struct nf_set_req {
+  char name[NF_SET_MAXNAMELEN];
+  int type;
+};
+
+/* Element as written after IOCTL_IPSET_ADD or IOCTL_IPSET_DEL, any
+ * number of them per write. An address is a prefix of length 32.
+ */
+struct nf_set_elem {
+  ipaddr_t addr;                 /* network byte order                   */
+  u8_t plen;                     /* prefix length, 32 in NF_SET_IPPORT   */
+  u8_t proto;                    /* NF_SET_IPPORT only                   */
+  u16_t port;                    /* NF_SET_IPPORT only, host byte order  */
+};
+
+struct nf_set_node {
+  struct nf_set_node *next;
+  struct nf_set_elem elem;
+};
+
+struct nf_set {
+  char name[NF_SET_MAXNAMELEN];  /* empty if the slot is free            */
+  int type;
+  int refcnt;                    /* rules using the set                  */
+  int count;                     /* elements                             */
+  unsigned int hashsize;         /* buckets, power of 2                  */
+  struct nf_set_node **hash;
+  int nplen[33];                 /* NF_SET_NET: elements per prefix len  */
+  int nplist;                    /* prefix lengths in use, longest first */
+  u8_t plist[33];
+};
+
+void nfSetInit(void);
+int nfSetFind(const char *name);
+struct nf_set *nfSetGet(int index);
+int nfSetTest(const struct nf_set *set, ipaddr_t addr, int proto, int port);
+int ipsetCreate(void *data);
+int ipsetDestroy(char *name);
+int ipsetFlush(char *name);
+int ipsetSelect(char *name);
+int ipsetAdd(const void *data, size_t len);
+int ipsetDel(const void *data, size_t len);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef NFSYNPROXY_H
+#define NFSYNPROXY_H NFSYNPROXY_H
+
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <nfconntrack.h>
+
+#define NF_SP_NR          NF_CT_NR   /* proxied connections           */
+#define NF_SP_HASH        NF_CT_HASH /* buckets, power of 2           */
+#define NF_SP_OUTQ        64     /* packets waiting to be sent by inet    */
+#define NF_SP_PKTLEN      44     /* IP and TCP header and an MSS option   */
+#define NF_SP_IFNAMELEN   16     /* same as IF_NAMESIZE                   */
+#define NF_SP_SYNTIME     10     /* seconds the server has to answer      */
+#define NF_SP_PERIOD      64     /* seconds the cookie counter lasts      */
+#define NF_SP_MAXAGE      2      /* counter steps a cookie stays valid    */
+
+/* Targinfo of SYNPROXY, mss in host byte order. The MSS offered to the
+ * client is the smaller one of this and the client's.
+ */
+struct ipt_synproxy_info {
+  u16_t mss;
+  u16_t flags;                   /* reserved, 0                           */
+};
+
+/* A packet the proxy built, to be sent by inet without going through
+ * the hooks. ifname is the interface the packet it answers came in on;
+ * inet routes from there, or delivers to its own TCP if the destination
+ * is a local address.
+ */
+struct nf_sp_pkt {
+  u16_t len;
+  char ifname[NF_SP_IFNAMELEN];
+  unsigned char data[NF_SP_PKTLEN];
+};
+
+struct sk_buff;
+
+void nfSynproxyInit(void (*notify)(void), const u8_t *seed, size_t len);
+void nfSynproxySetTime(unsigned long now);
+int nfSynproxyIn(struct sk_buff *skb, int hdrlen, unsigned int hook,
+                 const char *ifname);
+int nfSynproxyTarget(struct sk_buff *skb, unsigned int hook,
+                     const char *ifname, u16_t mss);
+const struct nf_sp_pkt *nfSynproxyPeek(void);
+void nfSynproxyConsume(void);
+int nfSynproxyExpire(void);
+
+#endif
@@ -14,6 +14,9 @@
 #include <net/gen/icmp_hdr.h>
 #include <net_device.h>
 
+struct nf_conn;
+struct nf_nat;
+
 struct sk_buff {
   struct sk_buff *next;
   struct sk_buff *prev;
@@ -38,6 +41,11 @@ struct sk_buff {
     unsigned char *raw;
   } h;
 
+  struct nf_conn *nfct;          /* flow of the packet, if tracked        */
+  int nfctinfo;                  /* enum ip_conntrack_info                */
+  struct nf_nat *nat;            /* address translation of the flow       */
+  int natinfo;                   /* direction, see nfnat.h                */
+
   unsigned char *head;
   unsigned char *data;
   unsigned char *tail;
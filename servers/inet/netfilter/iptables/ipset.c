@@ -0,0 +1,223 @@
+/*
+ *  MINIX-3 network filter - IP set control tool
+ *
+ *  Creates and fills the sets the SET match (iptables -m set) looks
+ *  packets up in. Elements are sent in chunks of NF_SET_CHUNK bytes,
+ *  so large block lists load with few writes:
+ *
+ *      ipset -N blocklist net
+ *      ipset -R blocklist < blocklist.txt
+ *      iptables -A INPUT -m set --match-set blocklist src -j DROP
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <nfdefs.h>
+#include <nfset.h>
+#include <net/gen/in.h>
+#include <net/gen/inet.h>
+
+#define MAX_LINE 256
+#define CHUNK_ELEMS (NF_SET_CHUNK/sizeof(struct nf_set_elem))
+
+static int fd;
+static struct nf_set_elem chunk[CHUNK_ELEMS];
+static int nchunk;
+
+void printHelp( void )
+{
+   printf("ipset: <-[NXFADR]> <set> [args]\n");
+   printf("\n");
+   printf("          actions: -N <set> <net|ipport> create set\n");
+   printf("                   -X <set>            remove set no rule uses\n");
+   printf("                   -F <set>            remove all elements\n");
+   printf("                   -A <set> <elem>...  add elements\n");
+   printf("                   -D <set> <elem>...  delete elements\n");
+   printf("                   -R <set> [file]     add the elements in file,\n");
+   printf("                                       one per line\n");
+   printf("\n");
+   printf("          elements: net     ipaddr[/bits]\n");
+   printf("                    ipport  ipaddr,<tcp|udp>:port\n");
+}
+
+void sendName(int request, char *name)
+{
+  ioctl(fd,request,NULL);
+  if (!write(fd,name,strlen(name)+1))
+  {
+    printf("no such set: %s\n",name);
+    close(fd);
+    exit(3);
+  }
+}
+
+void flushChunk( void )
+{
+  if (nchunk==0) return;
+  if (write(fd,chunk,nchunk*sizeof(struct nf_set_elem))<=0)
+  {
+    printf("elements refused by netfilter\n");
+    close(fd);
+    exit(3);
+  }
+  nchunk=0;
+}
+
+/* parses ipaddr[/bits] or ipaddr,proto:port */
+void parseElem(char *arg, struct nf_set_elem *e)
+{
+  char buf[64];
+  char *p;
+  ipaddr_t addr;
+
+  memset(e,0,sizeof(*e));
+  strncpy(buf,arg,sizeof(buf)-1);
+  buf[sizeof(buf)-1]='\0';
+  e->plen=32;
+  if ((p=strchr(buf,','))!=NULL)
+  {
+    *p++='\0';
+    if (strncmp(p,"tcp:",4)==0) e->proto=IPPROTO_TCP;
+    else if (strncmp(p,"udp:",4)==0) e->proto=IPPROTO_UDP;
+    else
+    {
+      printf("invalid element: %s\n",arg);
+      exit(2);
+    }
+    e->port=atoi(p+4);
+  }
+  else if ((p=strchr(buf,'/'))!=NULL)
+  {
+    *p++='\0';
+    e->plen=atoi(p);
+    if (e->plen>32)
+    {
+      printf("invalid mask bit size: %s\n",arg);
+      exit(2);
+    }
+  }
+  if (!inet_aton(buf,&addr))
+  {
+    printf("invalid IP address: %s\n",buf);
+    exit(2);
+  }
+  e->addr=addr;
+}
+
+void addElem(char *arg)
+{
+  parseElem(arg,&chunk[nchunk++]);
+  if (nchunk==CHUNK_ELEMS) flushChunk();
+}
+
+int main (int argc, char **argv)
+{
+  struct nf_set_req req;
+  FILE *in;
+  char line[MAX_LINE];
+  char *p;
+  int i, n;
+
+  if ((argc<3) || (strlen(argv[1])!=2) || (argv[1][0]!='-'))
+  {
+    printHelp();
+    exit(argc<=1 ? 0 : 1);
+  }
+  if (strlen(argv[2])>=NF_SET_MAXNAMELEN)
+  {
+    printf("set name too long: %s\n",argv[2]);
+    exit(2);
+  }
+
+  fd=open("/dev/netfilter0",O_RDWR);
+  if (fd<=0) {
+    printf("could not open netfilter device\n");
+    return 1;
+  }
+
+  switch (argv[1][1])
+  {
+    case 'N':
+      if (argc!=4) { printHelp(); exit(1); }
+      memset(&req,0,sizeof(req));
+      strcpy(req.name,argv[2]);
+      if (strcmp(argv[3],"net")==0) req.type=NF_SET_NET;
+      else if (strcmp(argv[3],"ipport")==0) req.type=NF_SET_IPPORT;
+      else
+      {
+        printf("unknown set type: %s\n",argv[3]);
+        exit(2);
+      }
+      ioctl(fd,IOCTL_IPSET_CREATE,NULL);
+      if (!write(fd,&req,sizeof(req)))
+      {
+        printf("could not create set %s\n",argv[2]);
+        close(fd);
+        exit(3);
+      }
+      break;
+    case 'X':
+      sendName(IOCTL_IPSET_DESTROY,argv[2]);
+      break;
+    case 'F':
+      sendName(IOCTL_IPSET_FLUSH,argv[2]);
+      break;
+    case 'A':
+    case 'D':
+      sendName(IOCTL_IPSET_SELECT,argv[2]);
+      ioctl(fd,argv[1][1]=='A' ? IOCTL_IPSET_ADD : IOCTL_IPSET_DEL,NULL);
+      for (i=3;i<argc;i++) addElem(argv[i]);
+      flushChunk();
+      break;
+    case 'R':
+      in=stdin;
+      if ((argc>3) && ((in=fopen(argv[3],"r"))==NULL))
+      {
+        printf("could not open %s\n",argv[3]);
+        close(fd);
+        exit(1);
+      }
+      sendName(IOCTL_IPSET_SELECT,argv[2]);
+      ioctl(fd,IOCTL_IPSET_ADD,NULL);
+      while (fgets(line,MAX_LINE,in)!=NULL)
+      {
+        /* one element per line, # starts a comment */
+        if ((p=strchr(line,'#'))!=NULL) *p='\0';
+        p=line+strspn(line," \t");
+        n=strcspn(p," \t\r\n");
+        if (n==0) continue;
+        p[n]='\0';
+        addElem(p);
+      }
+      flushChunk();
+      if (in!=stdin) fclose(in);
+      break;
+    default:
+      printHelp();
+      close(fd);
+      exit(1);
+  }
+
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,295 @@
+/*
+ *  MINIX-3 network filter - rule set loader
+ *
+ *  Reads rules in the format of iptables-save and loads each table at
+ *  once: the rules of a table are packed into a single blob (see
+ *  nfblob.h), which the filter checks completely before it replaces
+ *  the old rules. Packets never see a half loaded table.
+ *
+ *      *filter
+ *      :INPUT DROP [0:0]
+ *      -A INPUT -p tcp --dport 22 -j ACCEPT
+ *      COMMIT
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <nfdefs.h>
+#include <nfblob.h>
+#include "iptparse.h"
+
+#define MAX_CHAINS 16
+#define MAX_ARGS 64
+#define MAX_LINE 1024
+
+/* a rule and the chain it is appended to */
+struct restoreRule {
+  int chain;
+  struct nf_blob_rule rule;
+};
+
+static int table;                /* 0 outside of *table ... COMMIT */
+static struct nf_blob_chain chains[MAX_CHAINS];
+static int nchains;
+static struct restoreRule *rules;
+static int nrules, maxrules;
+static int lineno;
+static int testonly;
+
+void printHelp( void )
+{
+   printf("iptables-restore: [-t] [file]\n");
+   printf("\n");
+   printf("          loads the rules in file or on standard input:\n");
+   printf("                   *<table>            start of a table\n");
+   printf("                   :<chain> <policy>   chain and its policy,\n");
+   printf("                                       - keeps the policy\n");
+   printf("                   -A <chain> [opts]   rule as for iptables\n");
+   printf("                   COMMIT              load the table\n");
+   printf("\n");
+   printf("          options: -t                  only check the rules\n");
+}
+
+void lineError(char *msg, char *arg)
+{
+  printf("line %d: %s%s\n",lineno,msg,arg);
+  exit(2);
+}
+
+/* splits a line into words, "quoted strings" are kept together */
+int splitLine(char *line, char **argv, int max)
+{
+  int argc=0;
+
+  argv[argc++]="iptables";
+  while (*line)
+  {
+    while ((*line==' ') || (*line=='\t')) line++;
+    if (*line=='\0') break;
+    if (argc==max-1) lineError("too many arguments","");
+    if (*line=='"')
+    {
+      argv[argc++]=++line;
+      while (*line && (*line!='"')) line++;
+      if (*line=='\0') lineError("missing quote","");
+    }
+    else
+    {
+      argv[argc++]=line;
+      while (*line && (*line!=' ') && (*line!='\t')) line++;
+    }
+    if (*line) *line++='\0';
+  }
+  argv[argc]=NULL;
+  return argc;
+}
+
+int findChain(char *name)
+{
+  int i;
+
+  for (i=0;i<nchains;i++)
+  {
+    if (strcmp(chains[i].name,name)==0) return i;
+  }
+  return -1;
+}
+
+void startTable(char *name)
+{
+  if (table) lineError("COMMIT missing before table ",name);
+  if (strcmp(name,"filter")==0) table=NF_TABLE_FILTER;
+  else if (strcmp(name,"nat")==0) table=NF_TABLE_NAT;
+  else if (strcmp(name,"mangle")==0) table=NF_TABLE_MANGLE;
+  else lineError("no such table: ",name);
+  nchains=0;
+  nrules=0;
+}
+
+void addChain(int argc, char **argv)
+{
+  struct nf_blob_chain *chain;
+
+  /* argv[1] is ":name", argv[3] the counters, which are ignored */
+  if ((argc<3) || (strlen(argv[1])<2)) lineError("bad chain line","");
+  if (strlen(argv[1]+1)>=32) lineError("chain name too long: ",argv[1]+1);
+  if (findChain(argv[1]+1)>=0) lineError("chain listed twice: ",argv[1]+1);
+  if (nchains==MAX_CHAINS) lineError("too many chains","");
+
+  chain=&chains[nchains++];
+  memset(chain,0,sizeof(*chain));
+  strcpy(chain->name,argv[1]+1);
+  if (strcmp(argv[2],"ACCEPT")==0) chain->policy=NF_ACCEPT;
+  else if (strcmp(argv[2],"DROP")==0) chain->policy=NF_DROP;
+  else if (strcmp(argv[2],"-")==0) chain->policy=-1;
+  else lineError("unknown policy: ",argv[2]);
+}
+
+void addRule(int argc, char **argv)
+{
+  struct ipt_cmd cmd;
+  struct restoreRule *r;
+  int chain;
+
+  parseArgs(argc,argv,&cmd);
+  if (cmd.action!=A_APPEND) lineError("only -A is allowed here","");
+  chain=findChain(cmd.chain);
+  if (chain<0) lineError("chain not declared: ",cmd.chain);
+  if (strlen(cmd.target)==0) lineError("no target","");
+
+  if (nrules==maxrules)
+  {
+    maxrules=maxrules ? 2*maxrules : 32;
+    rules=(struct restoreRule*)realloc(rules,
+                                       maxrules*sizeof(struct restoreRule));
+    if (rules==NULL)
+    {
+      printf("out of memory\n");
+      exit(3);
+    }
+  }
+  r=&rules[nrules++];
+  memset(r,0,sizeof(*r));
+  r->chain=chain;
+  r->rule.ip=cmd.ip;
+  strcpy(r->rule.match,cmd.match);
+  strcpy(r->rule.target,cmd.target);
+  memcpy(r->rule.matchinfo,&cmd.matchinfo,cmd.matchinfosize);
+  memcpy(r->rule.targinfo,&cmd.targinfo,sizeof(cmd.targinfo));
+}
+
+/* packs the table into a blob and sends it in pieces after one ioctl */
+void commitTable(int fd)
+{
+  struct nf_blob_hdr *hdr;
+  struct nf_blob_chain *chain;
+  unsigned char *blob, *p;
+  size_t size, off, n;
+  int c, i;
+
+  if (!table) lineError("COMMIT outside of a table","");
+  size=sizeof(struct nf_blob_hdr)+nchains*sizeof(struct nf_blob_chain)+
+       nrules*sizeof(struct nf_blob_rule);
+  if (size>NF_BLOB_MAXSIZE) lineError("too many rules in table","");
+  blob=(unsigned char*)malloc(size);
+  if (blob==NULL)
+  {
+    printf("out of memory\n");
+    exit(3);
+  }
+
+  hdr=(struct nf_blob_hdr*)blob;
+  hdr->magic=NF_BLOB_MAGIC;
+  hdr->version=NF_BLOB_VERSION;
+  hdr->size=size;
+  hdr->table=table;
+  hdr->nchains=nchains;
+  p=blob+sizeof(struct nf_blob_hdr);
+  for (c=0;c<nchains;c++)
+  {
+    chain=(struct nf_blob_chain*)p;
+    memcpy(chain,&chains[c],sizeof(struct nf_blob_chain));
+    chain->nrules=0;
+    p+=sizeof(struct nf_blob_chain);
+    for (i=0;i<nrules;i++)
+    {
+      if (rules[i].chain!=c) continue;
+      memcpy(p,&rules[i].rule,sizeof(struct nf_blob_rule));
+      p+=sizeof(struct nf_blob_rule);
+      chain->nrules++;
+    }
+  }
+
+  if (!testonly)
+  {
+    ioctl(fd,IOCTL_IPT_RESTORE,NULL);
+    for (off=0;off<size;off+=n)
+    {
+      n=size-off;
+      if (n>NF_BLOB_CHUNK) n=NF_BLOB_CHUNK;
+      if (write(fd,blob+off,n)<=0)
+      {
+        printf("line %d: table not loaded, rejected by netfilter\n",lineno);
+        close(fd);
+        exit(3);
+      }
+    }
+  }
+  free(blob);
+  table=0;
+}
+
+int main (int argc, char **argv)
+{
+  FILE *in=stdin;
+  char line[MAX_LINE];
+  char *args[MAX_ARGS];
+  int fd=-1;
+  int i, n;
+
+  for (i=1;i<argc;i++)
+  {
+    if (strcmp(argv[i],"-t")==0) testonly=1;
+    else if (strcmp(argv[i],"-h")==0) { printHelp(); exit(0); }
+    else if (in==stdin)
+    {
+      in=fopen(argv[i],"r");
+      if (in==NULL)
+      {
+        printf("could not open %s\n",argv[i]);
+        return 1;
+      }
+    }
+    else { printHelp(); exit(1); }
+  }
+
+  if (!testonly)
+  {
+    fd=open("/dev/netfilter0",O_RDWR);
+    if (fd<=0) {
+      printf("could not open netfilter device\n");
+      return 1;
+    }
+  }
+
+  while (fgets(line,MAX_LINE,in)!=NULL)
+  {
+    lineno++;
+    n=strlen(line);
+    if ((n>0) && (line[n-1]!='\n') && !feof(in)) lineError("line too long","");
+    while ((n>0) && ((line[n-1]=='\n') || (line[n-1]=='\r'))) line[--n]='\0';
+    if ((n==0) || (line[0]=='#')) continue;
+
+    if (line[0]=='*') { startTable(line+1); continue; }
+    if (strcmp(line,"COMMIT")==0) { commitTable(fd); continue; }
+    if (!table) lineError("rule outside of a table","");
+    n=splitLine(line,args,MAX_ARGS);
+    if (line[0]==':') addChain(n,args);
+    else addRule(n,args);
+  }
+  if (table) lineError("COMMIT missing at end of input","");
+
+  if (fd>=0) close(fd);
+  if (in!=stdin) fclose(in);
+  return 0;
+}
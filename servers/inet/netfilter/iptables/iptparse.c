@@ -0,0 +1,1101 @@
+/*
+ *  MINIX-3 network filter - command line parser of the iptables tools
+ *
+ *  (C) 2007 Brian Schueler (brian.schueler@gmx.de)
+ *  
+ *      As part of the diploma thesis:
+ *      Analysis and Porting of a network 
+ *      filtering architecture on Minix-3
+ *      under supervision of
+ *      Prof. Dr. rer. nat. Ruediger Weis
+ *      at the University of Applied Sciences Berlin
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <nfdefs.h>
+#include "iptparse.h"
+#include <net/gen/in.h>
+#include <net/gen/inet.h>
+
+enum tokenSelect {T_NONE, T_TABLENAME, T_CHAINNAME, T_SOURCE, T_DEST, \
+                  T_TARGET, T_INSERT, T_APPEND, T_CREATE, T_DELETE, \
+		  T_DELETENUM, T_INSERTNUM, \
+		  T_REMOVE, T_FLUSH, T_INIF, T_OUTIF, T_PROTO, T_TARGETOPTS, \
+                  T_ZERO, T_PROTOOPTS, T_FRAG, T_POLICY, T_POLICYNAME, \
+                  T_MATCH, T_LIST};
+enum protTokenSelect {P_NONE, P_SPORT, P_DPORT, P_ICMPTYPE, P_ICMPCODE, \
+                      P_STATE, P_MATCHSET, P_MATCHSETDIR, P_LIMIT, \
+                      P_LIMITBURST, P_HASHUPTO, P_HASHABOVE, P_HASHBURST, \
+                      P_HASHSIZE, P_HASHMODE, P_RECENTNAME, P_RECENTSECONDS, \
+                      P_RECENTHITS};
+enum targTokenSelect {J_NONE, J_LOGPREFIX, J_ULOGPREFIX, J_ULOGCPRANGE, \
+                      J_TOSOURCE, J_TODEST, J_TOPORTS, J_QUEUENUM, \
+                      J_SYNPROXYMSS};
+
+static enum tokenSelect token;
+static enum actionSelect action;
+static enum protTokenSelect prottoken;
+static enum targTokenSelect targtoken;
+static int tokenOption;
+static int tableset, protoset, matchset;
+
+void setAction(enum actionSelect act)
+{
+  if (action==A_NONE) { action = act; return; }
+  printf("action error\n");
+  exit(2);
+}
+
+void setToken(enum tokenSelect tkn)
+{
+  if (token==T_NONE) { tokenOption=0; token = tkn; return; }
+  printf("option error\n");
+  exit(2);
+}
+
+void setProtToken(enum protTokenSelect tkn)
+{
+  if (prottoken==P_NONE) { tokenOption=0; prottoken = tkn; return; }
+  printf("match info option error\n");
+  exit(2);
+}
+
+void setTargToken(enum targTokenSelect tkn)
+{
+  if (targtoken==P_NONE) { tokenOption=0; targtoken = tkn; return; }
+  printf("target info option error\n");
+  exit(2);
+}
+
+int setIF(char *interface, char *name)
+{
+  if (strlen(interface)==0)
+  {
+    strncpy(interface,name,32);
+    return 1;
+  }
+  return 0;
+}
+
+unsigned char b2m(int bits)
+{
+  int i=128;
+  int ret=0;
+  while (i>=1)
+  {
+    if (bits > 0) ret+=i;
+    bits--;
+    i=i/2;
+  }
+  return ret;
+}
+
+int setIP(in_addr_t *ipaddr, in_addr_t *mask, char *name)
+{
+  char ip[32]="";
+  char m[32]="";
+
+  memset(ip,0,32);
+  memset(m,0,32);
+  if (index(name,'/'))
+  {
+     strncpy(ip,name,(index(name,'/')-name));
+     strcpy(m,index(name,'/')+1);
+     if ( !inet_aton(ip,ipaddr) )
+     {
+       printf("invalid IP address: %s\n",ip);
+       exit(2);
+     }
+     if ( strlen(m)<3 )
+     {
+       int maskbits=atoi(m);
+       int j;
+
+       if ( (maskbits<0) || (maskbits>32) )
+       {
+         printf("invalid mask bit size: %d\n",maskbits);
+         exit(2);
+       }
+       for (j=0;j<4;j++)
+       {
+	 ((char*)mask)[j]=b2m(maskbits-8*j);
+       }
+     }
+     else
+     {
+       if ( !inet_aton(m,mask) )
+       {
+         printf("invalid network mask: %s\n",m);
+         exit(2);
+       }
+     }
+  }
+  else
+  {
+     if ( !inet_aton(name,ipaddr) )
+     {
+       printf("invalid IP address: %s\n",name);
+       exit(2);
+     }
+     inet_aton("255.255.255.255",mask);
+  }
+  return 1;
+}
+
+int setRange(unsigned short *start, unsigned short *end, char *name)
+{
+  char s[32]="";
+  char e[32]="";
+
+  memset(s,0,32);
+  memset(e,0,32);
+  if (index(name,':'))
+  {
+     strncpy(s,name,(index(name,':')-name));
+     strcpy(e,index(name,':')+1);
+     *start=atoi(s);
+     *end=atoi(e);
+  }
+  else
+  {
+     strncpy(s,name,32);
+     *start=atoi(s);
+     *end=atoi(s);
+  }
+  return 1;
+}
+
+/* parses [ipaddr[-ipaddr]][:port[-port]], or port[-port] if ports_only */
+void setNatRange(struct nf_nat_range *range, char *name, int ports_only)
+{
+  char buf[64];
+  char *ports, *p;
+
+  strncpy(buf,name,sizeof(buf)-1);
+  buf[sizeof(buf)-1]='\0';
+  ports=buf;
+  if (!ports_only)
+  {
+    ports=index(buf,':');
+    if (ports) *ports++='\0';
+    if ((p=index(buf,'-'))!=NULL) *p++='\0';
+    if (!inet_aton(buf,&range->minip) ||
+        ((p!=NULL) && !inet_aton(p,&range->maxip)))
+    {
+      printf("invalid IP address range: %s\n",name);
+      exit(2);
+    }
+    if (p==NULL) range->maxip=range->minip;
+    if (ntohl(range->minip)>ntohl(range->maxip))
+    {
+      printf("invalid IP address range: %s\n",name);
+      exit(2);
+    }
+  }
+  if (ports==NULL) return;
+  if ((p=index(ports,'-'))!=NULL) *p++='\0';
+  range->minport=atoi(ports);
+  range->maxport=p ? atoi(p) : range->minport;
+  if ((range->minport==0) || (range->minport>range->maxport))
+  {
+    printf("invalid port range: %s\n",name);
+    exit(2);
+  }
+}
+
+void setPolicy(int *policy, char *pol)
+{
+  if (strlen(pol)==0)
+  {
+    printf("no policy given\n");
+    exit(2);
+  }
+  if (strcmp(pol,"ACCEPT")==0) { *policy=NF_ACCEPT; return; }
+  if (strcmp(pol,"DROP")==0) { *policy=NF_DROP; return; }
+  printf("unknown policy: %s\n",pol);
+  exit(2);
+}
+
+void setChainName(char *chain, char *name)
+{
+  if (strlen(chain)==0)
+  {
+    strncpy(chain,name,32);
+    return;
+  }
+  printf("chain parameter misuse\n");
+}
+
+void setTargetName(char *target, char *name)
+{
+  if (strlen(target)==0)
+  {
+    strncpy(target,name,32);
+    return;
+  }
+  printf("target parameter misuse\n");
+  exit(2);
+}
+
+void setTable(int *table, char *name)
+{
+  if (tableset)
+  {
+    printf("table parameter misuse\n");
+    exit(2);
+  }
+  tableset=1;
+  if ( strcmp(name,"filter") == 0 ) { *table=NF_TABLE_FILTER; return; };
+  if ( strcmp(name,"nat") == 0 )    { *table=NF_TABLE_NAT; return; };
+  if ( strcmp(name,"mangle") == 0 ) { *table=NF_TABLE_MANGLE; return; };
+  printf("no such table: %s\n",name);
+  exit(2);
+}
+
+void setMatch(char *match, char *name)
+{
+  if (matchset)
+  {
+    printf("match parameter misuse\n");
+    exit(2);
+  }
+  matchset=1;
+  if ( strcmp(name,"state") == 0 ) { strcpy(match,"STATE"); return; };
+  if ( strcmp(name,"set") == 0 )   { strcpy(match,"SET"); return; };
+  if ( strcmp(name,"limit") == 0 ) { strcpy(match,"LIMIT"); return; };
+  if ( strcmp(name,"hashlimit") == 0 ) { strcpy(match,"HASHLIMIT"); return; };
+  if ( strcmp(name,"recent") == 0 ) { strcpy(match,"RECENT"); return; };
+  printf("no such match: %s\n",name);
+  exit(2);
+}
+
+void setStateMask(unsigned int *mask, char *list)
+{
+  char *name;
+
+  *mask=0;
+  for (name=strtok(list,","); name!=NULL; name=strtok(NULL,","))
+  {
+    if (strcmp(name,"NEW")==0)
+      *mask|=IPT_STATE_BIT(IP_CT_NEW);
+    else if (strcmp(name,"ESTABLISHED")==0)
+      *mask|=IPT_STATE_BIT(IP_CT_ESTABLISHED);
+    else if (strcmp(name,"RELATED")==0)
+      *mask|=IPT_STATE_BIT(IP_CT_RELATED);
+    else if (strcmp(name,"INVALID")==0)
+      *mask|=IPT_STATE_INVALID;
+    else
+    {
+      printf("no such state: %s\n",name);
+      exit(2);
+    }
+  }
+}
+
+/* exits unless the option opt belongs to the -m match given */
+void checkMatch(char *extMatch, char *match, char *opt)
+{
+  if (strcmp(extMatch,match)!=0)
+  {
+    printf("option %s only valid on -m %s\n",opt,match);
+    exit(2);
+  }
+}
+
+/* parses n[/second|/minute|/hour|/day] into the time between two
+ * packets, in 1/IPT_LIMIT_SCALE seconds
+ */
+void setRate(u32_t *avg, char *name)
+{
+  unsigned long n, mult=1;
+  char *unit;
+
+  n=strtoul(name,&unit,10);
+  if (*unit=='/')
+  {
+    unit++;
+    if ((*unit!='\0') && (strncmp(unit,"second",strlen(unit))==0))
+      mult=1;
+    else if ((*unit!='\0') && (strncmp(unit,"minute",strlen(unit))==0))
+      mult=60;
+    else if ((*unit!='\0') && (strncmp(unit,"hour",strlen(unit))==0))
+      mult=60*60;
+    else if ((*unit!='\0') && (strncmp(unit,"day",strlen(unit))==0))
+      mult=24*60*60;
+    else unit=NULL;
+  }
+  else if (*unit!='\0') unit=NULL;
+  if ((unit==NULL) || (n==0))
+  {
+    printf("invalid rate: %s\n",name);
+    exit(2);
+  }
+  if (IPT_LIMIT_SCALE*mult/n==0)
+  {
+    printf("rate too fast: %s\n",name);
+    exit(2);
+  }
+  *avg=IPT_LIMIT_SCALE*mult/n;
+}
+
+/* options of -m recent that take no value, returns 0 if name is none */
+int setRecentFlag(struct ipt_recent_info *info, char *name)
+{
+  if (strcmp(name,"--set")==0) info->check_set|=IPT_RECENT_SET;
+  else if (strcmp(name,"--rcheck")==0) info->check_set|=IPT_RECENT_CHECK;
+  else if (strcmp(name,"--update")==0) info->check_set|=IPT_RECENT_UPDATE;
+  else if (strcmp(name,"--remove")==0) info->check_set|=IPT_RECENT_REMOVE;
+  else if (strcmp(name,"--rsource")==0) info->side=IPT_RECENT_SOURCE;
+  else if (strcmp(name,"--rdest")==0) info->side=IPT_RECENT_DEST;
+  else return 0;
+  return 1;
+}
+
+void setProto(int *proto, char *name)
+{
+  if (protoset)
+  {
+    printf("proto parameter misuse\n");
+    exit(2);
+  }
+  protoset=1;
+  if ( strcmp(name,"tcp") == 0 )  { *proto=PROTO_TCP; return; };
+  if ( strcmp(name,"udp") == 0 )  { *proto=PROTO_UDP; return; };
+  if ( strcmp(name,"icmp") == 0 ) { *proto=PROTO_ICMP; return; };
+  if ( strcmp(name,"any") == 0 ) { *proto=PROTO_ANY; return; };
+  printf("no such protocol: %s\n",name);
+  exit(2);
+}
+
+/* Parses a command line into *cmd, exits on errors. argv[0] is
+ * skipped.
+ */
+void parseArgs(int argc, char **argv, struct ipt_cmd *cmd)
+{
+  int i;
+
+  int table=NF_TABLE_FILTER;     /* def: filter table */
+  char chainName[32]="";         /* chain name must be set */
+  in_addr_t source;     
+  in_addr_t sourcemask;
+  int sourceinv=0;               /* def: no intversion */
+  in_addr_t dest;     
+  in_addr_t destmask;
+  int destinv=0;                 /* def: no inverseion */
+  int proto=PROTO_ANY;           /* def: any protocol */
+  char inif[32]="";              /* def: any input device */
+  int inifinv=0;                 /* def: no inversion */
+  char outif[32]="";             /* def: any output device */
+  int outifinv=0;                /* def: no inversion */
+  char target[32]="";            /* target must be set */
+  int insertpos=1;               /* def: insert on first position */
+  int fragment=0;                /* def: fragment or not */
+  int fragmentinv=0;             /* def: no inversion */
+  char matchName[32]="ANY";
+  char extMatch[32]="";          /* def: no -m match */
+
+  int policy=-1;
+
+  unsigned short sport_start=0;    /* source port beginning */
+  unsigned short sport_end=65535;  /* source port end */
+  int sportinv=0;
+  unsigned short dport_start=0;    /* destination port beginning */
+  unsigned short dport_end=65535;  /* destination port end */
+  int dportinv=0;
+  unsigned short icmptype=0;
+  unsigned short icmpcode_start=0;
+  unsigned short icmpcode_end=0;
+  int icmpinv=0;
+  int protoopts=0;                 /* port or icmp options given */
+  unsigned int statemask=0;
+  char setname[IPT_SET_MAXNAMELEN]="";
+  int setflags=0;
+  struct ipt_rateinfo limit;       /* -m limit */
+  struct ipt_hashlimit_info hashlimit; /* -m hashlimit */
+  struct ipt_recent_info recent;   /* -m recent */
+  
+  char logprefix[ULOG_PREFIX_LEN]=""; /* Logging prefix */
+  size_t cprange=0;                /* ULOG payload bytes */
+  struct nf_nat_range natrange;    /* SNAT, DNAT, MASQUERADE, REDIRECT */
+  int queuenum=0;                  /* NFQUEUE */
+  int queuebypass=0;
+  int synproxymss=0;               /* SYNPROXY */
+  
+  int targoptsindex=0;
+  int protooptsindex=0;
+  int protooptsindexend=0;
+  int deleteindex=0;
+  int listzero=0;
+
+  source=inet_addr("0.0.0.0");
+  sourcemask=inet_addr("0.0.0.0");
+  dest=inet_addr("0.0.0.0");
+  destmask=inet_addr("0.0.0.0");
+  action=A_NONE;
+  token=T_NONE;
+  prottoken=P_NONE;
+  targtoken=J_NONE;
+  memset(&natrange,0,sizeof(natrange));
+  memset(&limit,0,sizeof(limit));
+  memset(&hashlimit,0,sizeof(hashlimit));
+  memset(&recent,0,sizeof(recent));
+  limit.avg=IPT_LIMIT_SCALE*60*60/3;       /* def: 3/hour */
+  limit.burst=5;
+  hashlimit.burst=5;
+  tableset=0;
+  protoset=0;
+  matchset=0;
+
+  for (i=1;i<argc;i++)
+  {
+    tokenOption=1;    /* to be unset by setToken */
+
+    /* Actions */
+    if (strcmp(argv[i],"-A")==0) { setAction(A_APPEND); setToken(T_APPEND); }
+    if (strcmp(argv[i],"-I")==0) { setAction(A_INSERT); setToken(T_INSERT); }
+    if (strcmp(argv[i],"-N")==0) { setAction(A_CREATE); setToken(T_CREATE); }
+    if (strcmp(argv[i],"-X")==0) { setAction(A_REMOVE); setToken(T_REMOVE); }
+    if (strcmp(argv[i],"-D")==0) { setAction(A_DELETE); setToken(T_DELETE); }
+    if (strcmp(argv[i],"-F")==0) { setAction(A_FLUSH); setToken(T_FLUSH); }
+    if ((strcmp(argv[i],"-Z")==0) && (action==A_LIST))
+    {
+      /* -L -Z lists the counters and zeroes them in one go */
+      tokenOption=0;
+      listzero=1;
+    }
+    else if (strcmp(argv[i],"-Z")==0) { setAction(A_ZERO); setToken(T_ZERO); }
+    if (strcmp(argv[i],"-L")==0)
+    {
+      setAction(A_LIST);
+      setToken(T_LIST);
+      /* the chain is optional, all of the table are listed without it */
+      if ((i+1>=argc) || (strncmp(argv[i+1],"-",1)==0)) token=T_NONE;
+    }
+    if (strcmp(argv[i],"-P")==0) { setAction(A_POLICY); setToken(T_POLICY); }
+
+    /* IP options */
+    if (strcmp(argv[i],"-t")==0) { setToken(T_TABLENAME); }
+    if (strcmp(argv[i],"-s")==0) { setToken(T_SOURCE); }
+    if (strcmp(argv[i],"-d")==0) { setToken(T_DEST); }
+    if (strcmp(argv[i],"-f")==0) { setToken(T_FRAG); }
+    if (strcmp(argv[i],"-p")==0) { setToken(T_PROTO); }
+    if (strcmp(argv[i],"-i")==0) { setToken(T_INIF); }
+    if (strcmp(argv[i],"-o")==0) { setToken(T_OUTIF); }
+    if (strcmp(argv[i],"-j")==0) { setToken(T_TARGET); }
+    if (strcmp(argv[i],"-m")==0) { setToken(T_MATCH); }
+
+    /* protocol related options */
+    if (strcmp(argv[i],"--sport")==0) { setProtToken(P_SPORT); }
+    if (strcmp(argv[i],"--dport")==0) { setProtToken(P_DPORT); }
+    if (strcmp(argv[i],"--icmp-type")==0) { setProtToken(P_ICMPTYPE); }
+    if (strcmp(argv[i],"--state")==0) { setProtToken(P_STATE); }
+    if (strcmp(argv[i],"--match-set")==0) { setProtToken(P_MATCHSET); }
+    if (strcmp(argv[i],"--limit")==0) { setProtToken(P_LIMIT); }
+    if (strcmp(argv[i],"--limit-burst")==0) { setProtToken(P_LIMITBURST); }
+    if (strcmp(argv[i],"--hashlimit-upto")==0) { setProtToken(P_HASHUPTO); }
+    if (strcmp(argv[i],"--hashlimit-above")==0) { setProtToken(P_HASHABOVE); }
+    if (strcmp(argv[i],"--hashlimit-burst")==0) { setProtToken(P_HASHBURST); }
+    if (strcmp(argv[i],"--hashlimit-htable-size")==0)
+      { setProtToken(P_HASHSIZE); }
+    if (strcmp(argv[i],"--hashlimit-mode")==0) { setProtToken(P_HASHMODE); }
+    if (strcmp(argv[i],"--name")==0) { setProtToken(P_RECENTNAME); }
+    if (strcmp(argv[i],"--seconds")==0) { setProtToken(P_RECENTSECONDS); }
+    if (strcmp(argv[i],"--hitcount")==0) { setProtToken(P_RECENTHITS); }
+    if (setRecentFlag(&recent,argv[i]))
+    {
+      /* no value follows, the options may end here */
+      tokenOption=0;
+      checkMatch(extMatch,"RECENT",argv[i]);
+      if ((i+1<argc) && (strncmp(argv[i+1],"-",1)==0) &&
+                        (!strncmp(argv[i+1],"--",2)==0))
+        token=T_NONE;
+    }
+
+    /* target related options */
+    if (strcmp(argv[i],"--log-prefix")==0) { setTargToken(J_LOGPREFIX); }
+    if (strcmp(argv[i],"--ulog-prefix")==0) { setTargToken(J_ULOGPREFIX); }
+    if (strcmp(argv[i],"--ulog-cprange")==0) { setTargToken(J_ULOGCPRANGE); }
+    if (strcmp(argv[i],"--to-source")==0) { setTargToken(J_TOSOURCE); }
+    if (strcmp(argv[i],"--to-destination")==0) { setTargToken(J_TODEST); }
+    if (strcmp(argv[i],"--to-ports")==0) { setTargToken(J_TOPORTS); }
+    if (strcmp(argv[i],"--queue-num")==0) { setTargToken(J_QUEUENUM); }
+    if (strcmp(argv[i],"--mss")==0) { setTargToken(J_SYNPROXYMSS); }
+    if (strcmp(argv[i],"--queue-bypass")==0)
+    {
+      /* no value follows */
+      tokenOption=0;
+      queuebypass=1;
+    }
+
+    if (tokenOption)
+    {
+      if (token == T_NONE)
+      {
+        printf("unknown parameter: %s\n",argv[i]);
+        exit(1);
+      }
+      if (token == T_TABLENAME)
+      {
+        setTable(&table,argv[i]);
+        token=T_NONE;
+      }
+
+      if (token == T_LIST)
+      {
+        setChainName(chainName,argv[i]);
+        token=T_NONE;
+      }
+
+      if (token == T_ZERO)
+      {
+        setChainName(chainName,argv[i]);
+        token=T_NONE;
+      }
+
+      if (token == T_APPEND)
+      {
+        setChainName(chainName,argv[i]);
+        token=T_NONE;
+      }
+
+      if (token == T_INSERTNUM)
+      {
+        insertpos=atoi(argv[i]);
+	if (insertpos<=0)
+	{
+	  printf("illegal insert position\n");
+	  exit(2);
+	}
+        token=T_NONE;
+      }
+
+      if (token == T_INSERT)
+      {
+        setChainName(chainName,argv[i]);
+	/* the position is optional, the rule goes first without it */
+	if ((i+1<argc) && (strspn(argv[i+1],"0123456789")==strlen(argv[i+1])))
+	  token=T_INSERTNUM;
+	else
+	  token=T_NONE;
+      }
+
+      if (token == T_FLUSH)
+      {
+        setChainName(chainName,argv[i]);
+        token=T_NONE;
+      }
+
+      if ((token == T_CREATE) || (token == T_REMOVE))
+      {
+        setChainName(chainName,argv[i]);
+        token=T_NONE;
+      }
+
+      if (token == T_DELETENUM)
+      {
+        deleteindex=atoi(argv[i]);
+	if (deleteindex<=0)
+	{
+	  printf("illegal delete index\n");
+	  exit(2);
+	}
+        token=T_NONE;
+      }
+
+      if (token == T_DELETE)
+      {
+        setChainName(chainName,argv[i]);
+        token=T_DELETENUM;
+      }
+
+      if (token == T_POLICYNAME)
+      {
+        setPolicy(&policy,argv[i]);
+        token=T_NONE;
+      }
+
+      if (token == T_POLICY)
+      {
+	if (i==argc-1)
+	{
+	  printf("policy argument needed\n");
+	  exit(2);
+	}
+        setChainName(chainName,argv[i]);
+        token=T_POLICYNAME;
+      }
+
+      if (token == T_TABLENAME)
+      {
+        if (action!=A_NONE)
+        {
+          printf("table option must be the first parameter\n");
+          exit(2);
+        }
+        setTable(&table,argv[i]);
+        token=T_NONE;
+      }
+
+      if (token == T_FRAG)
+      {
+        if (strcmp(argv[i],"!")==0) { fragmentinv=!fragmentinv; }
+        else
+        {
+          fragment=atoi(argv[i]);
+          token=T_NONE;
+        }
+      }
+
+      if (token == T_SOURCE)
+      {
+        if (strcmp(argv[i],"!")==0) { sourceinv=!sourceinv; }
+        else
+        {
+          setIP(&source,&sourcemask,argv[i]);
+          token=T_NONE;
+        }
+      }
+
+      if (token == T_DEST)
+      {
+        if (strcmp(argv[i],"!")==0) { destinv=!destinv; }
+        else
+        {
+          setIP(&dest,&destmask,argv[i]);
+          token=T_NONE;
+        }
+      }
+
+      if (token == T_INIF)
+      {
+        if (strcmp(argv[i],"!")==0) { inifinv=!inifinv; }
+        else
+        {
+          setIF(inif,argv[i]);
+          token=T_NONE;
+        }
+      }
+
+      if (token == T_OUTIF)
+      {
+        if (strcmp(argv[i],"!")==0) { outifinv=!outifinv; }
+        else
+        {
+          setIF(outif,argv[i]);
+          token=T_NONE;
+        }
+      }
+
+      if (token == T_PROTO)
+      {
+        setProto(&proto,argv[i]);
+	token=T_PROTOOPTS;
+      }
+
+      if (token == T_MATCH)
+      {
+        setMatch(extMatch,argv[i]);
+	token=T_PROTOOPTS;
+      }
+
+      if (token == T_TARGET)
+      {
+        setTargetName(target,argv[i]);
+	token=T_TARGETOPTS;
+      }
+
+      if (token == T_TARGETOPTS)
+      {
+        if (targoptsindex==0) targoptsindex=i;
+	if (targtoken==J_LOGPREFIX) 
+	{
+	  if (strcmp(target,"LOG")!=0)
+	  {
+	    printf("option --log-prefix only valid on LOG target\n");
+	    exit(2);
+	  }
+	  strncpy(logprefix,argv[i],30);
+	}
+	if ((targtoken==J_ULOGPREFIX) || (targtoken==J_ULOGCPRANGE))
+	{
+	  if (strcmp(target,"ULOG")!=0)
+	  {
+	    printf("option %s only valid on ULOG target\n",argv[i-1]);
+	    exit(2);
+	  }
+	  if (targtoken==J_ULOGPREFIX)
+	    strncpy(logprefix,argv[i],ULOG_PREFIX_LEN-1);
+	  else
+	    cprange=atoi(argv[i]);
+	}
+	if (((targtoken==J_TOSOURCE) && (strcmp(target,"SNAT")!=0)) ||
+	    ((targtoken==J_TODEST) && (strcmp(target,"DNAT")!=0)) ||
+	    ((targtoken==J_TOPORTS) && (strcmp(target,"MASQUERADE")!=0) &&
+	                               (strcmp(target,"REDIRECT")!=0)))
+	{
+	  printf("option %s not valid on %s target\n",argv[i-1],target);
+	  exit(2);
+	}
+	if ((targtoken==J_TOSOURCE) || (targtoken==J_TODEST) ||
+	    (targtoken==J_TOPORTS))
+	  setNatRange(&natrange,argv[i],targtoken==J_TOPORTS);
+	if (targtoken==J_QUEUENUM)
+	{
+	  if (strcmp(target,"NFQUEUE")!=0)
+	  {
+	    printf("option --queue-num only valid on NFQUEUE target\n");
+	    exit(2);
+	  }
+	  queuenum=atoi(argv[i]);
+	  if ((queuenum<0) || (queuenum>=NF_QUEUE_MAX))
+	  {
+	    printf("queue number must be 0 to %d\n",NF_QUEUE_MAX-1);
+	    exit(2);
+	  }
+	}
+	if (targtoken==J_SYNPROXYMSS)
+	{
+	  if (strcmp(target,"SYNPROXY")!=0)
+	  {
+	    printf("option --mss only valid on SYNPROXY target\n");
+	    exit(2);
+	  }
+	  synproxymss=atoi(argv[i]);
+	  if ((synproxymss<536) || (synproxymss>65535))
+	  {
+	    printf("mss must be 536 to 65535\n");
+	    exit(2);
+	  }
+	}
+	targtoken=J_NONE;
+      }
+
+      if (token == T_PROTOOPTS)
+      {
+        if (protooptsindex==0) protooptsindex=i;
+	if (prottoken==P_SPORT) 
+	{
+	  if ((proto!=PROTO_TCP)&&(proto!=PROTO_UDP))
+	  {
+	    printf("source port range only valid on -p tcp and -p udp\n");
+	    exit(2);
+	  }
+          if (strcmp(argv[i],"!")==0) { sportinv=!sportinv; }
+	  else { setRange(&sport_start,&sport_end,argv[i]); protoopts=1; }
+	}
+	if (prottoken==P_DPORT) 
+	{
+	  if ((proto!=PROTO_TCP)&&(proto!=PROTO_UDP))
+	  {
+	    printf("destination port range only valid on -p tcp and -p udp\n");
+	    exit(2);
+	  }
+          if (strcmp(argv[i],"!")==0) { dportinv=!dportinv; }
+	  else { setRange(&dport_start,&dport_end,argv[i]); protoopts=1; }
+	}
+	if (prottoken==P_ICMPCODE) 
+	{
+	  setRange(&icmpcode_start,&icmpcode_end,argv[i]);
+	  prottoken=P_NONE;
+	}
+	if (prottoken==P_ICMPTYPE) 
+	{
+	  if (proto!=PROTO_ICMP)
+	  {
+	    printf("icmp type only valid on -p icmp\n");
+	    exit(2);
+	  }
+          if (strcmp(argv[i],"!")==0) { icmpinv=!icmpinv; }
+	  else { setRange(&icmptype,&icmptype,argv[i]); prottoken=P_ICMPCODE;
+	         protoopts=1; }
+	}
+	if (prottoken==P_STATE) 
+	{
+	  if (strcmp(extMatch,"STATE")!=0)
+	  {
+	    printf("option --state only valid on -m state\n");
+	    exit(2);
+	  }
+	  setStateMask(&statemask,argv[i]);
+	  prottoken=P_NONE;
+	}
+	if (prottoken==P_MATCHSETDIR) 
+	{
+	  if (strcmp(argv[i],"src")==0) setflags|=IPT_SET_SRC;
+	  else if (strcmp(argv[i],"dst")!=0)
+	  {
+	    printf("--match-set direction must be src or dst\n");
+	    exit(2);
+	  }
+	  prottoken=P_NONE;
+	}
+	if (prottoken==P_MATCHSET) 
+	{
+	  if (strcmp(extMatch,"SET")!=0)
+	  {
+	    printf("option --match-set only valid on -m set\n");
+	    exit(2);
+	  }
+          if (strcmp(argv[i],"!")==0) { setflags^=IPT_SET_INV; }
+	  else
+	  {
+	    if (strlen(argv[i])>=IPT_SET_MAXNAMELEN)
+	    {
+	      printf("set name too long: %s\n",argv[i]);
+	      exit(2);
+	    }
+	    strcpy(setname,argv[i]);
+	    prottoken=P_MATCHSETDIR;
+	  }
+	}
+	if ((prottoken==P_LIMIT) || (prottoken==P_LIMITBURST))
+	{
+	  checkMatch(extMatch,"LIMIT",argv[i-1]);
+	  if (prottoken==P_LIMIT) setRate(&limit.avg,argv[i]);
+	  else limit.burst=atoi(argv[i]);
+	  prottoken=P_NONE;
+	}
+	if ((prottoken==P_HASHUPTO) || (prottoken==P_HASHABOVE) ||
+	    (prottoken==P_HASHBURST) || (prottoken==P_HASHSIZE) ||
+	    (prottoken==P_HASHMODE))
+	{
+	  checkMatch(extMatch,"HASHLIMIT",argv[i-1]);
+	  if (prottoken==P_HASHUPTO) setRate(&hashlimit.avg,argv[i]);
+	  if (prottoken==P_HASHABOVE)
+	  {
+	    setRate(&hashlimit.avg,argv[i]);
+	    hashlimit.flags|=IPT_HASHLIMIT_ABOVE;
+	  }
+	  if (prottoken==P_HASHBURST) hashlimit.burst=atoi(argv[i]);
+	  if (prottoken==P_HASHSIZE) hashlimit.size=atoi(argv[i]);
+	  if (prottoken==P_HASHMODE)
+	  {
+	    if (strcmp(argv[i],"dstip")==0) hashlimit.flags|=IPT_HASHLIMIT_DST;
+	    else if (strcmp(argv[i],"srcip")!=0)
+	    {
+	      printf("--hashlimit-mode must be srcip or dstip\n");
+	      exit(2);
+	    }
+	  }
+	  prottoken=P_NONE;
+	}
+	if ((prottoken==P_RECENTNAME) || (prottoken==P_RECENTSECONDS) ||
+	    (prottoken==P_RECENTHITS))
+	{
+	  checkMatch(extMatch,"RECENT",argv[i-1]);
+	  if (prottoken==P_RECENTNAME)
+	  {
+	    if (strlen(argv[i])>=IPT_RECENT_NAME_LEN)
+	    {
+	      printf("list name too long: %s\n",argv[i]);
+	      exit(2);
+	    }
+	    strcpy(recent.name,argv[i]);
+	  }
+	  if (prottoken==P_RECENTSECONDS) recent.seconds=atoi(argv[i]);
+	  if (prottoken==P_RECENTHITS) recent.hit_count=atoi(argv[i]);
+	  prottoken=P_NONE;
+	}
+	else if ((prottoken==P_NONE) && (strcmp(extMatch,"RECENT")==0) &&
+	         (strcmp(argv[i],"!")==0))
+	  recent.invert=!recent.invert;
+      }
+
+      if ((token == T_PROTOOPTS) && (i+1<argc) &&
+                                    (strncmp(argv[i+1],"-",1)==0) &&
+		                    (!strncmp(argv[i+1],"--",2)==0))
+      {
+        protooptsindexend=i-1;
+	token=T_NONE;
+      }
+
+    }
+  }
+
+  switch (proto)
+  {
+    case PROTO_TCP: strcpy(matchName,"TCP"); break;
+    case PROTO_UDP: strcpy(matchName,"UDP"); break;
+    case PROTO_ICMP: strcpy(matchName,"ICMP"); break;
+    case PROTO_ANY: strcpy(matchName,"ANY"); break;
+    default: break;
+  }
+  if (strlen(extMatch)!=0)
+  {
+    /* a rule holds a single match besides the IP one */
+    if (protoopts)
+    {
+      printf("-m can not be combined with port or icmp options\n");
+      exit(2);
+    }
+    strcpy(matchName,extMatch);
+  }
+  if ((strcmp(matchName,"SET")==0) && (strlen(setname)==0))
+  {
+    printf("-m set needs --match-set <name> <src|dst>\n");
+    exit(2);
+  }
+  if ((strcmp(matchName,"HASHLIMIT")==0) && (hashlimit.avg==0))
+  {
+    printf("-m hashlimit needs --hashlimit-upto or --hashlimit-above\n");
+    exit(2);
+  }
+  if ((strcmp(matchName,"RECENT")==0) &&
+      (recent.check_set!=IPT_RECENT_SET) &&
+      (recent.check_set!=IPT_RECENT_CHECK) &&
+      (recent.check_set!=IPT_RECENT_UPDATE) &&
+      (recent.check_set!=IPT_RECENT_REMOVE))
+  {
+    printf("-m recent needs one of --set, --rcheck, --update, --remove\n");
+    exit(2);
+  }
+
+  memset(cmd,0,sizeof(*cmd));
+  cmd->action=action;
+  cmd->table=table;
+  strcpy(cmd->chain,chainName);
+  strcpy(cmd->match,matchName);
+  strcpy(cmd->target,target);
+  cmd->policy=policy;
+  cmd->deleteindex=deleteindex;
+  cmd->insertpos=insertpos;
+  cmd->listzero=listzero;
+
+  memcpy(&cmd->ip.src,&source,sizeof(in_addr_t));
+  memcpy(&cmd->ip.smsk,&sourcemask,sizeof(in_addr_t));
+  memcpy(&cmd->ip.dst,&dest,sizeof(in_addr_t));
+  memcpy(&cmd->ip.dmsk,&destmask,sizeof(in_addr_t));
+  strcpy(cmd->ip.iniface,inif);
+  strcpy(cmd->ip.outiface,outif);
+  strcpy((char*)cmd->ip.iniface_mask,inif);
+  strcpy((char*)cmd->ip.outiface_mask,outif);
+  cmd->ip.proto=proto;
+  cmd->ip.flags=fragment;
+  cmd->ip.invflags=(inifinv?IPT_INV_VIA_IN:0) |
+		   (outifinv?IPT_INV_VIA_OUT:0) |
+		   (sourceinv?IPT_INV_SRCIP:0) |
+		   (destinv?IPT_INV_DSTIP:0) |
+		   (fragmentinv?IPT_INV_FRAG:0); 
+
+  if (strcmp(matchName,"STATE")==0)
+  {
+    cmd->matchinfo.state.statemask=statemask;
+    cmd->matchinfosize=sizeof(struct ipt_state_info);
+  }
+  else if (strcmp(matchName,"SET")==0)
+  {
+    strcpy(cmd->matchinfo.set.name,setname);
+    cmd->matchinfo.set.index=-1;
+    cmd->matchinfo.set.flags=setflags;
+    cmd->matchinfosize=sizeof(struct ipt_set_info);
+  }
+  else if (strcmp(matchName,"LIMIT")==0)
+  {
+    cmd->matchinfo.limit=limit;
+    cmd->matchinfosize=sizeof(struct ipt_rateinfo);
+  }
+  else if (strcmp(matchName,"HASHLIMIT")==0)
+  {
+    cmd->matchinfo.hashlimit=hashlimit;
+    cmd->matchinfosize=sizeof(struct ipt_hashlimit_info);
+  }
+  else if (strcmp(matchName,"RECENT")==0)
+  {
+    cmd->matchinfo.recent=recent;
+    cmd->matchinfosize=sizeof(struct ipt_recent_info);
+  }
+  else switch(proto)
+  {
+    case PROTO_TCP:
+      cmd->matchinfo.tcp.spts[0]=sport_start;
+      cmd->matchinfo.tcp.spts[1]=sport_end;
+      cmd->matchinfo.tcp.dpts[0]=dport_start;
+      cmd->matchinfo.tcp.dpts[1]=dport_end;
+      cmd->matchinfo.tcp.option=0;
+      cmd->matchinfo.tcp.flg_mask=0;
+      cmd->matchinfo.tcp.flg_cmp=0;
+      cmd->matchinfo.tcp.invflags=(sportinv?IPT_TCP_INV_SRCPT:0) |
+                                  (dportinv?IPT_TCP_INV_DSTPT:0); 
+      cmd->matchinfosize=sizeof(struct ipt_tcp);
+      break;
+    case PROTO_UDP:
+      cmd->matchinfo.udp.spts[0]=sport_start;
+      cmd->matchinfo.udp.spts[1]=sport_end;
+      cmd->matchinfo.udp.dpts[0]=dport_start;
+      cmd->matchinfo.udp.dpts[1]=dport_end;
+      cmd->matchinfo.udp.invflags=(sportinv?IPT_UDP_INV_SRCPT:0) |
+                                  (dportinv?IPT_UDP_INV_DSTPT:0); 
+      cmd->matchinfosize=sizeof(struct ipt_udp);
+      break;
+    case PROTO_ICMP:
+      cmd->matchinfo.icmp.type=icmptype;
+      cmd->matchinfo.icmp.code[0]=icmpcode_start;
+      cmd->matchinfo.icmp.code[1]=icmpcode_end;
+      cmd->matchinfo.icmp.invflags=icmpinv;
+      cmd->matchinfosize=sizeof(struct ipt_icmp);
+      break;
+    default:
+      break;
+  }
+
+  if (queuebypass && (strcmp(target,"NFQUEUE")!=0))
+  {
+    printf("option --queue-bypass only valid on NFQUEUE target\n");
+    exit(2);
+  }
+  memset(&cmd->targinfo,0,sizeof(cmd->targinfo));
+  if (strcmp(target,"ULOG")==0)
+  {
+    strncpy(cmd->targinfo.ulog.prefix,logprefix,ULOG_PREFIX_LEN-1);
+    cmd->targinfo.ulog.copy_range=cprange;
+  }
+  else if (strcmp(target,"NFQUEUE")==0)
+  {
+    cmd->targinfo.nfqueue.queuenum=queuenum;
+    cmd->targinfo.nfqueue.flags=queuebypass ? IPT_NFQ_BYPASS : 0;
+  }
+  else if (strcmp(target,"SYNPROXY")==0)
+  {
+    if (proto!=PROTO_TCP)
+    {
+      printf("SYNPROXY only valid on -p tcp\n");
+      exit(2);
+    }
+    cmd->targinfo.synproxy.mss=synproxymss;
+  }
+  else if ((strcmp(target,"SNAT")==0) || (strcmp(target,"DNAT")==0) ||
+           (strcmp(target,"MASQUERADE")==0) || (strcmp(target,"REDIRECT")==0))
+  {
+    if ((natrange.minip==0) &&
+        ((strcmp(target,"SNAT")==0) || (strcmp(target,"DNAT")==0)))
+    {
+      printf("%s needs --%s\n",target,
+             strcmp(target,"SNAT")==0 ? "to-source" : "to-destination");
+      exit(2);
+    }
+    cmd->targinfo.nat=natrange;
+  }
+  else
+    strncpy(cmd->targinfo.log.prefix,logprefix,30);
+}
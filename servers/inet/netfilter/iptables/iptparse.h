@@ -0,0 +1,56 @@
+#ifndef IPTPARSE_H
+#define IPTPARSE_H IPTPARSE_H
+
+#include <ip_tables.h>
+#include <nfconntrack.h>
+#include <../targets/ipt_LOG.h>
+#include <../targets/ipt_ULOG.h>
+#include <../targets/ipt_NFQUEUE.h>
+#include <nfqueue.h>
+#include <nfnat.h>
+#include <nfsynproxy.h>
+#include <../targets/ipt_state.h>
+
+#define PROTO_ANY 0
+#define PROTO_TCP 6
+#define PROTO_ICMP 1
+#define PROTO_UDP 17
+
+enum actionSelect {A_NONE, A_APPEND, A_CREATE, A_DELETE, A_INSERT, \
+                   A_REMOVE, A_FLUSH, A_ZERO, A_POLICY, A_LIST};
+
+/* a command line as understood by parseArgs */
+struct ipt_cmd {
+  enum actionSelect action;
+  int table;
+  char chain[32];
+  char match[32];                /* match module of the rule */
+  char target[32];
+  struct ipt_ip ip;
+  union {
+    struct ipt_tcp tcp;
+    struct ipt_udp udp;
+    struct ipt_icmp icmp;
+    struct ipt_state_info state;
+    struct ipt_set_info set;
+    struct ipt_rateinfo limit;
+    struct ipt_hashlimit_info hashlimit;
+    struct ipt_recent_info recent;
+  } matchinfo;
+  int matchinfosize;             /* 0 if the match takes none */
+  union {
+    struct ipt_log_info log;
+    struct ipt_ulog_info ulog;
+    struct nf_nat_range nat;
+    struct ipt_nfq_info nfqueue;
+    struct ipt_synproxy_info synproxy;
+  } targinfo;
+  int policy;
+  int deleteindex;               /* counted from 1 */
+  int insertpos;                 /* counted from 1 */
+  int listzero;                  /* -L -Z: zero what was listed */
+};
+
+void parseArgs(int argc, char **argv, struct ipt_cmd *cmd);
+
+#endif
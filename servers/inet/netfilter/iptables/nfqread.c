@@ -0,0 +1,149 @@
+/*
+ *  MINIX-3 network filter - packet queue reader
+ *
+ *  Reads the packets the NFQUEUE target passes to a queue, prints them
+ *  and gives the verdict on all packets of a read with one batch
+ *  verdict:
+ *
+ *      iptables -A FORWARD -p tcp --dport 80 -j NFQUEUE --queue-num 1
+ *      nfqread -q 1
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <nfdefs.h>
+#include <nfqueue.h>
+#include <ip_tables.h>
+#include <net/gen/in.h>
+#include <net/gen/inet.h>
+
+#define READ_SIZE 32768
+
+static unsigned char buf[READ_SIZE];
+static char *hooks[]={"?","PREROUTING","INPUT","FORWARD","POSTROUTING",
+                      "OUTPUT"};
+
+void printHelp( void )
+{
+   printf("nfqread: [-q <n>] [-c <n>] [-d] [-s] [-x] [device]\n");
+   printf("\n");
+   printf("          prints packets passed on by the NFQUEUE target and\n");
+   printf("          lets them through, device is /dev/netfilter0 if not\n");
+   printf("          given\n");
+   printf("\n");
+   printf("          options: -q <n>              queue to read (def: 0)\n");
+   printf("                   -c <n>              packet bytes to read\n");
+   printf("                                       (def: all)\n");
+   printf("                   -d                  drop the packets instead\n");
+   printf("                   -s                  silent, print nothing\n");
+   printf("                   -x                  dump the packet bytes\n");
+}
+
+void printPacket(const struct nfq_packet *pkt, int dump)
+{
+  const unsigned char *p=(const unsigned char *)(pkt+1);
+  ipaddr_t src, dst;
+  int i, ihl;
+
+  printf("%lu %s IN=%s OUT=%s LEN=%u",(unsigned long)pkt->id,
+         pkt->hook<=NF_IP_NUMHOOKS ? hooks[pkt->hook] : hooks[0],
+         pkt->indev,pkt->outdev,pkt->pktlen);
+  if (pkt->caplen>=20)
+  {
+    memcpy(&src,p+12,4);
+    memcpy(&dst,p+16,4);
+    printf(" SRC=%s",inet_ntoa(src));
+    printf(" DST=%s PROTO=%u",inet_ntoa(dst),p[9]);
+    ihl=(p[0]&0x0f)*4;
+    if (((p[9]==6) || (p[9]==17)) && (pkt->caplen>=ihl+4))
+      printf(" SPT=%u DPT=%u",(p[ihl]<<8)|p[ihl+1],(p[ihl+2]<<8)|p[ihl+3]);
+  }
+  printf("\n");
+  if (dump)
+  {
+    for (i=0;i<pkt->caplen;i++)
+      printf("%02x%s",p[i],((i%16)==15 || i==pkt->caplen-1) ? "\n" : " ");
+  }
+}
+
+int main (int argc, char **argv)
+{
+  const struct nfq_packet *pkt;
+  struct nfq_bind bind;
+  struct nfq_verdict verdict;
+  char *dev="/dev/netfilter0";
+  int dump=0, silent=0, drop=0;
+  int fd, i, n, off;
+
+  memset(&bind,0,sizeof(bind));
+  for (i=1;i<argc;i++)
+  {
+    if ((strcmp(argv[i],"-q")==0) && (i+1<argc)) bind.queuenum=atoi(argv[++i]);
+    else if ((strcmp(argv[i],"-c")==0) && (i+1<argc)) bind.copy_range=atoi(argv[++i]);
+    else if (strcmp(argv[i],"-d")==0) drop=1;
+    else if (strcmp(argv[i],"-s")==0) silent=1;
+    else if (strcmp(argv[i],"-x")==0) dump=1;
+    else if (strcmp(argv[i],"-h")==0) { printHelp(); exit(0); }
+    else if (argv[i][0]!='-') dev=argv[i];
+    else { printHelp(); exit(1); }
+  }
+
+  fd=open(dev,O_RDWR);
+  if (fd<0) {
+    printf("could not open %s\n",dev);
+    return 1;
+  }
+  ioctl(fd,IOCTL_NFQ_BIND,NULL);
+  if (write(fd,&bind,sizeof(bind))!=sizeof(bind))
+  {
+    printf("could not read queue %u (bad number or already read)\n",
+           bind.queuenum);
+    close(fd);
+    return 1;
+  }
+
+  verdict.verdict=drop ? NF_DROP : NF_ACCEPT;
+  verdict.flags=NFQ_VERDICT_BATCH;
+  while ((n=read(fd,buf,READ_SIZE))>0)
+  {
+    pkt=NULL;
+    for (off=0;off+(int)sizeof(struct nfq_packet)<=n;off+=pkt->len)
+    {
+      pkt=(const struct nfq_packet *)(buf+off);
+      if (pkt->len<sizeof(struct nfq_packet)) break;
+      if (!silent) printPacket(pkt,dump);
+      verdict.id=pkt->id;
+    }
+    /* one verdict for everything read */
+    if ((pkt!=NULL) && (write(fd,&verdict,sizeof(verdict))<0))
+    {
+      printf("verdict on %s failed\n",dev);
+      break;
+    }
+    fflush(stdout);
+  }
+  if (n<0) printf("read from %s failed\n",dev);
+
+  close(fd);
+  return n<0;
+}
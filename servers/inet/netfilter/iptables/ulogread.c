@@ -0,0 +1,117 @@
+/*
+ *  MINIX-3 network filter - packet log reader
+ *
+ *  Prints the records the ULOG target stores in the log ring. The
+ *  ring is drained with large reads, each returning many records:
+ *
+ *      iptables -A INPUT -p tcp --dport 23 -j ULOG --ulog-prefix telnet
+ *      ulogread
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <nfdefs.h>
+#include <nflog.h>
+#include <net/gen/in.h>
+#include <net/gen/inet.h>
+
+#define READ_SIZE 32768
+
+static unsigned char buf[READ_SIZE];
+static char *hooks[]={"?","PREROUTING","INPUT","FORWARD","POSTROUTING",
+                      "OUTPUT"};
+
+void printHelp( void )
+{
+   printf("ulogread: [-x] [device]\n");
+   printf("\n");
+   printf("          prints packets logged by the ULOG target, device\n");
+   printf("          is /dev/nflog0 if not given\n");
+   printf("\n");
+   printf("          options: -x                  dump the captured bytes\n");
+}
+
+void printRecord(const struct nf_log_rec *rec, int dump)
+{
+  const unsigned char *p=(const unsigned char *)(rec+1);
+  ipaddr_t src, dst;
+  int i, ihl;
+
+  if (rec->lost) printf("*** %lu records lost\n",(unsigned long)rec->lost);
+  printf("%lu.%06lu %s %s IN=%s OUT=%s LEN=%u",
+         (unsigned long)rec->sec,(unsigned long)rec->usec,
+         rec->hook<=NF_IP_NUMHOOKS ? hooks[rec->hook] : hooks[0],
+         rec->prefix,rec->indev,rec->outdev,rec->pktlen);
+  if (rec->caplen>=20)
+  {
+    memcpy(&src,p+12,4);
+    memcpy(&dst,p+16,4);
+    printf(" SRC=%s",inet_ntoa(src));
+    printf(" DST=%s PROTO=%u",inet_ntoa(dst),p[9]);
+    ihl=(p[0]&0x0f)*4;
+    if (((p[9]==6) || (p[9]==17)) && (rec->caplen>=ihl+4))
+      printf(" SPT=%u DPT=%u",(p[ihl]<<8)|p[ihl+1],(p[ihl+2]<<8)|p[ihl+3]);
+  }
+  printf("\n");
+  if (dump)
+  {
+    for (i=0;i<rec->caplen;i++)
+      printf("%02x%s",p[i],((i%16)==15 || i==rec->caplen-1) ? "\n" : " ");
+  }
+}
+
+int main (int argc, char **argv)
+{
+  const struct nf_log_rec *rec;
+  char *dev="/dev/nflog0";
+  int dump=0;
+  int fd, i, n, off;
+
+  for (i=1;i<argc;i++)
+  {
+    if (strcmp(argv[i],"-x")==0) dump=1;
+    else if (strcmp(argv[i],"-h")==0) { printHelp(); exit(0); }
+    else if (argv[i][0]!='-') dev=argv[i];
+    else { printHelp(); exit(1); }
+  }
+
+  fd=open(dev,O_RDONLY);
+  if (fd<0) {
+    printf("could not open %s\n",dev);
+    return 1;
+  }
+
+  while ((n=read(fd,buf,READ_SIZE))>0)
+  {
+    for (off=0;off+(int)sizeof(struct nf_log_rec)<=n;off+=rec->len)
+    {
+      rec=(const struct nf_log_rec *)(buf+off);
+      if (rec->len<sizeof(struct nf_log_rec)) break;
+      printRecord(rec,dump);
+    }
+    fflush(stdout);
+  }
+  if (n<0) printf("read from %s failed\n",dev);
+
+  close(fd);
+  return n<0;
+}
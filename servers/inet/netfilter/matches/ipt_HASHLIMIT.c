@@ -0,0 +1,101 @@
+/*
+ * This is a module which is used for limiting the rate of packets per
+ * source or destination address, with a token bucket for every address
+ * in a table of fixed size.
+ */
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <errno.h>
+#include <sk_buff.h>
+#include <ip_tables.h>
+#include <net_device.h>
+#include <nfrate.h>
+#include "../targets/ipt_limit.h"
+#include "ipt_HASHLIMIT.h"
+#include <stdio.h>
+#include <string.h>
+
+static int
+ipt_hashlimit_match(const struct sk_buff *skb,
+		    const struct net_device *in,
+		    const struct net_device *out,
+		    const void *matchinfo,
+		    int offset,
+		    const void *hdr,
+		    u16_t datalen,
+		    int *hotdrop)
+{
+	const struct ipt_hashlimit_info *info = matchinfo;
+	const ip_hdr_t *iph = skb->nh.iph;
+	unsigned long now = nfRateNow();
+	struct nf_rate_node *node;
+	int fresh, ok;
+
+	node = nfRateAdd(info->table,
+			 (info->flags & IPT_HASHLIMIT_DST) ?
+			 iph->ih_dst : iph->ih_src, &fresh);
+	if (fresh)
+		node->credit = info->credit_cap;
+	else
+		node->credit = nfRateRefill(node->credit, info->credit_cap,
+					    now - node->stamp);
+	node->stamp = now;
+
+	ok = node->credit >= info->avg;
+	if (ok)
+		node->credit -= info->avg;
+
+	return ok ^ !!(info->flags & IPT_HASHLIMIT_ABOVE);
+}
+
+static int
+ipt_hashlimit_checkentry(const char *tablename,
+			 const struct ipt_ip *ip,
+			 void *matchinfo,
+			 unsigned int matchinfosize,
+			 unsigned int hook_mask)
+{
+	struct ipt_hashlimit_info *info = matchinfo;
+
+	if (info->avg == 0 || info->burst == 0 ||
+	    info->avg > 0xFFFFFFFFUL / info->burst) {
+		printf("MinixWall: hashlimit rate %lu/%lu out of range\n",
+		       (unsigned long)info->avg, (unsigned long)info->burst);
+		return 0;
+	}
+	if (info->size == 0)
+		info->size = IPT_HASHLIMIT_SIZE;
+	if (info->size > NF_RATE_MAXSIZE) {
+		printf("MinixWall: hashlimit size %lu too large\n",
+		       (unsigned long)info->size);
+		return 0;
+	}
+	info->credit_cap = info->avg * info->burst;
+	info->table = nfRateCreate(NULL, info->size);
+	return info->table != NULL;
+}
+
+static void
+ipt_hashlimit_destroy(void *matchinfo, unsigned int matchinfosize)
+{
+	struct ipt_hashlimit_info *info = matchinfo;
+
+	nfRateRelease(info->table);
+}
+
+static struct ipt_match ipt_hashlimit_reg
+= { { NULL, NULL }, "HASHLIMIT", ipt_hashlimit_match,
+    ipt_hashlimit_checkentry, ipt_hashlimit_destroy, NULL };
+
+int ipt_register_match_HASHLIMIT(void)
+{
+	if (ipt_register_match(&ipt_hashlimit_reg))
+		return -EINVAL;
+
+	return 0;
+}
+
+void ipt_unregister_match_HASHLIMIT(void)
+{
+	ipt_unregister_match(&ipt_hashlimit_reg);
+}
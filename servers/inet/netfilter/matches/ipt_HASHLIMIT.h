@@ -0,0 +1,7 @@
+#ifndef _IPT_HASHLIMIT_MATCH_H
+#define _IPT_HASHLIMIT_MATCH_H
+
+int ipt_register_match_HASHLIMIT( void );
+void ipt_unregister_match_HASHLIMIT( void );
+
+#endif /*_IPT_HASHLIMIT_MATCH_H*/
@@ -37,7 +37,8 @@ ipt_ip_match(const struct sk_buff *skb,
 	ipinfo=(struct ipt_ip*)matchinfo;
 	strncpy((char*)indev,in->name,IF_NAMESIZE);
 	strncpy((char*)outdev,out->name,IF_NAMESIZE);
-	isfrag=(ip->ih_flags_fragoff&IH_MORE_FRAGS)>0?1:0;
+	/* a fragment rule is about fragments without the protocol header */
+	isfrag=(ntohs(ip->ih_flags_fragoff)&IH_FRAGOFF_MASK)?1:0;
 
 #define FWINV(bool,invflg) ((bool) ^ !!(ipinfo->invflags & invflg))
 	if (FWINV((ip->ih_src&ipinfo->smsk.s_addr) != ipinfo->src.s_addr,
@@ -0,0 +1,76 @@
+/*
+ * This is a module which is used for limiting the rate at which a rule
+ * matches, with a token bucket refilled from the netfilter clock.
+ */
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <errno.h>
+#include <sk_buff.h>
+#include <ip_tables.h>
+#include <net_device.h>
+#include <nfrate.h>
+#include "../targets/ipt_limit.h"
+#include "ipt_LIMIT.h"
+#include <stdio.h>
+#include <string.h>
+
+static int
+ipt_limit_match(const struct sk_buff *skb,
+		const struct net_device *in,
+		const struct net_device *out,
+		const void *matchinfo,
+		int offset,
+		const void *hdr,
+		u16_t datalen,
+		int *hotdrop)
+{
+	/* the bucket is kept in the rule, which the snapshot owns */
+	struct ipt_rateinfo *r = (struct ipt_rateinfo *)matchinfo;
+	unsigned long now = nfRateNow();
+
+	r->credit = nfRateRefill(r->credit, r->credit_cap, now - r->prev);
+	r->prev = now;
+	if (r->credit < r->avg)
+		return 0;
+
+	r->credit -= r->avg;
+	return 1;
+}
+
+static int
+ipt_limit_checkentry(const char *tablename,
+		     const struct ipt_ip *ip,
+		     void *matchinfo,
+		     unsigned int matchinfosize,
+		     unsigned int hook_mask)
+{
+	struct ipt_rateinfo *r = matchinfo;
+
+	if (r->avg == 0 || r->burst == 0 ||
+	    r->avg > 0xFFFFFFFFUL / r->burst) {
+		printf("MinixWall: limit rate %lu/%lu out of range\n",
+		       (unsigned long)r->avg, (unsigned long)r->burst);
+		return 0;
+	}
+	r->credit_cap = r->avg * r->burst;
+	r->credit = r->credit_cap;
+	r->prev = nfRateNow();
+	return 1;
+}
+
+static struct ipt_match ipt_limit_reg
+= { { NULL, NULL }, "LIMIT", ipt_limit_match, ipt_limit_checkentry,
+    NULL, NULL };
+
+int ipt_register_match_LIMIT(void)
+{
+	if (ipt_register_match(&ipt_limit_reg))
+		return -EINVAL;
+
+	return 0;
+}
+
+void ipt_unregister_match_LIMIT(void)
+{
+	ipt_unregister_match(&ipt_limit_reg);
+}
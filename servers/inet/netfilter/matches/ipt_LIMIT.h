@@ -0,0 +1,7 @@
+#ifndef _IPT_LIMIT_MATCH_H
+#define _IPT_LIMIT_MATCH_H
+
+int ipt_register_match_LIMIT( void );
+void ipt_unregister_match_LIMIT( void );
+
+#endif /*_IPT_LIMIT_MATCH_H*/
@@ -0,0 +1,132 @@
+/*
+ * This is a module which is used for keeping named lists of the
+ * addresses recently seen, and for matching packets whose source or
+ * destination is on such a list.
+ */
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <errno.h>
+#include <sk_buff.h>
+#include <ip_tables.h>
+#include <net_device.h>
+#include <nfrate.h>
+#include "../targets/ipt_recent.h"
+#include "ipt_RECENT.h"
+#include <stdio.h>
+#include <string.h>
+
+static void
+recent_hit(struct nf_rate_node *node, unsigned long now)
+{
+	node->stamp = now;
+	node->hits[node->hit] = now;
+	node->hit = (node->hit + 1) % NF_RATE_HITS;
+	if (node->nhits < NF_RATE_HITS)
+		node->nhits++;
+}
+
+/* hits of node within the last seconds, all of them if seconds is 0 */
+static u32_t
+recent_count(const struct nf_rate_node *node, u32_t seconds,
+	     unsigned long now)
+{
+	u32_t n = 0;
+	int i;
+
+	if (seconds == 0)
+		return node->nhits;
+	for (i = 0; i < node->nhits; i++)
+		if (now - node->hits[i] <= seconds * 1000UL)
+			n++;
+	return n;
+}
+
+static int
+ipt_recent_match(const struct sk_buff *skb,
+		 const struct net_device *in,
+		 const struct net_device *out,
+		 const void *matchinfo,
+		 int offset,
+		 const void *hdr,
+		 u16_t datalen,
+		 int *hotdrop)
+{
+	const struct ipt_recent_info *info = matchinfo;
+	const ip_hdr_t *iph = skb->nh.iph;
+	ipaddr_t addr = info->side == IPT_RECENT_DEST ?
+			iph->ih_dst : iph->ih_src;
+	unsigned long now = nfRateNow();
+	struct nf_rate_node *node;
+	int fresh, ret;
+
+	if (info->check_set & IPT_RECENT_SET) {
+		node = nfRateAdd(info->table, addr, &fresh);
+		recent_hit(node, now);
+		return !info->invert;
+	}
+
+	node = nfRateFind(info->table, addr);
+	ret = node != NULL &&
+	      recent_count(node, info->seconds, now) >=
+	      (info->hit_count ? info->hit_count : 1);
+	if (ret) {
+		if (info->check_set & IPT_RECENT_UPDATE) {
+			node = nfRateAdd(info->table, addr, &fresh);
+			recent_hit(node, now);
+		} else if (info->check_set & IPT_RECENT_REMOVE)
+			nfRateRemove(info->table, node);
+	}
+	return ret ^ info->invert;
+}
+
+static int
+ipt_recent_checkentry(const char *tablename,
+		      const struct ipt_ip *ip,
+		      void *matchinfo,
+		      unsigned int matchinfosize,
+		      unsigned int hook_mask)
+{
+	struct ipt_recent_info *info = matchinfo;
+	u8_t cmd = info->check_set;
+
+	if (cmd == 0 || (cmd & (cmd - 1)) != 0 || cmd > IPT_RECENT_REMOVE) {
+		printf("MinixWall: recent needs one of set, rcheck, "
+		       "update, remove\n");
+		return 0;
+	}
+	if (info->hit_count > NF_RATE_HITS) {
+		printf("MinixWall: recent keeps at most %d hits\n",
+		       NF_RATE_HITS);
+		return 0;
+	}
+	info->name[IPT_RECENT_NAME_LEN-1] = '\0';
+	if (info->name[0] == '\0')
+		strcpy(info->name, "DEFAULT");
+	info->table = nfRateCreate(info->name, IPT_RECENT_SIZE);
+	return info->table != NULL;
+}
+
+static void
+ipt_recent_destroy(void *matchinfo, unsigned int matchinfosize)
+{
+	struct ipt_recent_info *info = matchinfo;
+
+	nfRateRelease(info->table);
+}
+
+static struct ipt_match ipt_recent_reg
+= { { NULL, NULL }, "RECENT", ipt_recent_match, ipt_recent_checkentry,
+    ipt_recent_destroy, NULL };
+
+int ipt_register_match_RECENT(void)
+{
+	if (ipt_register_match(&ipt_recent_reg))
+		return -EINVAL;
+
+	return 0;
+}
+
+void ipt_unregister_match_RECENT(void)
+{
+	ipt_unregister_match(&ipt_recent_reg);
+}
@@ -0,0 +1,7 @@
+#ifndef _IPT_RECENT_MATCH_H
+#define _IPT_RECENT_MATCH_H
+
+int ipt_register_match_RECENT( void );
+void ipt_unregister_match_RECENT( void );
+
+#endif /*_IPT_RECENT_MATCH_H*/
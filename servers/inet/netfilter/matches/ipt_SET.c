@@ -0,0 +1,94 @@
+/*
+ * This is a module which is used for matching the source or destination
+ * of a packet against an IP set.
+ */
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <errno.h>
+#include <sk_buff.h>
+#include <ip_tables.h>
+#include <net_device.h>
+#include <nfset.h>
+#include "ipt_SET.h"
+#include <stdio.h>
+#include <string.h>
+
+static int
+ipt_set_match(const struct sk_buff *skb,
+		const struct net_device *in,
+		const struct net_device *out,
+		const void *matchinfo,
+		int offset,
+		const void *hdr,
+		u16_t datalen,
+		int *hotdrop)
+{
+	const struct ipt_set_info *info = matchinfo;
+	const struct nf_set *set = nfSetGet(info->index);
+	const ip_hdr_t *iph = skb->nh.iph;
+	const u16_t *ports = (const u16_t *)skb->h.raw;
+	int src = !!(info->flags & IPT_SET_SRC);
+	int port = -1;
+
+	if (set == NULL)
+		return 0;
+
+	/* ports only in a complete TCP or UDP header of a first fragment */
+	if (set->type == NF_SET_IPPORT &&
+	    (iph->ih_proto == IPPROTO_TCP || iph->ih_proto == IPPROTO_UDP) &&
+	    !(ntohs(iph->ih_flags_fragoff) & IH_FRAGOFF_MASK) &&
+	    skb->h.raw + 2*sizeof(u16_t) <= skb->tail)
+		port = ntohs(ports[src ? 0 : 1]);
+
+	return nfSetTest(set, src ? iph->ih_src : iph->ih_dst,
+			 iph->ih_proto, port)
+		^ !!(info->flags & IPT_SET_INV);
+}
+
+static int
+ipt_set_checkentry(const char *tablename,
+		   const struct ipt_ip *ip,
+		   void *matchinfo,
+		   unsigned int matchinfosize,
+		   unsigned int hook_mask)
+{
+	struct ipt_set_info *info = matchinfo;
+	struct nf_set *set;
+
+	info->name[IPT_SET_MAXNAMELEN-1] = '\0';
+	info->index = nfSetFind(info->name);
+	set = nfSetGet(info->index);
+	if (set == NULL) {
+		printf("MinixWall: no such set: %s\n", info->name);
+		return 0;
+	}
+	set->refcnt++;
+	return 1;
+}
+
+static void
+ipt_set_destroy(void *matchinfo, unsigned int matchinfosize)
+{
+	struct ipt_set_info *info = matchinfo;
+	struct nf_set *set = nfSetGet(info->index);
+
+	if (set != NULL)
+		set->refcnt--;
+}
+
+static struct ipt_match ipt_set_reg
+= { { NULL, NULL }, "SET", ipt_set_match, ipt_set_checkentry,
+    ipt_set_destroy, NULL };
+
+int ipt_register_match_SET(void)
+{
+	if (ipt_register_match(&ipt_set_reg))
+		return -EINVAL;
+
+	return 0;
+}
+
+void ipt_unregister_match_SET(void)
+{
+	ipt_unregister_match(&ipt_set_reg);
+}
@@ -0,0 +1,7 @@
+#ifndef _IPT_SET_MATCH_H
+#define _IPT_SET_MATCH_H
+
+int ipt_register_match_SET( void );
+void ipt_unregister_match_SET( void );
+
+#endif /*_IPT_SET_MATCH_H*/
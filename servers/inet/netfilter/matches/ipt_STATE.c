@@ -0,0 +1,63 @@
+/*
+ * This is a module which is used for matching the connection tracking
+ * state of a packet.
+ */
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <errno.h>
+#include <sk_buff.h>
+#include <ip_tables.h>
+#include <net_device.h>
+#include <nfconntrack.h>
+#include "../targets/ipt_state.h"
+#include "ipt_STATE.h"
+#include <stdio.h>
+#include <string.h>
+
+static int
+ipt_state_match(const struct sk_buff *skb,
+		const struct net_device *in,
+		const struct net_device *out,
+		const void *matchinfo,
+		int offset,
+		const void *hdr,
+		u16_t datalen,
+		int *hotdrop)
+{
+	const struct ipt_state_info *sinfo = matchinfo;
+	unsigned int statebit;
+
+	if (skb->nfctinfo == IP_CT_INVALID)
+		statebit = IPT_STATE_INVALID;
+	else
+		statebit = IPT_STATE_BIT(skb->nfctinfo);
+
+	return (sinfo->statemask & statebit) != 0;
+}
+
+static int
+ipt_state_checkentry(const char *tablename,
+		     const struct ipt_ip *ip,
+		     void *matchinfo,
+		     unsigned int matchinfosize,
+		     unsigned int hook_mask)
+{
+	return 1;
+}
+
+static struct ipt_match ipt_state_reg
+= { { NULL, NULL }, "STATE", ipt_state_match, ipt_state_checkentry, NULL,
+    NULL };
+
+int ipt_register_match_STATE(void)
+{
+	if (ipt_register_match(&ipt_state_reg))
+		return -EINVAL;
+
+	return 0;
+}
+
+void ipt_unregister_match_STATE(void)
+{
+	ipt_unregister_match(&ipt_state_reg);
+}
@@ -0,0 +1,7 @@
+#ifndef _IPT_STATE_MATCH_H
+#define _IPT_STATE_MATCH_H
+
+int ipt_register_match_STATE( void );
+void ipt_unregister_match_STATE( void );
+
+#endif /*_IPT_STATE_MATCH_H*/
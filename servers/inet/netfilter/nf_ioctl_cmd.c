@@ -70,6 +70,7 @@
 
 #include <nfdefs.h>
 #include <nfcore.h>
+#include <nfset.h>
 #include "nf_ioctl_cmd.h"
 
 /*===========================================================================*
@@ -111,8 +112,13 @@ void* data;
 			ret=iptablesSetPolicy((int)*((int*)data));
 			break;
 		case IOCTL_IPT_INSERT:
+			ret=iptablesInsertRule((int)*((int*)data));
+			break;
+		case IOCTL_IPT_NEW:
+			ret=iptablesNewUserChain((char*)data);
 			break;
 		case IOCTL_IPT_DELETE:
+			ret=iptablesDeleteChain((char*)data);
 			break;
 		case IOCTL_IPT_DELETE_RULE:
                         ret=iptablesDeleteRule((int)*((int*)data));
@@ -123,6 +129,18 @@ void* data;
 		case IOCTL_IPT_ZERO:
                         ret=iptablesZeroCounters();
 			break;
+		case IOCTL_IPSET_CREATE:
+			ret=ipsetCreate((void*)data);
+			break;
+		case IOCTL_IPSET_DESTROY:
+			ret=ipsetDestroy((char*)data);
+			break;
+		case IOCTL_IPSET_FLUSH:
+			ret=ipsetFlush((char*)data);
+			break;
+		case IOCTL_IPSET_SELECT:
+			ret=ipsetSelect((char*)data);
+			break;
 		default:
 			printf("dev_ioctl: unknown request from iptables: %d\n",
 				request);
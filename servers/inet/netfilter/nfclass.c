@@ -0,0 +1,507 @@
+/*
+ *  MINIX-3 network filter - compiled chain classifier
+ *
+ *  A chain is compiled into a two level decision structure: the
+ *  packet's protocol selects a class, the destination port selects a
+ *  range within that class. Each range holds the indices of all rules
+ *  that can possibly match such a packet, in chain order, so first
+ *  match semantics are kept while most rules are never looked at.
+ *
+ *  Rules that differ only by source or destination prefix would all
+ *  end up in the same range. For those the chain also gets a path
+ *  compressed binary trie per address field; one walk down the trie
+ *  yields a bitmap of the rules whose prefix covers the address, and
+ *  candidates missing from it are skipped.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <net/hton.h>
+#include <net/gen/in.h>
+#include <nfdefs.h>
+#include <ip_tables.h>
+#include <nfcore.h>
+#include <nfclass.h>
+
+#define NF_CLASS_ALL ((1<<NF_CLASS_NR)-1)
+
+/* prefixes on an address field it takes to build a trie for it */
+#define NF_CLASS_MINPREFIX 4
+
+/* bit i of a host byte order address, counted from the top */
+#define ADDR_BIT(a,i) ((int)(((a) >> (31-(i))) & 1))
+
+/* what the classifier knows about a single rule */
+struct nf_class_key {
+  int mask;                      /* classes the rule can match in */
+  int lo, hi;                    /* destination port range        */
+};
+
+static int protoClass(int proto)
+{
+  switch (proto)
+  {
+    case IPPROTO_TCP : return NF_CLASS_TCP;
+    case IPPROTO_UDP : return NF_CLASS_UDP;
+    case IPPROTO_ICMP: return NF_CLASS_ICMP;
+    default          : return NF_CLASS_OTHER;
+  }
+}
+
+static int portClass(int class)
+{
+  return (class == NF_CLASS_TCP) || (class == NF_CLASS_UDP);
+}
+
+static void ruleKey(const struct ipt_entry *e, struct nf_class_key *key)
+{
+  int class;
+
+  key->mask=NF_CLASS_ALL;
+  key->lo=0;
+  key->hi=65535;
+  if ((e->ip.proto == 0) || (e->ip.invflags & IPT_INV_PROTO)) return;
+
+  class=protoClass(e->ip.proto);
+  key->mask=1<<class;
+  if (e->match == NULL) return;
+
+  if ((class == NF_CLASS_TCP) && (strcmp(e->match->name,"TCP") == 0))
+  {
+    const struct ipt_tcp *tcp=(const struct ipt_tcp*)e->l3match;
+
+    if (tcp->invflags & IPT_TCP_INV_DSTPT) return;
+    key->lo=tcp->dpts[0];
+    key->hi=tcp->dpts[1];
+  }
+  else if ((class == NF_CLASS_UDP) && (strcmp(e->match->name,"UDP") == 0))
+  {
+    const struct ipt_udp *udp=(const struct ipt_udp*)e->l3match;
+
+    if (udp->invflags & IPT_UDP_INV_DSTPT) return;
+    key->lo=udp->dpts[0];
+    key->hi=udp->dpts[1];
+  }
+
+  /* an empty port range never matches */
+  if (key->lo > key->hi) key->mask=0;
+}
+
+static int intCompare(const void *a, const void *b)
+{
+  return *(const int*)a - *(const int*)b;
+}
+
+/* collect the sorted, unique range starts of a class */
+static int classBounds(const struct nf_class_key *keys, int n, int class,
+                       int *bounds)
+{
+  int i, j, nb;
+
+  nb=0;
+  bounds[nb++]=0;
+  if (portClass(class))
+  {
+    for (i=0; i<n; i++)
+    {
+      if (!(keys[i].mask & (1<<class))) continue;
+      bounds[nb++]=keys[i].lo;
+      if (keys[i].hi < 65535) bounds[nb++]=keys[i].hi+1;
+    }
+    qsort(bounds,nb,sizeof(int),intCompare);
+  }
+  for (i=1, j=1; i<nb; i++)
+  {
+    if (bounds[i] != bounds[j-1]) bounds[j++]=bounds[i];
+  }
+  return j;
+}
+
+static u32_t prefixMask(int plen)
+{
+  return plen ? (0xffffffffUL << (32-plen)) & 0xffffffffUL : 0;
+}
+
+/* prefix length of a network byte order mask, -1 if it has holes */
+static int maskLen(ipaddr_t mask)
+{
+  u32_t m=ntohl(mask);
+  int plen=0;
+
+  while (m & 0x80000000UL)
+  {
+    m=(m<<1) & 0xffffffffUL;
+    plen++;
+  }
+  return (m == 0) ? plen : -1;
+}
+
+/* The prefix a rule needs on an address field. Returns its length,
+ * 0 if the rule may match any address (no prefix, an inverted one or
+ * a mask ipt_IP has to check) and -1 if it can match none.
+ */
+static int ruleAddr(const struct ipt_entry *e, int field, u32_t *prefix)
+{
+  ipaddr_t addr, mask;
+  int plen;
+
+  if (field == NF_CLASS_SRC)
+  {
+    if (e->ip.invflags & IPT_INV_SRCIP) return 0;
+    addr=e->ip.src.s_addr;
+    mask=e->ip.smsk.s_addr;
+  }
+  else
+  {
+    if (e->ip.invflags & IPT_INV_DSTIP) return 0;
+    addr=e->ip.dst.s_addr;
+    mask=e->ip.dmsk.s_addr;
+  }
+  plen=maskLen(mask);
+  if (plen <= 0) return 0;
+  *prefix=ntohl(addr);
+  if (*prefix & ~prefixMask(plen)) return -1;
+  return plen;
+}
+
+static int trieNew(struct nf_class_trie *t, u32_t prefix, int plen)
+{
+  struct nf_class_node *node=&t->node[t->nnodes];
+
+  node->prefix=prefix;
+  node->plen=plen;
+  node->child[0]=node->child[1]=-1;
+  return t->nnodes++;
+}
+
+static int commonLen(u32_t a, u32_t b, int max)
+{
+  int len=0;
+
+  while ((len < max) && (ADDR_BIT(a,len) == ADDR_BIT(b,len))) len++;
+  return len;
+}
+
+/* finds or adds the node of a prefix, at most two nodes are added */
+static int trieInsert(struct nf_class_trie *t, u32_t prefix, int plen)
+{
+  struct nf_class_node *node=t->node;
+  int n=0, b, c, m, len;
+
+  for (;;)
+  {
+    /* node n covers the prefix */
+    if (node[n].plen == plen) return n;
+    b=ADDR_BIT(prefix,node[n].plen);
+    c=node[n].child[b];
+    if (c < 0)
+    {
+      m=trieNew(t,prefix,plen);
+      node[n].child[b]=m;
+      return m;
+    }
+    len=commonLen(node[c].prefix,prefix,
+                  (node[c].plen < plen) ? node[c].plen : plen);
+    if (len == node[c].plen)
+    {
+      n=c;
+      continue;
+    }
+
+    /* the prefix leaves the path to c: split it where they part */
+    m=trieNew(t,prefix & prefixMask(len),len);
+    node[n].child[b]=m;
+    node[m].child[ADDR_BIT(node[c].prefix,len)]=c;
+    if (len == plen) return m;
+    n=trieNew(t,prefix,plen);
+    node[m].child[ADDR_BIT(prefix,len)]=n;
+    return n;
+  }
+}
+
+/* hands the rules of every node down to its subtree */
+static void trieInherit(struct nf_class_trie *t, int words, int n)
+{
+  int b, c, w;
+
+  for (b=0; b<2; b++)
+  {
+    if ((c=t->node[n].child[b]) < 0) continue;
+    for (w=0; w<words; w++) t->bits[c*words+w]|=t->bits[n*words+w];
+    trieInherit(t,words,c);
+  }
+}
+
+static void trieFree(struct nf_class_trie *t)
+{
+  if (t == NULL) return;
+  if (t->node) free(t->node);
+  if (t->bits) free(t->bits);
+  free(t);
+}
+
+/* builds the trie of an address field, NULL if too few rules need it */
+static int trieBuild(const struct ipt_entry *entry, int n, int words,
+                     int field, struct nf_class_trie **trie)
+{
+  struct nf_class_trie *t;
+  u32_t prefix;
+  int i, k, plen, nprefix;
+
+  *trie=NULL;
+  for (i=0, nprefix=0; i<n; i++)
+  {
+    if (ruleAddr(&entry[i],field,&prefix) > 0) nprefix++;
+  }
+  if (nprefix < NF_CLASS_MINPREFIX) return 1;
+
+  t=(struct nf_class_trie*)malloc(sizeof(struct nf_class_trie));
+  if (t == NULL) return 0;
+  t->bits=NULL;
+  t->node=(struct nf_class_node*)malloc((2*nprefix+1)*
+                                        sizeof(struct nf_class_node));
+  if (t->node == NULL)
+  {
+    trieFree(t);
+    return 0;
+  }
+  t->nnodes=0;
+  trieNew(t,0,0);
+  for (i=0; i<n; i++)
+  {
+    if ((plen=ruleAddr(&entry[i],field,&prefix)) > 0)
+      trieInsert(t,prefix,plen);
+  }
+
+  t->bits=(u32_t*)calloc(t->nnodes*words,sizeof(u32_t));
+  if (t->bits == NULL)
+  {
+    trieFree(t);
+    return 0;
+  }
+  for (i=0; i<n; i++)
+  {
+    plen=ruleAddr(&entry[i],field,&prefix);
+    if (plen < 0) continue;
+    k=(plen > 0) ? trieInsert(t,prefix,plen) : 0;
+    t->bits[k*words+(i>>5)]|=1UL<<(i&31);
+  }
+  trieInherit(t,words,0);
+  *trie=t;
+  return 1;
+}
+
+/* the rules the deepest node covering an address holds */
+static const u32_t *trieLookup(const struct nf_class_trie *t, int words,
+                               ipaddr_t addr)
+{
+  const struct nf_class_node *node=t->node;
+  u32_t a=ntohl(addr);
+  int n=0, c;
+
+  while (node[n].plen < 32)
+  {
+    c=node[n].child[ADDR_BIT(a,node[n].plen)];
+    if ((c < 0) || ((a ^ node[c].prefix) & prefixMask(node[c].plen)))
+      break;
+    n=c;
+  }
+  return t->bits+n*words;
+}
+
+/*******************************************************************
+ * nfClassCompile                                                  *
+ *                                                                 *
+ * Builds the classifier for the entries of a chain.               *
+ *                                                                 *
+ * Parameters:  struct ipt_entry *entry      rules of the chain    *
+ *              int n                        number of rules       *
+ *              char *name                   chain name            *
+ *                                                                 *
+ * Returns:     struct nf_classifier*        classifier or NULL    *
+ *                                           if out of memory      *
+ *                                                                 *
+ *******************************************************************/
+struct nf_classifier *nfClassCompile(const struct ipt_entry *entry, int n,
+                                     const char *name)
+{
+  struct nf_classifier *cls;
+  struct nf_class_key *keys=NULL;
+  int *bounds=NULL;
+  int nbounds[NF_CLASS_NR];
+  int c, i, k, nranges, npool, first;
+#ifdef _DEBUG
+  printf("nfClassCompile()\n");
+#endif
+  cls=(struct nf_classifier*)malloc(sizeof(struct nf_classifier));
+  keys=(struct nf_class_key*)malloc((n+1)*sizeof(struct nf_class_key));
+  bounds=(int*)malloc(NF_CLASS_NR*(2*n+1)*sizeof(int));
+  if (cls)
+  {
+    cls->ranges=NULL;
+    cls->rules=NULL;
+    cls->addr[NF_CLASS_SRC]=cls->addr[NF_CLASS_DST]=NULL;
+  }
+  if ((cls == NULL) || (keys == NULL) || (bounds == NULL))
+    goto nomem;
+
+  for (i=0; i<n; i++) ruleKey(&entry[i],&keys[i]);
+
+  /* first pass: size the range table and the rule pool */
+  nranges=0;
+  npool=0;
+  for (c=0; c<NF_CLASS_NR; c++)
+  {
+    int *b=bounds+c*(2*n+1);
+
+    nbounds[c]=classBounds(keys,n,c,b);
+    nranges+=nbounds[c];
+    for (i=0; i<n; i++)
+    {
+      if (!(keys[i].mask & (1<<c))) continue;
+      npool++;
+      for (k=0; k<nbounds[c]; k++)
+      {
+        if ((keys[i].lo <= b[k]) && (b[k] <= keys[i].hi)) npool++;
+      }
+    }
+  }
+
+  cls->ranges=(struct nf_class_range*)malloc(nranges*
+                                             sizeof(struct nf_class_range));
+  cls->rules=(int*)malloc((npool+1)*sizeof(int));
+  if ((cls->ranges == NULL) || (cls->rules == NULL))
+    goto nomem;
+
+  /* second pass: fill in the candidates */
+  nranges=0;
+  npool=0;
+  for (c=0; c<NF_CLASS_NR; c++)
+  {
+    struct nf_class_proto *p=&cls->proto[c];
+    int *b=bounds+c*(2*n+1);
+
+    p->allfirst=npool;
+    for (i=0; i<n; i++)
+    {
+      if (keys[i].mask & (1<<c)) cls->rules[npool++]=i;
+    }
+    p->allcount=npool-p->allfirst;
+
+    p->nranges=nbounds[c];
+    p->range=cls->ranges+nranges;
+    nranges+=nbounds[c];
+    for (k=0; k<nbounds[c]; k++)
+    {
+      first=npool;
+      for (i=0; i<n; i++)
+      {
+        if ((keys[i].mask & (1<<c)) &&
+            (keys[i].lo <= b[k]) && (b[k] <= keys[i].hi))
+          cls->rules[npool++]=i;
+      }
+      p->range[k].lo=b[k];
+      p->range[k].first=first;
+      p->range[k].count=npool-first;
+    }
+  }
+
+  /* third level: the address tries */
+  cls->words=(n+31)/32;
+  for (c=0; c<NF_CLASS_ADDRS; c++)
+  {
+    if (!trieBuild(entry,n,cls->words,c,&cls->addr[c]))
+      goto nomem;
+  }
+
+  free(keys);
+  free(bounds);
+  return cls;
+
+nomem:
+  printf("nfclass.c: nfClassCompile(): out of memory, chain %s is \
+scanned linearly\n", name);
+  if (cls) nfClassFree(cls);
+  if (keys) free(keys);
+  if (bounds) free(bounds);
+  return NULL;
+}
+
+/*******************************************************************
+ * nfClassFree                                                     *
+ *                                                                 *
+ * Releases a classifier built by nfClassCompile.                  *
+ *                                                                 *
+ *******************************************************************/
+void nfClassFree(struct nf_classifier *cls)
+{
+  if (cls == NULL) return;
+  if (cls->ranges) free(cls->ranges);
+  if (cls->rules) free(cls->rules);
+  trieFree(cls->addr[NF_CLASS_SRC]);
+  trieFree(cls->addr[NF_CLASS_DST]);
+  free(cls);
+}
+
+/*******************************************************************
+ * nfClassLookup                                                   *
+ *                                                                 *
+ * Finds the rules a packet has to be tested against.              *
+ *                                                                 *
+ * Parameters:  struct nf_classifier *cls    compiled chain        *
+ *              int proto                    IP protocol           *
+ *              int dport                    destination port, or  *
+ *                                           -1 if unknown         *
+ *              ipaddr_t src, dst            packet addresses      *
+ *              struct nf_class_match *m     returned candidates;  *
+ *                                           use only those that   *
+ *                                           pass NF_CLASS_ADDROK  *
+ *                                                                 *
+ *******************************************************************/
+void nfClassLookup(const struct nf_classifier *cls, int proto, int dport,
+                   ipaddr_t src, ipaddr_t dst, struct nf_class_match *m)
+{
+  const struct nf_class_proto *p=&cls->proto[protoClass(proto)];
+  int lo, hi, mid;
+
+  m->addr[NF_CLASS_SRC]=cls->addr[NF_CLASS_SRC] ?
+    trieLookup(cls->addr[NF_CLASS_SRC],cls->words,src) : NULL;
+  m->addr[NF_CLASS_DST]=cls->addr[NF_CLASS_DST] ?
+    trieLookup(cls->addr[NF_CLASS_DST],cls->words,dst) : NULL;
+
+  if (dport < 0)
+  {
+    m->rules=cls->rules+p->allfirst;
+    m->count=p->allcount;
+    return;
+  }
+
+  /* last range starting at or below the port */
+  lo=0;
+  hi=p->nranges-1;
+  while (lo < hi)
+  {
+    mid=(lo+hi+1)/2;
+    if (p->range[mid].lo <= dport) lo=mid;
+    else hi=mid-1;
+  }
+  m->rules=cls->rules+p->range[lo].first;
+  m->count=p->range[lo].count;
+}
@@ -0,0 +1,608 @@
+/*
+ *  MINIX-3 network filter - connection tracking
+ *
+ *  Flows are kept in a fixed pool, hashed by their 5-tuple. The hash is
+ *  symmetric in source and destination, so both directions of a flow
+ *  end up in the same bucket and a single lookup finds either. When the
+ *  pool is full, the least recently used flow makes room for a new one.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <nfdefs.h>
+#include <sk_buff.h>
+#include <nfconntrack.h>
+#include <macros.h>
+
+/* what getTuple() found in a packet */
+#define CT_PKT_NONE     0        /* not tracked                          */
+#define CT_PKT_FLOW     1        /* may start or continue a flow         */
+#define CT_PKT_REPLY    2        /* ICMP query reply, never starts one   */
+#define CT_PKT_ERROR    3        /* ICMP error, tuple of the inner packet */
+#define CT_PKT_INVALID  4        /* header too short to tell             */
+
+/* timeouts in seconds */
+static unsigned long tcp_timeouts[TCP_CT_MAX]=
+{
+  30,                            /* NONE, picked up without handshake    */
+  120,                           /* SYN_SENT                             */
+  60,                            /* SYN_RECV                             */
+  432000,                        /* ESTABLISHED, 5 days                  */
+  120,                           /* FIN_WAIT                             */
+  120,                           /* TIME_WAIT                            */
+  10                             /* CLOSE                                */
+};
+#define CT_UDP_TIMEOUT          30
+#define CT_UDP_STREAM_TIMEOUT   180
+#define CT_ICMP_TIMEOUT         30
+#define CT_GENERIC_TIMEOUT      600
+
+static struct nf_conn nf_ct_table[NF_CT_NR];
+static struct nf_conn *nf_ct_hash[NF_CT_HASH];
+static struct nf_conn *nf_ct_free;
+static unsigned long nf_ct_now;
+
+/* Flows in the order they were last used, least recently used first.
+ * Unreplied flows have a list of their own, they are given up before
+ * any flow that has seen a reply. The entries are list heads only.
+ */
+#define CT_LRU_NEW      0
+#define CT_LRU_SEEN     1
+static struct nf_conn nf_ct_lru[2];
+
+static int ctHash(const struct ip_conntrack_tuple *t)
+{
+  u32_t h;
+
+  h=t->src ^ t->dst;
+  h^=((u32_t)(t->sport ^ t->dport) << 16) | t->proto;
+  h^=h >> 16;
+  h^=h >> 8;
+  return h & (NF_CT_HASH-1);
+}
+
+static int icmpTuple(const icmp_hdr_t *icmp, int len,
+                     struct ip_conntrack_tuple *t, int inner)
+{
+  if (len < 8) return CT_PKT_INVALID;
+  switch (icmp->ih_type)
+  {
+    case ICMP_TYPE_ECHO_REQ:
+    case ICMP_TYPE_TS_REQ:
+    case ICMP_TYPE_INFO_REQ:
+      t->sport=t->dport=icmp->ih_hun.ihh_idseq.iis_id;
+      return CT_PKT_FLOW;
+    case ICMP_TYPE_ECHO_REPL:
+    case ICMP_TYPE_TS_REPL:
+    case ICMP_TYPE_INFO_REPL:
+      t->sport=t->dport=icmp->ih_hun.ihh_idseq.iis_id;
+      return CT_PKT_REPLY;
+    case ICMP_TYPE_DST_UNRCH:
+    case ICMP_TYPE_SRC_QUENCH:
+    case ICMP_TYPE_TIME_EXCEEDED:
+    case ICMP_TYPE_PARAM_PROBLEM:
+      return inner ? CT_PKT_INVALID : CT_PKT_ERROR;
+    default:
+      return CT_PKT_NONE;
+  }
+}
+
+/* Fills in the tuple of an IP header that has hdrlen contiguous bytes.
+ * Only the first 8 bytes behind the IP header are looked at if inner
+ * is set, that is all an ICMP error has to carry.
+ */
+static int getTuple(const ip_hdr_t *ip, int hdrlen,
+                    struct ip_conntrack_tuple *t, int *tcpflags, int inner)
+{
+  const unsigned char *l4;
+  int ihl, len;
+
+  ihl=(ip->ih_vers_ihl & IH_IHL_MASK) * 4;
+  if ((ihl < (int)sizeof(ip_hdr_t)) || (ihl > hdrlen))
+    return CT_PKT_INVALID;
+  l4=(const unsigned char*)ip + ihl;
+  len=hdrlen - ihl;
+
+  t->src=ip->ih_src;
+  t->dst=ip->ih_dst;
+  t->proto=ip->ih_proto;
+  t->sport=t->dport=0;
+  *tcpflags=0;
+
+  /* only the first fragment carries the ports */
+  if (ntohs(ip->ih_flags_fragoff) & IH_FRAGOFF_MASK)
+    return CT_PKT_NONE;
+
+  switch (ip->ih_proto)
+  {
+    case IPPROTO_TCP:
+      if (len < (inner ? 8 : (int)sizeof(tcp_hdr_t))) return CT_PKT_INVALID;
+      t->sport=((const tcp_hdr_t*)l4)->th_srcport;
+      t->dport=((const tcp_hdr_t*)l4)->th_dstport;
+      if (!inner) *tcpflags=((const tcp_hdr_t*)l4)->th_flags;
+      return CT_PKT_FLOW;
+    case IPPROTO_UDP:
+      if (len < (int)sizeof(udp_hdr_t)) return CT_PKT_INVALID;
+      t->sport=((const udp_hdr_t*)l4)->uh_src_port;
+      t->dport=((const udp_hdr_t*)l4)->uh_dst_port;
+      return CT_PKT_FLOW;
+    case IPPROTO_ICMP:
+      return icmpTuple((const icmp_hdr_t*)l4,len,t,inner);
+    default:
+      return CT_PKT_FLOW;
+  }
+}
+
+static struct nf_conn *ctFind(const struct ip_conntrack_tuple *t, int *dir)
+{
+  struct nf_conn *ct;
+
+  for (ct=nf_ct_hash[ctHash(t)]; ct!=NULL; ct=ct->next)
+  {
+    if ((ct->expires <= nf_ct_now) || (ct->tuple.proto != t->proto))
+      continue;
+    if ((ct->tuple.src == t->src) && (ct->tuple.dst == t->dst) &&
+        (ct->tuple.sport == t->sport) && (ct->tuple.dport == t->dport))
+    {
+      *dir=IP_CT_DIR_ORIGINAL;
+      return ct;
+    }
+    if ((ct->tuple.src == t->dst) && (ct->tuple.dst == t->src) &&
+        (ct->tuple.sport == t->dport) && (ct->tuple.dport == t->sport))
+    {
+      *dir=IP_CT_DIR_REPLY;
+      return ct;
+    }
+  }
+  return NULL;
+}
+
+static unsigned long ctTimeout(const struct nf_conn *ct)
+{
+  switch (ct->tuple.proto)
+  {
+    case IPPROTO_TCP : return tcp_timeouts[ct->tcpstate];
+    case IPPROTO_UDP : return (ct->status & IPS_SEEN_REPLY) ?
+                              CT_UDP_STREAM_TIMEOUT : CT_UDP_TIMEOUT;
+    case IPPROTO_ICMP: return CT_ICMP_TIMEOUT;
+    default          : return CT_GENERIC_TIMEOUT;
+  }
+}
+
+/* Moves a flow on by a packet that has passed all of its hooks. */
+static void tcpUpdate(struct nf_conn *ct, int dir, int flags)
+{
+  if (flags & THF_RST)
+  {
+    ct->tcpstate=TCP_CT_CLOSE;
+    return;
+  }
+  switch (flags & (THF_SYN|THF_ACK))
+  {
+    case THF_SYN:
+      if ((dir == IP_CT_DIR_ORIGINAL) &&
+          ((ct->tcpstate == TCP_CT_NONE) || (ct->tcpstate == TCP_CT_SYN_SENT)))
+        ct->tcpstate=TCP_CT_SYN_SENT;
+      return;
+    case THF_SYN|THF_ACK:
+      if ((dir == IP_CT_DIR_REPLY) &&
+          ((ct->tcpstate == TCP_CT_SYN_SENT) || (ct->tcpstate == TCP_CT_SYN_RECV)))
+        ct->tcpstate=TCP_CT_SYN_RECV;
+      return;
+  }
+  if (flags & THF_FIN)
+  {
+    ct->finseen|=1 << dir;
+    ct->tcpstate=(ct->finseen == 3) ? TCP_CT_TIME_WAIT : TCP_CT_FIN_WAIT;
+    return;
+  }
+  if (flags & THF_ACK)
+  {
+    /* a flow picked up in the middle counts as established */
+    if (((ct->tcpstate == TCP_CT_SYN_RECV) && (dir == IP_CT_DIR_ORIGINAL)) ||
+        (ct->tcpstate == TCP_CT_NONE))
+      ct->tcpstate=TCP_CT_ESTABLISHED;
+  }
+}
+
+static void ctReset(struct nf_conn *ct)
+{
+  ct->status=0;
+  ct->tcpstate=TCP_CT_NONE;
+  ct->finseen=0;
+  ct->gen=0;
+  ct->accepted[IP_CT_DIR_ORIGINAL]=0;
+  ct->accepted[IP_CT_DIR_REPLY]=0;
+  ct->passed[IP_CT_DIR_ORIGINAL]=0;
+  ct->passed[IP_CT_DIR_REPLY]=0;
+}
+
+/* does a SYN in direction dir start the flow over? */
+static int ctReopens(const struct nf_conn *ct, int dir, int flags)
+{
+  return (ct->tuple.proto == IPPROTO_TCP) &&
+         ((flags & (THF_SYN|THF_ACK)) == THF_SYN) &&
+         (dir == IP_CT_DIR_ORIGINAL) &&
+         ((ct->tcpstate == TCP_CT_TIME_WAIT) || (ct->tcpstate == TCP_CT_CLOSE));
+}
+
+/* the hook masks only hold for the rule generation they were made in */
+static void ctSetGen(struct nf_conn *ct, unsigned long gen)
+{
+  if (ct->gen == gen) return;
+  ct->gen=gen;
+  ct->accepted[IP_CT_DIR_ORIGINAL]=0;
+  ct->accepted[IP_CT_DIR_REPLY]=0;
+  ct->passed[IP_CT_DIR_ORIGINAL]=0;
+  ct->passed[IP_CT_DIR_REPLY]=0;
+}
+
+/* takes a flow off its use list, one on none is linked to itself */
+static void ctUnlink(struct nf_conn *ct)
+{
+  ct->lru_prev->lru_next=ct->lru_next;
+  ct->lru_next->lru_prev=ct->lru_prev;
+  ct->lru_prev=ct->lru_next=ct;
+}
+
+/* moves a flow to the end of the use list its status puts it on */
+static void ctTouch(struct nf_conn *ct)
+{
+  struct nf_conn *head;
+
+  head=&nf_ct_lru[(ct->status & IPS_SEEN_REPLY) ? CT_LRU_SEEN : CT_LRU_NEW];
+  ctUnlink(ct);
+  ct->lru_next=head;
+  ct->lru_prev=head->lru_prev;
+  head->lru_prev->lru_next=ct;
+  head->lru_prev=ct;
+}
+
+static void ctUnhash(struct nf_conn *ct)
+{
+  struct nf_conn **pp;
+
+  for (pp=&nf_ct_hash[ctHash(&ct->tuple)]; *pp!=ct; pp=&(*pp)->next)
+    ;
+  *pp=ct->next;
+}
+
+static struct nf_conn *ctAlloc(const struct ip_conntrack_tuple *t)
+{
+  struct nf_conn *ct, *seen;
+  int h;
+
+  h=ctHash(t);
+  if (nf_ct_free == NULL)
+  {
+    /* Full, the timed out flows are only collected by the timer. The
+     * least recently used unreplied flow goes, an established one only
+     * if it has timed out or there is no unreplied flow left.
+     */
+    ct=nf_ct_lru[CT_LRU_NEW].lru_next;
+    seen=nf_ct_lru[CT_LRU_SEEN].lru_next;
+    if ((seen != &nf_ct_lru[CT_LRU_SEEN]) &&
+        ((ct == &nf_ct_lru[CT_LRU_NEW]) || (seen->expires <= nf_ct_now)))
+      ct=seen;
+    ctUnhash(ct);
+  }
+  else
+  {
+    ct=nf_ct_free;
+    nf_ct_free=ct->next;
+  }
+  ct->tuple=*t;
+  ctReset(ct);
+  ct->next=nf_ct_hash[h];
+  nf_ct_hash[h]=ct;
+  ctTouch(ct);
+  return ct;
+}
+
+/*******************************************************************
+ * nfConntrackInit                                                 *
+ *                                                                 *
+ * Puts all flow entries on the free list.                         *
+ *                                                                 *
+ *******************************************************************/
+void nfConntrackInit(void)
+{
+  int i;
+#ifdef _DEBUG
+  printf("nfConntrackInit()\n");
+#endif
+  for (i=0; i<NF_CT_HASH; i++) nf_ct_hash[i]=NULL;
+  for (i=0; i<2; i++)
+    nf_ct_lru[i].lru_prev=nf_ct_lru[i].lru_next=&nf_ct_lru[i];
+  nf_ct_free=NULL;
+  for (i=NF_CT_NR-1; i>=0; i--)
+  {
+    nf_ct_table[i].lru_prev=nf_ct_table[i].lru_next=&nf_ct_table[i];
+    nf_ct_table[i].next=nf_ct_free;
+    nf_ct_free=&nf_ct_table[i];
+  }
+  nf_ct_now=0;
+}
+
+/*******************************************************************
+ * nfConntrackSetTime                                              *
+ *                                                                 *
+ * Tells connection tracking the current time in seconds. Set by   *
+ * inet before each packet and on each garbage collection.         *
+ *                                                                 *
+ *******************************************************************/
+void nfConntrackSetTime(unsigned long now)
+{
+  nf_ct_now=now;
+}
+
+/*******************************************************************
+ * nfConntrackIn                                                   *
+ *                                                                 *
+ * Looks up the flow of a packet and sets skb->nfct and            *
+ * skb->nfctinfo. The flow is left as it is: a packet without one  *
+ * is NEW, and only nfConntrackConfirm creates or updates a flow,  *
+ * once the packet has been accepted at its last hook.             *
+ *                                                                 *
+ * Parameters:  struct sk_buff *skb       the packet               *
+ *              int hdrlen                contiguous header bytes  *
+ *                                                                 *
+ * Returns:     struct nf_conn*           flow or NULL             *
+ *                                                                 *
+ *******************************************************************/
+struct nf_conn *nfConntrackIn(struct sk_buff *skb, int hdrlen)
+{
+  struct ip_conntrack_tuple t;
+  struct nf_conn *ct;
+  const ip_hdr_t *ip;
+  int kind, dir, flags, ihl;
+
+  skb->nfct=NULL;
+  skb->nfctinfo=IP_CT_NEW;
+  kind=getTuple(skb->nh.iph,hdrlen,&t,&flags,0);
+  if (kind == CT_PKT_NONE) return NULL;
+  if (kind == CT_PKT_INVALID)
+  {
+    skb->nfctinfo=IP_CT_INVALID;
+    return NULL;
+  }
+
+  if (kind == CT_PKT_ERROR)
+  {
+    /* an ICMP error is related to the flow of the packet it quotes */
+    ihl=(skb->nh.iph->ih_vers_ihl & IH_IHL_MASK) * 4;
+    ip=(const ip_hdr_t*)(skb->nh.raw + ihl + 8);
+    if ((hdrlen - ihl - 8 < (int)sizeof(ip_hdr_t)) ||
+        (getTuple(ip,hdrlen - ihl - 8,&t,&flags,1) == CT_PKT_INVALID) ||
+        ((ct=ctFind(&t,&dir)) == NULL))
+    {
+      skb->nfctinfo=IP_CT_INVALID;
+      return NULL;
+    }
+    skb->nfct=ct;
+    skb->nfctinfo=IP_CT_RELATED +
+                  ((dir == IP_CT_DIR_ORIGINAL) ? IP_CT_IS_REPLY : 0);
+    return ct;
+  }
+
+  ct=ctFind(&t,&dir);
+  if (ct == NULL)
+  {
+    /* replies and resets need a flow to belong to */
+    if ((kind == CT_PKT_REPLY) || (flags & THF_RST))
+      skb->nfctinfo=IP_CT_INVALID;
+    return NULL;
+  }
+
+  /* a reply establishes the flow; a new SYN reopens a closed one */
+  skb->nfct=ct;
+  if (dir == IP_CT_DIR_REPLY)
+    skb->nfctinfo=IP_CT_ESTABLISHED + IP_CT_IS_REPLY;
+  else if ((ct->status & IPS_SEEN_REPLY) && !ctReopens(ct,dir,flags))
+    skb->nfctinfo=IP_CT_ESTABLISHED;
+  return ct;
+}
+
+/*******************************************************************
+ * nfConntrackTuple                                                *
+ *                                                                 *
+ * Gets the tuple a packet is tracked by. For an ICMP error it is  *
+ * the tuple of the packet the error quotes.                       *
+ *                                                                 *
+ * Parameters:  ip_hdr_t *ip              the packet               *
+ *              int hdrlen                contiguous header bytes  *
+ *              struct ip_conntrack_tuple *t  returned tuple       *
+ *              int *related              set for ICMP errors      *
+ *                                                                 *
+ * Returns:     int                       1:tuple found            *
+ *                                        0:packet not tracked     *
+ *                                                                 *
+ *******************************************************************/
+int nfConntrackTuple(const ip_hdr_t *ip, int hdrlen,
+                     struct ip_conntrack_tuple *t, int *related)
+{
+  int kind, flags, ihl;
+
+  *related=0;
+  kind=getTuple(ip,hdrlen,t,&flags,0);
+  if (kind == CT_PKT_ERROR)
+  {
+    ihl=(ip->ih_vers_ihl & IH_IHL_MASK) * 4;
+    if (hdrlen - ihl - 8 < (int)sizeof(ip_hdr_t)) return 0;
+    kind=getTuple((const ip_hdr_t*)((const unsigned char*)ip + ihl + 8),
+                  hdrlen - ihl - 8,t,&flags,1);
+    *related=1;
+  }
+  return (kind == CT_PKT_FLOW) || (kind == CT_PKT_REPLY);
+}
+
+/* is there a live flow with tuple t in either direction? */
+int nfConntrackInUse(const struct ip_conntrack_tuple *t)
+{
+  int dir;
+
+  return ctFind(t,&dir) != NULL;
+}
+
+/*******************************************************************
+ * nfConntrackPass                                                 *
+ *                                                                 *
+ * Called for a packet that a hook before its last one has         *
+ * accepted. For an established flow the hook is remembered, but   *
+ * it only skips the rules once nfConntrackConfirm has seen a      *
+ * packet of the flow through to the end.                          *
+ *                                                                 *
+ * Parameters:  struct sk_buff *skb       the packet               *
+ *              unsigned int hook         hook that accepted it    *
+ *              unsigned long gen         current rule generation  *
+ *                                                                 *
+ *******************************************************************/
+void nfConntrackPass(struct sk_buff *skb, unsigned int hook,
+                     unsigned long gen)
+{
+  struct nf_conn *ct=skb->nfct;
+
+  if ((ct == NULL) ||
+      ((skb->nfctinfo % IP_CT_IS_REPLY) != IP_CT_ESTABLISHED))
+    return;
+  ctSetGen(ct,gen);
+  ct->passed[CTINFO2DIR(skb->nfctinfo)]|=1 << hook;
+}
+
+/*******************************************************************
+ * nfConntrackConfirm                                              *
+ *                                                                 *
+ * Called for a packet that its last hook, LOCAL_IN, POSTROUTING   *
+ * or FORWARD for a bridged one, has accepted: every table on its  *
+ * way has let it through. A NEW packet without a flow creates     *
+ * one, any other moves its flow on. For an established flow the   *
+ * hooks it passed are remembered, so the following packets of the *
+ * flow in the same direction are accepted without going through   *
+ * the rules again while the rule generation stays the same.       *
+ *                                                                 *
+ * Parameters:  struct sk_buff *skb       the packet               *
+ *              int hdrlen                contiguous header bytes  *
+ *              unsigned int hook         hook that accepted it    *
+ *              unsigned long gen         current rule generation  *
+ *                                                                 *
+ *******************************************************************/
+void nfConntrackConfirm(struct sk_buff *skb, int hdrlen, unsigned int hook,
+                        unsigned long gen)
+{
+  struct ip_conntrack_tuple t;
+  struct nf_conn *ct;
+  int kind, flags, dir;
+
+  ct=skb->nfct;
+  if (ct == NULL)
+  {
+    if (skb->nfctinfo != IP_CT_NEW) return;
+    if (getTuple(skb->nh.iph,hdrlen,&t,&flags,0) != CT_PKT_FLOW) return;
+    ct=ctAlloc(&t);
+    if (ct == NULL) return;
+    if (t.proto == IPPROTO_TCP) tcpUpdate(ct,IP_CT_DIR_ORIGINAL,flags);
+    ct->expires=nf_ct_now + ctTimeout(ct);
+    skb->nfct=ct;
+    return;
+  }
+
+  /* an ICMP error leaves the flow it is about alone */
+  if ((skb->nfctinfo % IP_CT_IS_REPLY) == IP_CT_RELATED) return;
+  kind=getTuple(skb->nh.iph,hdrlen,&t,&flags,0);
+  if ((kind != CT_PKT_FLOW) && (kind != CT_PKT_REPLY)) return;
+  dir=CTINFO2DIR(skb->nfctinfo);
+  if (ctReopens(ct,dir,flags)) ctReset(ct);
+  if (ct->tuple.proto == IPPROTO_TCP) tcpUpdate(ct,dir,flags);
+  if (dir == IP_CT_DIR_REPLY) ct->status|=IPS_SEEN_REPLY;
+  ct->expires=nf_ct_now + ctTimeout(ct);
+  ctTouch(ct);
+
+  if ((skb->nfctinfo % IP_CT_IS_REPLY) != IP_CT_ESTABLISHED) return;
+  ctSetGen(ct,gen);
+  ct->accepted[dir]|=ct->passed[dir] | (1 << hook);
+}
+
+/*******************************************************************
+ * nfConntrackEstablish                                            *
+ *                                                                 *
+ * Enters a TCP flow whose handshake the SYN proxy has done in its *
+ * place, so it never saw it. The flow is established in both      *
+ * directions at once; a flow with the same tuple is taken over.   *
+ *                                                                 *
+ * Parameters:  struct ip_conntrack_tuple *t  client to server     *
+ *                                                                 *
+ * Returns:     struct nf_conn*           flow or NULL if full     *
+ *                                                                 *
+ *******************************************************************/
+struct nf_conn *nfConntrackEstablish(const struct ip_conntrack_tuple *t)
+{
+  struct nf_conn *ct;
+  int dir;
+
+  ct=ctFind(t,&dir);
+  if (ct != NULL)
+  {
+    ct->tuple=*t;
+    ctReset(ct);
+  }
+  else if ((ct=ctAlloc(t)) == NULL)
+    return NULL;
+  ct->status=IPS_SEEN_REPLY;
+  ct->tcpstate=TCP_CT_ESTABLISHED;
+  ct->expires=nf_ct_now + ctTimeout(ct);
+  ctTouch(ct);
+  return ct;
+}
+
+/*******************************************************************
+ * nfConntrackExpire                                               *
+ *                                                                 *
+ * Returns all timed out flows to the free list. Run by the inet   *
+ * timer every NF_CT_GC_TIME seconds, never for a single packet.   *
+ *                                                                 *
+ * Returns:     int                       number of active flows   *
+ *                                                                 *
+ *******************************************************************/
+int nfConntrackExpire(void)
+{
+  struct nf_conn *ct, **pp;
+  int i, active;
+
+  active=0;
+  for (i=0; i<NF_CT_HASH; i++)
+  {
+    pp=&nf_ct_hash[i];
+    while ((ct=*pp) != NULL)
+    {
+      if (ct->expires <= nf_ct_now)
+      {
+        *pp=ct->next;
+        ctUnlink(ct);
+        ct->next=nf_ct_free;
+        nf_ct_free=ct;
+      }
+      else
+      {
+        active++;
+        pp=&ct->next;
+      }
+    }
+  }
+  return active;
+}
@@ -36,9 +36,14 @@
 #include <ip_tables.h>
 #include <net_device.h>
 #include <sk_buff.h>
-#include <buffer.h>
 #include <list.h>
 #include <nfcore.h>
+#include <nfclass.h>
+#include <nfconntrack.h>
+#include <nfblob.h>
+#include <nfset.h>
+#include <nfnat.h>
+#include <nfsynproxy.h>
 #include <macros.h>
 
 #include "matches/ipt_IP.h"
@@ -46,32 +51,59 @@
 #include "matches/ipt_UDP.h"
 #include "matches/ipt_ICMP.h"
 #include "matches/ipt_ANY.h"
+#include "matches/ipt_STATE.h"
+#include "matches/ipt_SET.h"
+#include "matches/ipt_LIMIT.h"
+#include "matches/ipt_HASHLIMIT.h"
+#include "matches/ipt_RECENT.h"
 
 #include "targets/ipt_ACCEPT.h"
 #include "targets/ipt_DROP.h"
 #include "targets/ipt_LOG.h"
+#include "targets/ipt_RETURN.h"
+#include "targets/ipt_ULOG.h"
+#include "targets/ipt_SNAT.h"
+#include "targets/ipt_DNAT.h"
+#include "targets/ipt_MASQUERADE.h"
+#include "targets/ipt_REDIRECT.h"
+#include "targets/ipt_NFQUEUE.h"
+#include "targets/ipt_SYNPROXY.h"
 
 #define min(a,b) (a<=b?a:b)
 
-static int inetLocalIPcount;
-char inetLocalIPs[MAX_LOCAL_IPS][4];
-char currInIf[IF_NAMESIZE];
-char currOutIf[IF_NAMESIZE];
-struct buffer currData;
-char *afterData;
-static int currDataSize;
-static int currPackSize;
-static int currLayerID;
-unsigned int hooknum;
-
-struct ipt_table *selectedTable;
-struct ipt_chain *selectedChain;
-struct ipt_chain *jumpChain;
-struct ipt_match *selectedL3Match;
-struct ipt_target *selectedTarget;
-struct ipt_ip IPMatchInfo;
-unsigned char L3MatchInfo[MATCHINFO_MAXSIZE];
-unsigned char targetInfo[TARGINFO_MAXSIZE];
+/* verdict of a rule that jumps to a user chain, see nfRunChain */
+#define NF_JUMP (IPT_RETURN-1)
+
+/* The local addresses, an open addressing hash set of addresses in
+ * network byte order that is at most half full. 0.0.0.0 marks a free
+ * slot.
+ */
+struct nf_localip {
+  ipaddr_t addr;
+  int refcnt;                    /* ports configured with it */
+};
+static struct nf_localip *inetLocalIPs;
+static unsigned int inetLocalIPsize;
+static unsigned int inetLocalIPcount;
+
+/* the rule being put together by the iptables ioctls */
+static struct nf_rulebuild {
+  struct ipt_table *table;
+  struct ipt_chain *chain;
+  struct ipt_chain *jumpchain;
+  struct ipt_match *match;
+  struct ipt_target *target;
+  struct ipt_ip ip;
+  unsigned char matchinfo[MATCHINFO_MAXSIZE];
+  unsigned char targinfo[TARGINFO_MAXSIZE];
+} nfBuild;
+
+/* rule set blob being received by iptablesRestore */
+static struct nf_restore {
+  struct nf_blob_hdr hdr;
+  unsigned char *blob;           /* allocated once hdr is complete */
+  size_t got;
+} nfRestore;
 
 static struct ipt_target* target_mods[32];
 static struct ipt_match* match_mods[32];
@@ -79,6 +111,51 @@ static int targetmodcounter;
 static int matchmodcounter;
 static struct ipt_table tab_filter, tab_nat, tab_mangle;
 
+/* tables in the order a packet passes them */
+static struct ipt_table *nfTables[]={ &tab_mangle, &tab_nat, &tab_filter };
+#define NF_TABLES (sizeof(nfTables)/sizeof(nfTables[0]))
+
+/* read-only copy of a chain as it was when the rule set was committed */
+struct nf_chainview {
+  char name[IPT_CHAIN_MAXNAMELEN];
+  int defaultverdict;
+  struct ipt_entry *entry;       /* the chain's rules when committed */
+  struct ipt_counters *counters; /* and their counters                */
+  int count;
+  int *jump;                     /* view a rule jumps to, or -1      */
+  int nat;                       /* only new flows without a binding */
+  struct nf_classifier *classifier;
+};
+
+/* where a packet is in a chain, see nfRunChain */
+struct nf_chainpos {
+  const struct nf_chainview *chain;
+  struct nf_class_match cand;    /* if the chain has a classifier */
+  int next;                      /* next candidate or entry       */
+};
+
+/* Snapshot of all rules, never changed once committed. Packets are
+ * evaluated against the snapshot they started with; a newer one is
+ * swapped in by nfCommit. Snapshots are freed oldest first once nobody
+ * uses them, together with the rule blocks replaced while they were
+ * active.
+ */
+struct nf_ruleset {
+  struct nf_ruleset *next;       /* next newer retired snapshot        */
+  unsigned long gen;             /* bumped by every commit             */
+  int refcnt;                    /* 1 while active, +1 per user        */
+  int nchains[NF_IP_NUMHOOKS+1];
+  struct nf_chainview *chain[NF_IP_NUMHOOKS+1][NF_TABLES];
+  int nviews;
+  struct nf_chainview *view;     /* every chain of every table         */
+  int *jumps;                    /* jump[] of all views                */
+  struct ipt_rules *retired;     /* replaced while this set was active */
+};
+
+static struct nf_ruleset *nfActive;
+static struct nf_ruleset *nfRetiredHead, *nfRetiredTail;
+static unsigned long nfRuleGen;
+
 void nfCoreInit(void)
 {
 #ifdef _DEBUG
@@ -86,14 +163,8 @@ void nfCoreInit(void)
 #endif
   targetmodcounter=0;
   matchmodcounter=0;
-  afterData=NULL;
-  currData.next=NULL;
-  currData.data=NULL;
-  currDataSize=0;
-  currPackSize=0;
-  currInIf[0]='\0';
-  currOutIf[0]='\0';
-  inetLocalIPcount=0;
+  inetLocalIPs=NULL;
+  inetLocalIPsize=inetLocalIPcount=0;
 
   /* register the match functions */
   ipt_register_match_IP();    /* must be first */
@@ -101,11 +172,31 @@ void nfCoreInit(void)
   ipt_register_match_UDP();
   ipt_register_match_ICMP();
   ipt_register_match_ANY();
+  ipt_register_match_STATE();
+  ipt_register_match_SET();
+  ipt_register_match_LIMIT();
+  ipt_register_match_HASHLIMIT();
+  ipt_register_match_RECENT();
 
   /* register the target functions */
   ipt_register_target_LOG();
   ipt_register_target_ACCEPT();
   ipt_register_target_DROP();
+  ipt_register_target_RETURN();
+  ipt_register_target_ULOG();
+  ipt_register_target_SNAT();
+  ipt_register_target_DNAT();
+  ipt_register_target_MASQUERADE();
+  ipt_register_target_REDIRECT();
+  ipt_register_target_NFQUEUE();
+  ipt_register_target_SYNPROXY();
+
+  nfConntrackInit();
+  nfNatInit();
+  nfSetInit();
+  nfActive=NULL;
+  nfRetiredHead=nfRetiredTail=NULL;
+  nfRuleGen=0;
 
   /* name the three tables */
   strcpy(tab_filter.name,"filter");
@@ -117,8 +208,8 @@ void nfCoreInit(void)
 
   /* Add the standard chains used for packet filtering */
   iptablesNewChain(&tab_filter,"INPUT",NF_ACCEPT,1,NF_IP_LOCAL_IN);
-  iptablesNewChain(&tab_filter,"OUTPUT",NF_ACCEPT,1,NF_IP_FORWARD);
-  iptablesNewChain(&tab_filter,"FORWARD",NF_ACCEPT,1,NF_IP_LOCAL_OUT);
+  iptablesNewChain(&tab_filter,"OUTPUT",NF_ACCEPT,1,NF_IP_LOCAL_OUT);
+  iptablesNewChain(&tab_filter,"FORWARD",NF_ACCEPT,1,NF_IP_FORWARD);
 
   /* Add the standard chains used for address translation */
   iptablesNewChain(&tab_nat,"PREROUTING",NF_ACCEPT,1,NF_IP_PRE_ROUTING);
@@ -133,513 +224,899 @@ void nfCoreInit(void)
   iptablesNewChain(&tab_mangle,"POSTROUTING",NF_ACCEPT,1,NF_IP_POST_ROUTING);
 }
 
+static unsigned int localHash(ipaddr_t addr)
+{
+  u32_t h;
+
+  h=addr*0x9e3779b1UL;
+  return (h ^ (h >> 16)) & (inetLocalIPsize-1);
+}
+
+/* slot of an address, or the free slot where it would go */
+static unsigned int localSlot(ipaddr_t addr)
+{
+  unsigned int i;
+
+  for (i=localHash(addr); inetLocalIPs[i].addr != 0;
+       i=(i+1) & (inetLocalIPsize-1))
+  {
+    if (inetLocalIPs[i].addr == addr) break;
+  }
+  return i;
+}
+
+/* makes room for size addresses, keeping the set at most half full */
+static int localResize(unsigned int size)
+{
+  struct nf_localip *old;
+  unsigned int oldsize, i;
+
+  old=inetLocalIPs;
+  oldsize=inetLocalIPsize;
+  inetLocalIPs=(struct nf_localip*)calloc(size,sizeof(struct nf_localip));
+  if (inetLocalIPs == NULL)
+  {
+    inetLocalIPs=old;
+    return -ENOMEM;
+  }
+  inetLocalIPsize=size;
+  for (i=0; i<oldsize; i++)
+  {
+    if (old[i].addr != 0) inetLocalIPs[localSlot(old[i].addr)]=old[i];
+  }
+  if (old) free(old);
+  return 0;
+}
+
 /*******************************************************************
  * inetRegisterLocalIP                                             *
  *                                                                 *
- * Tells netfilter the local IP addresses for later decisions      *
- * on which is FORWARDED or not.                                   *
+ * Tells netfilter a local IP address for later decisions on       *
+ * which packets are FORWARDED or not. An address configured on    *
+ * several ports is counted, each has to unregister it.            *
  *                                                                 *
- * Parameters:  int  a                IP address byte 1            *
- *              int  b                IP address byte 2            *
- *              int  c                IP address byte 3            *
- *              int  d                IP address byte 4            *
+ * Parameters:  ipaddr_t addr         address, network byte order  *
  *                                                                 *
- * Returns:     -                                                  * 
+ * Returns:     int                   0 or -ENOMEM                 *
  *                                                                 *
  *******************************************************************/
-void inetRegisterLocalIP(int a, int b, int c, int d)
+int inetRegisterLocalIP(ipaddr_t addr)
 {
+  unsigned int i;
+  u32_t a;
+
 #ifdef _DEBUG
   printf("inetRegisterLocalIP()\n");
 #endif
-  if (!inetCheckLocalIP(a,b,c,d))
+  if (addr == 0) return 0;
+  if ((inetLocalIPcount+1)*2 > inetLocalIPsize)
   {
-     if (inetLocalIPcount<MAX_LOCAL_IPS)
-     {
-        printf("MinixWall: Registered device IP address: %d.%d.%d.%d\n",
-               a,b,c,d);
-        inetLocalIPs[inetLocalIPcount][0]=(char)a;
-        inetLocalIPs[inetLocalIPcount][1]=(char)b;
-        inetLocalIPs[inetLocalIPcount][2]=(char)c;
-        inetLocalIPs[inetLocalIPcount][3]=(char)d;
-        inetLocalIPcount++;
-     }
-     else
-     {
-        printf("MinixWall: Error registering device IP address.\n");
-     }
+    if (localResize(inetLocalIPsize ? inetLocalIPsize*2 : NF_LOCAL_HASH) < 0)
+    {
+      printf("MinixWall: Error registering device IP address.\n");
+      return -ENOMEM;
+    }
+  }
+
+  i=localSlot(addr);
+  if (inetLocalIPs[i].addr == 0)
+  {
+    a=ntohl(addr);
+    printf("MinixWall: Registered device IP address: %d.%d.%d.%d\n",
+           (int)(a>>24)&0xff,(int)(a>>16)&0xff,(int)(a>>8)&0xff,(int)a&0xff);
+    inetLocalIPs[i].addr=addr;
+    inetLocalIPcount++;
   }
+  inetLocalIPs[i].refcnt++;
+  return 0;
 }
 
 /*******************************************************************
- * inetCheckLocalIP                                                *
+ * inetUnregisterLocalIP                                           *
  *                                                                 *
- * Checks wether the given IP address is a local IP addresses      *
+ * Forgets a local IP address once the last port that had it is    *
+ * configured with another one.                                    *
  *                                                                 *
- * Parameters:  int  a                IP address byte 1            *
- *              int  b                IP address byte 2            *
- *              int  c                IP address byte 3            *
- *              int  d                IP address byte 4            *
+ * Parameters:  ipaddr_t addr         address, network byte order  *
  *                                                                 *
- * Returns:     -                                                  * 
+ * Returns:     -                                                  *
  *                                                                 *
  *******************************************************************/
-int inetCheckLocalIP(int a, int b, int c, int d)
+void inetUnregisterLocalIP(ipaddr_t addr)
 {
-   int i;
-#ifdef _DEBUG
-  printf("inetCheckLocalIP()\n");
-#endif
-   for (i=0; i<inetLocalIPcount;i++)
-   {
-      if ( (inetLocalIPs[i][0]==(char)a)&&
-           (inetLocalIPs[i][1]==(char)b)&&
-           (inetLocalIPs[i][2]==(char)c)&&
-           (inetLocalIPs[i][3]==(char)d) )
-      {
-	 return 1;
-      }
-   }
-   return 0;
+  unsigned int i, j, k;
+
+  if ((addr == 0) || (inetLocalIPcount == 0)) return;
+  i=localSlot(addr);
+  if ((inetLocalIPs[i].addr == 0) || (--inetLocalIPs[i].refcnt > 0)) return;
+  inetLocalIPcount--;
+
+  /* move up the addresses that probed past the freed slot */
+  for (;;)
+  {
+    inetLocalIPs[i].addr=0;
+    inetLocalIPs[i].refcnt=0;
+    for (j=i;;)
+    {
+      j=(j+1) & (inetLocalIPsize-1);
+      if (inetLocalIPs[j].addr == 0) return;
+      k=localHash(inetLocalIPs[j].addr);
+      /* j stays if its home slot k lies cyclically in (i,j] */
+      if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+        continue;
+      break;
+    }
+    inetLocalIPs[i]=inetLocalIPs[j];
+    i=j;
+  }
 }
 
 /*******************************************************************
- * inetEthIn                                                       *
+ * inetCheckLocalIP                                                *
  *                                                                 *
- * Tells netfilter the network interface on which the              *
- * current packet arrived.                                         *
+ * Checks wether the given IP address is a local IP addresses      *
  *                                                                 *
- * Parameters:  char* ethername       ethernet interface name      *
+ * Parameters:  ipaddr_t addr         address, network byte order  *
  *                                                                 *
- * Returns:     -                                                  * 
+ * Returns:     int                   1 if it is local, 0 if not   *
  *                                                                 *
  *******************************************************************/
-void inetEthIn(char *ethername)
+int inetCheckLocalIP(ipaddr_t addr)
 {
-#ifdef _DEBUG
-  printf("inetEthIn(): in\n");
-#endif
-  if( ethername == NULL ){
-    strncpy(currInIf,"",31);
-#ifdef _DEBUG
-    printf("inetEthIn(): ethername was NULL\n");
-#endif
-  }else{
-  strncpy(currInIf,(char*)ethername,31);
-  }
-  clearBuffers(&currData);
-  if (afterData) { free(afterData); afterData=NULL; };
-#ifdef _DEBUG
-  printf("inetEthIn(): out\n");
-#endif
+  if ((inetLocalIPcount == 0) || (addr == 0)) return 0;
+  return inetLocalIPs[localSlot(addr)].addr == addr;
 }
 
 /*******************************************************************
- * inetEthOut                                                      *
+ * nfRunEntry                                                      *
  *                                                                 *
- * Tells netfilter the network interface on which the              *
- * current packet leaves.                                          *
+ * Tests a packet against a single rule and runs its target if     *
+ * the rule matches.                                               *
  *                                                                 *
- * Parameters:  char* ethername       ethernet interface name      *
- *                                                                 *
- * Returns:     -                                                  * 
+ * Returns:     int                       verdict of the target,   *
+ *                                        IPT_CONTINUE if the rule *
+ *                                        did not match, NF_JUMP   *
+ *                                        if it jumps to a chain   *
  *                                                                 *
  *******************************************************************/
-void inetEthOut(char *ethername)
+static int nfRunEntry(struct ipt_entry *entry,
+                      struct ipt_counters *counters,
+                      struct sk_buff *pskb,
+                      const struct net_device *in,
+                      const struct net_device *out,
+                      unsigned int hook,
+                      int offset,
+                      int packsize,
+                      int *hotdrop)
 {
+  int verdict;
+
+  /* inspect IP information */
+  if (!match_mods[0]->match(pskb,
+                            in,
+                            out,
+                            &entry->ip,
+                            offset,
+                            pskb->nh.iph,
+                            packsize,
+                            hotdrop))
+    return IPT_CONTINUE;
 #ifdef _DEBUG
-  printf("inetEthOut(): in\n");
+  printf("IP match, ");
 #endif
-  if( ethername == NULL ){
-    strncpy(currOutIf,"",31);
+
+  /* check for protocol specific information */
+  if (entry->match!=NULL)
+  {
+    if (!entry->match->match(pskb,
+                             in,
+                             out,
+                             entry->l3match,
+                             offset,
+                             pskb->h.raw,
+                             packsize,
+                             hotdrop))
+      return IPT_CONTINUE;
 #ifdef _DEBUG
-    printf("inetEthOut(): enthername was NULL\n");
+    printf("L3 match, ");
 #endif
-  }else{
-    strncpy(currOutIf,(char*)ethername,31);
   }
-  clearBuffers(&currData);
-  if (afterData) { free(afterData); afterData=NULL; };
+
+  /* increment packet and byte counters */
+  counters->pcnt++;
+  counters->bcnt+=packsize;
+
+  /* the caller follows jumps to user chains */
+  if (entry->target == NULL) return NF_JUMP;
+
+  /* execute the target function and get verdict */
+  verdict=entry->target->target(&pskb,
+                                hook,
+                                in,
+                                out,
+                                entry->targinfo,
+                                NULL);
 #ifdef _DEBUG
-  printf("inetEthOut(): out\n");
+  printf("verdict=%d\n",verdict);
 #endif
+  return verdict;
+}
+
+/* a block for count rules with zeroed counters, see struct ipt_rules */
+static struct ipt_rules *nfAllocRules(int count)
+{
+  struct ipt_rules *rules;
+
+  rules=(struct ipt_rules*)malloc(sizeof(struct ipt_rules)+
+                                  (count>1 ? count-1 : 0)*
+                                  sizeof(struct ipt_entry)+
+                                  count*sizeof(struct ipt_counters));
+  if (rules == NULL) return NULL;
+  rules->retired=NULL;
+  rules->count=count;
+  rules->dead=rules->ndead=0;
+  rules->counters=(struct ipt_counters*)&rules->entry[count];
+  memset(rules->counters,0,count*sizeof(struct ipt_counters));
+  return rules;
+}
+
+/* tells the match of a rule that the rule is gone for good */
+static void nfDestroyEntry(struct ipt_entry *entry)
+{
+  if ((entry->match != NULL) && (entry->match->destroy != NULL))
+    entry->match->destroy(entry->l3match,MATCHINFO_MAXSIZE);
+}
+
+/* frees a block and destroys its deleted entries */
+static void nfFreeRules(struct ipt_rules *rules)
+{
+  int i;
+
+  for (i=rules->dead; i<rules->dead+rules->ndead; i++)
+    nfDestroyEntry(&rules->entry[i]);
+  free(rules);
 }
 
 /*******************************************************************
- * inetSetPackSize                                                 *
+ * nfFreeRuleset                                                   *
  *                                                                 *
- * Tells netfilter the network packet size of currently arrived    *
- * packet.                                                         *
+ * Frees a snapshot and the rule blocks replaced while it was      *
+ * active.                                                         *
  *                                                                 *
- * Parameters:  int size              network packet length        *
+ *******************************************************************/
+static void nfFreeRuleset(struct nf_ruleset *rs)
+{
+  struct ipt_rules *rules;
+  int v;
+
+  for (v=0; v<rs->nviews; v++)
+    nfClassFree(rs->view[v].classifier);
+  free(rs->view);
+  free(rs->jumps);
+  while ((rules=rs->retired) != NULL)
+  {
+    rs->retired=rules->retired;
+    nfFreeRules(rules);
+  }
+  free(rs);
+}
+
+/*******************************************************************
+ * nfReclaim                                                       *
  *                                                                 *
- * Returns:     -                                                  * 
+ * Frees retired snapshots, oldest first, as long as they are not  *
+ * in use. A newer one may not go before an older one, the older   *
+ * one can still point to blocks retired with the newer.           *
  *                                                                 *
  *******************************************************************/
-void inetSetPackSize(int size)
+static void nfReclaim(void)
 {
-#ifdef _DEBUG
-  printf("inetSetPackSizeze()\n");
-#endif
-  currPackSize=size;
+  struct nf_ruleset *rs;
+
+  while (((rs=nfRetiredHead) != NULL) && (rs->refcnt == 0))
+  {
+    nfRetiredHead=rs->next;
+    if (nfRetiredHead == NULL) nfRetiredTail=NULL;
+    nfFreeRuleset(rs);
+  }
 }
 
 /*******************************************************************
- * inetSetDataSize                                                 *
+ * nfBuildRuleset                                                  *
  *                                                                 *
- * Prepares netfilter to fetch a number of data bytes              *
+ * Builds a snapshot of all chains as they are now, nothing is     *
+ * changed yet. A built-in chain without rules and with ACCEPT     *
+ * policy can not change the verdict, so its hook leaves it out.   *
  *                                                                 *
- * Parameters:  int size              data buffer length           *
- *                                                                 *
- * Returns:     -                                                  * 
+ * Returns:     struct nf_ruleset*           the snapshot or NULL  *
+ *                                           if out of memory      *
  *                                                                 *
  *******************************************************************/
-void inetSetDataSize(int size)
+static struct nf_ruleset *nfBuildRuleset(void)
 {
-#ifdef _DEBUG
-  printf("inetSetDataSize()\n");
-#endif
-  currDataSize=size;
+  struct nf_ruleset *rs;
+  struct nf_chainview *view;
+  struct ipt_chain *chain;
+  struct list_head *pos;
+  int hook, t, i, n, nrules;
+  /* number the chains, jumps are turned into view numbers */
+  n=0;
+  nrules=0;
+  for (t=0; t<NF_TABLES; t++)
+  {
+    list_for_each(pos,&nfTables[t]->list)
+    {
+      chain=(struct ipt_chain*)pos;
+      chain->view=n++;
+      if (chain->rules != NULL) nrules+=chain->rules->count;
+    }
+  }
+
+  rs=(struct nf_ruleset*)malloc(sizeof(struct nf_ruleset));
+  if (rs != NULL)
+  {
+    rs->view=(struct nf_chainview*)malloc(n*sizeof(struct nf_chainview));
+    rs->jumps=(int*)malloc((nrules+1)*sizeof(int));
+    if ((rs->view == NULL) || (rs->jumps == NULL))
+    {
+      if (rs->view) free(rs->view);
+      if (rs->jumps) free(rs->jumps);
+      free(rs);
+      rs=NULL;
+    }
+  }
+  if (rs == NULL)
+  {
+    printf("nfcore.c: nfBuildRuleset(): out of memory, rules not changed\n");
+    return NULL;
+  }
+  rs->next=NULL;
+  rs->gen=++nfRuleGen;
+  rs->refcnt=1;
+  rs->retired=NULL;
+  rs->nviews=n;
+  nrules=0;
+  for (t=0; t<NF_TABLES; t++)
+  {
+    list_for_each(pos,&nfTables[t]->list)
+    {
+      chain=(struct ipt_chain*)pos;
+      view=&rs->view[chain->view];
+      strncpy(view->name,chain->name,IPT_CHAIN_MAXNAMELEN);
+      view->defaultverdict=chain->defaultverdict;
+      view->nat=(nfTables[t] == &tab_nat);
+      view->entry=chain->rules ? chain->rules->entry : NULL;
+      view->counters=chain->rules ? chain->rules->counters : NULL;
+      view->count=chain->rules ? chain->rules->count : 0;
+      view->jump=&rs->jumps[nrules];
+      nrules+=view->count;
+      for (i=0; i<view->count; i++)
+        view->jump[i]=view->entry[i].jumpchain ?
+                      view->entry[i].jumpchain->view : -1;
+      view->classifier=(view->count > 0) ?
+                       nfClassCompile(view->entry,view->count,view->name) :
+                       NULL;
+    }
+  }
+  for (hook=1; hook<=NF_IP_NUMHOOKS; hook++)
+  {
+    rs->nchains[hook]=0;
+    for (t=0; t<NF_TABLES; t++)
+    {
+      chain=nfTables[t]->hook[hook];
+      if ((chain == NULL) ||
+          ((chain->rules == NULL) && (chain->defaultverdict == NF_ACCEPT)))
+        continue;
+      rs->chain[hook][rs->nchains[hook]++]=&rs->view[chain->view];
+    }
+  }
+  return rs;
 }
 
 /*******************************************************************
- * inetGetDataSize                                                 *
+ * nfActivate                                                      *
  *                                                                 *
- * Gets the size of the last block                                 *
+ * Makes a snapshot built by nfBuildRuleset the active rule set.   *
+ * The old set lives on until its last user is done.               *
+ *                                                                 *
+ *******************************************************************/
+static void nfActivate(struct nf_ruleset *rs)
+{
+  struct nf_ruleset *old;
+
+  old=nfActive;
+  nfActive=rs;
+  if (old != NULL)
+  {
+    old->refcnt--;
+    if (nfRetiredTail) nfRetiredTail->next=old;
+    else nfRetiredHead=old;
+    nfRetiredTail=old;
+    nfReclaim();
+  }
+}
+
+/*******************************************************************
+ * nfCommit                                                        *
  *                                                                 *
- * Parameters:  -                                                  *
+ * Builds a new snapshot of all chains and makes it the active     *
+ * rule set.                                                       *
  *                                                                 *
- * Returns:     int                  number of bytes               * 
+ * Returns:     int error code               0:OK                  *
+ *                                           2:out of memory, the  *
+ *                                             old rules stay      *
  *                                                                 *
  *******************************************************************/
-int inetGetDataSize(void)
+static int nfCommit(void)
 {
+  struct nf_ruleset *rs;
 #ifdef _DEBUG
-  printf("inetGetDataSize()\n");
+  printf("nfCommit()\n");
 #endif
-  return currDataSize;
+  rs=nfBuildRuleset();
+  if (rs == NULL) return 2;
+  nfActivate(rs);
+  return 0;
 }
 
 /*******************************************************************
- * inetData                                                        *
- *                                                                 *
- * Transfers a data block from the outer space to the buffer       *
+ * nfSetRules                                                      *
  *                                                                 *
- * Parameters:  char *address        address of the buffer         *
+ * Gives a chain a new block of rules. The old block goes to the   *
+ * active snapshot, it is freed when no snapshot can refer to it   *
+ * any more.                                                       *
  *                                                                 *
- * Returns:     int                  0: OK                         * 
- *                                   1: out of memory              *
+ * Parameters:  struct ipt_chain *chain      chain to change       *
+ *              struct ipt_rules *rules      new rules or NULL     *
+ *              int dead, ndead              entries of the old    *
+ *                                           block deleted for     *
+ *                                           good                  *
  *                                                                 *
  *******************************************************************/
-int inetData(char *address)
+static void nfSetRules(struct ipt_chain *chain, struct ipt_rules *rules,
+                       int dead, int ndead)
 {
-#ifdef _DEBUG
-  printf("inetData()\n");
-#endif
-  if (!appendBuffer(&currData,address,currDataSize))
+  struct ipt_rules *old=chain->rules;
+
+  chain->rules=rules;
+  if (old == NULL) return;
+  old->dead=dead;
+  old->ndead=ndead;
+  if (nfActive == NULL)
   {
-    printf("nfcore.c: inetData(): out of memory\n");
-    return 0;
+    nfFreeRules(old);
+    return;
   }
-  return 1;
+  old->retired=nfActive->retired;
+  nfActive->retired=old;
 }
 
 /*******************************************************************
- * inetHook                                                        *
+ * nfCommitRules                                                   *
  *                                                                 *
- * Sets the hook which the network filter passes                   *
+ * Gives a chain a new block of rules and commits it. The snapshot *
+ * is built with the new block first, the old one is retired only  *
+ * once that worked.                                               *
  *                                                                 *
- * Parameters:  unsigned int hooknum   hook number                 *
- *                                       NF_IP_PRE_ROUTING         *
- *                                       NF_IP_LOCAL_IN            *
- *                                       NF_IP_FORWARD             *
- *                                       NF_IP_LOCAL_OUT           *
- *                                       NF_IP_POST_ROUTING        *
+ * Parameters:  struct ipt_chain *chain      chain to change       *
+ *              struct ipt_rules *rules      new rules or NULL     *
+ *              int dead, ndead              see nfSetRules        *
  *                                                                 *
- * Returns:     -                                                  * 
+ * Returns:     int                          1:OK, 0:out of memory,*
+ *                                             the chain and the   *
+ *                                             active rules are    *
+ *                                             unchanged           *
  *                                                                 *
  *******************************************************************/
-void inetHook(unsigned int hook)
+static int nfCommitRules(struct ipt_chain *chain, struct ipt_rules *rules,
+                         int dead, int ndead)
 {
-#ifdef _DEBUG
-  printf("inetHook()\n");
-#endif
-  hooknum=hook;
+  struct ipt_rules *old=chain->rules;
+  struct nf_ruleset *rs;
+
+  chain->rules=rules;
+  rs=nfBuildRuleset();
+  chain->rules=old;
+  if (rs == NULL) return 0;
+  nfSetRules(chain,rules,dead,ndead);
+  nfActivate(rs);
+  return 1;
 }
 
 /*******************************************************************
- * inetGetData                                                     *
+ * nfSpliceRules                                                   *
  *                                                                 *
- * Gets the manipulated packet back                                *
+ * Builds the block of a chain with ndel rules removed at pos and  *
+ * entry (if not NULL) put there instead. The other rules keep     *
+ * their counters.                                                 *
  *                                                                 *
- * Parameters:  char **address       returned buffer               *
- *                                                                 *
- * Returns:     int                  size of the data buffer       * 
+ * Returns:     int                          1:OK, *rules is the   *
+ *                                             block or NULL if    *
+ *                                             it has no rules     *
+ *                                           0:out of memory       *
  *                                                                 *
  *******************************************************************/
-int inetGetData(char *address)
+static int nfSpliceRules(const struct ipt_chain *chain, int pos, int ndel,
+                         const struct ipt_entry *entry,
+                         struct ipt_rules **rules)
 {
-#ifdef _DEBUG
-  printf("inetGetData()\n");
-#endif
-  currInIf[0]=0;
-  currOutIf[0]=0;
-  currLayerID=-1;
-  hooknum=-1; currDataSize = getTotalBufSize(&currData);
-  /* copy the output buffer to the caller */
-  if (address != NULL) memcpy(address,afterData,currDataSize);
-  if (afterData) { free(afterData); afterData=NULL; };
-  return currDataSize;
+  const struct ipt_rules *old=chain->rules;
+  int count, n;
+
+  count=old ? old->count : 0;
+  n=count-ndel+(entry != NULL);
+  *rules=NULL;
+  if (n == 0) return 1;
+  if ((*rules=nfAllocRules(n)) == NULL) return 0;
+  if (pos > 0)
+  {
+    memcpy((*rules)->entry,old->entry,pos*sizeof(struct ipt_entry));
+    memcpy((*rules)->counters,old->counters,
+           pos*sizeof(struct ipt_counters));
+  }
+  if (entry != NULL)
+    (*rules)->entry[pos]=*entry;
+  if (count-pos-ndel > 0)
+  {
+    memcpy(&(*rules)->entry[pos+(entry != NULL)],&old->entry[pos+ndel],
+           (count-pos-ndel)*sizeof(struct ipt_entry));
+    memcpy(&(*rules)->counters[pos+(entry != NULL)],&old->counters[pos+ndel],
+           (count-pos-ndel)*sizeof(struct ipt_counters));
+  }
+  return 1;
+}
+
+/* positions a packet at the start of a chain */
+static void nfChainStart(struct nf_chainpos *pos,
+                         const struct nf_chainview *chain,
+                         const struct nf_pktctx *pkt)
+{
+  const struct ip_hdr *iph=pkt->skb.nh.iph;
+
+  pos->chain=chain;
+  pos->next=0;
+  if (chain->classifier != NULL)
+    nfClassLookup(chain->classifier,iph->ih_proto,pkt->dport,
+                  iph->ih_src,iph->ih_dst,&pos->cand);
+}
+
+/* next rule a packet has to be tested against, -1 at the chain end */
+static int nfChainNext(struct nf_chainpos *pos)
+{
+  const struct nf_chainview *chain=pos->chain;
+  int r;
+
+  if (chain->classifier == NULL)
+    return (pos->next < chain->count) ? pos->next++ : -1;
+
+  /* only the rules the classifier found for this packet */
+  while (pos->next < pos->cand.count)
+  {
+    r=pos->cand.rules[pos->next++];
+    if (NF_CLASS_ADDROK(&pos->cand,r)) return r;
+  }
+  return -1;
 }
 
 /*******************************************************************
- * inetContainLayers                                               *
- *                                                                 *
- * Sets the beginning of the header of the network packet          *
+ * nfRunChain                                                      *
  *                                                                 *
- * Parameters:  int layerid          layer to begin with           *
- *                                     NF_LAYER_ETH  ethernet l.   *
- *                                     NF_LAYER_IP   IP layer      *
+ * Runs a packet through the rules of a built-in chain and the     *
+ * user chains it jumps to. The chains being run are kept on an    *
+ * explicit stack; a user chain returns to its caller at its end   *
+ * or on RETURN. The jumps were checked for loops and depth when   *
+ * the rules were loaded, see nfCheckJumps.                        *
  *                                                                 *
- * Returns:     -                                                  * 
+ * Returns:     int                       verdict of the matching  *
+ *                                        rule or the chain policy *
  *                                                                 *
  *******************************************************************/
-void inetContainLayers(int layerid)
+static int nfRunChain(const struct nf_ruleset *rs,
+                      const struct nf_chainview *chain,
+                      struct nf_pktctx *pkt,
+                      const struct net_device *in,
+                      const struct net_device *out,
+                      unsigned int hook,
+                      int offset)
 {
+  struct sk_buff *pskb=&pkt->skb;
+  struct nf_chainpos stack[NF_JUMP_MAXDEPTH];
+  struct nf_chainpos *pos;
+  int verdict;
+  int hotdrop=0;
+  int r;
+
+  pos=stack;
+  nfChainStart(pos,chain,pkt);
+  for (;;)
+  {
+    r=nfChainNext(pos);
+    if (r < 0) verdict=IPT_RETURN;
+    else
+    {
 #ifdef _DEBUG
-  printf("inetContainLayers()\n");
+      printf("%s[%d]: ", pos->chain->name, r);
 #endif
-  currLayerID = layerid;
+      verdict=nfRunEntry(&pos->chain->entry[r],&pos->chain->counters[r],
+                         pskb,in,out,hook,
+                         offset,pskb->len,&hotdrop);
+
+      /* hot drop ! */
+      if (hotdrop) return NF_DROP;
+    }
+
+    if (verdict == IPT_CONTINUE) continue;
+    if (verdict == NF_JUMP)
+    {
+      if (pos == &stack[NF_JUMP_MAXDEPTH-1])
+      {
+        printf("nfcore.c: nfRunChain(): chain %s nested too deep\n",
+               pos->chain->name);
+        return NF_DROP;
+      }
+      pos++;
+      nfChainStart(pos,&rs->view[(pos-1)->chain->jump[r]],pkt);
+      continue;
+    }
+    if (verdict != IPT_RETURN) return verdict;
+
+    /* If none verdict was spoken, the chain policy (verdict) is taken */
+    if (pos == stack) return pos->chain->defaultverdict;
+    pos--;
+  }
 }
 
 /*******************************************************************
- * inetProcess                                                     *
- *                                                                 *
- * Let the firewall do its' work. F                                *
+ * nfPrepPacket                                                    *
  *                                                                 *
- * Parameters:  -                                                  *
+ * Points the packet context into the caller's buffer and runs     *
+ * connection tracking on it.                                      *
  *                                                                 *
- * Returns:     int                       verdict of the firewall  * 
+ * Returns:     int                   NF_ACCEPT or NF_DROP if the  *
+ *                                    packet is already decided,   *
+ *                                    IPT_CONTINUE if it has to go *
+ *                                    through the rules            *
  *                                                                 *
  *******************************************************************/
-int inetProcess(void)
-{
-  struct sk_buff *pskb=NULL;
-  struct net_device in;
-  struct net_device out;
-  char *targinfo=NULL;
-  void *matchinfo=NULL;
-  void *userinfo=NULL;
-  char *tempDataBuf=NULL;
-  int verdict=IPT_CONTINUE;
-  int hotdrop=0;
-  int tabnum=0;
-  int i;
-  int offset;
-  struct ipt_chain *chain,*lastchain;
-#ifdef _DEBUG
-  printf("inetProcess(): in\n");
-#endif
-  /* bond all data snipsets of current data buffer for use for a sk_buff */
-  tempDataBuf = (char*) malloc(getTotalBufSize(&currData) * sizeof(char));
+static int nfPrepPacket(struct nf_batchctx *ctx,
+                        struct nf_pktctx *pkt,
+                        unsigned int hook,
+                        const struct nf_packet *p)
+{
+  struct sk_buff *pskb=&pkt->skb;
+  struct nf_conn *ct;
+  int hdr_len;
 
-#ifdef _DEBUG
-  printf("inetProcess(): currData.size: %d\n",currData.size);
-  printf("             : currData->data: %08x\n",&currData.data);
-  printf("             : currData->next: %08x\n",&currData.next);
-  printf("             : currData groesse: %d\n",getTotalBufSize(&currData));
-#endif
+  if (p->hdrlen < (int)sizeof(struct ip_hdr))
+  {
+    printf("nfcore.c: nfPrepPacket(): truncated header (%d bytes)\n",
+           p->hdrlen);
+    return NF_DROP;
+  }
 
-  if (tempDataBuf == NULL)
+  /* point the layers into the caller's buffer */
+  pskb->next=pskb->prev=NULL;
+  pskb->dev=&ctx->in;
+  pskb->real_dev=NULL;
+  pskb->mac.raw=(unsigned char*)(p->mac ? p->mac : p->data);
+  pskb->nh.raw=(unsigned char*)p->data;
+  hdr_len=(pskb->nh.iph->ih_vers_ihl & IH_IHL_MASK) * 4;
+  if (hdr_len < (int)sizeof(struct ip_hdr) || hdr_len > p->hdrlen)
+    hdr_len=sizeof(struct ip_hdr);
+  pskb->h.raw=pskb->nh.raw + hdr_len;
+  pskb->len=p->packsize;
+  pskb->head=pskb->data=(unsigned char*)p->data;
+  pskb->tail=(unsigned char*)p->data + p->hdrlen;
+
+  /* translated destinations are restored before conntrack looks */
+  pskb->nat=NULL;
+  pskb->natinfo=0;
+  if ((hook == NF_IP_PRE_ROUTING) || (hook == NF_IP_LOCAL_OUT) ||
+      (hook == NF_IP_POST_ROUTING))
   {
-    printf("nfcore.c: inetProcess(): tempDataBuf: out of memory while \
-allocating %d bytes\n", getTotalBufSize(&currData) * sizeof(char));
-    return -1;
+    if ((nfNatLookup(pskb) != NULL) && (nfNatApply(pskb,hook) < 0))
+      return NF_DROP;
   }
 
+  /* proxied connections are adjusted, the server's SYN-ACK taken */
+  if (nfSynproxyIn(pskb,p->hdrlen,hook,ctx->in.name) == NF_DROP)
+    return NF_DROP;
+
+  /* packets of a flow this hook has accepted before skip the rules,
+   * see nfConntrackConfirm
+   */
+  ct=nfConntrackIn(pskb,p->hdrlen);
+  if ((ct != NULL) &&
+      ((pskb->nfctinfo % IP_CT_IS_REPLY) == IP_CT_ESTABLISHED) &&
+      (ct->gen == ctx->rules->gen) &&
+      (ct->accepted[CTINFO2DIR(pskb->nfctinfo)] & (1 << hook)))
+  {
 #ifdef _DEBUG
+    printf("nfPrepPacket(): established flow, accepted\n");
 #endif
+    return NF_ACCEPT;
+  }
 
-  bondBuffers(tempDataBuf,&currData);
-
-  /* prepare layers to be processed */
-  pskb=(struct sk_buff*)malloc(sizeof(struct sk_buff));
-  if (pskb == NULL)
+  /* destination port for the classifier, if the header is complete */
+  pkt->dport=-1;
+  pkt->fragoff=ntohs(pskb->nh.iph->ih_flags_fragoff) & IH_FRAGOFF_MASK;
+  if (pkt->fragoff == 0)
   {
-    free (tempDataBuf);
-    printf("nfcore.c: inetProcess(): pskb: out of memory while allocating \
-%d bytes\n", sizeof(struct sk_buff));
-    return -1;
+    if ((pskb->nh.iph->ih_proto == IPPROTO_TCP) &&
+        (hdr_len + (int)sizeof(struct tcp_hdr) <= p->hdrlen))
+      pkt->dport=ntohs(pskb->h.th->th_dstport);
+    else if ((pskb->nh.iph->ih_proto == IPPROTO_UDP) &&
+             (hdr_len + (int)sizeof(struct udp_hdr) <= p->hdrlen))
+      pkt->dport=ntohs(pskb->h.uh->uh_dst_port);
   }
-  strcpy(in.name,currInIf);
-  strcpy(out.name,currOutIf);
-  pskb->dev=&in;
- 
-  offset=0;
-  switch (currLayerID)
+  return IPT_CONTINUE;
+}
+
+/*******************************************************************
+ * inetProcessBatch                                                *
+ *                                                                 *
+ * Let the firewall do its' work on a burst of packets that pass   *
+ * the same hook between the same interfaces. The packets stay in  *
+ * the caller's buffers; their headers must be contiguous at data, *
+ * they are neither copied nor freed and targets may modify them   *
+ * in place. Each chain is run for all packets of the burst before *
+ * the next one, so its rules stay in the cache. All packets of a  *
+ * call see the same rule set snapshot, even if it is replaced in  *
+ * the meantime.                                                   *
+ *                                                                 *
+ * Parameters:  struct nf_batchctx *ctx  caller's evaluation state *
+ *              unsigned int hook     hook number                  *
+ *                                      NF_IP_PRE_ROUTING          *
+ *                                      NF_IP_LOCAL_IN             *
+ *                                      NF_IP_FORWARD              *
+ *                                      NF_IP_LOCAL_OUT            *
+ *                                      NF_IP_POST_ROUTING         *
+ *              char *ifin            input interface or NULL      *
+ *              char *ifout           output interface or NULL     *
+ *              struct nf_packet *pkts the packets                 *
+ *              int count             number of packets            *
+ *              int *verdicts         verdict for each packet      *
+ *                                                                 *
+ * Returns:     int                   number of accepted packets   *
+ *                                                                 *
+ *******************************************************************/
+int inetProcessBatch(struct nf_batchctx *ctx,
+                     unsigned int hook,
+                     const char *ifin,
+                     const char *ifout,
+                     const struct nf_packet *pkts,
+                     int count,
+                     int *verdicts)
+{
+  struct nf_ruleset *rs;
+  struct nf_pktctx *pkt;
+  int first, n, i, c, pending, accepted, last;
+#ifdef _DEBUG
+  printf("inetProcessBatch(): %d packets\n",count);
+#endif
+  if ((hook < 1) || (hook > NF_IP_NUMHOOKS) || (nfActive == NULL))
   {
-    case NF_LAYER_ETH:
-         pskb->dev->hard_header_len = sizeof(struct eth_hdr);
-         pskb->mac.raw = (void*)(tempDataBuf);
-         pskb->nh.raw = (void*)(tempDataBuf + sizeof(struct eth_hdr));
-         pskb->h.raw = (void*)(tempDataBuf + sizeof(struct eth_hdr) +
-                                             sizeof(struct ip_hdr));
-	 break;
-    case NF_LAYER_IP:
-         pskb->dev->hard_header_len = 0;
-         pskb->mac.raw = (void*)(tempDataBuf);
-         pskb->nh.raw = (void*)(tempDataBuf);
-         pskb->h.raw = (void*)(tempDataBuf + sizeof(struct ip_hdr));
-         break;
+    if (nfActive != NULL)
+      printf("nfcore.c: inetProcessBatch(): wrong hook number %u\n",hook);
+    for (i=0; i<count; i++) verdicts[i]=NF_ACCEPT;
+    return count;
   }
 
-  /* for all 3 tables */
-  for ( tabnum=0; tabnum<3; tabnum++ )
+  /* hold on to the current rules */
+  rs=ctx->rules=nfActive;
+  rs->refcnt++;
+
+  strncpy(ctx->in.name,ifin ? ifin : "",IF_NAMESIZE-1);
+  ctx->in.name[IF_NAMESIZE-1]='\0';
+  strncpy(ctx->out.name,ifout ? ifout : "",IF_NAMESIZE-1);
+  ctx->out.name[IF_NAMESIZE-1]='\0';
+  ctx->in.hard_header_len=(count > 0 && pkts[0].mac) ?
+                          sizeof(struct eth_hdr) : 0;
+
+  /* Flows are only made and moved on at the last hook of a packet,
+   * when all tables have accepted it. A bridged packet, the only kind
+   * that comes with its link header (IP's own frames skip eth_filter),
+   * passes FORWARD alone.
+   */
+  last=(hook == NF_IP_LOCAL_IN) || (hook == NF_IP_POST_ROUTING) ||
+       ((hook == NF_IP_FORWARD) && ctx->in.hard_header_len);
+
+  accepted=0;
+  for (first=0; first<count; first+=NF_BATCH_MAX)
   {
-    char hookName[32]="";
-    struct ipt_table *table;
-    //struct iot_chain *chin;
+    n=min(count-first,NF_BATCH_MAX);
 
-    /* set table to be used */
-    switch (tabnum)
+    pending=0;
+    for (i=0; i<n; i++)
     {
-      case 0 : table=&tab_mangle; break;
-      case 1 : table=&tab_nat;    break;
-      case 2 : table=&tab_filter; break;
-      default: table=NULL;        break;
+      pkt=&ctx->pkt[i];
+      verdicts[first+i]=nfPrepPacket(ctx,pkt,hook,&pkts[first+i]);
+      pkt->decided=(verdicts[first+i] != IPT_CONTINUE);
+      if (!pkt->decided)
+      {
+        verdicts[first+i]=NF_ACCEPT;
+        pending++;
+      }
     }
 
-    /* select current hook */
-    switch (hooknum)
+    /* the chains of this hook, each table in turn, until one drops */
+    for (c=0; (c<rs->nchains[hook]) && pending; c++)
     {
-      case NF_IP_PRE_ROUTING :  strcpy (hookName, "PREROUTING");  break;
-      case NF_IP_LOCAL_IN    :  strcpy (hookName, "INPUT");       break;
-      case NF_IP_FORWARD     :  strcpy (hookName, "FORWARD");     break;
-      case NF_IP_POST_ROUTING:  strcpy (hookName, "POSTROUTING"); break;
-      case NF_IP_LOCAL_OUT   :  strcpy (hookName, "OUTPUT");      break;
-      default                :  printf ("netfilter.c: inetProcess(): \
-wrong Hook number"); break;
+      for (i=0; i<n; i++)
+      {
+        pkt=&ctx->pkt[i];
+        if (pkt->decided || (verdicts[first+i] != NF_ACCEPT))
+          continue;
+        /* the nat table only binds the first packets of a flow */
+        if (rs->chain[hook][c]->nat &&
+            ((pkt->skb.nat != NULL) || (pkt->skb.nfctinfo != IP_CT_NEW)))
+          continue;
+        verdicts[first+i]=nfRunChain(rs,rs->chain[hook][c],pkt,
+                                     &ctx->in,&ctx->out,hook,pkt->fragoff);
+        if (verdicts[first+i] != NF_ACCEPT) pending--;
+      }
     }
 
-#ifdef _DEBUG
-    printf("Hook:%s, processing %s:\n", hookName,table->name);
-    printf("-------------------------\n");
-#endif
-    chain=getChain(table,hookName);
-
-    if (chain != NULL)
+    for (i=0; i<n; i++)
     {
-      lastchain=chain;
-      verdict=IPT_CONTINUE;
-      /* go through the entries */
-      for ( i=0; (i<MAX_ENTRIES_PER_CHAIN)&&(!hotdrop)&&(verdict<0); i++ )
+      pkt=&ctx->pkt[i];
+      if (verdicts[first+i] != NF_ACCEPT)
       {
-        if (chain->entry[i]!=NULL)
-	{
-#ifdef _DEBUG
-	  printf("%s[%d]: ", chain->name, i);
-#endif
-
-          /* inspect IP information */
-          if (match_mods[0]->match(pskb,
-                                   &in,
-                                   &out,
-                                   &chain->entry[i]->ip,
-                                   offset,
-                                   pskb->nh.iph,
-                                   currPackSize,
-                                   &hotdrop))
-	  {
-#ifdef _DEBUG
-	    printf("IP match, ");
-#endif
-	    matchinfo=chain->entry[i]->l3match;
-
-            /* check for protocol specific information */
-	    if (chain->entry[i]->match!=NULL)
-	    {
-              if (chain->entry[i]->match->match(pskb,
-                                                &in,
-                                                &out,
-                                                matchinfo,
-                                                offset,
-                                                pskb->h.raw,
-                                                currPackSize,
-                                                &hotdrop))
-	      {
-		targinfo=chain->entry[i]->targinfo;
-#ifdef _DEBUG
-	        printf("L3 match, ");
-#endif
-
-                /* increment packet and byte counters */
-	        chain->entry[i]->counters.pcnt++;
-	        chain->entry[i]->counters.bcnt+=getTotalBufSize(&currData);
-
-                /* execute the target function and get verdict */
-	        verdict=chain->entry[i]->target->target(&pskb,
-                                                        hooknum,
-                                                        &in,
-                                                        &out,
-                                                        targinfo,
-                                                        userinfo);
-#ifdef _DEBUG
-	        printf("verdict=%d\n",verdict);
-#endif
-	      } 
-	    }
-	    else
-	    {
-              /* increment packet and byte counters */
-	      chain->entry[i]->counters.pcnt++;
-	      chain->entry[i]->counters.bcnt+=getTotalBufSize(&currData);
-
-              /* execute the target function and get verdict */
-	      verdict=chain->entry[i]->target->target(&pskb,
-                                                      hooknum,
-                                                      &in,
-                                                      &out,
-                                                      targinfo,
-                                                      userinfo);
-#ifdef _DEBUG
-	      printf("verdict=%d\n",verdict);
-#endif
-	    }
-	  }
-	}
-	else i=MAX_ENTRIES_PER_CHAIN;
-#ifdef _DEBUG
-	printf("\n");
-#endif
+        /* A packet queued at its last hook may be let through later.
+         * Its flow is made now, so the replies are not NEW; the flow is
+         * not marked as accepted, its next packets are queued again.
+         */
+        if (((verdicts[first+i] & NF_VERDICT_MASK) == NF_QUEUE) && last &&
+            !pkt->decided && (pkt->skb.nfct == NULL))
+          nfConntrackConfirm(&pkt->skb,pkts[first+i].hdrlen,hook,rs->gen);
+        continue;
+      }
+      if (last)
+        nfConntrackConfirm(&pkt->skb,pkts[first+i].hdrlen,hook,rs->gen);
+      else
+        nfConntrackPass(&pkt->skb,hook,rs->gen);
+      if (pkt->skb.nat != NULL)
+      {
+        /* sources are translated last, conntrack saw the old ones */
+        if ((hook == NF_IP_POST_ROUTING) && (nfNatApply(&pkt->skb,hook) < 0))
+        {
+          verdicts[first+i]=NF_DROP;
+          continue;
+        }
+        nfNatTouch(&pkt->skb);
       }
+      accepted++;
     }
-#ifdef _DEBUG
-    printf("-------------------------\n");
-#endif
   }
-  /* hot drop ! */
-  if (hotdrop) verdict=NF_DROP;
-
-  /* If none verdict was spoken, the chain policy (verdict) is taken */
-  if ((verdict < 0)&&(lastchain)) verdict=lastchain->defaultverdict;
 
-  /* prepare the output buffer */
-  afterData = malloc(getTotalBufSize(&currData));
-  if (afterData == NULL)
-  {
-    free(pskb);
-    free(tempDataBuf);
-    printf("nfcore.c: inetProcess(): afterData: out of memory while allocating \
-%d bytes\n", getTotalBufSize(&currData));
-    return -1;
-  }
-  memcpy(afterData,pskb,getTotalBufSize(&currData));
-  free(pskb);
-  free(tempDataBuf);
+  /* done with the rules, they may be freed if they were replaced */
+  ctx->rules=NULL;
+  if ((--rs->refcnt == 0) && (rs != nfActive)) nfReclaim();
 #ifdef _DEBUG
-  printf("Final verdict=%d \n",verdict);
+  printf("inetProcessBatch(): %d of %d accepted\n",accepted,count);
 #endif
-  return verdict;
+  return accepted;
+}
+
+/* a chain without rules, not in any table yet */
+static struct ipt_chain *nfAllocChain(const char *name, int policy,
+                                      int builtin)
+{
+  struct ipt_chain *chain;
+
+  chain=(struct ipt_chain*)malloc(sizeof(struct ipt_chain));
+  if (chain == NULL) return NULL;
+  strncpy(chain->name,name,IPT_CHAIN_MAXNAMELEN);
+  chain->name[IPT_CHAIN_MAXNAMELEN-1]='\0';
+  chain->rules=NULL;
+  chain->defaultverdict=policy;
+  chain->builtin=builtin;
+  return chain;
+}
+
+static void nfFreeChain(struct ipt_chain *chain)
+{
+  free(chain);
 }
 
 /*******************************************************************
@@ -687,19 +1164,19 @@ int iptablesNewChain(const struct ipt_table *table,
    {
      struct ipt_chain *newchain;
 
-     newchain=(struct ipt_chain*) malloc(sizeof(struct ipt_chain));
-     strncpy(newchain->name,name,IPT_CHAIN_MAXNAMELEN);
-     newchain->entry=(struct ipt_entry**)malloc((MAX_ENTRIES_PER_CHAIN+1)*
-                                         sizeof(struct ipt_entry*));
-     if (newchain->entry == NULL)
+     newchain=nfAllocChain(name,policy,builtin);
+     if (newchain == NULL)
      {
-       printf("nfcore.c: iptablesNewChain(): out of memory while allocating \
-%d bytes\n", (MAX_ENTRIES_PER_CHAIN+1)*sizeof(struct ipt_entry*));
+       printf("nfcore.c: iptablesNewChain(): out of memory\n");
        return 2;
      }
-     newchain->entry[0]=NULL;
-     newchain->defaultverdict=policy;
      list_add((struct list_head*)newchain,(struct list_head*)&table->list);
+     if (builtin && (hooknum >= 1) && (hooknum <= NF_IP_NUMHOOKS))
+     {
+       ((struct ipt_table*)table)->hook[hooknum]=newchain;
+       ((struct ipt_table*)table)->valid_hooks|=1 << hooknum;
+       nfCommit();
+     }
      if (builtin) printf("MinixWall: Initialized built-in chain %s:%s\n",table->name,name);
              else printf("MinixWall: Added chain %s:%s\n",table->name,name);
    }
@@ -745,13 +1222,13 @@ int iptablesSelectTable(enum nftable table)
   switch(table)
   {
     case NF_TABLE_FILTER:
-		      selectedTable=&tab_filter;
+		      nfBuild.table=&tab_filter;
 		      break;
     case NF_TABLE_NAT:
-		      selectedTable=&tab_nat;
+		      nfBuild.table=&tab_nat;
 		      break;
     case NF_TABLE_MANGLE:
-		      selectedTable=&tab_mangle;
+		      nfBuild.table=&tab_mangle;
 		      break;
     default:
 		      printf("nfcore: iptablesSelectTable(): invalid table: %d\n",table);
@@ -765,165 +1242,433 @@ int iptablesSelectChain(char *name)
 #ifdef _DEBUG
   printf("iptablesSelectChain()\n");
 #endif
-  if ( !chainExists( selectedTable, name ) ) return 0;
-  selectedChain= getChain( selectedTable, name);
+  if ( !chainExists( nfBuild.table, name ) ) return 0;
+  nfBuild.chain= getChain( nfBuild.table, name);
   return 1;
 }
 
-int iptablesSelectL3Match(char *name)
+static struct ipt_match *findMatch(const char *name)
 {
   int i;
-#ifdef _DEBUG
-  printf("iptablesSelectL3Match()\n");
-#endif
-  selectedL3Match=NULL;
+
   for (i=0; i<matchmodcounter; i++)
   {
-    if (strcmp(match_mods[i]->name,name)==0)
-    {
-      selectedL3Match=match_mods[i];
-      return 1;
-    }
+    if (strcmp(match_mods[i]->name,name)==0) return match_mods[i];
   }
-  printf("Match %s not found.\n",name);
-  return 0;
+  return NULL;
 }
 
-int iptablesSelectTarget(char *name)
+static struct ipt_target *findTarget(const char *name)
 {
   int i;
-#ifdef _DEBUG
-  printf("iptablesSelectTarget()\n");
-#endif
-  selectedTarget=NULL;
+
   for (i=0; i<targetmodcounter; i++)
   {
-    if (strcmp(target_mods[i]->name,name)==0)
-    {
-      selectedTarget=target_mods[i];
-      return 1;
-    }
+    if (strcmp(target_mods[i]->name,name)==0) return target_mods[i];
   }
-  jumpChain=getChain(selectedTable,name);
-  if (jumpChain != NULL) return 1;
-
-  return 0;
+  return NULL;
 }
 
-int iptablesSetL3MatchInfo(void *matchinfo)
+static const struct ipt_rules *nfLiveRules(struct ipt_chain *chain,
+                                           void *arg)
 {
-#ifdef _DEBUG
-  printf("iptablesSetL3MatchInfo()\n");
-#endif
-  memcpy(&L3MatchInfo,matchinfo,MATCHINFO_MAXSIZE);
-  return 1;
+  return chain->rules;
 }
 
-int iptablesSetIPMatchInfo(void *matchinfo)
+/* Depth of a chain and the chains below it, -1 if the jumps loop. The
+ * depth of finished chains is kept in chain->depth, -1 marks a chain
+ * on the current path.
+ */
+static int nfJumpDepth(struct ipt_chain *chain, int level,
+                       const struct ipt_rules *(*rules)(struct ipt_chain*,
+                                                        void*),
+                       void *arg)
 {
-#ifdef _DEBUG
-  printf("iptablesSetIPMatchInfo()\n");
-#endif
-  memcpy(&IPMatchInfo,matchinfo,sizeof(struct ipt_ip));
-  return 1;/* match_mods[0]->checkentry(selectedTable->name,&IPMatchInfo,
-				  &IPMatchInfo,sizeof(struct ipt_ip),0);*/
-}
+  const struct ipt_rules *r;
+  int i, d, depth;
 
-int iptablesSetTargInfo(void *targinfo)
-{
-#ifdef _DEBUG
-  printf("iptablesSetTargInfo()\n");
-#endif
-  memcpy(&targetInfo,targinfo,TARGINFO_MAXSIZE);
-  return 1; /*selectedTarget->checkentry(selectedTable->name,NULL,
-	                           targinfo,TARGINFO_MAXSIZE,0);*/
-}
+  if (chain->depth < 0) return -1;
+  if (chain->depth > 0) return chain->depth;
+  if (level > NF_JUMP_MAXDEPTH) return 1;     /* too deep already */
 
-int addEntry(struct ipt_chain *chain, struct ipt_entry *entry)
-{
-  int i;
-#ifdef _DEBUG
-  printf("addEntry()\n");
-#endif
-  for (i=0; (i<MAX_ENTRIES_PER_CHAIN) && (chain->entry[i]!=NULL); i++);
-  if (i < MAX_ENTRIES_PER_CHAIN)
+  chain->depth=-1;
+  depth=1;
+  r=rules(chain,arg);
+  for (i=0; (r != NULL) && (i<r->count); i++)
   {
-    chain->entry[i]=entry;
-    chain->entry[i+1]=NULL;
-    printf("MinixWall: Entry added: chain=%s, pos=%d, src=%d.%d.%d.%d/%d.%d.%d.%d, \
+    if (r->entry[i].jumpchain == NULL) continue;
+    d=nfJumpDepth(r->entry[i].jumpchain,level+1,rules,arg);
+    if (d < 0) return -1;
+    if (d+1 > depth) depth=d+1;
+  }
+  chain->depth=depth;
+  return depth;
+}
+
+/*******************************************************************
+ * nfCheckJumps                                                    *
+ *                                                                 *
+ * Checks that the jumps between the chains of a table do not loop *
+ * and nest no deeper than the stack of nfRunChain.                *
+ *                                                                 *
+ * Parameters:  struct ipt_table *table      table to check        *
+ *              rules(chain,arg)             rules of a chain, the *
+ *                                           live ones or those    *
+ *                                           about to be loaded    *
+ *                                                                 *
+ * Returns:     int                          1:OK                  *
+ *                                           0:loop or too deep    *
+ *                                                                 *
+ *******************************************************************/
+static int nfCheckJumps(const struct ipt_table *table,
+                        const struct ipt_rules *(*rules)(struct ipt_chain*,
+                                                         void*),
+                        void *arg)
+{
+  struct list_head *pos;
+  int d;
+
+  list_for_each(pos,&table->list)
+    ((struct ipt_chain*)pos)->depth=0;
+  list_for_each(pos,&table->list)
+  {
+    d=nfJumpDepth((struct ipt_chain*)pos,1,rules,arg);
+    if (d < 0)
+    {
+      printf("nfcore.c: jumps from chain %s:%s loop\n",table->name,
+             ((struct ipt_chain*)pos)->name);
+      return 0;
+    }
+    if (d > NF_JUMP_MAXDEPTH)
+    {
+      printf("nfcore.c: jumps from chain %s:%s nest deeper than %d\n",
+             table->name,((struct ipt_chain*)pos)->name,NF_JUMP_MAXDEPTH);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*******************************************************************
+ * iptablesNewUserChain                                            *
+ *                                                                 *
+ * Creates an empty user chain in the selected table. Rules jump   *
+ * to it by naming it as their target.                             *
+ *                                                                 *
+ * Returns:     int                          1:OK, 0:error         *
+ *                                                                 *
+ *******************************************************************/
+int iptablesNewUserChain(char *name)
+{
+#ifdef _DEBUG
+  printf("iptablesNewUserChain()\n");
+#endif
+  if ((nfBuild.table == NULL) || (strlen(name) == 0) ||
+      (strlen(name) >= IPT_CHAIN_MAXNAMELEN))
+    return 0;
+  if (findTarget(name) != NULL)
+  {
+    printf("nfcore.c: iptablesNewUserChain(): %s is a target\n",name);
+    return 0;
+  }
+  return iptablesNewChain(nfBuild.table,name,IPT_RETURN,0,0) == 0;
+}
+
+/*******************************************************************
+ * iptablesDeleteChain                                             *
+ *                                                                 *
+ * Removes an empty user chain no rule jumps to.                   *
+ *                                                                 *
+ * Returns:     int                          1:OK, 0:error         *
+ *                                                                 *
+ *******************************************************************/
+int iptablesDeleteChain(char *name)
+{
+  struct ipt_chain *chain, *other;
+  struct list_head *pos;
+  int i;
+#ifdef _DEBUG
+  printf("iptablesDeleteChain()\n");
+#endif
+  if (nfBuild.table == NULL) return 0;
+  chain=getChain(nfBuild.table,name);
+  if ((chain == NULL) || chain->builtin || (chain->rules != NULL))
+    return 0;
+  list_for_each(pos,&nfBuild.table->list)
+  {
+    other=(struct ipt_chain*)pos;
+    for (i=0; (other->rules != NULL) && (i<other->rules->count); i++)
+    {
+      if (other->rules->entry[i].jumpchain == chain)
+      {
+        printf("nfcore.c: iptablesDeleteChain(): %s is used by %s\n",
+               name,other->name);
+        return 0;
+      }
+    }
+  }
+
+  /* snapshots have their own copy of the chain */
+  list_del(&chain->list);
+  if (nfBuild.chain == chain) nfBuild.chain=NULL;
+  if (nfBuild.jumpchain == chain) nfBuild.jumpchain=NULL;
+  printf("MinixWall: Removed chain %s:%s\n",nfBuild.table->name,name);
+  nfFreeChain(chain);
+  return 1;
+}
+
+int iptablesSelectL3Match(char *name)
+{
+#ifdef _DEBUG
+  printf("iptablesSelectL3Match()\n");
+#endif
+  nfBuild.match=findMatch(name);
+  if (nfBuild.match != NULL) return 1;
+  printf("Match %s not found.\n",name);
+  return 0;
+}
+
+int iptablesSelectTarget(char *name)
+{
+#ifdef _DEBUG
+  printf("iptablesSelectTarget()\n");
+#endif
+  nfBuild.jumpchain=NULL;
+  nfBuild.target=findTarget(name);
+  if (nfBuild.target != NULL) return 1;
+  /* only user chains can be jumped to */
+  nfBuild.jumpchain=getChain(nfBuild.table,name);
+  if ((nfBuild.jumpchain != NULL) && !nfBuild.jumpchain->builtin) return 1;
+
+  nfBuild.jumpchain=NULL;
+  return 0;
+}
+
+int iptablesSetL3MatchInfo(void *matchinfo)
+{
+#ifdef _DEBUG
+  printf("iptablesSetL3MatchInfo()\n");
+#endif
+  memcpy(nfBuild.matchinfo,matchinfo,MATCHINFO_MAXSIZE);
+  return 1;
+}
+
+int iptablesSetIPMatchInfo(void *matchinfo)
+{
+#ifdef _DEBUG
+  printf("iptablesSetIPMatchInfo()\n");
+#endif
+  memcpy(&nfBuild.ip,matchinfo,sizeof(struct ipt_ip));
+  return 1;/* match_mods[0]->checkentry(nfBuild.table->name,&nfBuild.ip,
+				  &nfBuild.ip,sizeof(struct ipt_ip),0);*/
+}
+
+int iptablesSetTargInfo(void *targinfo)
+{
+#ifdef _DEBUG
+  printf("iptablesSetTargInfo()\n");
+#endif
+  memcpy(nfBuild.targinfo,targinfo,TARGINFO_MAXSIZE);
+  return 1; /*nfBuild.target->checkentry(nfBuild.table->name,NULL,
+	                           targinfo,TARGINFO_MAXSIZE,0);*/
+}
+
+static const char *targetName(const struct ipt_entry *entry)
+{
+  return entry->target ? entry->target->name : entry->jumpchain->name;
+}
+
+static void logEntry(const char *what, const struct ipt_chain *chain,
+                     int pos, const struct ipt_entry *entry)
+{
+  printf("MinixWall: Entry %s: chain=%s, pos=%d, src=%d.%d.%d.%d/%d.%d.%d.%d, \
 dst=%d.%d.%d.%d/%d.%d.%d.%d, proto=%d, target=%s\n",
+	    what,
 	    chain->name,
-	    i,
+	    pos,
 	    NIPQUAD(entry->ip.src.s_addr),
 	    NIPQUAD(entry->ip.smsk.s_addr),
 	    NIPQUAD(entry->ip.dst.s_addr),
 	    NIPQUAD(entry->ip.dmsk.s_addr),
 	    entry->ip.proto,
-	    entry->target->name
+	    targetName(entry)
 	  );
-    return 1;
+}
+
+static int ruleCount(const struct ipt_chain *chain)
+{
+  return chain->rules ? chain->rules->count : 0;
+}
+
+/*******************************************************************
+ * addEntry                                                        *
+ *                                                                 *
+ * Inserts a rule into a chain, the rules from pos on move down.   *
+ * A jump must not close a loop, the chain is left alone if it     *
+ * would.                                                          *
+ *                                                                 *
+ * Returns:     int                          1:OK, 0:error         *
+ *                                                                 *
+ *******************************************************************/
+static int addEntry(struct ipt_chain *chain, int pos,
+                    const struct ipt_entry *entry)
+{
+  struct ipt_rules *rules, *old;
+#ifdef _DEBUG
+  printf("addEntry()\n");
+#endif
+  if ((pos < 0) || (pos > ruleCount(chain))) return 0;
+  if (!nfSpliceRules(chain,pos,0,entry,&rules))
+  {
+    printf("nfcore.c: addEntry(): out of memory\n");
+    return 0;
   }
-  return 0;
+
+  /* a jump is checked with the rule in place, it is never committed if
+   * it loops
+   */
+  if (entry->jumpchain != NULL)
+  {
+    old=chain->rules;
+    chain->rules=rules;
+    if (!nfCheckJumps(nfBuild.table,nfLiveRules,NULL))
+    {
+      chain->rules=old;
+      free(rules);
+      return 0;
+    }
+    chain->rules=old;
+  }
+  if (!nfCommitRules(chain,rules,0,0))
+  {
+    free(rules);
+    return 0;
+  }
+  logEntry("added",chain,pos,entry);
+  return 1;
 }
 
-int delEntry(struct ipt_chain *chain, int index)
+/*******************************************************************
+ * delEntry                                                        *
+ *                                                                 *
+ * Deletes the rules pos to pos+n-1 of a chain, the following ones *
+ * move up.                                                        *
+ *                                                                 *
+ * Returns:     int                          1:OK, 0:error         *
+ *                                                                 *
+ *******************************************************************/
+static int delEntry(struct ipt_chain *chain, int pos, int n)
 {
+  struct ipt_rules *rules;
   int i;
 #ifdef _DEBUG
   printf("delEntry()\n");
 #endif
-  for (i=0; (i<MAX_ENTRIES_PER_CHAIN) && (chain->entry[i]!=NULL); i++)
+  if ((pos < 0) || (n <= 0) || (pos+n > ruleCount(chain))) return 0;
+  if (!nfSpliceRules(chain,pos,n,NULL,&rules))
   {
-    if (i==index)
-    {
-      printf("MinixWall: Entry removed: chain=%s, pos=%d, src=%d.%d.%d.%d/%d.%d.%d.%d, \
-dst=%d.%d.%d.%d/%d.%d.%d.%d, proto=%d, target=%s\n",
-	    chain->name,
-	    i,
-	    NIPQUAD(chain->entry[i]->ip.src.s_addr),
-	    NIPQUAD(chain->entry[i]->ip.smsk.s_addr),
-	    NIPQUAD(chain->entry[i]->ip.dst.s_addr),
-	    NIPQUAD(chain->entry[i]->ip.dmsk.s_addr),
-	    chain->entry[i]->ip.proto,
-	    chain->entry[i]->target->name
-            );
-      /* remove the entry */
-      free(chain->entry[i]->l3match);
-      free(chain->entry[i]->targinfo);
-      free(chain->entry[i]);
-      /* move the following entries one up */
-      for (; (i<MAX_ENTRIES_PER_CHAIN-1) && (chain->entry[i]!=NULL); i++)
-      {
-	chain->entry[i]=chain->entry[i+1];
-      }
-      chain->entry[MAX_ENTRIES_PER_CHAIN-1]=NULL;
-      return 1;
-    }
+    printf("nfcore.c: delEntry(): out of memory\n");
+    return 0;
   }
-  return 0;
+  for (i=pos; i<pos+n; i++)
+    logEntry("removed",chain,i,&chain->rules->entry[i]);
+  /* packets may still be looking at the old block */
+  if (!nfCommitRules(chain,rules,pos,n))
+  {
+    free(rules);
+    return 0;
+  }
+  return 1;
 }
   
+/*******************************************************************
+ * nfNewEntry                                                      *
+ *                                                                 *
+ * Fills in a rule. The match and target info are copied and the   *
+ * match and target get to check them. A rule that was accepted    *
+ * has to be passed to nfDestroyEntry if it is not used after all. *
+ *                                                                 *
+ * Returns:     int error code               0:OK                  *
+ *                                           1:refused by match    *
+ *                                             or target           *
+ *                                                                 *
+ *******************************************************************/
+static int nfNewEntry(struct ipt_entry *entry,
+                      const struct ipt_table *table,
+                      const struct ipt_ip *ip,
+                      struct ipt_match *match,
+                      const void *matchinfo,
+                      struct ipt_target *target,
+                      const void *targinfo,
+                      struct ipt_chain *jumpchain)
+{
+  memcpy(&entry->ip,ip,sizeof(struct ipt_ip));
+  memcpy(entry->l3match,matchinfo,MATCHINFO_MAXSIZE);
+  memcpy(entry->targinfo,targinfo,TARGINFO_MAXSIZE);
+  entry->nfcache=0;
+  entry->comefrom=0;
+  entry->jumpchain=jumpchain;
+  entry->match=match;
+  entry->target=target;
+  if ((match != NULL) && (match->checkentry != NULL) &&
+      !match->checkentry(table->name,&entry->ip,entry->l3match,
+                         MATCHINFO_MAXSIZE,table->valid_hooks))
+    return 1;
+  if ((target != NULL) && (target->checkentry != NULL) &&
+      !target->checkentry(table->name,entry,entry->targinfo,
+                          TARGINFO_MAXSIZE,table->valid_hooks))
+  {
+    nfDestroyEntry(entry);
+    return 1;
+  }
+  return 0;
+}
+
+/* builds the rule selected by the ioctls before and puts it at pos */
+static int nfAddRule(int pos)
+{
+  struct ipt_entry newentry;
+
+  if (nfBuild.chain == NULL) return 0;
+  if ((nfBuild.target == NULL) && (nfBuild.jumpchain == NULL)) return 0;
+  if (nfNewEntry(&newentry,nfBuild.table,&nfBuild.ip,nfBuild.match,
+                 nfBuild.matchinfo,nfBuild.target,nfBuild.targinfo,
+                 nfBuild.jumpchain) != 0)
+    return 0;
+  if (!addEntry(nfBuild.chain,pos,&newentry))
+  {
+    nfDestroyEntry(&newentry);
+    return 0;
+  }
+  return 1;
+}
+
 int iptablesAppendRule()
 {
-  struct ipt_entry *newentry;
 #ifdef _DEBUG
   printf("iptablesAppendRule()\n");
 #endif
-  newentry=(struct ipt_entry*) malloc(sizeof(struct ipt_entry));
-  memcpy(&newentry->ip,&IPMatchInfo,sizeof(struct ipt_ip));
-  newentry->l3match=(void*)malloc(MATCHINFO_MAXSIZE);
-  memcpy(newentry->l3match,&L3MatchInfo,MATCHINFO_MAXSIZE);
-  newentry->targinfo=(void*)malloc(TARGINFO_MAXSIZE);
-  memcpy(newentry->targinfo,&targetInfo,TARGINFO_MAXSIZE);
-  newentry->nfcache=0;
-  newentry->comefrom=0;
-  newentry->counters.pcnt=0;
-  newentry->counters.bcnt=0;
-  newentry->jumpchain=jumpChain;
-  newentry->match=selectedL3Match;
-  newentry->target=selectedTarget;
-  addEntry(selectedChain,newentry);
-  return 0;
+  if (nfBuild.chain == NULL) return 0;
+  return nfAddRule(ruleCount(nfBuild.chain));
+}
+
+/*******************************************************************
+ * iptablesInsertRule                                              *
+ *                                                                 *
+ * Inserts the rule selected by the ioctls before at a position of *
+ * the selected chain, counted from 0. The position may be the end *
+ * of the chain.                                                   *
+ *                                                                 *
+ * Returns:     int                          1:OK, 0:error         *
+ *                                                                 *
+ *******************************************************************/
+int iptablesInsertRule(index)
+int index;
+{
+#ifdef _DEBUG
+  printf("iptablesInsertRule()\n");
+#endif
+  return nfAddRule(index);
 }
 
 int iptablesDeleteRule(index)
@@ -932,7 +1677,8 @@ int index;
 #ifdef _DEBUG
   printf("iptablesDeleteRule()\n");
 #endif
-  return delEntry(selectedChain,index);
+  if (nfBuild.chain == NULL) return 0;
+  return delEntry(nfBuild.chain,index,1);
 }
 
 int iptablesFlushChain( void )
@@ -940,34 +1686,458 @@ int iptablesFlushChain( void )
 #ifdef _DEBUG
   printf("iptablesFlushChain()\n");
 #endif
-   while (delEntry(selectedChain,0));
-   return 1;
+   if (nfBuild.chain == NULL) return 0;
+   if (ruleCount(nfBuild.chain) == 0) return 1;
+   return delEntry(nfBuild.chain,0,ruleCount(nfBuild.chain));
 }
 	
 int iptablesZeroCounters( void )
 {
-   int i;
 #ifdef _DEBUG
   printf("iptablesZeroCounters()\n");
 #endif
-   for (i=0; (i<MAX_ENTRIES_PER_CHAIN) && (selectedChain->entry[i]!=NULL); i++)
-   {
-     selectedChain->entry[i]->counters.pcnt=0;
-     selectedChain->entry[i]->counters.bcnt=0;
-   }
+   if (nfBuild.chain == NULL) return 0;
+   if (nfBuild.chain->rules != NULL)
+     memset(nfBuild.chain->rules->counters,0,
+            nfBuild.chain->rules->count*sizeof(struct ipt_counters));
    return 1;
 }
+
+/*******************************************************************
+ * iptablesGetCounters                                             *
+ *                                                                 *
+ * Copies the counters of every rule of the selected table to buf, *
+ * see struct ipt_counters_chain, and zeroes them if zero is set.  *
+ * Nothing is copied if size is too small.                         *
+ *                                                                 *
+ * Parameters:  void *buf                    destination or NULL   *
+ *              size_t size                  bytes at buf          *
+ *              int zero                     reset them            *
+ *                                                                 *
+ * Returns:     size_t                       bytes needed          *
+ *                                                                 *
+ *******************************************************************/
+size_t iptablesGetCounters(void *buf, size_t size, int zero)
+{
+  struct ipt_counters_chain hdr;
+  struct ipt_chain *chain;
+  struct list_head *pos;
+  unsigned char *p=buf;
+  size_t need, n;
+
+  if (nfBuild.table == NULL) return 0;
+  need=0;
+  list_for_each(pos,&nfBuild.table->list)
+  {
+    chain=(struct ipt_chain*)pos;
+    need+=sizeof(hdr)+ruleCount(chain)*sizeof(struct ipt_counters);
+  }
+  if ((buf == NULL) || (size < need)) return need;
+
+  list_for_each(pos,&nfBuild.table->list)
+  {
+    chain=(struct ipt_chain*)pos;
+    memset(&hdr,0,sizeof(hdr));
+    n=strlen(chain->name);
+    if (n > sizeof(hdr.name)-1) n=sizeof(hdr.name)-1;
+    memcpy(hdr.name,chain->name,n);
+    hdr.count=ruleCount(chain);
+    memcpy(p,&hdr,sizeof(hdr));
+    p+=sizeof(hdr);
+    if (hdr.count == 0) continue;
+    n=hdr.count*sizeof(struct ipt_counters);
+    memcpy(p,chain->rules->counters,n);
+    if (zero) memset(chain->rules->counters,0,n);
+    p+=n;
+  }
+  return need;
+}
 	
 int iptablesSetPolicy( policy )
 int policy;
 {
+  int old;
 #ifdef _DEBUG
   printf("iptablesSetPolicy()\n");
 #endif
-  selectedChain->defaultverdict=policy;
+  /* user chains always return to their caller */
+  if ((nfBuild.chain == NULL) || !nfBuild.chain->builtin) return 0;
+  old=nfBuild.chain->defaultverdict;
+  nfBuild.chain->defaultverdict=policy;
+  if (nfCommit() != 0)
+  {
+    nfBuild.chain->defaultverdict=old;
+    return 0;
+  }
   return 1;
 }
 
+/* rules of a table about to be restored, for nfCheckJumps */
+struct nf_restorerules {
+  int nchains;
+  struct ipt_chain **chains;     /* chains in the blob               */
+  struct ipt_rules **rules;      /* their new rules, NULL if none    */
+};
+
+static const struct ipt_rules *nfRestoreRules(struct ipt_chain *chain,
+                                              void *arg)
+{
+  struct nf_restorerules *rr=(struct nf_restorerules*)arg;
+  int c;
+
+  for (c=0; c<rr->nchains; c++)
+  {
+    if (rr->chains[c] == chain) return rr->rules[c];
+  }
+  return NULL;                   /* chains not in the blob are emptied */
+}
+
+/*******************************************************************
+ * nfRestoreTable                                                  *
+ *                                                                 *
+ * Checks a complete blob and replaces the rules of its table.     *
+ * All rules and the new snapshot are built before anything is     *
+ * changed, so the table is left alone if the blob is broken or    *
+ * memory runs out. Chains of the blob without a policy that the   *
+ * table lacks are created as user chains.                         *
+ *                                                                 *
+ * Returns:     int error code               0:OK                  *
+ *                                           1:invalid blob        *
+ *                                           2:out of memory       *
+ *                                                                 *
+ *******************************************************************/
+static int nfRestoreTable(const unsigned char *blob, size_t size)
+{
+  const struct nf_blob_hdr *hdr=(const struct nf_blob_hdr*)blob;
+  const struct nf_blob_chain *bc;
+  const struct nf_blob_rule *br;
+  struct ipt_table *table;
+  struct ipt_chain **chains=NULL;
+  struct ipt_rules **rules=NULL, **old;
+  int *policy=NULL, *oldpolicy;
+  char *fresh=NULL;
+  struct nf_restorerules rr;
+  struct nf_ruleset *rs;
+  struct ipt_chain *chain;
+  struct ipt_match *match;
+  struct ipt_target *target;
+  struct ipt_chain *jumpchain;
+  struct list_head *pos;
+  size_t off;
+  int c, r, k, n, nrules, nfresh, ret;
+#ifdef _DEBUG
+  printf("nfRestoreTable()\n");
+#endif
+  ret=1;
+  nfresh=0;
+  switch (hdr->table)
+  {
+    case NF_TABLE_FILTER: table=&tab_filter; break;
+    case NF_TABLE_NAT:    table=&tab_nat;    break;
+    case NF_TABLE_MANGLE: table=&tab_mangle; break;
+    default:
+      printf("nfcore.c: nfRestoreTable(): invalid table: %d\n",hdr->table);
+      return 1;
+  }
+  if ((hdr->nchains < 0) || ((size_t)hdr->nchains >
+      (size-sizeof(struct nf_blob_hdr))/sizeof(struct nf_blob_chain)))
+    goto invalid;
+
+  /* first pass: check the layout and find the chains */
+  chains=(struct ipt_chain**)malloc((hdr->nchains+1)*sizeof(struct ipt_chain*));
+  rules=(struct ipt_rules**)calloc(hdr->nchains+1,sizeof(struct ipt_rules*));
+  policy=(int*)malloc((hdr->nchains+1)*sizeof(int));
+  fresh=(char*)malloc(hdr->nchains+1);
+  if ((chains == NULL) || (rules == NULL) || (policy == NULL) ||
+      (fresh == NULL))
+    goto nomem;
+  nrules=0;
+  off=sizeof(struct nf_blob_hdr);
+  for (c=0; c<hdr->nchains; c++)
+  {
+    if (size-off < sizeof(struct nf_blob_chain)) goto invalid;
+    bc=(const struct nf_blob_chain*)(blob+off);
+    off+=sizeof(struct nf_blob_chain);
+    if (memchr(bc->name,0,IPT_CHAIN_MAXNAMELEN) == NULL) goto invalid;
+    fresh[c]=0;
+    policy[c]=bc->policy;
+    chains[c]=getChain(table,bc->name);
+    for (k=0; k<c; k++)
+    {
+      if ((chains[c] == NULL) ? (strcmp(chains[k]->name,bc->name) == 0)
+                              : (chains[k] == chains[c]))
+        goto invalid;
+    }
+    if ((chains[c] == NULL) && (bc->policy == -1) && (bc->name[0] != '\0') &&
+        (findTarget(bc->name) == NULL))
+    {
+      /* a new user chain, it joins the table when the blob is loaded */
+      chains[c]=nfAllocChain(bc->name,IPT_RETURN,0);
+      if (chains[c] == NULL) goto nomem;
+      fresh[c]=1;
+      nfresh++;
+    }
+    if (chains[c] == NULL)
+    {
+      printf("nfcore.c: nfRestoreTable(): no such chain: %s:%s\n",
+             table->name,bc->name);
+      goto invalid;
+    }
+    if (bc->nrules < 0) goto invalid;
+    if ((bc->policy != -1) &&
+        (!chains[c]->builtin ||
+         ((bc->policy != NF_ACCEPT) && (bc->policy != NF_DROP))))
+      goto invalid;
+    if ((size-off)/sizeof(struct nf_blob_rule) < (size_t)bc->nrules)
+      goto invalid;
+    off+=bc->nrules*sizeof(struct nf_blob_rule);
+    nrules+=bc->nrules;
+  }
+  if (off != size) goto invalid;
+
+  /* second pass: build the rules, a block per chain */
+  off=sizeof(struct nf_blob_hdr);
+  for (c=0; c<hdr->nchains; c++)
+  {
+    bc=(const struct nf_blob_chain*)(blob+off);
+    off+=sizeof(struct nf_blob_chain);
+    if (bc->nrules > 0)
+    {
+      if ((rules[c]=nfAllocRules(bc->nrules)) == NULL) goto nomem;
+      rules[c]->count=0;         /* counts the rules built so far */
+    }
+    for (r=0; r<bc->nrules; r++)
+    {
+      br=(const struct nf_blob_rule*)(blob+off);
+      off+=sizeof(struct nf_blob_rule);
+      if ((memchr(br->match,0,IPT_FUNCTION_MAXNAMELEN) == NULL) ||
+          (memchr(br->target,0,IPT_FUNCTION_MAXNAMELEN) == NULL))
+        goto invalid;
+      match=findMatch(br->match);
+      if (match == NULL)
+      {
+        printf("Match %s not found.\n",br->match);
+        goto invalid;
+      }
+      jumpchain=NULL;
+      target=findTarget(br->target);
+      for (k=0; (target == NULL) && (k<hdr->nchains); k++)
+      {
+        if (strcmp(chains[k]->name,br->target) == 0) jumpchain=chains[k];
+      }
+      if ((target == NULL) && (jumpchain == NULL))
+        jumpchain=getChain(table,br->target);
+      if ((target == NULL) && ((jumpchain == NULL) || jumpchain->builtin))
+      {
+        printf("Target %s not found.\n",br->target);
+        goto invalid;
+      }
+      if (nfNewEntry(&rules[c]->entry[r],table,&br->ip,match,br->matchinfo,
+                     target,br->targinfo,jumpchain) != 0)
+        goto invalid;
+      rules[c]->count++;
+    }
+  }
+
+  /* the jumps of the new rules, new chains have to be in the table */
+  for (c=0; c<hdr->nchains; c++)
+  {
+    if (fresh[c])
+      list_add((struct list_head*)chains[c],(struct list_head*)&table->list);
+  }
+  rr.nchains=hdr->nchains;
+  rr.chains=chains;
+  rr.rules=rules;
+  if (!nfCheckJumps(table,nfRestoreRules,&rr))
+  {
+    for (c=0; c<hdr->nchains; c++)
+    {
+      if (fresh[c]) list_del(&chains[c]->list);
+    }
+    goto invalid;
+  }
+
+  /* the snapshot is built with the new rules put in for a moment,
+   * the table keeps its old ones if that runs out of memory
+   */
+  n=0;
+  list_for_each(pos,&table->list) n++;
+  old=(struct ipt_rules**)malloc(n*sizeof(struct ipt_rules*));
+  oldpolicy=(int*)malloc(n*sizeof(int));
+  rs=NULL;
+  if ((old != NULL) && (oldpolicy != NULL))
+  {
+    k=0;
+    list_for_each(pos,&table->list)
+    {
+      chain=(struct ipt_chain*)pos;
+      old[k]=chain->rules;
+      oldpolicy[k++]=chain->defaultverdict;
+      chain->rules=(struct ipt_rules*)nfRestoreRules(chain,&rr);
+    }
+    for (c=0; c<hdr->nchains; c++)
+    {
+      if (policy[c] != -1) chains[c]->defaultverdict=policy[c];
+    }
+    rs=nfBuildRuleset();
+    k=0;
+    list_for_each(pos,&table->list)
+    {
+      chain=(struct ipt_chain*)pos;
+      chain->rules=old[k];
+      chain->defaultverdict=oldpolicy[k++];
+    }
+  }
+  if (old) free(old);
+  if (oldpolicy) free(oldpolicy);
+  if (rs == NULL)
+  {
+    for (c=0; c<hdr->nchains; c++)
+    {
+      if (fresh[c]) list_del(&chains[c]->list);
+    }
+    goto nomem;
+  }
+  nfresh=0;                      /* they stay now */
+
+  /* install, chains not in the blob end up empty */
+  list_for_each(pos,&table->list)
+  {
+    chain=(struct ipt_chain*)pos;
+    nfSetRules(chain,NULL,0,ruleCount(chain));
+  }
+  for (c=0; c<hdr->nchains; c++)
+  {
+    chains[c]->rules=rules[c];
+    if (policy[c] != -1) chains[c]->defaultverdict=policy[c];
+  }
+  nfActivate(rs);
+  free(chains);
+  free(rules);
+  free(policy);
+  free(fresh);
+  printf("MinixWall: Table %s restored: %d chains, %d rules\n",
+         table->name,hdr->nchains,nrules);
+  return 0;
+
+nomem:
+  printf("nfcore.c: nfRestoreTable(): out of memory, table %s not changed\n",
+         table->name);
+  ret=2;
+invalid:
+  if (ret == 1)
+    printf("nfcore.c: nfRestoreTable(): invalid rule set, table %s not \
+changed\n", table->name);
+  if (rules)
+  {
+    for (c=0; c<hdr->nchains; c++)
+    {
+      if (rules[c] == NULL) continue;
+      rules[c]->ndead=rules[c]->count;
+      nfFreeRules(rules[c]);
+    }
+    free(rules);
+  }
+  if (chains)
+  {
+    for (c=0; nfresh>0; c++)
+    {
+      if (!fresh[c]) continue;
+      nfFreeChain(chains[c]);
+      nfresh--;
+    }
+    free(chains);
+  }
+  if (policy) free(policy);
+  if (fresh) free(fresh);
+  return ret;
+}
+
+/*******************************************************************
+ * iptablesRestore                                                 *
+ *                                                                 *
+ * Collects a blob (see nfblob.h) written in pieces and restores   *
+ * its table once it is complete. Called with NULL, a partly       *
+ * received blob is thrown away.                                   *
+ *                                                                 *
+ * Parameters:  void *data                   next part of the blob *
+ *              size_t len                   its length            *
+ *                                                                 *
+ * Returns:     int                          1:more data expected  *
+ *                                           0:table restored      *
+ *                                          -1:error, the blob is  *
+ *                                             thrown away         *
+ *                                                                 *
+ *******************************************************************/
+int iptablesRestore(const void *data, size_t len)
+{
+  const unsigned char *p=(const unsigned char*)data;
+  size_t n;
+  int ret;
+#ifdef _DEBUG
+  printf("iptablesRestore()\n");
+#endif
+  if (data == NULL)
+  {
+    if (nfRestore.blob) free(nfRestore.blob);
+    nfRestore.blob=NULL;
+    nfRestore.got=0;
+    return 0;
+  }
+  while (len > 0)
+  {
+    if (nfRestore.got < sizeof(struct nf_blob_hdr))
+    {
+      /* the header tells how much to allocate */
+      n=min(len,sizeof(struct nf_blob_hdr)-nfRestore.got);
+      memcpy((unsigned char*)&nfRestore.hdr+nfRestore.got,p,n);
+    }
+    else
+    {
+      n=min(len,nfRestore.hdr.size-nfRestore.got);
+      if (n == 0)
+      {
+        printf("nfcore.c: iptablesRestore(): data beyond end of rule set\n");
+        iptablesRestore(NULL,0);
+        return -1;
+      }
+      memcpy(nfRestore.blob+nfRestore.got,p,n);
+    }
+    nfRestore.got+=n;
+    p+=n;
+    len-=n;
+
+    if ((nfRestore.blob == NULL) &&
+        (nfRestore.got == sizeof(struct nf_blob_hdr)))
+    {
+      if ((nfRestore.hdr.magic != NF_BLOB_MAGIC) ||
+          (nfRestore.hdr.version != NF_BLOB_VERSION) ||
+          (nfRestore.hdr.size < sizeof(struct nf_blob_hdr)) ||
+          (nfRestore.hdr.size > NF_BLOB_MAXSIZE))
+      {
+        printf("nfcore.c: iptablesRestore(): bad rule set header\n");
+        iptablesRestore(NULL,0);
+        return -1;
+      }
+      nfRestore.blob=(unsigned char*)malloc(nfRestore.hdr.size);
+      if (nfRestore.blob == NULL)
+      {
+        printf("nfcore.c: iptablesRestore(): out of memory while \
+allocating %u bytes\n", nfRestore.hdr.size);
+        iptablesRestore(NULL,0);
+        return -1;
+      }
+      memcpy(nfRestore.blob,&nfRestore.hdr,sizeof(struct nf_blob_hdr));
+    }
+  }
+  if ((nfRestore.blob == NULL) || (nfRestore.got < nfRestore.hdr.size))
+    return 1;
+
+  ret=nfRestoreTable(nfRestore.blob,nfRestore.got);
+  iptablesRestore(NULL,0);
+  return (ret == 0) ? 0 : -1;
+}
+
 /* Register Target */
 int
 ipt_register_target(struct ipt_target *target)
@@ -0,0 +1,184 @@
+/*
+ *  MINIX-3 network filter - packet log ring
+ *
+ *  The ULOG target appends compact binary records to a fixed ring
+ *  instead of formatting text on the forwarding path. A reader
+ *  drains the ring in large batches through /dev/nflog (see nf.c).
+ *  Records never wrap around the end of the ring; the space left
+ *  there is filled with a pad record that is never read. If the
+ *  reader falls behind, new records are dropped and counted, the
+ *  next record stored tells how many were lost.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <nflog.h>
+
+#define NF_LOG_PAD 0             /* hook of a pad record, hooks start at 1 */
+#define NF_LOG_ALIGN(n) (((n)+3) & ~3)
+
+static unsigned char nfLogRing[NF_LOG_RINGSIZE];
+static size_t nfLogHead;         /* where the next record goes        */
+static size_t nfLogTail;         /* first record not read yet         */
+static size_t nfLogFill;         /* bytes in use, pads included       */
+static u32_t nfLogLost;
+static u32_t nfLogSec, nfLogUsec;
+static void (*nfLogNotify)(void);
+
+/*******************************************************************
+ * nfLogInit                                                       *
+ *                                                                 *
+ * Empties the ring.                                               *
+ *                                                                 *
+ * Parameters:  notify()                     called when the ring  *
+ *                                           gets its first record *
+ *                                           or fills up to        *
+ *                                           NF_LOG_THRESHOLD      *
+ *                                                                 *
+ *******************************************************************/
+void nfLogInit(void (*notify)(void))
+{
+  nfLogHead=nfLogTail=nfLogFill=0;
+  nfLogLost=0;
+  nfLogSec=nfLogUsec=0;
+  nfLogNotify=notify;
+}
+
+void nfLogSetTime(u32_t sec, u32_t usec)
+{
+  nfLogSec=sec;
+  nfLogUsec=usec;
+}
+
+/*******************************************************************
+ * nfLogPut                                                        *
+ *                                                                 *
+ * Appends a record for a packet.                                  *
+ *                                                                 *
+ * Parameters:  unsigned int hook            hook number           *
+ *              char *indev, *outdev         interfaces            *
+ *              char *prefix                 rule's log prefix     *
+ *              void *pkt                    start of IP header    *
+ *              size_t caplen                bytes to keep of it,  *
+ *                                           cut to NF_LOG_CAPMAX  *
+ *              size_t pktlen                IP packet length      *
+ *                                                                 *
+ * Returns:     int                          1:logged              *
+ *                                           0:ring full, lost     *
+ *                                                                 *
+ *******************************************************************/
+int nfLogPut(unsigned int hook, const char *indev, const char *outdev,
+             const char *prefix, const void *pkt, size_t caplen,
+             size_t pktlen)
+{
+  struct nf_log_rec *rec;
+  size_t len, room, fill;
+
+  if (caplen > NF_LOG_CAPMAX) caplen=NF_LOG_CAPMAX;
+  len=NF_LOG_ALIGN(sizeof(struct nf_log_rec)+caplen);
+
+  /* a record that does not fit before the end starts over at 0 */
+  room=NF_LOG_RINGSIZE-nfLogHead;
+  if (NF_LOG_RINGSIZE-nfLogFill < ((room < len) ? room+len : len))
+  {
+    nfLogLost++;
+    return 0;
+  }
+  fill=nfLogFill;
+  if (room < len)
+  {
+    rec=(struct nf_log_rec*)(nfLogRing+nfLogHead);
+    rec->len=room;
+    rec->hook=NF_LOG_PAD;
+    nfLogFill+=room;
+    nfLogHead=0;
+  }
+
+  rec=(struct nf_log_rec*)(nfLogRing+nfLogHead);
+  memset(rec,0,sizeof(struct nf_log_rec));
+  rec->len=len;
+  rec->hook=hook;
+  rec->lost=nfLogLost;
+  rec->sec=nfLogSec;
+  rec->usec=nfLogUsec;
+  rec->pktlen=pktlen;
+  rec->caplen=caplen;
+  if (indev) strncpy(rec->indev,indev,NF_LOG_IFNAMELEN-1);
+  if (outdev) strncpy(rec->outdev,outdev,NF_LOG_IFNAMELEN-1);
+  if (prefix) strncpy(rec->prefix,prefix,NF_LOG_PREFIXLEN-1);
+  memcpy(rec+1,pkt,caplen);
+  nfLogLost=0;
+  nfLogHead=(nfLogHead+len) % NF_LOG_RINGSIZE;
+  nfLogFill+=len;
+
+  if ((nfLogNotify != NULL) &&
+      ((fill == 0) ||
+       ((fill < NF_LOG_THRESHOLD) && (nfLogFill >= NF_LOG_THRESHOLD))))
+    nfLogNotify();
+  return 1;
+}
+
+/* bytes waiting to be read */
+size_t nfLogUsed(void)
+{
+  return nfLogFill;
+}
+
+/*******************************************************************
+ * nfLogPeek                                                       *
+ *                                                                 *
+ * Finds the next run of whole records that are contiguous in the  *
+ * ring. They stay in the ring until nfLogConsume.                 *
+ *                                                                 *
+ * Parameters:  unsigned char **data         returned start        *
+ *              size_t max                   most bytes wanted     *
+ *                                                                 *
+ * Returns:     size_t                       bytes of the run, 0   *
+ *                                           if the ring is empty  *
+ *                                           or the next record is *
+ *                                           bigger than max       *
+ *                                                                 *
+ *******************************************************************/
+size_t nfLogPeek(const unsigned char **data, size_t max)
+{
+  const struct nf_log_rec *rec;
+  size_t n;
+
+  /* skip the pad at the end */
+  if (nfLogFill > 0)
+  {
+    rec=(const struct nf_log_rec*)(nfLogRing+nfLogTail);
+    if (rec->hook == NF_LOG_PAD) nfLogConsume(rec->len);
+  }
+
+  *data=nfLogRing+nfLogTail;
+  for (n=0; (n < nfLogFill) && (nfLogTail+n < NF_LOG_RINGSIZE); n+=rec->len)
+  {
+    rec=(const struct nf_log_rec*)(nfLogRing+nfLogTail+n);
+    if ((rec->hook == NF_LOG_PAD) || (n+rec->len > max)) break;
+  }
+  return n;
+}
+
+void nfLogConsume(size_t len)
+{
+  nfLogTail=(nfLogTail+len) % NF_LOG_RINGSIZE;
+  nfLogFill-=len;
+  if (nfLogFill == 0) nfLogHead=nfLogTail=0;
+}
@@ -0,0 +1,597 @@
+/*
+ *  MINIX-3 network filter - address translation
+ *
+ *  The SNAT, DNAT, MASQUERADE and REDIRECT targets bind the first packet
+ *  of a flow to a translation. Bindings live in a fixed pool and are
+ *  hashed by the tuple of each direction, so every later packet finds
+ *  its binding with one lookup and is rewritten in place, without going
+ *  through the nat table again. Checksums are updated incrementally
+ *  (RFC 1624). A binding expires together with its conntrack flow.
+ *
+ *  Destinations are rewritten in PREROUTING and OUTPUT before
+ *  connection tracking looks at the packet, sources in POSTROUTING
+ *  after the packet has been accepted. Connection tracking and the
+ *  filter rules therefore always see the addresses of the inner side.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <nfdefs.h>
+#include <sk_buff.h>
+#include <nfconntrack.h>
+#include <nfnat.h>
+
+static struct nf_nat nf_nat_table[NF_NAT_NR];
+static struct nf_nat *nf_nat_hash[IP_CT_DIR_MAX][NF_NAT_HASH];
+static struct nf_nat *nf_nat_free;
+static int nf_nat_used;          /* bindings not on the free list     */
+static unsigned long nf_nat_now;
+
+/* interface addresses for MASQUERADE and REDIRECT */
+static struct nf_nat_if {
+  char name[IF_NAMESIZE];
+  ipaddr_t addr;
+} nf_nat_if[NF_NAT_MAXIFS];
+
+static int natHash(const struct ip_conntrack_tuple *t)
+{
+  u32_t h;
+
+  h=t->src ^ (t->dst * 31);
+  h^=((u32_t)t->sport << 16) ^ t->dport ^ t->proto;
+  h^=h >> 16;
+  h^=h >> 8;
+  return h & (NF_NAT_HASH-1);
+}
+
+static int natSame(const struct ip_conntrack_tuple *a,
+                   const struct ip_conntrack_tuple *b)
+{
+  return (a->src == b->src) && (a->dst == b->dst) &&
+         (a->sport == b->sport) && (a->dport == b->dport) &&
+         (a->proto == b->proto);
+}
+
+static void natInvert(const struct ip_conntrack_tuple *t,
+                      struct ip_conntrack_tuple *inv)
+{
+  inv->src=t->dst;
+  inv->dst=t->src;
+  inv->sport=t->dport;
+  inv->dport=t->sport;
+  inv->proto=t->proto;
+}
+
+static struct nf_nat *natFind(const struct ip_conntrack_tuple *t, int dir)
+{
+  struct nf_nat *nat;
+
+  for (nat=nf_nat_hash[dir][natHash(t)]; nat!=NULL; nat=nat->next[dir])
+  {
+    if ((nat->expires > nf_nat_now) && natSame(&nat->key[dir],t))
+      return nat;
+  }
+  return NULL;
+}
+
+static void natUnlink(struct nf_nat *nat, int dir)
+{
+  struct nf_nat **pp;
+
+  for (pp=&nf_nat_hash[dir][natHash(&nat->key[dir])]; *pp!=NULL;
+       pp=&(*pp)->next[dir])
+  {
+    if (*pp == nat)
+    {
+      *pp=nat->next[dir];
+      return;
+    }
+  }
+}
+
+static void natRelease(struct nf_nat *nat)
+{
+  natUnlink(nat,IP_CT_DIR_ORIGINAL);
+  natUnlink(nat,IP_CT_DIR_REPLY);
+  nat->next[IP_CT_DIR_ORIGINAL]=nf_nat_free;
+  nf_nat_free=nat;
+  nf_nat_used--;
+}
+
+/* Can a packet of flow t be rewritten to nt? Nothing else may arrive
+ * with the tuple its replies will have.
+ */
+static int natUnique(const struct ip_conntrack_tuple *t,
+                     const struct ip_conntrack_tuple *nt)
+{
+  struct ip_conntrack_tuple r;
+
+  natInvert(nt,&r);
+  if (natFind(&r,IP_CT_DIR_REPLY) != NULL) return 0;
+  if (natSame(t,nt)) return 1;
+  return (natFind(&r,IP_CT_DIR_ORIGINAL) == NULL) && !nfConntrackInUse(&r);
+}
+
+static void natSetPort(struct ip_conntrack_tuple *nt, int manip, u16_t port)
+{
+  /* ICMP queries keep their identifier in both */
+  if ((manip == NF_NAT_SRC) || (nt->proto == IPPROTO_ICMP))
+    nt->sport=htons(port);
+  if ((manip == NF_NAT_DST) || (nt->proto == IPPROTO_ICMP))
+    nt->dport=htons(port);
+}
+
+/* Picks the translated tuple of a new flow: the address by a hash of
+ * the client, so a client keeps its address, the port by searching
+ * the range from a hashed start for one that gives a unique tuple.
+ */
+static int natChoose(const struct ip_conntrack_tuple *t, int manip,
+                     const struct nf_nat_range *range,
+                     struct ip_conntrack_tuple *nt)
+{
+  u32_t lo, hi, n, start, port, tries, i;
+  ipaddr_t *addr;
+
+  *nt=*t;
+  addr=(manip == NF_NAT_SRC) ? &nt->src : &nt->dst;
+  if (range->minip != 0)
+  {
+    lo=ntohl(range->minip);
+    hi=ntohl(range->maxip);
+    *addr=(hi > lo) ? htonl(lo + natHash(t) % (hi - lo + 1)) : range->minip;
+  }
+
+  if ((t->proto != IPPROTO_TCP) && (t->proto != IPPROTO_UDP) &&
+      (t->proto != IPPROTO_ICMP))
+    return natUnique(t,nt);
+
+  port=ntohs((manip == NF_NAT_SRC) ? nt->sport : nt->dport);
+  if (range->minport != 0)
+  {
+    lo=range->minport;
+    hi=range->maxport;
+  }
+  else
+  {
+    lo=hi=port;
+  }
+  if ((port >= lo) && (port <= hi) && natUnique(t,nt)) return 1;
+
+  /* a new destination without port range is taken as it is */
+  if ((range->minport == 0) && (manip == NF_NAT_DST)) return 1;
+  if (range->minport == 0)
+  {
+    lo=NF_NAT_PORTMIN;
+    hi=NF_NAT_PORTMAX;
+  }
+
+  /* at most one tuple per binding and flow can be taken */
+  n=hi - lo + 1;
+  tries=(n < NF_NAT_NR+NF_CT_NR+1) ? n : NF_NAT_NR+NF_CT_NR+1;
+  start=(natHash(t) * 2654435761UL) % n;
+  for (i=0; i<tries; i++)
+  {
+    natSetPort(nt,manip,lo + (start + i) % n);
+    if (natUnique(t,nt)) return 1;
+  }
+  return 0;
+}
+
+/* one's complement checksum update for a changed 16 bit word */
+static void csumAdjust(u16_t *sum, u16_t from, u16_t to)
+{
+  u32_t s;
+
+  s=(u16_t)~*sum + (u32_t)(u16_t)~from + to;
+  s=(s & 0xffff) + (s >> 16);
+  s=(s & 0xffff) + (s >> 16);
+  *sum=~s;
+}
+
+/* replaces a 16 bit word and fixes the checksums covering it */
+static void natWord(u16_t *p, u16_t v, u16_t *sum, u16_t *sum2)
+{
+  if (*p == v) return;
+  if (sum != NULL) csumAdjust(sum,*p,v);
+  if (sum2 != NULL) csumAdjust(sum2,*p,v);
+  *p=v;
+}
+
+static void natAddr(ipaddr_t *a, ipaddr_t v, u16_t *sum, u16_t *sum2)
+{
+  u16_t w[2];
+
+  memcpy(w,&v,sizeof(w));
+  natWord((u16_t*)a,w[0],sum,sum2);
+  natWord((u16_t*)a + 1,w[1],sum,sum2);
+}
+
+/* Rewrites an ICMP error quoting a translated packet: the outer address
+ * and the quoted packet, which travelled the other way. The transport
+ * checksum of the quoted packet is left alone, nobody checks it.
+ */
+static int natRewriteError(ip_hdr_t *ip, unsigned char *l4, int len,
+                           const struct ip_conntrack_tuple *nt, int dst)
+{
+  icmp_hdr_t *icmp=(icmp_hdr_t*)l4;
+  ip_hdr_t *inner=(ip_hdr_t*)(l4 + 8);
+  unsigned char *il4;
+  u16_t chk, *ports;
+  int ihl;
+
+  if (len < 8 + (int)sizeof(ip_hdr_t)) return 0;
+  ihl=(inner->ih_vers_ihl & IH_IHL_MASK) * 4;
+  if (len < 8 + ihl + 8) return 0;
+  il4=l4 + 8 + ihl;
+
+  chk=inner->ih_hdr_chk;
+  if (dst)
+  {
+    natAddr(&ip->ih_dst,nt->dst,&ip->ih_hdr_chk,NULL);
+    natAddr(&inner->ih_src,nt->dst,&inner->ih_hdr_chk,&icmp->ih_chksum);
+  }
+  else
+  {
+    natAddr(&ip->ih_src,nt->src,&ip->ih_hdr_chk,NULL);
+    natAddr(&inner->ih_dst,nt->src,&inner->ih_hdr_chk,&icmp->ih_chksum);
+  }
+  csumAdjust(&icmp->ih_chksum,chk,inner->ih_hdr_chk);
+
+  if (ntohs(inner->ih_flags_fragoff) & IH_FRAGOFF_MASK) return 1;
+  ports=(u16_t*)il4;
+  switch (inner->ih_proto)
+  {
+    case IPPROTO_TCP:
+    case IPPROTO_UDP:
+      if (dst) natWord(&ports[0],nt->dport,&icmp->ih_chksum,NULL);
+      else natWord(&ports[1],nt->sport,&icmp->ih_chksum,NULL);
+      break;
+    case IPPROTO_ICMP:
+      natWord(&((icmp_hdr_t*)il4)->ih_hun.ihh_idseq.iis_id,nt->sport,
+              &icmp->ih_chksum,NULL);
+      break;
+  }
+  return 1;
+}
+
+/* rewrites the source or destination of a packet to that of nt */
+static int natRewrite(struct sk_buff *skb, const struct ip_conntrack_tuple *nt,
+                      int dst, int related)
+{
+  ip_hdr_t *ip=skb->nh.iph;
+  unsigned char *l4;
+  u16_t *sum, *icmpsum, udpsum;
+  int ihl, len, ports;
+
+  ihl=(ip->ih_vers_ihl & IH_IHL_MASK) * 4;
+  l4=skb->nh.raw + ihl;
+  len=(skb->tail - skb->nh.raw) - ihl;
+  if (related) return natRewriteError(ip,l4,len,nt,dst);
+
+  sum=icmpsum=NULL;
+  udpsum=0;
+  ports=0;
+  if (!(ntohs(ip->ih_flags_fragoff) & IH_FRAGOFF_MASK))
+  {
+    switch (ip->ih_proto)
+    {
+      case IPPROTO_TCP:
+        if (len < (int)sizeof(tcp_hdr_t)) return 0;
+        sum=&((tcp_hdr_t*)l4)->th_chksum;
+        ports=1;
+        break;
+      case IPPROTO_UDP:
+        if (len < (int)sizeof(udp_hdr_t)) return 0;
+        udpsum=((udp_hdr_t*)l4)->uh_chksum;
+        if (udpsum != 0) sum=&((udp_hdr_t*)l4)->uh_chksum;
+        ports=1;
+        break;
+      case IPPROTO_ICMP:
+        if (len < 8) return 0;
+        icmpsum=&((icmp_hdr_t*)l4)->ih_chksum;
+        break;
+    }
+  }
+
+  if (dst) natAddr(&ip->ih_dst,nt->dst,&ip->ih_hdr_chk,sum);
+  else natAddr(&ip->ih_src,nt->src,&ip->ih_hdr_chk,sum);
+
+  if (icmpsum != NULL)
+    natWord(&((icmp_hdr_t*)l4)->ih_hun.ihh_idseq.iis_id,nt->sport,icmpsum,
+            NULL);
+  else if (ports)
+  {
+    /* TCP and UDP have the ports at the same place */
+    if (dst) natWord(&((udp_hdr_t*)l4)->uh_dst_port,nt->dport,sum,NULL);
+    else natWord(&((udp_hdr_t*)l4)->uh_src_port,nt->sport,sum,NULL);
+    if ((ip->ih_proto == IPPROTO_UDP) && (udpsum != 0) && (*sum == 0))
+      *sum=0xffff;
+  }
+  return 1;
+}
+
+/*******************************************************************
+ * nfNatInit                                                       *
+ *                                                                 *
+ * Puts all bindings on the free list.                             *
+ *                                                                 *
+ *******************************************************************/
+void nfNatInit(void)
+{
+  int i;
+#ifdef _DEBUG
+  printf("nfNatInit()\n");
+#endif
+  memset(nf_nat_hash,0,sizeof(nf_nat_hash));
+  nf_nat_free=NULL;
+  for (i=NF_NAT_NR-1; i>=0; i--)
+  {
+    nf_nat_table[i].next[IP_CT_DIR_ORIGINAL]=nf_nat_free;
+    nf_nat_free=&nf_nat_table[i];
+  }
+  nf_nat_used=0;
+  nf_nat_now=0;
+  memset(nf_nat_if,0,sizeof(nf_nat_if));
+}
+
+void nfNatSetTime(unsigned long now)
+{
+  nf_nat_now=now;
+}
+
+/*******************************************************************
+ * nfNatSetIfAddr                                                  *
+ *                                                                 *
+ * Tells the address of an interface, for MASQUERADE and REDIRECT. *
+ * Flows masqueraded behind the old address are dropped.           *
+ *                                                                 *
+ * Parameters:  char *ifname                 interface name        *
+ *              ipaddr_t addr                its address, 0 if it  *
+ *                                           has none any more     *
+ *                                                                 *
+ *******************************************************************/
+void nfNatSetIfAddr(const char *ifname, ipaddr_t addr)
+{
+  struct nf_nat_if *nif, *slot;
+  int i;
+
+  slot=NULL;
+  for (nif=nf_nat_if; nif<&nf_nat_if[NF_NAT_MAXIFS]; nif++)
+  {
+    if (strncmp(nif->name,ifname,IF_NAMESIZE) == 0) break;
+    if ((slot == NULL) && (nif->name[0] == '\0')) slot=nif;
+  }
+  if (nif == &nf_nat_if[NF_NAT_MAXIFS])
+  {
+    if (slot == NULL)
+    {
+      printf("nfnat.c: nfNatSetIfAddr(): too many interfaces\n");
+      return;
+    }
+    nif=slot;
+    strncpy(nif->name,ifname,IF_NAMESIZE-1);
+    nif->addr=0;
+  }
+  if ((nif->addr != 0) && (nif->addr != addr))
+  {
+    for (i=0; i<NF_NAT_NR; i++)
+    {
+      if ((nf_nat_table[i].expires > nf_nat_now) &&
+          (nf_nat_table[i].manip == NF_NAT_SRC) &&
+          (nf_nat_table[i].key[IP_CT_DIR_REPLY].dst == nif->addr))
+        nf_nat_table[i].expires=nf_nat_now;
+    }
+  }
+  nif->addr=addr;
+}
+
+/* address of an interface, 0 if unknown */
+ipaddr_t nfNatIfAddr(const char *ifname)
+{
+  int i;
+
+  for (i=0; i<NF_NAT_MAXIFS; i++)
+  {
+    if (strncmp(nf_nat_if[i].name,ifname,IF_NAMESIZE) == 0)
+      return nf_nat_if[i].addr;
+  }
+  return 0;
+}
+
+/*******************************************************************
+ * nfNatLookup                                                     *
+ *                                                                 *
+ * Finds the binding of a packet and sets skb->nat and             *
+ * skb->natinfo. ICMP errors are looked up by the packet they      *
+ * quote.                                                          *
+ *                                                                 *
+ * Parameters:  struct sk_buff *skb       the packet               *
+ *                                                                 *
+ * Returns:     struct nf_nat*            binding or NULL          *
+ *                                                                 *
+ *******************************************************************/
+struct nf_nat *nfNatLookup(struct sk_buff *skb)
+{
+  struct ip_conntrack_tuple t, inv;
+  struct nf_nat *nat;
+  int related, dir;
+
+  skb->nat=NULL;
+  skb->natinfo=0;
+  if (nf_nat_used == 0) return NULL;
+  if (!nfConntrackTuple(skb->nh.iph,skb->tail - skb->nh.raw,&t,&related))
+    return NULL;
+
+  /* an error travels against the packet it quotes */
+  if (related)
+  {
+    natInvert(&t,&inv);
+    t=inv;
+  }
+  for (dir=IP_CT_DIR_ORIGINAL; dir<IP_CT_DIR_MAX; dir++)
+  {
+    if ((nat=natFind(&t,dir)) != NULL)
+    {
+      skb->nat=nat;
+      skb->natinfo=dir | (related ? NF_NAT_RELATED : 0);
+      return nat;
+    }
+  }
+  return NULL;
+}
+
+/*******************************************************************
+ * nfNatBind                                                       *
+ *                                                                 *
+ * Binds the flow of a new packet to a translation, unless it has  *
+ * one already. The packet is not rewritten here, see nfNatApply.  *
+ *                                                                 *
+ * Parameters:  struct sk_buff *skb       the packet               *
+ *              int manip                 NF_NAT_SRC, NF_NAT_DST   *
+ *              struct nf_nat_range *range  where to translate to  *
+ *                                                                 *
+ * Returns:     int                       1:bound                  *
+ *                                        0:no tuple is free, or   *
+ *                                          the packet has no flow *
+ *                                                                 *
+ *******************************************************************/
+int nfNatBind(struct sk_buff *skb, int manip,
+              const struct nf_nat_range *range)
+{
+  struct ip_conntrack_tuple t, nt;
+  struct nf_nat *nat;
+  int related;
+
+  if (skb->nat != NULL) return 1;
+  if (!nfConntrackTuple(skb->nh.iph,skb->tail - skb->nh.raw,&t,&related) ||
+      related)
+    return 0;
+  if ((nat=natFind(&t,IP_CT_DIR_ORIGINAL)) == NULL)
+  {
+    if (!natChoose(&t,manip,range,&nt))
+    {
+#ifdef _DEBUG
+      printf("nfNatBind(): no free tuple\n");
+#endif
+      return 0;
+    }
+    if (nf_nat_free == NULL) nfNatExpire();
+    if (nf_nat_free == NULL)
+    {
+#ifdef _DEBUG
+      printf("nfNatBind(): out of bindings\n");
+#endif
+      return 0;
+    }
+    nat=nf_nat_free;
+    nf_nat_free=nat->next[IP_CT_DIR_ORIGINAL];
+    nf_nat_used++;
+
+    nat->key[IP_CT_DIR_ORIGINAL]=t;
+    natInvert(&nt,&nat->key[IP_CT_DIR_REPLY]);
+    nat->manip=manip;
+    nat->expires=nf_nat_now + NF_NAT_TIMEOUT;
+    nat->next[IP_CT_DIR_ORIGINAL]=nf_nat_hash[IP_CT_DIR_ORIGINAL][natHash(&t)];
+    nf_nat_hash[IP_CT_DIR_ORIGINAL][natHash(&t)]=nat;
+    nat->next[IP_CT_DIR_REPLY]=
+      nf_nat_hash[IP_CT_DIR_REPLY][natHash(&nat->key[IP_CT_DIR_REPLY])];
+    nf_nat_hash[IP_CT_DIR_REPLY][natHash(&nat->key[IP_CT_DIR_REPLY])]=nat;
+  }
+  skb->nat=nat;
+  skb->natinfo=IP_CT_DIR_ORIGINAL;
+  return 1;
+}
+
+/*******************************************************************
+ * nfNatApply                                                      *
+ *                                                                 *
+ * Rewrites a packet with a binding in place, if its binding       *
+ * changes what this hook translates: destinations in PREROUTING   *
+ * and OUTPUT, sources in POSTROUTING.                             *
+ *                                                                 *
+ * Parameters:  struct sk_buff *skb       the packet, skb->nat set *
+ *              unsigned int hook         hook number              *
+ *                                                                 *
+ * Returns:     int                       1:rewritten              *
+ *                                        0:nothing to do here     *
+ *                                       -1:header too short       *
+ *                                                                 *
+ *******************************************************************/
+int nfNatApply(struct sk_buff *skb, unsigned int hook)
+{
+  struct ip_conntrack_tuple nt;
+  struct nf_nat *nat=skb->nat;
+  int dir, dst;
+
+  if (nat == NULL) return 0;
+  dir=skb->natinfo & ~NF_NAT_RELATED;
+  dst=((nat->manip == NF_NAT_DST) == (dir == IP_CT_DIR_ORIGINAL));
+  if (dst ? (hook != NF_IP_PRE_ROUTING) && (hook != NF_IP_LOCAL_OUT)
+          : (hook != NF_IP_POST_ROUTING))
+    return 0;
+
+  natInvert(&nat->key[!dir],&nt);
+  if (!natRewrite(skb,&nt,dst,skb->natinfo & NF_NAT_RELATED))
+  {
+#ifdef _DEBUG
+    printf("nfNatApply(): header too short\n");
+#endif
+    return -1;
+  }
+  return 1;
+}
+
+/*******************************************************************
+ * nfNatTouch                                                      *
+ *                                                                 *
+ * Lets the binding of a packet live as long as its conntrack      *
+ * flow, which knows the state of the connection.                  *
+ *                                                                 *
+ *******************************************************************/
+void nfNatTouch(struct sk_buff *skb)
+{
+  if ((skb->nat != NULL) && (skb->nfct != NULL) &&
+      !(skb->natinfo & NF_NAT_RELATED))
+    skb->nat->expires=skb->nfct->expires;
+}
+
+/*******************************************************************
+ * nfNatExpire                                                     *
+ *                                                                 *
+ * Returns all timed out bindings to the free list, their tuples   *
+ * can be used again.                                              *
+ *                                                                 *
+ * Returns:     int                       active bindings          *
+ *                                                                 *
+ *******************************************************************/
+int nfNatExpire(void)
+{
+  struct nf_nat *nat, *next;
+  int i;
+
+  for (i=0; i<NF_NAT_HASH; i++)
+  {
+    for (nat=nf_nat_hash[IP_CT_DIR_ORIGINAL][i]; nat!=NULL; nat=next)
+    {
+      next=nat->next[IP_CT_DIR_ORIGINAL];
+      if (nat->expires <= nf_nat_now) natRelease(nat);
+    }
+  }
+  return nf_nat_used;
+}
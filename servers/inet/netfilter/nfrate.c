@@ -0,0 +1,242 @@
+/*
+ *  MINIX-3 network filter - rate state of the limit matches
+ *
+ *  The millisecond clock the limit, hashlimit and recent matches
+ *  refill and stamp with, and the address tables of hashlimit and
+ *  recent. A table has a fixed number of nodes allocated with it; once
+ *  all are in use the least recently seen address makes room, so a
+ *  flood of spoofed sources costs no memory and no allocations.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <net/hton.h>
+#include <net/gen/in.h>
+#include <nfrate.h>
+
+static unsigned long nfRateMs;
+static struct nf_rate_table *nfRateNamed;
+
+void nfRateSetTime(unsigned long ms)
+{
+  nfRateMs=ms;
+}
+
+unsigned long nfRateNow(void)
+{
+  return nfRateMs;
+}
+
+/*******************************************************************
+ * nfRateRefill                                                    *
+ *                                                                 *
+ * Adds the credit of elapsed milliseconds to a token bucket.      *
+ *                                                                 *
+ * Returns:     u32_t                        new credit, at most   *
+ *                                           cap                   *
+ *                                                                 *
+ *******************************************************************/
+u32_t nfRateRefill(u32_t credit, u32_t cap, unsigned long elapsed)
+{
+  if (credit >= cap) return cap;
+  if (elapsed >= (cap-credit)/NF_RATE_PERMS+1) return cap;
+  return credit+elapsed*NF_RATE_PERMS;
+}
+
+static unsigned int rateHash(const struct nf_rate_table *table,
+                             ipaddr_t addr)
+{
+  u32_t h;
+
+  h=addr*0x9e3779b1UL;
+  return (h ^ (h >> 16)) & (table->hashsize-1);
+}
+
+static void rateUnlink(struct nf_rate_table *table, struct nf_rate_node *node)
+{
+  if (node->newer) node->newer->older=node->older;
+  else table->newest=node->older;
+  if (node->older) node->older->newer=node->newer;
+  else table->oldest=node->newer;
+}
+
+static void rateFront(struct nf_rate_table *table, struct nf_rate_node *node)
+{
+  node->newer=NULL;
+  node->older=table->newest;
+  if (table->newest) table->newest->newer=node;
+  else table->oldest=node;
+  table->newest=node;
+}
+
+/*******************************************************************
+ * nfRateCreate                                                    *
+ *                                                                 *
+ * Gets a table of size addresses. A named table is shared, the    *
+ * first user decides its size.                                    *
+ *                                                                 *
+ * Parameters:  char *name                   name or NULL for a    *
+ *                                           table of its own      *
+ *              int size                     nodes                 *
+ *                                                                 *
+ * Returns:     struct nf_rate_table*        table or NULL if out  *
+ *                                           of memory             *
+ *                                                                 *
+ *******************************************************************/
+struct nf_rate_table *nfRateCreate(const char *name, int size)
+{
+  struct nf_rate_table *table;
+  int i;
+
+  if ((name != NULL) && (name[0] != '\0'))
+  {
+    for (table=nfRateNamed; table; table=table->next)
+    {
+      if (strncmp(table->name,name,NF_RATE_NAMELEN) == 0)
+      {
+        table->refcnt++;
+        return table;
+      }
+    }
+  }
+  if ((size <= 0) || (size > NF_RATE_MAXSIZE)) return NULL;
+
+  table=(struct nf_rate_table*)malloc(sizeof(struct nf_rate_table));
+  if (table == NULL) return NULL;
+  for (table->hashsize=1; table->hashsize<(unsigned int)size;
+       table->hashsize<<=1);
+  table->hash=(struct nf_rate_node**)calloc(table->hashsize,
+                                            sizeof(struct nf_rate_node*));
+  table->pool=(struct nf_rate_node*)malloc(size*sizeof(struct nf_rate_node));
+  if ((table->hash == NULL) || (table->pool == NULL))
+  {
+    if (table->hash) free(table->hash);
+    if (table->pool) free(table->pool);
+    free(table);
+    printf("nfrate.c: nfRateCreate(): out of memory\n");
+    return NULL;
+  }
+  table->free=NULL;
+  for (i=size-1; i>=0; i--)
+  {
+    table->pool[i].next=table->free;
+    table->free=&table->pool[i];
+  }
+  table->newest=table->oldest=NULL;
+  table->size=size;
+  table->refcnt=1;
+  table->name[0]='\0';
+  table->next=NULL;
+  if ((name != NULL) && (name[0] != '\0'))
+  {
+    strncpy(table->name,name,NF_RATE_NAMELEN-1);
+    table->name[NF_RATE_NAMELEN-1]='\0';
+    table->next=nfRateNamed;
+    nfRateNamed=table;
+  }
+  return table;
+}
+
+/* drops a user of a table, the last one frees it */
+void nfRateRelease(struct nf_rate_table *table)
+{
+  struct nf_rate_table **pp;
+
+  if ((table == NULL) || (--table->refcnt > 0)) return;
+  for (pp=&nfRateNamed; *pp; pp=&(*pp)->next)
+  {
+    if (*pp == table)
+    {
+      *pp=table->next;
+      break;
+    }
+  }
+  free(table->hash);
+  free(table->pool);
+  free(table);
+}
+
+/* the node of an address, NULL if it is not in the table */
+struct nf_rate_node *nfRateFind(struct nf_rate_table *table, ipaddr_t addr)
+{
+  struct nf_rate_node *node;
+
+  for (node=table->hash[rateHash(table,addr)]; node; node=node->next)
+  {
+    if (node->addr == addr) return node;
+  }
+  return NULL;
+}
+
+/*******************************************************************
+ * nfRateAdd                                                       *
+ *                                                                 *
+ * Finds or adds the node of an address and makes it the most      *
+ * recently seen. A new node is cleared, it replaces the least     *
+ * recently seen one if the table is full.                         *
+ *                                                                 *
+ * Returns:     struct nf_rate_node*         the node, *fresh is   *
+ *                                           set if it is new      *
+ *                                                                 *
+ *******************************************************************/
+struct nf_rate_node *nfRateAdd(struct nf_rate_table *table, ipaddr_t addr,
+                               int *fresh)
+{
+  struct nf_rate_node *node;
+  unsigned int h;
+
+  *fresh=0;
+  if ((node=nfRateFind(table,addr)) != NULL)
+  {
+    rateUnlink(table,node);
+    rateFront(table,node);
+    return node;
+  }
+
+  if (table->free == NULL) nfRateRemove(table,table->oldest);
+  node=table->free;
+  table->free=node->next;
+  memset(node,0,sizeof(*node));
+  node->addr=addr;
+  h=rateHash(table,addr);
+  node->next=table->hash[h];
+  table->hash[h]=node;
+  rateFront(table,node);
+  *fresh=1;
+  return node;
+}
+
+/* forgets an address */
+void nfRateRemove(struct nf_rate_table *table, struct nf_rate_node *node)
+{
+  struct nf_rate_node **pp;
+
+  for (pp=&table->hash[rateHash(table,node->addr)]; *pp; pp=&(*pp)->next)
+  {
+    if (*pp == node)
+    {
+      *pp=node->next;
+      break;
+    }
+  }
+  rateUnlink(table,node);
+  node->next=table->free;
+  table->free=node;
+}
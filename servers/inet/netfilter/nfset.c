@@ -0,0 +1,451 @@
+/*
+ *  MINIX-3 network filter - IP sets
+ *
+ *  Named hash sets of addresses, CIDR prefixes or address/port pairs
+ *  that a single rule can match against with the SET match. Prefixes
+ *  are hashed together with their length; a lookup tries each prefix
+ *  length in use once, longest first, so its cost does not depend on
+ *  the number of elements.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <net/hton.h>
+#include <net/gen/in.h>
+#include <nfdefs.h>
+#include <nfset.h>
+
+static struct nf_set nfSets[NF_SET_MAX];
+
+/* state of the IOCTL_IPSET_ADD and IOCTL_IPSET_DEL writes */
+static struct nf_set *nfSetSelected;
+static struct nf_set_elem nfSetPartial;  /* element split between writes */
+static size_t nfSetPartialGot;
+
+static ipaddr_t prefixMask(int plen)
+{
+  return plen ? htonl(0xffffffffUL << (32-plen)) : 0;
+}
+
+static unsigned int setHash(const struct nf_set *set,
+                            const struct nf_set_elem *e)
+{
+  u32_t h;
+
+  h=e->addr ^ ((u32_t)e->port << 16) ^ ((u32_t)e->proto << 8) ^ e->plen;
+  h*=0x9e3779b1UL;
+  return (h ^ (h >> 16)) & (set->hashsize-1);
+}
+
+static struct nf_set_node **setFind(struct nf_set *set,
+                                    const struct nf_set_elem *e)
+{
+  struct nf_set_node **pp;
+
+  for (pp=&set->hash[setHash(set,e)]; *pp; pp=&(*pp)->next)
+  {
+    if (((*pp)->elem.addr == e->addr) && ((*pp)->elem.plen == e->plen) &&
+        ((*pp)->elem.port == e->port) && ((*pp)->elem.proto == e->proto))
+      break;
+  }
+  return pp;
+}
+
+/* rebuilds the list of prefix lengths in use */
+static void setPrefixes(struct nf_set *set)
+{
+  int plen;
+
+  set->nplist=0;
+  for (plen=32; plen>=0; plen--)
+  {
+    if (set->nplen[plen] > 0) set->plist[set->nplist++]=plen;
+  }
+}
+
+/* doubles the number of buckets, nothing happens if memory is short */
+static void setGrow(struct nf_set *set)
+{
+  struct nf_set_node **oldhash, *node;
+  unsigned int oldsize, i;
+
+  oldhash=set->hash;
+  oldsize=set->hashsize;
+  set->hash=(struct nf_set_node**)calloc(2*oldsize,
+                                          sizeof(struct nf_set_node*));
+  if (set->hash == NULL)
+  {
+    set->hash=oldhash;
+    return;
+  }
+  set->hashsize=2*oldsize;
+  for (i=0; i<oldsize; i++)
+  {
+    while ((node=oldhash[i]) != NULL)
+    {
+      unsigned int h=setHash(set,&node->elem);
+
+      oldhash[i]=node->next;
+      node->next=set->hash[h];
+      set->hash[h]=node;
+    }
+  }
+  free(oldhash);
+}
+
+static void setClear(struct nf_set *set)
+{
+  struct nf_set_node *node;
+  unsigned int i;
+
+  for (i=0; i<set->hashsize; i++)
+  {
+    while ((node=set->hash[i]) != NULL)
+    {
+      set->hash[i]=node->next;
+      free(node);
+    }
+  }
+  set->count=0;
+  memset(set->nplen,0,sizeof(set->nplen));
+  set->nplist=0;
+}
+
+/* returns 0 if the element was added or is there already, 1 if it is
+ * not valid for the set, 2 if memory or room in the set ran out
+ */
+static int setAddElem(struct nf_set *set, struct nf_set_elem *e)
+{
+  struct nf_set_node **pp, *node;
+
+  if (set->type == NF_SET_NET)
+  {
+    if ((e->plen > 32) || (e->proto != 0)) return 1;
+    e->addr&=prefixMask(e->plen);
+    e->port=0;
+  }
+  else if ((e->plen != 32) || (e->proto == 0)) return 1;
+
+  pp=setFind(set,e);
+  if (*pp != NULL) return 0;
+  if (set->count >= NF_SET_MAXELEM) return 2;
+  node=(struct nf_set_node*)malloc(sizeof(struct nf_set_node));
+  if (node == NULL) return 2;
+  node->elem=*e;
+  node->next=NULL;
+  *pp=node;
+  set->count++;
+  if (set->type == NF_SET_NET && set->nplen[e->plen]++ == 0)
+    setPrefixes(set);
+  if (set->count > 2*set->hashsize) setGrow(set);
+  return 0;
+}
+
+static int setDelElem(struct nf_set *set, struct nf_set_elem *e)
+{
+  struct nf_set_node **pp, *node;
+
+  if (set->type == NF_SET_NET)
+  {
+    if (e->plen > 32) return 1;
+    e->addr&=prefixMask(e->plen);
+    e->proto=0;
+    e->port=0;
+  }
+  pp=setFind(set,e);
+  if ((node=*pp) == NULL) return 0;
+  *pp=node->next;
+  free(node);
+  set->count--;
+  if (set->type == NF_SET_NET && --set->nplen[e->plen] == 0)
+    setPrefixes(set);
+  return 0;
+}
+
+/*******************************************************************
+ * nfSetInit                                                       *
+ *                                                                 *
+ * Marks all sets as free.                                         *
+ *                                                                 *
+ *******************************************************************/
+void nfSetInit(void)
+{
+  int i;
+
+  for (i=0; i<NF_SET_MAX; i++)
+  {
+    nfSets[i].name[0]='\0';
+    nfSets[i].hash=NULL;
+  }
+  nfSetSelected=NULL;
+  nfSetPartialGot=0;
+}
+
+/*******************************************************************
+ * nfSetFind                                                       *
+ *                                                                 *
+ * Returns:     int                          index of the set with *
+ *                                           that name or -1       *
+ *                                                                 *
+ *******************************************************************/
+int nfSetFind(const char *name)
+{
+  int i;
+
+  if (name[0] == '\0') return -1;
+  for (i=0; i<NF_SET_MAX; i++)
+  {
+    if (strncmp(nfSets[i].name,name,NF_SET_MAXNAMELEN) == 0) return i;
+  }
+  return -1;
+}
+
+struct nf_set *nfSetGet(int index)
+{
+  if ((index < 0) || (index >= NF_SET_MAX) || (nfSets[index].name[0] == 0))
+    return NULL;
+  return &nfSets[index];
+}
+
+/*******************************************************************
+ * nfSetTest                                                       *
+ *                                                                 *
+ * Looks an address up in a set.                                   *
+ *                                                                 *
+ * Parameters:  struct nf_set *set                                 *
+ *              ipaddr_t addr                network byte order    *
+ *              int proto                    IP protocol           *
+ *              int port                     host byte order, -1   *
+ *                                           if not known          *
+ *                                                                 *
+ * Returns:     int                          1 if it is in the set *
+ *                                                                 *
+ *******************************************************************/
+int nfSetTest(const struct nf_set *set, ipaddr_t addr, int proto, int port)
+{
+  struct nf_set_elem e;
+  int i;
+
+  if (set->count == 0) return 0;
+  if (set->type == NF_SET_IPPORT)
+  {
+    if (port < 0) return 0;
+    e.addr=addr;
+    e.plen=32;
+    e.proto=proto;
+    e.port=port;
+    return *setFind((struct nf_set*)set,&e) != NULL;
+  }
+
+  e.proto=0;
+  e.port=0;
+  for (i=0; i<set->nplist; i++)
+  {
+    e.plen=set->plist[i];
+    e.addr=addr & prefixMask(e.plen);
+    if (*setFind((struct nf_set*)set,&e) != NULL) return 1;
+  }
+  return 0;
+}
+
+/*******************************************************************
+ * ipsetCreate                                                     *
+ *                                                                 *
+ * Parameters:  struct nf_set_req *data      name and type         *
+ *                                                                 *
+ * Returns:     int                          1:OK                  *
+ *                                           0:invalid, name in    *
+ *                                             use or no free set  *
+ *                                                                 *
+ *******************************************************************/
+int ipsetCreate(void *data)
+{
+  struct nf_set_req *req=(struct nf_set_req*)data;
+  struct nf_set *set=NULL;
+  int i;
+#ifdef _DEBUG
+  printf("ipsetCreate()\n");
+#endif
+  req->name[NF_SET_MAXNAMELEN-1]='\0';
+  if ((req->name[0] == '\0') ||
+      ((req->type != NF_SET_NET) && (req->type != NF_SET_IPPORT)))
+    return 0;
+  if (nfSetFind(req->name) >= 0)
+  {
+    printf("MinixWall: set %s exists already\n",req->name);
+    return 0;
+  }
+  for (i=0; (i<NF_SET_MAX) && (set == NULL); i++)
+  {
+    if (nfSets[i].name[0] == '\0') set=&nfSets[i];
+  }
+  if (set == NULL)
+  {
+    printf("MinixWall: no room for set %s\n",req->name);
+    return 0;
+  }
+
+  set->hash=(struct nf_set_node**)calloc(NF_SET_MINHASH,
+                                         sizeof(struct nf_set_node*));
+  if (set->hash == NULL)
+  {
+    printf("nfset.c: ipsetCreate(): out of memory\n");
+    return 0;
+  }
+  set->hashsize=NF_SET_MINHASH;
+  set->type=req->type;
+  set->refcnt=0;
+  set->count=0;
+  memset(set->nplen,0,sizeof(set->nplen));
+  set->nplist=0;
+  strcpy(set->name,req->name);
+  printf("MinixWall: Added set %s\n",set->name);
+  return 1;
+}
+
+/*******************************************************************
+ * ipsetDestroy                                                    *
+ *                                                                 *
+ * Removes a set that no rule uses any more.                       *
+ *                                                                 *
+ *******************************************************************/
+int ipsetDestroy(char *name)
+{
+  struct nf_set *set;
+#ifdef _DEBUG
+  printf("ipsetDestroy()\n");
+#endif
+  name[NF_SET_MAXNAMELEN-1]='\0';
+  set=nfSetGet(nfSetFind(name));
+  if (set == NULL) return 0;
+  if (set->refcnt > 0)
+  {
+    printf("MinixWall: set %s is in use\n",name);
+    return 0;
+  }
+  setClear(set);
+  free(set->hash);
+  set->hash=NULL;
+  set->name[0]='\0';
+  if (nfSetSelected == set) nfSetSelected=NULL;
+  printf("MinixWall: Removed set %s\n",name);
+  return 1;
+}
+
+int ipsetFlush(char *name)
+{
+  struct nf_set *set;
+#ifdef _DEBUG
+  printf("ipsetFlush()\n");
+#endif
+  name[NF_SET_MAXNAMELEN-1]='\0';
+  set=nfSetGet(nfSetFind(name));
+  if (set == NULL) return 0;
+  setClear(set);
+  return 1;
+}
+
+/* the set following IOCTL_IPSET_ADD and IOCTL_IPSET_DEL work on */
+int ipsetSelect(char *name)
+{
+#ifdef _DEBUG
+  printf("ipsetSelect()\n");
+#endif
+  name[NF_SET_MAXNAMELEN-1]='\0';
+  nfSetSelected=nfSetGet(nfSetFind(name));
+  return nfSetSelected != NULL;
+}
+
+/* feeds written elements to setAddElem or setDelElem */
+static int setUpdate(int add, const void *data, size_t len)
+{
+  const unsigned char *p=(const unsigned char*)data;
+  struct nf_set_elem e;
+  size_t n;
+  int r;
+
+  if (data == NULL)
+  {
+    nfSetPartialGot=0;
+    return 0;
+  }
+  if (nfSetSelected == NULL) return -1;
+  while (len > 0)
+  {
+    if ((nfSetPartialGot > 0) || (len < sizeof(e)))
+    {
+      n=sizeof(e)-nfSetPartialGot;
+      if (n > len) n=len;
+      memcpy((unsigned char*)&nfSetPartial+nfSetPartialGot,p,n);
+      nfSetPartialGot+=n;
+      p+=n;
+      len-=n;
+      if (nfSetPartialGot < sizeof(e)) break;
+      e=nfSetPartial;
+      nfSetPartialGot=0;
+    }
+    else
+    {
+      memcpy(&e,p,sizeof(e));
+      p+=sizeof(e);
+      len-=sizeof(e);
+    }
+
+    r=add ? setAddElem(nfSetSelected,&e) : setDelElem(nfSetSelected,&e);
+    if (r == 2)
+    {
+      printf("MinixWall: set %s is full, %d elements\n",
+             nfSetSelected->name,nfSetSelected->count);
+      return -1;
+    }
+    if (r != 0)
+    {
+      printf("MinixWall: invalid element for set %s\n",nfSetSelected->name);
+      return -1;
+    }
+  }
+  return 1;
+}
+
+/*******************************************************************
+ * ipsetAdd                                                        *
+ *                                                                 *
+ * Adds the elements written after IOCTL_IPSET_ADD to the selected *
+ * set. An element may be split between two writes. Called with    *
+ * NULL, such a partial element is thrown away.                    *
+ *                                                                 *
+ * Parameters:  void *data                   struct nf_set_elem[]  *
+ *              size_t len                   length in bytes       *
+ *                                                                 *
+ * Returns:     int                          1:more data expected  *
+ *                                          -1:error, the elements *
+ *                                             before it are kept  *
+ *                                                                 *
+ *******************************************************************/
+int ipsetAdd(const void *data, size_t len)
+{
+  return setUpdate(1,data,len);
+}
+
+/* like ipsetAdd, for IOCTL_IPSET_DEL */
+int ipsetDel(const void *data, size_t len)
+{
+  return setUpdate(0,data,len);
+}
@@ -0,0 +1,576 @@
+/*
+ *  MINIX-3 network filter - SYN proxy
+ *
+ *  The SYNPROXY target answers the SYN of a client itself, with a SYN
+ *  cookie as its sequence number, and keeps no state for it. Only when
+ *  the client's ACK returns a valid cookie is the connection opened to
+ *  the server, with the client's sequence number and the MSS the cookie
+ *  encodes; a flood of SYNs from forged addresses never gets to take a
+ *  TCP connection or buffers of the server. The server picks its own
+ *  sequence number, which differs from the cookie by a fixed offset:
+ *  nfSynproxyIn takes it off or adds it on in every packet of the
+ *  connection, before connection tracking looks at the packet.
+ *
+ *  No window scale, SACK or timestamp option is offered to either side,
+ *  so sequence and acknowledgement numbers are all there is to adjust.
+ *  The packets built here are queued, inet sends them after the burst
+ *  without running the hooks (see nf_sp_send in generic/nf.c).
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <nfdefs.h>
+#include <ip_tables.h>
+#include <sk_buff.h>
+#include <nfconntrack.h>
+#include <nfsynproxy.h>
+
+#define SP_FREE         0
+#define SP_SYN_SENT     1        /* cookie was good, SYN sent to server  */
+#define SP_OPEN         2        /* server answered, numbers adjusted    */
+
+/* a proxied connection, tuple is client to server */
+struct sp_conn {
+  struct sp_conn *next;
+  struct ip_conntrack_tuple tuple;
+  int state;
+  int local;                     /* server is inet's own TCP             */
+  u32_t isn;                     /* client's initial sequence number     */
+  u32_t cookie;                  /* ours towards the client              */
+  u32_t delta;                   /* server's one minus the cookie        */
+  u16_t window;                  /* client's, from its ACK               */
+  u16_t mss;
+  unsigned long expires;         /* SP_SYN_SENT only                     */
+  char ifname[NF_SP_IFNAMELEN];  /* interface towards the client         */
+};
+
+/* the MSS values a cookie can encode */
+static const u16_t sp_msstab[]= { 536, 1220, 1440, 1460 };
+#define SP_MSSNR        (sizeof(sp_msstab)/sizeof(sp_msstab[0]))
+
+static struct sp_conn nf_sp_table[NF_SP_NR];
+static struct sp_conn *nf_sp_hash[NF_SP_HASH];
+static struct sp_conn *nf_sp_free;
+static int nf_sp_used;           /* entries not on the free list         */
+static unsigned long nf_sp_now;
+static u32_t nf_sp_secret[2];
+static u16_t nf_sp_id;
+
+static struct nf_sp_pkt nf_sp_outq[NF_SP_OUTQ];
+static int nf_sp_qhead, nf_sp_qlen;
+static void (*nf_sp_notify)(void);
+
+/* same as ctHash, both directions of a connection share a bucket */
+static int spHash(const struct ip_conntrack_tuple *t)
+{
+  u32_t h;
+
+  h=t->src ^ t->dst;
+  h^=((u32_t)(t->sport ^ t->dport) << 16) | t->proto;
+  h^=h >> 16;
+  h^=h >> 8;
+  return h & (NF_SP_HASH-1);
+}
+
+#define spRot(x,k) (((x) << (k)) | ((x) >> (32-(k))))
+
+/* final mix of Bob Jenkins' lookup3 */
+static u32_t spMix(u32_t a, u32_t b, u32_t c)
+{
+  c^=b; c-=spRot(b,14);
+  a^=c; a-=spRot(c,11);
+  b^=a; b-=spRot(a,25);
+  c^=b; c-=spRot(b,16);
+  a^=c; a-=spRot(c,4);
+  b^=a; b-=spRot(a,14);
+  c^=b; c-=spRot(b,24);
+  return c;
+}
+
+/* keyed hash of a tuple and a cookie counter value */
+static u32_t spKey(const struct ip_conntrack_tuple *t, u32_t count, int n)
+{
+  return spMix(spMix(t->src,t->dst,((u32_t)t->sport << 16) | t->dport),
+               count,nf_sp_secret[n]);
+}
+
+/* As the Linux SYN cookies: the top 8 bits count NF_SP_PERIOD seconds,
+ * the rest hides the MSS index under a hash of tuple and counter.
+ */
+static u32_t spCookie(const struct ip_conntrack_tuple *t, u32_t isn,
+                      int mssind)
+{
+  u32_t count=nf_sp_now / NF_SP_PERIOD;
+
+  return spKey(t,0,0) + isn + (count << 24) +
+         ((spKey(t,count,1) + mssind) & 0xffffff);
+}
+
+/* the MSS index of a cookie, or -1 if it is not one of ours */
+static int spCheck(const struct ip_conntrack_tuple *t, u32_t isn,
+                   u32_t cookie)
+{
+  u32_t count, diff, mssind;
+
+  count=nf_sp_now / NF_SP_PERIOD;
+  cookie-=spKey(t,0,0) + isn;
+  diff=(count - (cookie >> 24)) & 0xff;
+  if (diff >= NF_SP_MAXAGE) return -1;
+  mssind=(cookie - spKey(t,count - diff,1)) & 0xffffff;
+  return (mssind < SP_MSSNR) ? (int)mssind : -1;
+}
+
+/* the tuple and TCP header of a packet, if it is TCP and has one */
+static int spTuple(ip_hdr_t *ip, int hdrlen, struct ip_conntrack_tuple *t,
+                   tcp_hdr_t **th)
+{
+  int ihl;
+
+  if (ip->ih_proto != IPPROTO_TCP) return 0;
+  if (ntohs(ip->ih_flags_fragoff) & IH_FRAGOFF_MASK) return 0;
+  ihl=(ip->ih_vers_ihl & IH_IHL_MASK) * 4;
+  if ((ihl < (int)sizeof(ip_hdr_t)) ||
+      (ihl + (int)sizeof(tcp_hdr_t) > hdrlen))
+    return 0;
+  *th=(tcp_hdr_t*)((unsigned char*)ip + ihl);
+  t->src=ip->ih_src;
+  t->dst=ip->ih_dst;
+  t->sport=(*th)->th_srcport;
+  t->dport=(*th)->th_dstport;
+  t->proto=IPPROTO_TCP;
+  return 1;
+}
+
+/* the MSS option of a SYN, len bytes of it are contiguous */
+static int spMss(const tcp_hdr_t *th, int len)
+{
+  const unsigned char *opt;
+  int n;
+
+  opt=(const unsigned char*)(th+1);
+  n=((th->th_data_off & TH_DO_MASK) >> 2) - (int)sizeof(tcp_hdr_t);
+  if (n > len - (int)sizeof(tcp_hdr_t)) n=len - (int)sizeof(tcp_hdr_t);
+  while (n > 0)
+  {
+    if (opt[0] == TCP_OPT_EOL) break;
+    if (opt[0] == TCP_OPT_NOP)
+    {
+      opt++;
+      n--;
+      continue;
+    }
+    if ((n < 2) || (opt[1] < 2) || (opt[1] > n)) break;
+    if ((opt[0] == TCP_OPT_MSS) && (opt[1] == 4))
+      return (opt[2] << 8) | opt[3];
+    n-=opt[1];
+    opt+=opt[1];
+  }
+  return 536;                    /* RFC 1122 default */
+}
+
+static struct sp_conn *spFind(const struct ip_conntrack_tuple *t, int *dir)
+{
+  struct sp_conn *sp;
+
+  for (sp=nf_sp_hash[spHash(t)]; sp!=NULL; sp=sp->next)
+  {
+    if ((sp->state == SP_SYN_SENT) && (sp->expires <= nf_sp_now))
+      continue;
+    if ((sp->tuple.src == t->src) && (sp->tuple.dst == t->dst) &&
+        (sp->tuple.sport == t->sport) && (sp->tuple.dport == t->dport))
+    {
+      *dir=IP_CT_DIR_ORIGINAL;
+      return sp;
+    }
+    if ((sp->tuple.src == t->dst) && (sp->tuple.dst == t->src) &&
+        (sp->tuple.sport == t->dport) && (sp->tuple.dport == t->sport))
+    {
+      *dir=IP_CT_DIR_REPLY;
+      return sp;
+    }
+  }
+  return NULL;
+}
+
+static void spFree(struct sp_conn *sp)
+{
+  struct sp_conn **pp;
+
+  for (pp=&nf_sp_hash[spHash(&sp->tuple)]; *pp!=NULL; pp=&(*pp)->next)
+  {
+    if (*pp == sp)
+    {
+      *pp=sp->next;
+      break;
+    }
+  }
+  sp->state=SP_FREE;
+  sp->next=nf_sp_free;
+  nf_sp_free=sp;
+  nf_sp_used--;
+}
+
+static struct sp_conn *spAlloc(const struct ip_conntrack_tuple *t)
+{
+  struct sp_conn *sp;
+  int h;
+
+  if (nf_sp_free == NULL) nfSynproxyExpire();
+  if ((sp=nf_sp_free) == NULL) return NULL;
+  nf_sp_free=sp->next;
+  nf_sp_used++;
+  h=spHash(t);
+  sp->tuple=*t;
+  sp->next=nf_sp_hash[h];
+  nf_sp_hash[h]=sp;
+  return sp;
+}
+
+/* one's complement sum of len bytes, len even */
+static u32_t spSum(u32_t sum, const void *data, int len)
+{
+  const u16_t *p=data;
+
+  for (; len>0; len-=2) sum+=*p++;
+  return sum;
+}
+
+static u16_t spFold(u32_t sum)
+{
+  sum=(sum & 0xffff) + (sum >> 16);
+  sum=(sum & 0xffff) + (sum >> 16);
+  return ~sum;
+}
+
+/* one's complement checksum update for a changed 16 bit word */
+static void spAdjust(u16_t *sum, u16_t from, u16_t to)
+{
+  u32_t s;
+
+  s=(u16_t)~*sum + (u32_t)(u16_t)~from + to;
+  s=(s & 0xffff) + (s >> 16);
+  s=(s & 0xffff) + (s >> 16);
+  *sum=~s;
+}
+
+/* stores v in the 32 bit word at p in network byte order and fixes the
+ * checksum covering it
+ */
+static void spWord32(u32_t *p, u32_t v, u16_t *sum)
+{
+  u32_t old=ntohl(*p);
+
+  spAdjust(sum,htons(old >> 16),htons(v >> 16));
+  spAdjust(sum,htons(old & 0xffff),htons(v & 0xffff));
+  *p=htonl(v);
+}
+
+/* builds a TCP packet without data and queues it for inet */
+static void spSend(const char *ifname, ipaddr_t src, ipaddr_t dst,
+                   u16_t sport, u16_t dport, u32_t seq, u32_t ack,
+                   int flags, u16_t window, u16_t mss)
+{
+  struct nf_sp_pkt *p;
+  ip_hdr_t *ip;
+  tcp_hdr_t *th;
+  unsigned char *opt;
+  u32_t sum;
+  int tcplen;
+
+  if (nf_sp_qlen == NF_SP_OUTQ)
+  {
+    /* the peer will retransmit */
+    return;
+  }
+  p=&nf_sp_outq[(nf_sp_qhead + nf_sp_qlen) % NF_SP_OUTQ];
+  tcplen=sizeof(tcp_hdr_t) + (mss ? 4 : 0);
+  memset(p->data,0,sizeof(p->data));
+  p->len=sizeof(ip_hdr_t) + tcplen;
+  strncpy(p->ifname,ifname ? ifname : "",NF_SP_IFNAMELEN-1);
+  p->ifname[NF_SP_IFNAMELEN-1]='\0';
+
+  ip=(ip_hdr_t*)p->data;
+  ip->ih_vers_ihl=(IP_VERSION << 4) | (sizeof(ip_hdr_t) / 4);
+  ip->ih_length=htons(p->len);
+  ip->ih_id=htons(nf_sp_id++);
+  ip->ih_ttl=IP_DEF_TTL;
+  ip->ih_proto=IPPROTO_TCP;
+  ip->ih_src=src;
+  ip->ih_dst=dst;
+  ip->ih_hdr_chk=spFold(spSum(0,ip,sizeof(ip_hdr_t)));
+
+  th=(tcp_hdr_t*)(ip+1);
+  th->th_srcport=sport;
+  th->th_dstport=dport;
+  th->th_seq_nr=htonl(seq);
+  th->th_ack_nr=htonl(ack);
+  th->th_data_off=tcplen << 2;
+  th->th_flags=flags;
+  th->th_window=htons(window);
+  if (mss)
+  {
+    opt=(unsigned char*)(th+1);
+    opt[0]=TCP_OPT_MSS;
+    opt[1]=4;
+    opt[2]=mss >> 8;
+    opt[3]=mss & 0xff;
+  }
+  sum=spSum(0,&ip->ih_src,2*sizeof(ipaddr_t));
+  sum+=htons(IPPROTO_TCP) + htons(tcplen);
+  th->th_chksum=spFold(spSum(sum,th,tcplen));
+
+  if ((nf_sp_qlen++ == 0) && (nf_sp_notify != NULL))
+    nf_sp_notify();
+}
+
+/*******************************************************************
+ * nfSynproxyInit                                                  *
+ *                                                                 *
+ * Puts all entries on the free list and keys the cookies.         *
+ *                                                                 *
+ * Parameters:  notify()                 called when the first     *
+ *                                       packet is queued          *
+ *              u8_t *seed               random bytes              *
+ *              size_t len               number of them            *
+ *                                                                 *
+ *******************************************************************/
+void nfSynproxyInit(void (*notify)(void), const u8_t *seed, size_t len)
+{
+  size_t i;
+
+  for (i=0; i<NF_SP_HASH; i++) nf_sp_hash[i]=NULL;
+  nf_sp_free=NULL;
+  for (i=NF_SP_NR; i-->0; )
+  {
+    nf_sp_table[i].state=SP_FREE;
+    nf_sp_table[i].next=nf_sp_free;
+    nf_sp_free=&nf_sp_table[i];
+  }
+  nf_sp_used=0;
+  nf_sp_now=0;
+  nf_sp_id=0;
+  nf_sp_secret[0]=nf_sp_secret[1]=0;
+  for (i=0; i<len; i++)
+    nf_sp_secret[(i >> 2) & 1]^=(u32_t)seed[i] << ((i & 3) * 8);
+  nf_sp_qhead=nf_sp_qlen=0;
+  nf_sp_notify=notify;
+}
+
+void nfSynproxySetTime(unsigned long now)
+{
+  nf_sp_now=now;
+}
+
+/*******************************************************************
+ * nfSynproxyIn                                                    *
+ *                                                                 *
+ * Called for every packet before connection tracking. Packets of  *
+ * a proxied connection get their sequence or acknowledgement      *
+ * number adjusted where they pass the firewall for the first or   *
+ * the last time: the client's at PREROUTING, the server's at      *
+ * PREROUTING if it is forwarded and at POSTROUTING if it is inet's *
+ * own TCP. The server's SYN-ACK completes both handshakes and is   *
+ * taken here.                                                     *
+ *                                                                 *
+ * Parameters:  struct sk_buff *skb       the packet               *
+ *              int hdrlen                contiguous header bytes  *
+ *              unsigned int hook         hook number              *
+ *              char *ifname              input interface or ""    *
+ *                                                                 *
+ * Returns:     int                       NF_DROP if the proxy     *
+ *                                        took the packet,         *
+ *                                        IPT_CONTINUE otherwise   *
+ *                                                                 *
+ *******************************************************************/
+int nfSynproxyIn(struct sk_buff *skb, int hdrlen, unsigned int hook,
+                 const char *ifname)
+{
+  struct ip_conntrack_tuple t;
+  struct sp_conn *sp;
+  tcp_hdr_t *th;
+  int dir, flags;
+  u32_t seq;
+
+  if (nf_sp_used == 0) return IPT_CONTINUE;
+  if (!spTuple(skb->nh.iph,hdrlen,&t,&th)) return IPT_CONTINUE;
+  if ((sp=spFind(&t,&dir)) == NULL) return IPT_CONTINUE;
+  flags=th->th_flags;
+
+  if (dir == IP_CT_DIR_ORIGINAL)
+  {
+    /* the client, always coming in */
+    if (hook != NF_IP_PRE_ROUTING) return IPT_CONTINUE;
+    if (flags & THF_SYN)
+    {
+      /* it starts over, the rule answers it again */
+      spFree(sp);
+      return IPT_CONTINUE;
+    }
+    /* its window is closed until the server has answered */
+    if (sp->state != SP_OPEN) return NF_DROP;
+    spWord32(&th->th_ack_nr,ntohl(th->th_ack_nr) + sp->delta,
+             &th->th_chksum);
+    return IPT_CONTINUE;
+  }
+
+  if (hook != (sp->local ? NF_IP_POST_ROUTING : NF_IP_PRE_ROUTING))
+    return IPT_CONTINUE;
+  seq=ntohl(th->th_seq_nr);
+  if ((flags & (THF_SYN|THF_ACK|THF_RST)) == (THF_SYN|THF_ACK))
+  {
+    if (ntohl(th->th_ack_nr) != sp->isn + 1) return NF_DROP;
+    if (sp->state == SP_SYN_SENT)
+    {
+      sp->delta=seq - sp->cookie;
+      sp->state=SP_OPEN;
+      nfConntrackEstablish(&sp->tuple);
+
+      /* open the client's window */
+      spSend(sp->ifname,sp->tuple.dst,sp->tuple.src,sp->tuple.dport,
+             sp->tuple.sport,sp->cookie + 1,sp->isn + 1,THF_ACK,
+             ntohs(th->th_window),0);
+    }
+    else if (seq != sp->cookie + sp->delta)
+      return NF_DROP;
+
+    /* the ACK of the client, again if the server lost it */
+    spSend(ifname,sp->tuple.src,sp->tuple.dst,sp->tuple.sport,
+           sp->tuple.dport,sp->isn + 1,seq + 1,THF_ACK,sp->window,0);
+    return NF_DROP;
+  }
+  if (sp->state != SP_OPEN)
+  {
+    if (flags & THF_RST)
+    {
+      /* refused, the client thinks it is connected */
+      spSend(sp->ifname,sp->tuple.dst,sp->tuple.src,sp->tuple.dport,
+             sp->tuple.sport,sp->cookie + 1,0,THF_RST,0,0);
+      spFree(sp);
+    }
+    return NF_DROP;
+  }
+  spWord32(&th->th_seq_nr,seq - sp->delta,&th->th_chksum);
+  return IPT_CONTINUE;
+}
+
+/*******************************************************************
+ * nfSynproxyTarget                                                *
+ *                                                                 *
+ * The work of the SYNPROXY target. A SYN is answered with a       *
+ * cookie, an ACK that returns a good cookie starts the handshake  *
+ * with the server. Both are dropped; an ACK without a good cookie *
+ * is dropped too unless it belongs to a flow conntrack knows or   *
+ * to a proxied connection.                                        *
+ *                                                                 *
+ * Parameters:  struct sk_buff *skb       the packet               *
+ *              unsigned int hook         NF_IP_LOCAL_IN or        *
+ *                                        NF_IP_FORWARD            *
+ *              char *ifname              input interface          *
+ *              u16_t mss                 largest MSS to offer     *
+ *                                                                 *
+ * Returns:     int                       NF_DROP or IPT_CONTINUE  *
+ *                                                                 *
+ *******************************************************************/
+int nfSynproxyTarget(struct sk_buff *skb, unsigned int hook,
+                     const char *ifname, u16_t mss)
+{
+  struct ip_conntrack_tuple t;
+  struct sp_conn *sp;
+  tcp_hdr_t *th;
+  int hdrlen, dir, flags, i, cmss;
+  u32_t isn;
+
+  hdrlen=skb->tail - skb->nh.raw;
+  if (!spTuple(skb->nh.iph,hdrlen,&t,&th)) return IPT_CONTINUE;
+  flags=th->th_flags & (THF_SYN|THF_ACK|THF_RST|THF_FIN);
+
+  if (flags == THF_SYN)
+  {
+    cmss=spMss(th,hdrlen - ((unsigned char*)th - skb->nh.raw));
+    if (mss && (mss < cmss)) cmss=mss;
+    for (i=SP_MSSNR-1; (i > 0) && (sp_msstab[i] > cmss); i--)
+      ;
+    isn=ntohl(th->th_seq_nr);
+
+    /* a closed window keeps the client quiet until the server is there */
+    spSend(ifname,t.dst,t.src,t.dport,t.sport,spCookie(&t,isn,i),isn + 1,
+           THF_SYN|THF_ACK,0,sp_msstab[i]);
+    return NF_DROP;
+  }
+  if (flags != THF_ACK) return IPT_CONTINUE;
+  if ((skb->nfct != NULL) &&
+      ((skb->nfctinfo % IP_CT_IS_REPLY) == IP_CT_ESTABLISHED))
+    return IPT_CONTINUE;
+  if (spFind(&t,&dir) != NULL) return IPT_CONTINUE;
+
+  isn=ntohl(th->th_seq_nr) - 1;
+  i=spCheck(&t,isn,ntohl(th->th_ack_nr) - 1);
+  if ((i < 0) || ((sp=spAlloc(&t)) == NULL)) return NF_DROP;
+  sp->state=SP_SYN_SENT;
+  sp->local=(hook == NF_IP_LOCAL_IN);
+  sp->isn=isn;
+  sp->cookie=ntohl(th->th_ack_nr) - 1;
+  sp->delta=0;
+  sp->window=ntohs(th->th_window);
+  sp->mss=sp_msstab[i];
+  sp->expires=nf_sp_now + NF_SP_SYNTIME;
+  strncpy(sp->ifname,ifname ? ifname : "",NF_SP_IFNAMELEN-1);
+  sp->ifname[NF_SP_IFNAMELEN-1]='\0';
+
+  spSend(ifname,t.src,t.dst,t.sport,t.dport,isn,0,THF_SYN,sp->window,
+         sp->mss);
+  return NF_DROP;
+}
+
+/* the next packet for inet to send, or NULL */
+const struct nf_sp_pkt *nfSynproxyPeek(void)
+{
+  return nf_sp_qlen ? &nf_sp_outq[nf_sp_qhead] : NULL;
+}
+
+void nfSynproxyConsume(void)
+{
+  if (nf_sp_qlen == 0) return;
+  nf_sp_qhead=(nf_sp_qhead + 1) % NF_SP_OUTQ;
+  nf_sp_qlen--;
+}
+
+/*******************************************************************
+ * nfSynproxyExpire                                                *
+ *                                                                 *
+ * Frees handshakes the server did not answer in time and open     *
+ * connections whose conntrack flow has timed out.                 *
+ *                                                                 *
+ * Returns:     int                       entries still in use     *
+ *                                                                 *
+ *******************************************************************/
+int nfSynproxyExpire(void)
+{
+  struct sp_conn *sp;
+  int i;
+
+  for (i=0; i<NF_SP_NR; i++)
+  {
+    sp=&nf_sp_table[i];
+    if (((sp->state == SP_SYN_SENT) && (sp->expires <= nf_sp_now)) ||
+        ((sp->state == SP_OPEN) && !nfConntrackInUse(&sp->tuple)))
+      spFree(sp);
+  }
+  return nf_sp_used;
+}
@@ -0,0 +1,71 @@
+/*
+ * This is a module which is used for destination NAT. The packet is
+ * rewritten right away, so routing and the filter table see the new
+ * destination.
+ */
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <net/gen/ip_hdr.h>
+#include <errno.h>
+#include <string.h>
+#include <sk_buff.h>
+#include <ip_tables.h>
+#include <net_device.h>
+#include <macros.h>
+#include <nfnat.h>
+#include "ipt_DNAT.h"
+
+#include <stdio.h>
+
+static unsigned int
+ipt_dnat_target(struct sk_buff **pskb,
+	       unsigned int hooknum,
+	       const struct net_device *in,
+	       const struct net_device *out,
+	       const void *targinfo,
+	       void *userinfo)
+{
+	if (hooknum != NF_IP_PRE_ROUTING && hooknum != NF_IP_LOCAL_OUT) {
+#ifdef _DEBUG
+		printf("DNAT: only valid in PREROUTING and OUTPUT\n");
+#endif
+		return NF_DROP;
+	}
+	if (!nfNatBind(*pskb, NF_NAT_DST, targinfo) ||
+	    nfNatApply(*pskb, hooknum) < 0)
+		return NF_DROP;
+
+	return NF_ACCEPT;
+}
+
+static int
+ipt_dnat_checkentry(const char *tablename,
+		    const struct ipt_entry *e,
+		    void *targinfo,
+		    unsigned int targinfosize,
+		    unsigned int hook_mask)
+{
+	const struct nf_nat_range *range = targinfo;
+
+	if (strcmp(tablename, "nat") != 0)
+		return 0;
+	return range->minip != 0 && ntohl(range->minip) <= ntohl(range->maxip)
+	       && range->minport <= range->maxport;
+}
+
+static struct ipt_target ipt_dnat_reg
+= { { NULL, NULL }, "DNAT", ipt_dnat_target, ipt_dnat_checkentry, NULL,
+    NULL };
+
+int ipt_register_target_DNAT(void)
+{
+	if (ipt_register_target(&ipt_dnat_reg))
+		return -EINVAL;
+
+	return 0;
+}
+
+void ipt_unregister_target_DNAT(void)
+{
+	ipt_unregister_target(&ipt_dnat_reg);
+}
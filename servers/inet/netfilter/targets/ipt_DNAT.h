@@ -0,0 +1,7 @@
+#ifndef _IPT_DNAT_H
+#define _IPT_DNAT_H
+
+int ipt_register_target_DNAT( void );
+void ipt_unregister_target_DNAT( void );
+
+#endif /*_IPT_DNAT_H*/
@@ -0,0 +1,7 @@
+#ifndef _IPT_MASQUERADE_H
+#define _IPT_MASQUERADE_H
+
+int ipt_register_target_MASQUERADE( void );
+void ipt_unregister_target_MASQUERADE( void );
+
+#endif /*_IPT_MASQUERADE_H*/
@@ -0,0 +1,61 @@
+/*
+ * This is a module which is used for passing packets to a userspace
+ * reader of /dev/netfilter. The packet is parked in inet until the
+ * reader gives its verdict; see nf_queue in generic/nf.c.
+ */
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <errno.h>
+#include <sk_buff.h>
+#include <ip_tables.h>
+#include <net_device.h>
+#include <macros.h>
+#include <nfqueue.h>
+#include "ipt_NFQUEUE.h"
+
+#include <stdio.h>
+
+static unsigned int
+ipt_nfqueue_target(struct sk_buff **pskb,
+	       unsigned int hooknum,
+	       const struct net_device *in,
+	       const struct net_device *out,
+	       const void *targinfo,
+	       void *userinfo)
+{
+	const struct ipt_nfq_info *info = targinfo;
+
+	if (info->flags & IPT_NFQ_BYPASS)
+		return NF_QUEUE_NR(info->queuenum) |
+		       NF_VERDICT_FLAG_QUEUE_BYPASS;
+	return NF_QUEUE_NR(info->queuenum);
+}
+
+static int
+ipt_nfqueue_checkentry(const char *tablename,
+		       const struct ipt_entry *e,
+		       void *targinfo,
+		       unsigned int targinfosize,
+		       unsigned int hook_mask)
+{
+	const struct ipt_nfq_info *info = targinfo;
+
+	return info->queuenum < NF_QUEUE_MAX;
+}
+
+static struct ipt_target ipt_nfqueue_reg
+= { { NULL, NULL }, "NFQUEUE", ipt_nfqueue_target, ipt_nfqueue_checkentry,
+    NULL, NULL };
+
+int ipt_register_target_NFQUEUE(void)
+{
+	if (ipt_register_target(&ipt_nfqueue_reg))
+		return -EINVAL;
+
+	return 0;
+}
+
+void ipt_unregister_target_NFQUEUE(void)
+{
+	ipt_unregister_target(&ipt_nfqueue_reg);
+}
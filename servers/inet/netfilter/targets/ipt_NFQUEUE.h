@@ -0,0 +1,15 @@
+#ifndef _IPT_NFQUEUE_H
+#define _IPT_NFQUEUE_H
+
+/* private data structure for each rule with a NFQUEUE target */
+struct ipt_nfq_info {
+	u16_t queuenum;
+	u16_t flags;
+};
+
+#define IPT_NFQ_BYPASS	1	/* accept if nobody reads the queue */
+
+int ipt_register_target_NFQUEUE( void );
+void ipt_unregister_target_NFQUEUE( void );
+
+#endif /*_IPT_NFQUEUE_H*/
@@ -0,0 +1,7 @@
+#ifndef _IPT_REDIRECT_H
+#define _IPT_REDIRECT_H
+
+int ipt_register_target_REDIRECT( void );
+void ipt_unregister_target_REDIRECT( void );
+
+#endif /*_IPT_REDIRECT_H*/
@@ -0,0 +1,43 @@
+/*
+ * This is a module which is used for returning from a user chain to
+ * the chain that jumped to it. In a built-in chain the policy applies.
+ */
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <net/gen/ip_hdr.h>
+#include <errno.h>
+#include <sk_buff.h>
+#include <ip_tables.h>
+#include <net_device.h>
+#include <macros.h>
+#include "ipt_RETURN.h"
+
+#include <stdio.h>
+
+static unsigned int
+ipt_return_target(struct sk_buff **pskb,
+	       unsigned int hooknum,
+	       const struct net_device *in,
+	       const struct net_device *out,
+	       const void *targinfo,
+	       void *userinfo)
+{
+	return IPT_RETURN;
+}
+
+static struct ipt_target ipt_return_reg
+= { { NULL, NULL }, "RETURN", ipt_return_target, NULL, NULL,
+    NULL };
+
+int ipt_register_target_RETURN(void)
+{
+	if (ipt_register_target(&ipt_return_reg))
+		return -EINVAL;
+
+	return 0;
+}
+
+void ipt_unregister_target_RETURN(void)
+{
+	ipt_unregister_target(&ipt_return_reg);
+}
@@ -0,0 +1,7 @@
+#ifndef _IPT_RETURN_H
+#define _IPT_RETURN_H
+
+int ipt_register_target_RETURN( void );
+void ipt_unregister_target_RETURN( void );
+
+#endif /*_IPT_RETURN_H*/
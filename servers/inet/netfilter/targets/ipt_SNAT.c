@@ -0,0 +1,71 @@
+/*
+ * This is a module which is used for source NAT. The first packet of a
+ * flow binds it to an address and port of the range, later packets and
+ * the replies are translated by the NAT engine before the chains run.
+ */
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <net/gen/ip_hdr.h>
+#include <errno.h>
+#include <string.h>
+#include <sk_buff.h>
+#include <ip_tables.h>
+#include <net_device.h>
+#include <macros.h>
+#include <nfnat.h>
+#include "ipt_SNAT.h"
+
+#include <stdio.h>
+
+static unsigned int
+ipt_snat_target(struct sk_buff **pskb,
+	       unsigned int hooknum,
+	       const struct net_device *in,
+	       const struct net_device *out,
+	       const void *targinfo,
+	       void *userinfo)
+{
+	if (hooknum != NF_IP_POST_ROUTING) {
+#ifdef _DEBUG
+		printf("SNAT: only valid in POSTROUTING\n");
+#endif
+		return NF_DROP;
+	}
+	/* the source is rewritten once the packet leaves the chains */
+	if (!nfNatBind(*pskb, NF_NAT_SRC, targinfo))
+		return NF_DROP;
+
+	return NF_ACCEPT;
+}
+
+static int
+ipt_snat_checkentry(const char *tablename,
+		    const struct ipt_entry *e,
+		    void *targinfo,
+		    unsigned int targinfosize,
+		    unsigned int hook_mask)
+{
+	const struct nf_nat_range *range = targinfo;
+
+	if (strcmp(tablename, "nat") != 0)
+		return 0;
+	return range->minip != 0 && ntohl(range->minip) <= ntohl(range->maxip)
+	       && range->minport <= range->maxport;
+}
+
+static struct ipt_target ipt_snat_reg
+= { { NULL, NULL }, "SNAT", ipt_snat_target, ipt_snat_checkentry, NULL,
+    NULL };
+
+int ipt_register_target_SNAT(void)
+{
+	if (ipt_register_target(&ipt_snat_reg))
+		return -EINVAL;
+
+	return 0;
+}
+
+void ipt_unregister_target_SNAT(void)
+{
+	ipt_unregister_target(&ipt_snat_reg);
+}
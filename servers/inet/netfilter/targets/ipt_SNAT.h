@@ -0,0 +1,7 @@
+#ifndef _IPT_SNAT_H
+#define _IPT_SNAT_H
+
+int ipt_register_target_SNAT( void );
+void ipt_unregister_target_SNAT( void );
+
+#endif /*_IPT_SNAT_H*/
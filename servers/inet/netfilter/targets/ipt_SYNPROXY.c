@@ -0,0 +1,67 @@
+/*
+ * This is a module which is used for protecting servers against SYN
+ * floods. SYNs are answered with a SYN cookie, the server only gets to
+ * see the connections whose ACK returns a valid one; see nfsynproxy.c.
+ */
+#include <sys/types.h>
+#include <net/gen/in.h>
+#include <net/gen/ip_hdr.h>
+#include <errno.h>
+#include <string.h>
+#include <sk_buff.h>
+#include <ip_tables.h>
+#include <net_device.h>
+#include <macros.h>
+#include <nfsynproxy.h>
+#include "ipt_SYNPROXY.h"
+
+#include <stdio.h>
+
+static unsigned int
+ipt_synproxy_target(struct sk_buff **pskb,
+	       unsigned int hooknum,
+	       const struct net_device *in,
+	       const struct net_device *out,
+	       const void *targinfo,
+	       void *userinfo)
+{
+	const struct ipt_synproxy_info *info = targinfo;
+
+	if (hooknum != NF_IP_LOCAL_IN && hooknum != NF_IP_FORWARD) {
+#ifdef _DEBUG
+		printf("SYNPROXY: only valid in INPUT and FORWARD\n");
+#endif
+		return NF_DROP;
+	}
+	return nfSynproxyTarget(*pskb, hooknum, in ? in->name : NULL,
+				info->mss);
+}
+
+static int
+ipt_synproxy_checkentry(const char *tablename,
+			const struct ipt_entry *e,
+			void *targinfo,
+			unsigned int targinfosize,
+			unsigned int hook_mask)
+{
+	if (strcmp(tablename, "filter") != 0)
+		return 0;
+	return e->ip.proto == IPPROTO_TCP && !(e->ip.invflags & IPT_INV_PROTO);
+}
+
+static struct ipt_target ipt_synproxy_reg
+= { { NULL, NULL }, "SYNPROXY", ipt_synproxy_target, ipt_synproxy_checkentry,
+    NULL, NULL };
+
+int ipt_register_target_SYNPROXY(void)
+{
+	if (ipt_register_target(&ipt_synproxy_reg))
+		return -EINVAL;
+
+	return 0;
+}
+
+void ipt_unregister_target_SYNPROXY(void)
+{
+	ipt_unregister_target(&ipt_synproxy_reg);
+}
@@ -0,0 +1,7 @@
+#ifndef _IPT_SYNPROXY_H
+#define _IPT_SYNPROXY_H
+
+int ipt_register_target_SYNPROXY( void );
+void ipt_unregister_target_SYNPROXY( void );
+
+#endif /*_IPT_SYNPROXY_H*/
@@ -1,21 +1,42 @@
 #ifndef _IPT_RATE_H
 #define _IPT_RATE_H
 
-/* timings are in milliseconds. */
+/* rates are given as the time between two packets, in 1/10000 s */
 #define IPT_LIMIT_SCALE 10000
 
-/* 1/10,000 sec period => max of 10,000/sec.  Min rate is then 429490
-   seconds, or one every 59 hours. */
+/* A token bucket per rule: credit grows by IPT_LIMIT_SCALE a second up
+ * to avg*burst, every packet matched costs avg. Minimum rate is one
+ * packet every 429496 seconds, maximum 10000 a second.
+ */
 struct ipt_rateinfo {
-	u_int32_t avg;    /* Average secs between packets * scale */
-	u_int32_t burst;  /* Period multiplier for upper limit. */
+	u32_t avg;		/* time between packets, 1/10000 s */
+	u32_t burst;		/* packets allowed back to back */
 
-	/* Used internally by the kernel */
-	unsigned long prev;
-	u_int32_t credit;
-	u_int32_t credit_cap, cost;
+	/* kept by the match, set up by checkentry */
+	unsigned long prev;	/* ms of the last refill */
+	u32_t credit;
+	u32_t credit_cap;
+};
+
+/* Values for "flags" field in struct ipt_hashlimit_info. */
+#define IPT_HASHLIMIT_DST	0x01	/* a bucket per destination */
+#define IPT_HASHLIMIT_ABOVE	0x02	/* match packets over the limit */
+
+#define IPT_HASHLIMIT_SIZE	1024	/* addresses tracked by default */
+
+struct nf_rate_table;
+
+/* A token bucket per source (or destination) address, the least
+ * recently seen addresses are forgotten once size are tracked.
+ */
+struct ipt_hashlimit_info {
+	u32_t avg;
+	u32_t burst;
+	u32_t size;		/* addresses tracked */
+	u8_t flags;		/* IPT_HASHLIMIT_* */
 
-	/* Ugly, ugly fucker. */
-	struct ipt_rateinfo *master;
+	/* set up by checkentry */
+	u32_t credit_cap;
+	struct nf_rate_table *table;
 };
 #endif /*_IPT_RATE_H*/
@@ -1,27 +1,33 @@
 #ifndef _IPT_RECENT_H
 #define _IPT_RECENT_H
 
-#define RECENT_NAME	"ipt_recent"
-#define RECENT_VER	"v0.3.1"
-
-#define IPT_RECENT_CHECK  1
-#define IPT_RECENT_SET    2
-#define IPT_RECENT_UPDATE 4
-#define IPT_RECENT_REMOVE 8
-#define IPT_RECENT_TTL   16
+/* Values for "check_set" field in struct ipt_recent_info. */
+#define IPT_RECENT_CHECK  1	/* is the address in the list ? */
+#define IPT_RECENT_SET    2	/* add it */
+#define IPT_RECENT_UPDATE 4	/* CHECK, and note the hit if it is */
+#define IPT_RECENT_REMOVE 8	/* CHECK, and remove it if it is */
 
 #define IPT_RECENT_SOURCE 0
 #define IPT_RECENT_DEST   1
 
-#define IPT_RECENT_NAME_LEN 200
+#define IPT_RECENT_NAME_LEN 16
+#define IPT_RECENT_SIZE   1024	/* addresses a list keeps */
+
+struct nf_rate_table;
 
+/* Named lists of the addresses recently seen, shared by all rules using
+ * the same name. The last NF_RATE_HITS hits of an address are kept.
+ */
 struct ipt_recent_info {
-	u_int32_t   seconds;
-	u_int32_t   hit_count;
-	u_int8_t    check_set;
-	u_int8_t    invert;
-	char        name[IPT_RECENT_NAME_LEN];
-	u_int8_t    side;
+	u32_t seconds;		/* only hits this recent count, 0: all */
+	u32_t hit_count;	/* hits needed, 0: one */
+	u8_t check_set;		/* IPT_RECENT_* */
+	u8_t invert;
+	u8_t side;		/* IPT_RECENT_SOURCE or IPT_RECENT_DEST */
+	char name[IPT_RECENT_NAME_LEN];
+
+	/* set up by checkentry */
+	struct nf_rate_table *table;
 };
 
 #endif /*_IPT_RECENT_H*/
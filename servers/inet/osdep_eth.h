@@ -24,6 +24,15 @@ typedef struct osdep_eth_port
 	cp_grant_id_t etp_wr_vec_grant;
 	iovec_s_t etp_rd_iovec[RD_IOVEC];
 	cp_grant_id_t etp_rd_vec_grant;
+	eth_ring_t *etp_ring;		/* receive ring for DL_READRING_S */
+	cp_grant_id_t etp_ring_grant;
+	eth_ring_t *etp_tx_ring;	/* transmit ring for DL_WRITERING_S */
+	cp_grant_id_t etp_tx_ring_grant;
+	struct acc *etp_txq_head;	/* frames for the next DL_WRITERING_S */
+	struct acc *etp_txq_tail;
+	int etp_txq_nr;
+	struct acc *etp_tx_sent;	/* frames of the pending one */
+	event_t etp_txev;
 	event_t etp_recvev;
 	cp_grant_id_t etp_stat_gid;
 	eth_stat_t *etp_stat_buf;
@@ -49,6 +58,8 @@ typedef struct osdep_eth_port
 #define OEPF_NEED_STAT	8	/* Issue getstat request when the state becomes
 				 * idle
 				 */
+#define OEPF_RING	16	/* Driver accepts DL_READRING_S */
+#define OEPF_TXRING	32	/* Driver accepts DL_WRITERING_S */
 
 #endif /* INET__OSDEP_ETH_H */
 
@@ -123,6 +123,10 @@ void nic_init_all(void)
 			if (cpf_getgrants(gid, 1) != 1)
 				panic("Cannot initialize grants");
 		}
+		if (cpf_getgrants(&devices[i].tx_ring_grant, 1) != 1)
+			panic("Cannot initialize grants");
+		devices[i].tx_ring = NULL;
+		devices[i].tx_sent = 0;
 		devices[i].raw_socket = NULL;
 	}
 }
@@ -167,12 +171,70 @@ static void nic_up(struct nic * nic, message * m)
 			nic->netif.hwaddr[4],
 			nic->netif.hwaddr[5]);
 
+	/*
+	 * Drivers that take a whole ring of frames per request get one,
+	 * granted once here
+	 */
+	if (m->DL_STAT & DL_STAT_TXRING) {
+		if (nic->tx_ring == NULL &&
+			!(nic->tx_ring = debug_malloc(sizeof(eth_ring_t))))
+			panic("Cannot allocate tx ring");
+		if (cpf_setgrant_direct(nic->tx_ring_grant, nic->drv_ep,
+				(vir_bytes) nic->tx_ring,
+				sizeof(eth_ring_t), CPF_READ) != OK)
+			panic("Failed to set grant");
+	} else if (nic->tx_ring) {
+		debug_free(nic->tx_ring);
+		nic->tx_ring = NULL;
+	}
+
 	driver_setup_read(nic);
 
 	netif_set_link_up(&nic->netif);
 	netif_set_up(&nic->netif);
 }
 
+static int driver_tx_ring(struct nic * nic)
+{
+	struct packet_q * pkt;
+	unsigned len, n;
+	message m;
+
+	/*
+	 * Copy whatever is queued into the ring. The packets stay queued
+	 * until the driver reports them sent.
+	 */
+	for (n = 0, pkt = driver_tx_head(nic); pkt && n < ETH_RING_NR;
+						n++, pkt = pkt->next) {
+		assert(pkt->buf_len <= nic->max_pkt_sz);
+
+		memcpy(nic->tx_ring->er_data[n], pkt->buf, pkt->buf_len);
+		if ((len = pkt->buf_len) < nic->min_pkt_sz) {
+			memset(nic->tx_ring->er_data[n] + len, 0,
+						nic->min_pkt_sz - len);
+			len = nic->min_pkt_sz;
+		}
+		nic->tx_ring->er_len[n] = len;
+	}
+	if (n == 0) {
+		debug_print("no packets enqueued");
+		return 0;
+	}
+
+	m.m_type = DL_WRITERING_S;
+	m.DL_COUNT = n;
+	m.DL_GRANT = nic->tx_ring_grant;
+
+	if (asynsend(nic->drv_ep, &m) != OK)
+		panic("asynsend to the driver failed!");
+	nic->state = DRV_SENDING;
+	nic->tx_sent = n;
+
+	debug_print("%d packets sent to driver", n);
+
+	return 1;
+}
+
 int driver_tx(struct nic * nic)
 {
 	struct packet_q * pkt;
@@ -184,6 +246,9 @@ int driver_tx(struct nic * nic)
 	debug_print("device /dev/%s", nic->name);
 	assert(nic->tx_buffer);
 
+	if (nic->tx_ring)
+		return driver_tx_ring(nic);
+
 	pkt = driver_tx_head(nic);
 	if (pkt == NULL) {
 		debug_print("no packets enqueued");
@@ -214,6 +279,7 @@ int driver_tx(struct nic * nic)
 	if (asynsend(nic->drv_ep, &m) != OK)
 		panic("asynsend to the driver failed!");
 	nic->state = DRV_SENDING;
+	nic->tx_sent = 1;
 	
 	debug_print("packet sent to driver");
 
@@ -225,8 +291,11 @@ static void nic_pkt_sent(struct nic * nic)
 	debug_print("device /dev/%s", nic->name);
 	assert(nic->state != DRV_IDLE);
 
-	/* packet has been sent, we are not intereted anymore */
-	driver_tx_dequeue(nic);
+	/* packets have been sent, we are not intereted anymore */
+	while (nic->tx_sent > 0) {
+		driver_tx_dequeue(nic);
+		nic->tx_sent--;
+	}
 	/*
 	 * Try to transmit the next packet. Failure means that no packet is
 	 * enqueued and thus the device is entering idle state
@@ -370,7 +439,8 @@ void driver_request(message * m)
 
 	switch (m->m_type) {
 	case DL_CONF_REPLY:
-		if (m->DL_STAT == OK)
+		/* positive values are capability bits, e.g. DL_STAT_RING */
+		if (m->DL_STAT >= OK)
 			nic_up(nic, m);
 		break;
 	case DL_TASK_REPLY:
@@ -3,6 +3,8 @@
 
 #include <minix/endpoint.h>
 #include <minix/ds.h>
+#include <net/gen/ether.h>
+#include <net/gen/eth_io.h>
 
 #include <lwip/pbuf.h>
 
@@ -36,6 +38,9 @@ struct nic {
 	struct packet_q	*	tx_head;
 	struct packet_q	*	tx_tail;
 	void *			tx_buffer;
+	eth_ring_t *		tx_ring;	/* set if DL_WRITERING_S works */
+	cp_grant_id_t		tx_ring_grant;
+	unsigned		tx_sent;	/* frames in the pending request */
 	struct netif		netif;
 	unsigned		max_pkt_sz;
 	unsigned		min_pkt_sz;
@@ -47,7 +52,8 @@ void driver_tx_dequeue(struct nic * nic);
 struct packet_q * driver_tx_head(struct nic * nic);
 
 /*
- * Transmit the next packet in the TX queue of this device. Returns 1 if
+ * Transmit the next packet in the TX queue of this device, or as many as
+ * fit in one DL_WRITERING_S if the driver takes those. Returns 1 if
  * success, 0 otherwise.
  */
 int driver_tx(struct nic * nic);